@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,20 +22,48 @@ extern "C" {
 // ============================================
 
 #define COREFS_MAGIC           0x43524653  // "CRFS"
-#define COREFS_VERSION         0x0100      // v1.0
+#define COREFS_VERSION         0x0104      // v1.4: compressed blocks marked in the inode
 #define COREFS_BLOCK_MAGIC     0x424C4B00  // "BLK"
 #define COREFS_BTREE_MAGIC     0x42545245  // "BTRE"
 #define COREFS_FILE_MAGIC      0x46494C45  // "FILE"
+#define COREFS_WEAR_MAGIC      0x5745524C  // "WERL"
+#define COREFS_RESCUE_MAGIC    0x52534355  // "RSCU"
+#define COREFS_RESCUE_LOG_MAGIC 0x5253434C // "RSCL"
 
 #define COREFS_BLOCK_SIZE      2048
 #define COREFS_SECTOR_SIZE     4096
 #define COREFS_MAX_FILENAME    255
 #define COREFS_MAX_PATH        512
-#define COREFS_MAX_OPEN_FILES  16
+#define COREFS_INODE_CACHE     8           // Open inodes kept in RAM (corefs_config_t.inode_cache)
+#define COREFS_MAX_FILES       64          // Default handle limit (corefs_config_t.max_files)
+#define COREFS_MAX_FILES_LIMIT 1024
+#define COREFS_FD_TABLE_MIN    8           // First size of the descriptor table
 #define COREFS_MAX_BLOCKS      128         // Max blocks per file
 #define COREFS_BTREE_ORDER     8
 #define COREFS_TXN_LOG_SIZE    128
-#define COREFS_METADATA_BLOCKS 4
+#define COREFS_RESCUE_SECTORS  2           // Rescue log and spare sector (see corefs_block_program)
+#define COREFS_RESCUE_ENTRIES  (COREFS_SECTOR_SIZE / sizeof(corefs_rescue_entry_t))
+#define COREFS_RESCUE_RESERVE  8           // Free sectors the allocator leaves for rescue copies
+#define COREFS_SUPERBLOCK_SLOTS 2          // Superblock copies, sectors 0 and 1
+#define COREFS_METADATA_BLOCKS (10 + 2 * COREFS_RESCUE_SECTORS) // Superblock A/B, root A/B,
+                                                                // txn log and rescue area, a
+                                                                // sector each; wear log follows
+
+// Static Wear Leveling
+#define COREFS_WEAR_STATIC_THRESHOLD  200   // Max/min wear spread that triggers relocation (< 255)
+#define COREFS_WEAR_STATIC_BUDGET     (8 * COREFS_BLOCK_SIZE)  // Bytes per background run
+#define COREFS_WEAR_STATIC_INTERVAL_MS 10000
+
+// Wear Log Persistence
+#define COREFS_WEAR_LOG_SECTORS       1     // Delta log sectors per slot
+#define COREFS_WEAR_FLUSH_THRESHOLD   64    // Pending erases (all sectors together) before
+                                            // deltas are appended; also one sector at 255
+#define COREFS_WEAR_PENDING_SLOTS     (COREFS_WEAR_FLUSH_THRESHOLD + 16)  // Dirty sectors tracked in RAM,
+                                                                          // saved at once when full
+
+// Wear Map Scaling
+#define COREFS_WEAR_REGION_SECTORS    64    // Sectors per allocator summary region
+#define COREFS_WEAR_DETAIL_MAX_SECTORS 4096 // Above this only region summaries stay in RAM
 
 // File Flags
 #define COREFS_O_RDONLY        0x01
@@ -43,6 +72,72 @@ extern "C" {
 #define COREFS_O_CREAT         0x04
 #define COREFS_O_TRUNC         0x08
 #define COREFS_O_APPEND        0x10
+#define COREFS_O_HOT           0x20  // Placement hint: frequently rewritten
+#define COREFS_O_COLD          0x40  // Placement hint: written once / appended
+#define COREFS_O_REPLACE       0x80  // Set on corefs_replace_begin() handles only
+#define COREFS_O_RING          0x100 // Set on handles of ring files (corefs_open_ring())
+#define COREFS_O_COMPRESS      0x200 // Store the file's blocks compressed (sticks to the file)
+
+// Inode Flags
+#define COREFS_INODE_HOT       0x0001
+#define COREFS_INODE_COLD      0x0002
+#define COREFS_INODE_RING      0x0004  // Fixed block set, appends overwrite the oldest data
+#define COREFS_INODE_RECORDS   0x0008  // Written by corefs_append_record() only
+#define COREFS_INODE_TIMESERIES 0x0010 // Records start with a timestamp (corefs_ts_append())
+#define COREFS_INODE_COMPRESSED 0x0020 // Blocks are stored as compressed chunks
+
+// Placement Classes (blocks of different classes avoid sharing a sector)
+typedef enum {
+    COREFS_CLASS_META = 0,     // Inodes
+    COREFS_CLASS_HOT,          // Rewritten data
+    COREFS_CLASS_COLD,         // Appended / static data
+    COREFS_CLASS_COUNT
+} corefs_class_t;
+
+#define COREFS_HOT_REWRITES    4     // Overwrites before a file is treated as hot
+
+// Locking
+#define COREFS_SECTOR_LOCKS    8     // Striped sector locks for flash RMW
+#define COREFS_NODE_LOCKS      16    // Striped open inode locks, by inode block
+
+// Instances
+#define COREFS_MAX_MOUNTS      4     // Partitions mounted at the same time
+#define COREFS_CACHE_MAX_BLOCKS 32   // Upper bound for corefs_config_t.cache_blocks
+#define COREFS_WQ_MAX_BLOCKS   16    // Upper bound for corefs_config_t.write_queue_blocks
+#define COREFS_DEDUP_MAX_SLOTS 1024  // Upper bound for corefs_config_t.dedup_slots
+
+// Snapshots
+#define COREFS_MAX_SNAPSHOTS   4     // Superblock slots (snapshot ids 1..4)
+
+// Framed Records
+#define COREFS_RECORD_MAGIC    0x5243  // "RC"
+#define COREFS_RECORD_MAX      (COREFS_BLOCK_SIZE - sizeof(corefs_record_hdr_t))
+#define COREFS_TS_RECORD_MAX   (COREFS_RECORD_MAX - sizeof(uint64_t))
+#define COREFS_RECORD_RESERVE  4     // Erased blocks a record file grows by (even)
+
+// Compressed Chunks
+#define COREFS_CHUNK_MAGIC     0x5A43  // "CZ"
+#define COREFS_CHUNK_MAX       (COREFS_BLOCK_SIZE - sizeof(corefs_chunk_hdr_t))
+#define COREFS_LZ_HASH_BITS    10      // Match finder table of uint16_t, one block buffer
+
+// Key-Value Store
+#define COREFS_KV_KEY_MAX      32    // Key bytes
+#define COREFS_KV_VALUE_MAX    (COREFS_RECORD_MAX - sizeof(corefs_kv_entry_t) - COREFS_KV_KEY_MAX)
+#define COREFS_KV_SLOTS        512   // Hash index slots (power of two)
+#define COREFS_KV_MAX_KEYS     384   // Live keys, 3/4 of the slots
+#define COREFS_KV_COMPACT_MIN  (32 * COREFS_BLOCK_SIZE) // Smaller logs are left alone
+#define COREFS_KV_COMPACT_PCT  50    // Dead share of the log that triggers compaction
+#define COREFS_KV_STACK_SIZE   3072
+
+// Arena (zero-malloc mode)
+#define COREFS_ARENA_BUFFERS   8     // Default block-sized slab slots
+#define COREFS_ARENA_MAX_BUFFERS 32  // Upper bound for corefs_config_t.arena_buffers
+#define COREFS_ARENA_ALIGN     8
+
+// Asynchronous I/O
+#define COREFS_AIO_QUEUE_DEPTH 8     // Default requests queued per instance
+#define COREFS_AIO_PRIORITY    5     // Default I/O task priority
+#define COREFS_AIO_STACK_SIZE  4096
 
 // Seek Modes
 #define COREFS_SEEK_SET        0
@@ -66,7 +161,13 @@ typedef struct __attribute__((packed)) {
     uint32_t wear_table_block;
     uint32_t mount_count;
     uint32_t clean_unmount;
-    uint8_t reserved[4000];
+    uint32_t wear_log_blocks;    // Blocks in wear log region (two slots)
+    uint32_t metadata_blocks;    // First allocatable block
+    uint32_t snapshots[COREFS_MAX_SNAPSHOTS];  // Snapshot directory blocks, 0 = free slot
+    uint32_t rescue_block;       // Rescue log sector, the spare sector follows
+    uint32_t root_alt_block;     // Second root slot (root_block is the first)
+    uint32_t seq;                // Slots: the valid one with the higher seq is live
+    uint8_t reserved[3964];
     uint32_t checksum;
 } corefs_superblock_t;
 
@@ -82,7 +183,9 @@ typedef struct __attribute__((packed)) {
         uint32_t name_hash;
         char name[64];
     } entries[COREFS_BTREE_ORDER - 1];
-    uint8_t padding[512];
+    uint32_t seq;              // Root slots: the valid one with the higher seq is live
+    uint32_t checksum;         // CRC32 over the node (checksum = 0)
+    uint8_t padding[1492];     // Pad to COREFS_BLOCK_SIZE
 } corefs_btree_node_t;
 
 // Inode (File Metadata)
@@ -96,11 +199,37 @@ typedef struct __attribute__((packed)) {
     uint32_t modified;
     uint16_t mode;
     uint16_t flags;
-    char name[COREFS_MAX_FILENAME];  // ← ADD: filename in inode
-    uint8_t reserved[1145];          // ← ADJUST padding
+    char name[COREFS_MAX_FILENAME];  // Name at creation; the directory entry is authoritative
+    uint16_t rewrites;               // Overwrites of existing data (saturating)
+    uint32_t record_seq;             // Sequence of the first record past size
+    uint64_t ts_last;                // Time-series: newest timestamp
+    uint64_t ts_index[COREFS_MAX_BLOCKS];  // Time-series: first timestamp per block
+    uint8_t chunks[COREFS_MAX_BLOCKS / 8];  // Compressed files: bit i set if block i is a chunk
+    uint8_t reserved[191];           // Pad to COREFS_BLOCK_SIZE
     uint32_t checksum;               // ← CORRECT field name
 } corefs_inode_t;
 
+// Record Frame (corefs_append_record). A record starts on a 4-byte
+// boundary and never crosses a block; the erased rest of a block that
+// cannot take the next record is skipped.
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint16_t len;            // Payload bytes that follow
+    uint32_t seq;            // One more than the previous record of the file
+    uint32_t crc;            // CRC32 over len, seq and payload
+} corefs_record_hdr_t;
+
+// Compressed Chunk (COREFS_INODE_COMPRESSED files). Each block keeps
+// its own logical 2 KB, compressed (LZ4 block format) behind this
+// header with the rest left erased; a block that does not shrink is
+// stored as it is, without a header. The inode's chunks bits say which
+// blocks are chunks, the contents are never taken for a sign of it.
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint16_t len;            // Compressed bytes that follow
+    uint32_t crc;            // CRC32 over len and the compressed bytes
+} corefs_chunk_hdr_t;
+
 // Transaction Entry
 typedef struct {
     uint32_t op;
@@ -109,15 +238,174 @@ typedef struct {
     uint32_t timestamp;
 } corefs_txn_entry_t;
 
-// File Handle (In-Memory)
+// Wear Log Checkpoint (start of each wear log slot, followed by
+// one uint16_t erase count per sector, relative to base)
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t seq;            // Highest valid sequence wins on load
+    uint32_t sector_count;
+    uint32_t base;           // Lowest erase count at checkpoint time
+    uint32_t checksum;       // CRC32 over header (checksum = 0) + table
+} corefs_wear_header_t;
+
+// Wear Log Record (appended after the checkpoint, one per dirty sector)
+typedef struct __attribute__((packed)) {
+    uint16_t sector;
+    uint8_t delta;
+    uint8_t check;           // ~(sector_lo ^ sector_hi ^ delta)
+} corefs_wear_record_t;
+
+// Rescue Image Header (first half of the sector a sibling is saved
+// to, the block image fills the second half). The sector is a free
+// one of low wear, or the spare sector when none is free.
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t block;          // Block the image belongs to
+    uint32_t seq;            // Matches the log entry
+    uint32_t checksum;       // CRC32 over block, seq and the image
+} corefs_rescue_hdr_t;
+
+// Rescue Log Entry (appended to the rescue log sector, which is only
+// erased once full). Programmed after the image is saved and before
+// the erase it guards; done is programmed to 0 once the sector has
+// been rewritten.
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t seq;            // Oldest unfinished entry is replayed first
+    uint32_t sector;         // First block of the sector holding the image
+    uint32_t check;          // CRC32 over seq and sector
+    uint32_t done;           // 0xFFFFFFFF while the rewrite is in flight
+    uint32_t reserved[3];    // Pad to 32 bytes
+} corefs_rescue_entry_t;
+
+// Wear Region Summary (COREFS_WEAR_REGION_SECTORS sectors)
+typedef struct {
+    uint32_t erases;         // Total erases in region
+    uint16_t free_blocks;
+    uint8_t min_delta;       // Lowest sector delta (detail mode)
+    uint8_t cursor;          // Next sector to try (summary mode)
+} corefs_wear_region_t;
+
+// Unsaved erases of one sector
+typedef struct {
+    uint16_t sector;
+    uint16_t count;
+} corefs_wear_pending_t;
+
+// Inode Write-Back Policy
+typedef enum {
+    COREFS_WRITE_BACK = 0,     // Inode written on close / corefs_fs_sync()
+    COREFS_WRITE_THROUGH,      // Inode written after every corefs_write()
+} corefs_write_policy_t;
+
+// Mount Configuration (per instance)
+typedef struct {
+    uint32_t cache_blocks;               // Block read cache entries, 0 = off
+    corefs_write_policy_t write_policy;
+    uint32_t wear_flush_threshold;       // Erases kept in RAM before the wear log append
+                                         // (1..COREFS_WEAR_FLUSH_THRESHOLD, 0 = max)
+    uint32_t write_queue_blocks;         // Data block writes held for merging, 0 = off
+                                         // (lost on power failure until flushed)
+    void* arena;                         // All instance memory, NULL = heap
+    uint32_t arena_size;
+    uint32_t arena_buffers;              // Block-sized slab slots (0 = default): one per
+                                         // open file, up to 3 per concurrent call
+    uint32_t max_files;                  // Open handles, 0 = COREFS_MAX_FILES
+    uint32_t snapshot;                   // Mount this snapshot read-only, 0 = live files
+    uint32_t dedup_slots;                // Content-hash index entries for block dedup
+                                         // (power of two), 0 = off
+    uint32_t inode_cache;                // Inodes of open files kept in RAM, 0 = default
+                                         // (COREFS_INODE_CACHE, at most half the arena buffers)
+} corefs_config_t;
+
+#define COREFS_CONFIG_DEFAULT() {                   \
+    .cache_blocks = 0,                              \
+    .write_policy = COREFS_WRITE_BACK,              \
+    .wear_flush_threshold = COREFS_WEAR_FLUSH_THRESHOLD, \
+    .write_queue_blocks = 0,                        \
+    .arena = NULL,                                  \
+    .arena_size = 0,                                \
+    .arena_buffers = 0,                             \
+    .max_files = 0,                                 \
+    .snapshot = 0,                                  \
+    .dedup_slots = 0,                               \
+    .inode_cache = 0,                               \
+}
+
+// Block Cache Entry (data lives in ctx->cache_data)
+typedef struct {
+    uint32_t block;          // UINT32_MAX = empty
+    uint32_t used;           // LRU tick
+} corefs_cache_entry_t;
+
+// Dedup Index Entry (RAM only, slot = hash & (dedup_slots - 1))
+typedef struct {
+    uint32_t hash;           // CRC32 of the block contents
+    uint32_t block;          // 0 = empty
+    uint32_t stamp;          // New for every entry written to the slot
+} corefs_dedup_entry_t;
+
+// Fixed-Size Slab (used is a bitmap of taken slots)
+typedef struct {
+    uint8_t* base;
+    uint32_t slot_size;
+    uint32_t count;
+    uint32_t* used;
+    uint32_t in_use;
+    uint32_t peak;
+} corefs_slab_t;
+
+typedef enum {
+    COREFS_SLAB_HANDLE = 0,    // corefs_file_t
+    COREFS_SLAB_NODE,          // corefs_node_t
+    COREFS_SLAB_BUFFER,        // COREFS_BLOCK_SIZE: scratch, directory nodes, inodes
+    COREFS_SLAB_COUNT
+} corefs_slab_class_t;
+
+// Caller-Provided Arena (base == NULL: heap)
+typedef struct {
+    uint8_t* base;
+    uint32_t size;
+    uint32_t top;            // Bytes carved so far
+    corefs_slab_t slabs[COREFS_SLAB_COUNT];
+    uint32_t failures;
+} corefs_arena_t;
+
+// Reader/Writer Lock (FreeRTOS semaphores, NULL when unmounted)
+typedef struct {
+    void* lock;             // Guards readers (SemaphoreHandle_t)
+    void* write;            // Held by the writer or on behalf of all readers
+    uint32_t readers;
+} corefs_rwlock_t;
+
+// Open Inode (shared by all handles of one file)
+// The inode is only held in RAM while it is in use or among the
+// config.inode_cache most recently used ones (ctx->node_lock).
 typedef struct {
-    char path[COREFS_MAX_PATH];
-    corefs_inode_t* inode;
+    corefs_inode_t* inode;  // NULL while dropped, loaded again on use
     uint32_t inode_block;
-    uint32_t position;    // ← ADD: current offset
-    uint32_t flags;
-    bool dirty;           // ← ADD: modified flag
-    bool valid;
+    uint32_t refs;          // Handles referencing this inode
+    uint32_t users;         // Calls using inode right now; it stays in RAM
+    uint32_t used;          // Last use (ctx->nodes_tick)
+    uint32_t crc;           // Inode checksum on flash; a different copy is written back
+    char name[64];          // Directory entry name, follows renames
+    corefs_rwlock_t* lock;  // Stripe of ctx->node_locks
+} corefs_node_t;
+
+struct corefs_ctx;
+
+// File Handle (In-Memory)
+// A handle keeps its own position, so corefs_read/write/seek on one
+// handle must not be used by two tasks at once. corefs_pread/pwrite
+// leave the position alone and may share a handle between tasks.
+// Name, size and block list live in the shared node.
+typedef struct {
+    struct corefs_ctx* ctx;   // Instance the file was opened on
+    corefs_node_t* node;
+    uint32_t position;
+    int32_t fd;               // Index in ctx->files
+    uint16_t flags;
+    bool dirty;
 } corefs_file_t;
 
 // Memory-Mapped File
@@ -127,6 +415,17 @@ typedef struct {
     uint32_t flash_addr;
 } corefs_mmap_t;
 
+// Async Completion (any combination; all are signalled from the I/O task)
+typedef void (*corefs_aio_cb_t)(int result, void* arg);
+
+typedef struct {
+    corefs_aio_cb_t callback;  // result: bytes, -1, or esp_err_t for sync
+    void* arg;
+    void* notify_task;         // TaskHandle_t, notified with the result as value
+    void* event_group;         // EventGroupHandle_t
+    uint32_t event_bits;       // Bits set in event_group
+} corefs_aio_done_t;
+
 // Filesystem Info
 typedef struct {
     uint64_t total_bytes;
@@ -138,51 +437,321 @@ typedef struct {
     uint32_t mount_count;
 } corefs_info_t;
 
-// Context (Global State)
+// File Status
+typedef struct {
+    uint64_t size;
+    uint32_t blocks;         // Data blocks allocated
+    uint32_t created;        // esp_log_timestamp() at creation
+    uint32_t modified;
+    uint16_t mode;
+} corefs_stat_t;
+
+// Wear Leveling Statistics
+typedef struct {
+    uint32_t static_passes;     // Static leveling runs that found work
+    uint32_t static_moves;      // Blocks relocated
+    uint64_t bytes_relocated;   // Data bytes copied by relocation
+    uint32_t min_wear;
+    uint32_t max_wear;
+} corefs_wear_stats_t;
+
+// Memory Statistics (arena mode; all zero on the heap)
+typedef struct {
+    uint32_t arena_size;
+    uint32_t arena_used;        // Carved at mount, including slabs
+    uint32_t high_water;        // arena_used less slab slots never taken
+    uint32_t handles_in_use;
+    uint32_t handles_peak;
+    uint32_t buffers_total;
+    uint32_t buffers_in_use;
+    uint32_t buffers_peak;
+    uint32_t alloc_failures;    // Requests refused for lack of space
+} corefs_mem_stats_t;
+
+// I/O Statistics (write amplification = programmed_bytes / logical_bytes)
 typedef struct {
+    uint64_t logical_bytes;     // Bytes passed to corefs_write()
+    uint64_t programmed_bytes;  // Bytes programmed to flash (blocks + wear log)
+    uint64_t erased_bytes;      // Bytes erased
+    uint32_t sibling_copies;    // Live sector halves rewritten by an erase (rescued first)
+    uint32_t merged_writes;     // Queued sector pairs programmed with one erase
+    uint32_t dropped_writes;    // Queued writes superseded before reaching flash
+    uint32_t shared_blocks;     // Blocks shared by a clone instead of copied
+    uint32_t cow_copies;        // Shared blocks copied on write
+    uint32_t record_appends;    // Records added without rewriting their block
+    uint64_t compress_in;       // Block bytes written to compressed files
+    uint64_t compress_out;      // The same blocks as stored (chunk or raw)
+    uint32_t dedup_hits;        // Block writes replaced by a reference to an identical block
+    uint32_t class_allocs[COREFS_CLASS_COUNT];
+} corefs_io_stats_t;
+
+// Context (one per mounted partition)
+typedef struct corefs_ctx {
     const esp_partition_t* partition;
+    corefs_config_t config;
+    corefs_arena_t arena;
     corefs_superblock_t* sb;
     uint8_t* block_bitmap;
-    uint16_t* wear_table;
-    corefs_file_t* open_files[COREFS_MAX_OPEN_FILES];
+    uint8_t* block_class;       // 2 bits per block (corefs_class_t)
+    uint8_t* block_refs;        // References beyond the first (clones, dedup), per block
+    corefs_cache_entry_t* cache;
+    uint8_t* cache_data;        // config.cache_blocks * COREFS_BLOCK_SIZE
+    uint32_t cache_tick;
+    uint32_t* wq_blocks;        // Queued data writes (block numbers), NULL = off
+    uint8_t* wq_data;           // config.write_queue_blocks * COREFS_BLOCK_SIZE
+    uint32_t wq_count;
+    corefs_dedup_entry_t* dedup; // config.dedup_slots entries, NULL = off
+    uint32_t dedup_stamp;
+    uint32_t wear_base;         // Erase count all sector deltas are relative to
+    uint8_t* wear_delta;        // Per sector, NULL on large partitions
+    corefs_wear_region_t* wear_regions;
+    uint32_t wear_region_count;
+    uint32_t wear_free_sectors; // Sectors with both halves free
+    corefs_wear_pending_t wear_pending[COREFS_WEAR_PENDING_SLOTS];
+    uint32_t wear_pending_count;
+    uint32_t wear_pending_total;  // Erases in wear_pending
+    uint32_t wear_pending_peak;   // Highest count of one entry
+    uint32_t wear_seq;          // Sequence of active wear log slot
+    uint32_t wear_slot;
+    uint32_t wear_log_pos;      // Records appended to active slot
+    bool wear_saving;
+    corefs_file_t** files;      // Open handles by descriptor, grows to config.max_files
+    uint32_t files_cap;
+    uint32_t files_free;        // No free descriptor below this one
+    corefs_node_t** nodes;      // Open inodes, grows like files (dir_lock)
+    uint32_t nodes_cap;
+    uint32_t nodes_resident;    // Nodes with the inode in RAM (node_lock)
+    uint32_t nodes_tick;
+    corefs_rwlock_t dir_lock;
+    corefs_rwlock_t sector_locks[COREFS_SECTOR_LOCKS];
+    corefs_rwlock_t node_locks[COREFS_NODE_LOCKS];
+    void* node_lock;            // Inode residency of open nodes (SemaphoreHandle_t)
+    void* alloc_lock;           // Recursive mutex (SemaphoreHandle_t)
+    void* txn_lock;             // Held for the duration of a transaction
+    void* wq_lock;              // Write queue, held across a flush (SemaphoreHandle_t)
+    void* rescue_lock;          // Rescue log (SemaphoreHandle_t)
+    uint32_t rescue_pos;        // Next free rescue log entry
+    uint32_t rescue_seq;
+    corefs_txn_entry_t txn_log[COREFS_TXN_LOG_SIZE];
+    uint32_t txn_count;
+    bool txn_active;
+    bool txn_prepared;          // Log is on flash, the next root write commits it
+    uint32_t root_active;       // Block of the live root (a root slot, or a snapshot's directory)
+    uint32_t root_seq;          // Sequence of the live root
+    uint32_t sb_slot;           // Superblock slot the live copy was read from or written to
     uint32_t next_inode_num;
+    corefs_wear_stats_t wear_stats;
+    corefs_io_stats_t io_stats;
+    void* volatile wear_task;   // Background static leveling task (TaskHandle_t)
+    uint32_t wear_interval_ms;
+    uint32_t wear_budget;
+    volatile bool wear_stop;
+    void* aio_queue;            // Async requests, NULL when stopped (QueueHandle_t, aio_lock)
+    void* aio_task;             // I/O task (TaskHandle_t, aio_ctl)
+    void* aio_lock;             // Guards aio_queue for submission (SemaphoreHandle_t)
+    void* aio_ctl;              // Serializes aio start/stop (SemaphoreHandle_t)
+    void* aio_exit;             // Given by the I/O task when it exits (SemaphoreHandle_t)
     bool mounted;
+    bool read_only;             // Snapshot mount: flash is never written
 } corefs_ctx_t;
 
 // ============================================
 // PUBLIC API
 // ============================================
 
+// Every call taking a corefs_ctx_t* works on that mounted instance. The
+// calls without one operate on the default instance mounted by
+// corefs_mount() and are kept for existing code.
+
 // Lifecycle
 esp_err_t corefs_format(const esp_partition_t* partition);
 esp_err_t corefs_mount(const esp_partition_t* partition);
 esp_err_t corefs_unmount(void);
 bool corefs_is_mounted(void);
+esp_err_t corefs_sync(void);
+esp_err_t corefs_flush(void);
+
+// Instances
+esp_err_t corefs_fs_mount(const esp_partition_t* partition, const corefs_config_t* config,
+                          corefs_ctx_t** out_fs);
+esp_err_t corefs_fs_unmount(corefs_ctx_t* fs);
+esp_err_t corefs_fs_sync(corefs_ctx_t* fs);
+esp_err_t corefs_fs_flush(corefs_ctx_t* fs);
+corefs_ctx_t* corefs_get_context(void);
 
 // File Operations
 corefs_file_t* corefs_open(const char* path, uint32_t flags);
+corefs_file_t* corefs_fs_open(corefs_ctx_t* fs, const char* path, uint32_t flags);
+corefs_file_t* corefs_open_ring(const char* path, uint32_t flags, uint32_t max_size);
+corefs_file_t* corefs_fs_open_ring(corefs_ctx_t* fs, const char* path, uint32_t flags,
+                                   uint32_t max_size);
 int corefs_read(corefs_file_t* file, void* buf, size_t size);
 int corefs_write(corefs_file_t* file, const void* buf, size_t size);
+int corefs_pread(corefs_file_t* file, void* buf, size_t size, uint32_t offset);
+int corefs_pwrite(corefs_file_t* file, const void* buf, size_t size, uint32_t offset);
+int corefs_readv(corefs_file_t* file, const struct iovec* iov, int iovcnt);
+int corefs_writev(corefs_file_t* file, const struct iovec* iov, int iovcnt);
+int corefs_copy_range(corefs_file_t* src, uint32_t src_offset,
+                      corefs_file_t* dst, uint32_t dst_offset, size_t len);
 int corefs_seek(corefs_file_t* file, int offset, int whence);
 size_t corefs_tell(corefs_file_t* file);
 size_t corefs_size(corefs_file_t* file);
 esp_err_t corefs_close(corefs_file_t* file);
+esp_err_t corefs_fsync(corefs_file_t* file);
+esp_err_t corefs_ftruncate(corefs_file_t* file, uint32_t length);
+esp_err_t corefs_fallocate(corefs_file_t* file, uint32_t offset, uint32_t len);
+esp_err_t corefs_fstat(corefs_file_t* file, corefs_stat_t* st);
+int corefs_fileno(corefs_file_t* file);
+const char* corefs_name(corefs_file_t* file);
+corefs_file_t* corefs_replace_begin(const char* path);
+corefs_file_t* corefs_fs_replace_begin(corefs_ctx_t* fs, const char* path);
+esp_err_t corefs_replace_commit(corefs_file_t* file);
+corefs_file_t* corefs_fs_get_file(corefs_ctx_t* fs, int fd);
+
+// Framed Records
+typedef struct {
+    corefs_file_t* file;
+    uint32_t pos;            // Stream offset of the next record
+    uint32_t seq;            // Sequence of the last record returned
+    uint32_t at;             // Stream offset of the last record returned
+    bool started;
+} corefs_record_iter_t;
+
+esp_err_t corefs_append_record(corefs_file_t* file, const void* data, size_t len, uint32_t* pos);
+void corefs_record_iter_init(corefs_record_iter_t* it, corefs_file_t* file);
+int corefs_record_next(corefs_record_iter_t* it, void* buf, size_t size);
+
+// Time-Series Files (timestamped records)
+esp_err_t corefs_ts_append(corefs_file_t* file, uint64_t ts, const void* data, size_t len);
+esp_err_t corefs_ts_seek(corefs_file_t* file, uint64_t t, corefs_record_iter_t* it);
+int corefs_ts_next(corefs_record_iter_t* it, uint64_t* ts, void* buf, size_t size);
+
+// Key-Value Store (log of records in one file, RAM hash index)
+typedef struct __attribute__((packed)) {
+    uint8_t op;              // Put or delete
+    uint8_t key_len;
+    uint16_t value_len;      // Key and value follow
+} corefs_kv_entry_t;
+
+typedef struct {
+    uint32_t hash;           // 0 = empty, 1 = deleted, else hash of the key
+    uint32_t pos;            // Stream offset of the record holding the entry
+    uint16_t off;            // Entry offset in the record payload
+    uint16_t len;            // Entry bytes (header, key, value)
+} corefs_kv_slot_t;
+
+typedef struct {
+    corefs_ctx_t* fs;
+    corefs_file_t* file;
+    char path[64];
+    uint8_t* buf;            // Block-sized scratch buffer
+    void* lock;              // Serializes all calls (SemaphoreHandle_t)
+    void* volatile task;     // Background compaction (TaskHandle_t)
+    volatile bool stop;
+    uint32_t keys;           // Live keys
+    uint32_t deleted;        // Deleted slots
+    uint32_t live_bytes;     // Log bytes of the live entries
+    uint32_t compactions;
+    corefs_kv_slot_t slots[COREFS_KV_SLOTS];
+} corefs_kv_t;
+
+typedef struct {
+    corefs_kv_t* kv;
+    uint8_t* buf;            // Entries, committed as one record
+    uint32_t len;
+    esp_err_t err;           // First failed put/delete, returned by commit
+} corefs_kv_batch_t;
+
+typedef struct {
+    uint32_t keys;
+    uint32_t live_bytes;
+    uint32_t log_bytes;      // Live and dead
+    uint32_t compactions;    // Since open
+} corefs_kv_stats_t;
+
+// Return false to stop the iteration
+typedef bool (*corefs_kv_iter_cb_t)(const char* key, const void* value, size_t len, void* arg);
+
+esp_err_t corefs_kv_open(const char* path, corefs_kv_t* kv);
+esp_err_t corefs_fs_kv_open(corefs_ctx_t* fs, const char* path, corefs_kv_t* kv);
+esp_err_t corefs_kv_close(corefs_kv_t* kv);
+esp_err_t corefs_kv_get(corefs_kv_t* kv, const char* key, void* buf, size_t size, size_t* len);
+esp_err_t corefs_kv_put(corefs_kv_t* kv, const char* key, const void* value, size_t len);
+esp_err_t corefs_kv_delete(corefs_kv_t* kv, const char* key);
+esp_err_t corefs_kv_iterate(corefs_kv_t* kv, corefs_kv_iter_cb_t cb, void* arg);
+esp_err_t corefs_kv_batch_begin(corefs_kv_t* kv, corefs_kv_batch_t* batch);
+esp_err_t corefs_kv_batch_put(corefs_kv_batch_t* batch, const char* key, const void* value, size_t len);
+esp_err_t corefs_kv_batch_delete(corefs_kv_batch_t* batch, const char* key);
+esp_err_t corefs_kv_batch_commit(corefs_kv_batch_t* batch);
+void corefs_kv_batch_abort(corefs_kv_batch_t* batch);
+esp_err_t corefs_kv_compact(corefs_kv_t* kv);
+esp_err_t corefs_kv_compact_start(corefs_kv_t* kv);
+esp_err_t corefs_kv_get_stats(corefs_kv_t* kv, corefs_kv_stats_t* stats);
 
 // File Management
 esp_err_t corefs_unlink(const char* path);
 bool corefs_exists(const char* path);
+esp_err_t corefs_rename(const char* old_path, const char* new_path);
+esp_err_t corefs_clone(const char* src_path, const char* dst_path);
+esp_err_t corefs_stat(const char* path, corefs_stat_t* st);
+esp_err_t corefs_fs_unlink(corefs_ctx_t* fs, const char* path);
+bool corefs_fs_exists(corefs_ctx_t* fs, const char* path);
+esp_err_t corefs_fs_rename(corefs_ctx_t* fs, const char* old_path, const char* new_path);
+esp_err_t corefs_fs_clone(corefs_ctx_t* fs, const char* src_path, const char* dst_path);
+esp_err_t corefs_fs_stat(corefs_ctx_t* fs, const char* path, corefs_stat_t* st);
 
 // Info
 esp_err_t corefs_info(corefs_info_t* info);
+esp_err_t corefs_get_io_stats(corefs_io_stats_t* stats);
+void corefs_reset_io_stats(void);
+esp_err_t corefs_get_mem_stats(corefs_mem_stats_t* stats);
 esp_err_t corefs_check(void);
+esp_err_t corefs_fs_info(corefs_ctx_t* fs, corefs_info_t* info);
+esp_err_t corefs_fs_get_io_stats(corefs_ctx_t* fs, corefs_io_stats_t* stats);
+void corefs_fs_reset_io_stats(corefs_ctx_t* fs);
+esp_err_t corefs_fs_get_mem_stats(corefs_ctx_t* fs, corefs_mem_stats_t* stats);
+esp_err_t corefs_fs_check(corefs_ctx_t* fs);
+
+// Snapshots (ids 1..COREFS_MAX_SNAPSHOTS)
+esp_err_t corefs_snapshot_create(uint32_t* out_id);
+esp_err_t corefs_snapshot_rollback(uint32_t id);
+esp_err_t corefs_snapshot_delete(uint32_t id);
+esp_err_t corefs_fs_snapshot_create(corefs_ctx_t* fs, uint32_t* out_id);
+esp_err_t corefs_fs_snapshot_rollback(corefs_ctx_t* fs, uint32_t id);
+esp_err_t corefs_fs_snapshot_delete(corefs_ctx_t* fs, uint32_t id);
 
 // Memory-Mapped Files
 corefs_mmap_t* corefs_mmap(const char* path);
 void corefs_munmap(corefs_mmap_t* mmap);
 
+// Wear Leveling
+esp_err_t corefs_wear_level(uint32_t io_budget);
+esp_err_t corefs_wear_start(uint32_t interval_ms, uint32_t io_budget);
+esp_err_t corefs_wear_stop(void);
+esp_err_t corefs_wear_get_stats(corefs_wear_stats_t* stats);
+esp_err_t corefs_fs_wear_level(corefs_ctx_t* fs, uint32_t io_budget);
+esp_err_t corefs_fs_wear_start(corefs_ctx_t* fs, uint32_t interval_ms, uint32_t io_budget);
+esp_err_t corefs_fs_wear_stop(corefs_ctx_t* fs);
+esp_err_t corefs_fs_wear_get_stats(corefs_ctx_t* fs, corefs_wear_stats_t* stats);
+
+// Asynchronous I/O
+esp_err_t corefs_aio_start(uint32_t queue_depth, uint32_t priority);
+esp_err_t corefs_aio_stop(void);
+esp_err_t corefs_read_async(corefs_file_t* file, void* buf, size_t size,
+                            const corefs_aio_done_t* done);
+esp_err_t corefs_write_async(corefs_file_t* file, const void* buf, size_t size,
+                             const corefs_aio_done_t* done);
+esp_err_t corefs_sync_async(const corefs_aio_done_t* done);
+esp_err_t corefs_fs_aio_start(corefs_ctx_t* fs, uint32_t queue_depth, uint32_t priority);
+esp_err_t corefs_fs_aio_stop(corefs_ctx_t* fs);
+esp_err_t corefs_fs_sync_async(corefs_ctx_t* fs, const corefs_aio_done_t* done);
+
 // VFS Integration
 esp_err_t corefs_vfs_register(const char* base_path);
+esp_err_t corefs_fs_vfs_register(corefs_ctx_t* fs, const char* base_path);
 esp_err_t corefs_vfs_unregister(const char* base_path);
+ssize_t corefs_vfs_readv(int fd, const struct iovec* iov, int iovcnt);
+ssize_t corefs_vfs_writev(int fd, const struct iovec* iov, int iovcnt);
 
 // ============================================
 // INTERNAL API
@@ -197,34 +766,132 @@ esp_err_t corefs_superblock_init(corefs_ctx_t* ctx);
 esp_err_t corefs_block_init(corefs_ctx_t* ctx);
 esp_err_t corefs_block_read(corefs_ctx_t* ctx, uint32_t block, void* buf);
 esp_err_t corefs_block_write(corefs_ctx_t* ctx, uint32_t block, const void* buf);
+esp_err_t corefs_block_program(corefs_ctx_t* ctx, uint32_t block, const void* buf,
+                               const void* sibling_buf);
+esp_err_t corefs_block_erase(corefs_ctx_t* ctx, uint32_t block);
+esp_err_t corefs_block_rescue_format(corefs_ctx_t* ctx);
+esp_err_t corefs_block_rescue_recover(corefs_ctx_t* ctx);
 uint32_t corefs_block_alloc(corefs_ctx_t* ctx);
+uint32_t corefs_block_alloc_class(corefs_ctx_t* ctx, corefs_class_t cls);
+uint32_t corefs_block_alloc_run(corefs_ctx_t* ctx, uint32_t count, corefs_class_t cls);
+corefs_class_t corefs_block_get_class(corefs_ctx_t* ctx, uint32_t block);
+void corefs_block_set_class(corefs_ctx_t* ctx, uint32_t block, corefs_class_t cls);
 void corefs_block_free(corefs_ctx_t* ctx, uint32_t block);
+bool corefs_block_is_allocated(corefs_ctx_t* ctx, uint32_t block);
+bool corefs_block_share(corefs_ctx_t* ctx, uint32_t block);
+bool corefs_block_is_shared(corefs_ctx_t* ctx, uint32_t block);
+bool corefs_block_reserve(corefs_ctx_t* ctx, uint32_t block);
+esp_err_t corefs_block_scan(corefs_ctx_t* ctx);
 uint32_t corefs_block_get_flash_addr(corefs_ctx_t* ctx, uint32_t block);
+esp_err_t corefs_block_append(corefs_ctx_t* ctx, uint32_t block, uint32_t offset,
+                              const void* data, uint32_t len);
+
+// Block Deduplication
+esp_err_t corefs_dedup_init(corefs_ctx_t* ctx);
+void corefs_dedup_cleanup(corefs_ctx_t* ctx);
+uint32_t corefs_dedup_share(corefs_ctx_t* ctx, uint32_t hash, const void* buf);
+void corefs_dedup_insert(corefs_ctx_t* ctx, uint32_t hash, uint32_t block);
+void corefs_dedup_forget(corefs_ctx_t* ctx, uint32_t block);
+
+// Compression (LZ4 block format)
+uint32_t corefs_lz_compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap,
+                            uint16_t* table);
+int corefs_lz_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap);
+
+// Memory (arena or heap)
+esp_err_t corefs_mem_init(corefs_ctx_t* ctx);
+corefs_ctx_t* corefs_mem_new_context(const corefs_config_t* config);
+void corefs_mem_delete_context(corefs_ctx_t* ctx);
+void* corefs_mem_carve(corefs_ctx_t* ctx, size_t size);
+void* corefs_mem_alloc(corefs_ctx_t* ctx, size_t size);
+void* corefs_mem_calloc(corefs_ctx_t* ctx, size_t size);
+void corefs_mem_free(corefs_ctx_t* ctx, void* ptr);
+
+// Write Elevator
+esp_err_t corefs_elevator_init(corefs_ctx_t* ctx);
+void corefs_elevator_cleanup(corefs_ctx_t* ctx);
+esp_err_t corefs_elevator_write(corefs_ctx_t* ctx, uint32_t block, const void* buf);
+bool corefs_elevator_read(corefs_ctx_t* ctx, uint32_t block, void* buf);
+void corefs_elevator_lock(corefs_ctx_t* ctx);
+void corefs_elevator_unlock(corefs_ctx_t* ctx);
+void corefs_elevator_drop(corefs_ctx_t* ctx, uint32_t block);
+bool corefs_elevator_patch(corefs_ctx_t* ctx, uint32_t block, uint32_t offset,
+                           const void* data, uint32_t len);
+esp_err_t corefs_elevator_flush(corefs_ctx_t* ctx);
 
 // B-Tree
 esp_err_t corefs_btree_init(corefs_ctx_t* ctx);
 esp_err_t corefs_btree_load(corefs_ctx_t* ctx);  // ← ADD: load from flash
+esp_err_t corefs_btree_commit(corefs_ctx_t* ctx, corefs_btree_node_t* node);
 int32_t corefs_btree_find(corefs_ctx_t* ctx, const char* path);
 esp_err_t corefs_btree_insert(corefs_ctx_t* ctx, const char* path, uint32_t inode_block);
 esp_err_t corefs_btree_delete(corefs_ctx_t* ctx, const char* path);
+esp_err_t corefs_btree_update(corefs_ctx_t* ctx, const char* path, uint32_t inode_block);
+esp_err_t corefs_btree_rename(corefs_ctx_t* ctx, const char* old_path, const char* new_path,
+                              int32_t* replaced);
+
+typedef bool (*corefs_btree_iter_cb_t)(const char* name, uint32_t inode_block, void* arg);
+esp_err_t corefs_btree_iterate(corefs_ctx_t* ctx, corefs_btree_iter_cb_t cb, void* arg);
+esp_err_t corefs_btree_iterate_at(corefs_ctx_t* ctx, uint32_t root_block,
+                                  corefs_btree_iter_cb_t cb, void* arg);
 
 // Inode
 esp_err_t corefs_inode_read(corefs_ctx_t* ctx, uint32_t block, corefs_inode_t* inode);
 esp_err_t corefs_inode_write(corefs_ctx_t* ctx, uint32_t block, const corefs_inode_t* inode);
 esp_err_t corefs_inode_create(corefs_ctx_t* ctx, const char* filename, uint32_t* out_block);
+esp_err_t corefs_inode_clone(corefs_ctx_t* ctx, const char* filename, const corefs_inode_t* src,
+                             uint32_t* out_block);
+esp_err_t corefs_inode_relocate(corefs_ctx_t* ctx, const corefs_inode_t* inode, uint32_t* out_block);
 esp_err_t corefs_inode_delete(corefs_ctx_t* ctx, uint32_t inode_block);
+corefs_class_t corefs_inode_class(const corefs_inode_t* inode);
 
 // Transaction
-void corefs_txn_begin(void);
-void corefs_txn_log(uint32_t op, uint32_t inode, uint32_t block);
+void corefs_txn_begin(corefs_ctx_t* ctx);
+void corefs_txn_log(corefs_ctx_t* ctx, uint32_t op, uint32_t inode, uint32_t block);
+esp_err_t corefs_txn_prepare(corefs_ctx_t* ctx);
 esp_err_t corefs_txn_commit(corefs_ctx_t* ctx);
-void corefs_txn_rollback(void);
+void corefs_txn_rollback(corefs_ctx_t* ctx);
+bool corefs_txn_is_active(corefs_ctx_t* ctx);
+
+// Open File Table
+esp_err_t corefs_file_table_init(corefs_ctx_t* ctx);
+void corefs_file_table_cleanup(corefs_ctx_t* ctx);
+esp_err_t corefs_file_share(corefs_ctx_t* ctx, uint32_t inode_block, const char* filename,
+                            uint32_t* out_block);
+esp_err_t corefs_file_store(corefs_file_t* file);
+bool corefs_file_is_open(corefs_ctx_t* ctx, uint32_t inode_block);
+uint16_t corefs_file_inode_flags(corefs_file_t* file);
+
+// Locking
+esp_err_t corefs_lock_init(corefs_ctx_t* ctx);
+void corefs_lock_deinit(corefs_ctx_t* ctx);
+void corefs_rwlock_rdlock(corefs_rwlock_t* rw);
+void corefs_rwlock_rdunlock(corefs_rwlock_t* rw);
+void corefs_rwlock_wrlock(corefs_rwlock_t* rw);
+void corefs_rwlock_wrunlock(corefs_rwlock_t* rw);
+void corefs_alloc_lock(corefs_ctx_t* ctx);
+void corefs_alloc_unlock(corefs_ctx_t* ctx);
+void corefs_node_lock(corefs_ctx_t* ctx);
+void corefs_node_unlock(corefs_ctx_t* ctx);
 
 // Wear Leveling
+esp_err_t corefs_wear_init(corefs_ctx_t* ctx);
+void corefs_wear_cleanup(corefs_ctx_t* ctx);
+uint32_t corefs_wear_region_blocks(uint32_t block_count);
 esp_err_t corefs_wear_load(corefs_ctx_t* ctx);
 esp_err_t corefs_wear_save(corefs_ctx_t* ctx);
+esp_err_t corefs_wear_compact(corefs_ctx_t* ctx);
 esp_err_t corefs_wear_check(corefs_ctx_t* ctx);
 uint32_t corefs_wear_get_best_block(corefs_ctx_t* ctx);
+uint32_t corefs_wear_get_best_sector(corefs_ctx_t* ctx);
+uint32_t corefs_wear_get_best_pair(corefs_ctx_t* ctx, corefs_class_t cls);
+uint32_t corefs_wear_get_best_half(corefs_ctx_t* ctx);
+uint32_t corefs_wear_get(corefs_ctx_t* ctx, uint32_t block);
+void corefs_wear_increment(corefs_ctx_t* ctx, uint32_t block);
+bool corefs_wear_flush_due(corefs_ctx_t* ctx);
+void corefs_wear_note_alloc(corefs_ctx_t* ctx, uint32_t block, bool allocated);
+void corefs_wear_recount(corefs_ctx_t* ctx);
+esp_err_t corefs_wear_static_step(corefs_ctx_t* ctx, uint32_t io_budget);
 
 // Recovery
 esp_err_t corefs_recovery_scan(corefs_ctx_t* ctx);
@@ -234,6 +901,8 @@ esp_err_t corefs_recovery_scan(corefs_ctx_t* ctx);
 // ============================================
 
 uint32_t crc32(const void* data, size_t len);
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len);
+uint32_t crc32_finalize(uint32_t crc);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,264 @@
+/**
+ * CoreFS - Asynchronous I/O
+ *
+ * Requests are queued to one I/O task per mounted instance and run in
+ * submission order, so the caller is not blocked for flash erase and
+ * program time. Completion is signalled from the I/O task through any
+ * combination of callback, task notification (value = result) and
+ * event group bits.
+ *
+ * Buffers must stay valid until completion. A handle with requests in
+ * flight must not be used synchronously or closed until they complete.
+ *
+ * aio_ctl serializes start and stop and is held while stop waits for the
+ * task, so the task never takes it: a completion callback may submit
+ * more requests but cannot stop (or restart) its own I/O task. aio_lock
+ * covers the queue handle only, around a send that never blocks, so a
+ * submission cannot race stop deleting the queue.
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char* TAG = "corefs_aio";
+
+typedef enum {
+    AIO_OP_READ,
+    AIO_OP_WRITE,
+    AIO_OP_SYNC,
+    AIO_OP_STOP,
+} aio_op_t;
+
+typedef struct {
+    aio_op_t op;
+    corefs_ctx_t* ctx;
+    corefs_file_t* file;
+    void* buf;
+    size_t size;
+    corefs_aio_done_t done;
+} aio_req_t;
+
+// ============================================
+// I/O TASK
+// ============================================
+
+static void aio_complete(const corefs_aio_done_t* done, int result) {
+    if (done->callback) {
+        done->callback(result, done->arg);
+    }
+    if (done->notify_task) {
+        xTaskNotify((TaskHandle_t)done->notify_task, (uint32_t)result, eSetValueWithOverwrite);
+    }
+    if (done->event_group && done->event_bits) {
+        xEventGroupSetBits((EventGroupHandle_t)done->event_group, done->event_bits);
+    }
+}
+
+// arg is the queue: stop detaches it from the context before the last
+// request, so the task never looks at ctx->aio_queue
+static void aio_task(void* arg) {
+    QueueHandle_t queue = (QueueHandle_t)arg;
+    aio_req_t req;
+
+    while (xQueueReceive(queue, &req, portMAX_DELAY) == pdTRUE) {
+        if (req.op == AIO_OP_STOP) {
+            break;
+        }
+
+        int result = -1;
+        switch (req.op) {
+            case AIO_OP_READ:
+                result = corefs_read(req.file, req.buf, req.size);
+                break;
+            case AIO_OP_WRITE:
+                result = corefs_write(req.file, req.buf, req.size);
+                break;
+            case AIO_OP_SYNC:
+                result = corefs_fs_sync(req.ctx);
+                break;
+            default:
+                break;
+        }
+
+        aio_complete(&req.done, result);
+    }
+
+    // Stop owns the queue and the context once this is given
+    xSemaphoreGive((SemaphoreHandle_t)req.ctx->aio_exit);
+    vTaskDelete(NULL);
+}
+
+// ============================================
+// LIFECYCLE
+// ============================================
+
+static bool aio_on_task(corefs_ctx_t* fs) {
+    return fs->aio_task && fs->aio_task == xTaskGetCurrentTaskHandle();
+}
+
+esp_err_t corefs_fs_aio_start(corefs_ctx_t* fs, uint32_t queue_depth, uint32_t priority) {
+    if (!fs || !fs->mounted) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Called from a completion callback: it is running
+    if (aio_on_task(fs)) {
+        return ESP_OK;
+    }
+
+    if (queue_depth == 0) {
+        queue_depth = COREFS_AIO_QUEUE_DEPTH;
+    }
+    if (priority == 0) {
+        priority = COREFS_AIO_PRIORITY;
+    }
+
+    xSemaphoreTake((SemaphoreHandle_t)fs->aio_ctl, portMAX_DELAY);
+
+    if (fs->aio_task) {
+        xSemaphoreGive((SemaphoreHandle_t)fs->aio_ctl);
+        return ESP_OK;
+    }
+
+    QueueHandle_t queue = xQueueCreate(queue_depth, sizeof(aio_req_t));
+    if (!queue) {
+        xSemaphoreGive((SemaphoreHandle_t)fs->aio_ctl);
+        return ESP_ERR_NO_MEM;
+    }
+
+    TaskHandle_t task = NULL;
+    if (xTaskCreate(aio_task, "corefs_aio", COREFS_AIO_STACK_SIZE, queue,
+                    priority, &task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start I/O task");
+        vQueueDelete(queue);
+        xSemaphoreGive((SemaphoreHandle_t)fs->aio_ctl);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Submissions are accepted from here on
+    fs->aio_task = task;
+    xSemaphoreTake((SemaphoreHandle_t)fs->aio_lock, portMAX_DELAY);
+    fs->aio_queue = queue;
+    xSemaphoreGive((SemaphoreHandle_t)fs->aio_lock);
+
+    xSemaphoreGive((SemaphoreHandle_t)fs->aio_ctl);
+    ESP_LOGI(TAG, "I/O task started (queue %lu, priority %lu)", queue_depth, priority);
+    return ESP_OK;
+}
+
+esp_err_t corefs_aio_start(uint32_t queue_depth, uint32_t priority) {
+    return corefs_fs_aio_start(corefs_get_context(), queue_depth, priority);
+}
+
+esp_err_t corefs_fs_aio_stop(corefs_ctx_t* fs) {
+    if (!fs) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // The task would wait for itself
+    if (aio_on_task(fs)) {
+        ESP_LOGE(TAG, "I/O task cannot stop itself");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    xSemaphoreTake((SemaphoreHandle_t)fs->aio_ctl, portMAX_DELAY);
+
+    if (!fs->aio_task) {
+        xSemaphoreGive((SemaphoreHandle_t)fs->aio_ctl);
+        return ESP_OK;
+    }
+
+    // New submissions fail from here on
+    xSemaphoreTake((SemaphoreHandle_t)fs->aio_lock, portMAX_DELAY);
+    QueueHandle_t queue = (QueueHandle_t)fs->aio_queue;
+    fs->aio_queue = NULL;
+    xSemaphoreGive((SemaphoreHandle_t)fs->aio_lock);
+
+    // Queued behind all pending requests, so they complete first
+    aio_req_t req = { .op = AIO_OP_STOP, .ctx = fs };
+    xQueueSend(queue, &req, portMAX_DELAY);
+    xSemaphoreTake((SemaphoreHandle_t)fs->aio_exit, portMAX_DELAY);
+
+    vQueueDelete(queue);
+    fs->aio_task = NULL;
+
+    xSemaphoreGive((SemaphoreHandle_t)fs->aio_ctl);
+    ESP_LOGI(TAG, "I/O task stopped");
+    return ESP_OK;
+}
+
+esp_err_t corefs_aio_stop(void) {
+    return corefs_fs_aio_stop(corefs_get_context());
+}
+
+// ============================================
+// SUBMISSION
+// ============================================
+
+static esp_err_t aio_submit(corefs_ctx_t* ctx, aio_req_t* req) {
+    if (!ctx || !ctx->mounted) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    req->ctx = ctx;
+
+    esp_err_t ret = ESP_OK;
+    xSemaphoreTake((SemaphoreHandle_t)ctx->aio_lock, portMAX_DELAY);
+    if (!ctx->aio_queue) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (xQueueSend((QueueHandle_t)ctx->aio_queue, req, 0) != pdTRUE) {
+        // Never blocks the submitter; a full queue is reported instead
+        ret = ESP_ERR_TIMEOUT;
+    }
+    xSemaphoreGive((SemaphoreHandle_t)ctx->aio_lock);
+    return ret;
+}
+
+static void aio_fill(aio_req_t* req, aio_op_t op, corefs_file_t* file, void* buf,
+                     size_t size, const corefs_aio_done_t* done) {
+    memset(req, 0, sizeof(*req));
+    req->op = op;
+    req->file = file;
+    req->buf = buf;
+    req->size = size;
+    if (done) {
+        req->done = *done;
+    }
+}
+
+esp_err_t corefs_read_async(corefs_file_t* file, void* buf, size_t size,
+                            const corefs_aio_done_t* done) {
+    if (!file || !buf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    aio_req_t req;
+    aio_fill(&req, AIO_OP_READ, file, buf, size, done);
+    return aio_submit(file->ctx, &req);
+}
+
+esp_err_t corefs_write_async(corefs_file_t* file, const void* buf, size_t size,
+                             const corefs_aio_done_t* done) {
+    if (!file || !buf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    aio_req_t req;
+    aio_fill(&req, AIO_OP_WRITE, file, (void*)buf, size, done);
+    return aio_submit(file->ctx, &req);
+}
+
+esp_err_t corefs_fs_sync_async(corefs_ctx_t* fs, const corefs_aio_done_t* done) {
+    aio_req_t req;
+    aio_fill(&req, AIO_OP_SYNC, NULL, NULL, 0, done);
+    return aio_submit(fs, &req);
+}
+
+esp_err_t corefs_sync_async(const corefs_aio_done_t* done) {
+    return corefs_fs_sync_async(corefs_get_context(), done);
+}
@@ -6,11 +6,17 @@
 
 #include "esp_log.h"
 #include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
 
 static const char* TAG = "corefs_blk";
 
+static esp_err_t cache_init(corefs_ctx_t* ctx);
+static void cache_cleanup(corefs_ctx_t* ctx);
+
 // ============================================
 // INITIALIZATION
 // ============================================
@@ -22,77 +28,176 @@ esp_err_t corefs_block_init(corefs_ctx_t* ctx) {
     
     // Allocate bitmap (1 bit per block)
     uint32_t bitmap_size = (ctx->sb->block_count + 7) / 8;
-    ctx->block_bitmap = calloc(1, bitmap_size);
+    ctx->block_bitmap = corefs_mem_carve(ctx, bitmap_size);
     if (!ctx->block_bitmap) {
         return ESP_ERR_NO_MEM;
     }
     
-    // Mark metadata blocks as used (blocks 0-3)
-    for (uint32_t i = 0; i < COREFS_METADATA_BLOCKS; i++) {
+    ctx->block_class = corefs_mem_carve(ctx, (ctx->sb->block_count + 3) / 4);
+    ctx->block_refs = corefs_mem_carve(ctx, ctx->sb->block_count);
+    if (!ctx->block_class || !ctx->block_refs) {
+        corefs_mem_free(ctx, ctx->block_bitmap);
+        corefs_mem_free(ctx, ctx->block_class);
+        corefs_mem_free(ctx, ctx->block_refs);
+        ctx->block_bitmap = NULL;
+        ctx->block_class = NULL;
+        ctx->block_refs = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // Mark metadata blocks as used (superblock, root, txn log, wear log)
+    for (uint32_t i = 0; i < ctx->sb->metadata_blocks; i++) {
         uint32_t byte_idx = i / 8;
         uint32_t bit_idx = i % 8;
         ctx->block_bitmap[byte_idx] |= (1 << bit_idx);
     }
     
-    // Allocate wear table
-    ctx->wear_table = calloc(ctx->sb->block_count, sizeof(uint16_t));
-    if (!ctx->wear_table) {
-        free(ctx->block_bitmap);
+    // Allocate wear table (loaded separately by corefs_wear_load)
+    esp_err_t ret = corefs_wear_init(ctx);
+    if (ret == ESP_OK) {
+        ret = cache_init(ctx);
+        if (ret != ESP_OK) {
+            corefs_wear_cleanup(ctx);
+        }
+    }
+    if (ret != ESP_OK) {
+        corefs_mem_free(ctx, ctx->block_bitmap);
+        corefs_mem_free(ctx, ctx->block_class);
+        corefs_mem_free(ctx, ctx->block_refs);
         ctx->block_bitmap = NULL;
+        ctx->block_class = NULL;
+        ctx->block_refs = NULL;
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "Block manager initialized: %u blocks", ctx->sb->block_count);
+    return ESP_OK;
+}
+
+// ============================================
+// BITMAP REBUILD
+// ============================================
+
+typedef struct {
+    corefs_ctx_t* ctx;
+    corefs_inode_t* inode;
+    uint32_t files;
+} block_scan_t;
+
+static void mark_used(corefs_ctx_t* ctx, uint32_t block, corefs_class_t cls) {
+    if (block < ctx->sb->metadata_blocks || block >= ctx->sb->block_count) {
+        return;
+    }
+    
+    if (!corefs_block_is_allocated(ctx, block)) {
+        ctx->block_bitmap[block / 8] |= (1 << (block % 8));
+        ctx->sb->blocks_used++;
+        corefs_block_set_class(ctx, block, cls);
+    } else if (ctx->block_refs[block] < UINT8_MAX) {
+        // Reached from another inode: shared by a clone or dedup
+        ctx->block_refs[block]++;
+    }
+}
+
+static bool scan_file(const char* name, uint32_t inode_block, void* arg) {
+    block_scan_t* scan = (block_scan_t*)arg;
+    corefs_ctx_t* ctx = scan->ctx;
+    
+    if (corefs_inode_read(ctx, inode_block, scan->inode) != ESP_OK) {
+        ESP_LOGW(TAG, "Skipping '%s': unreadable inode at block %u", name, inode_block);
+        return true;
+    }
+    
+    corefs_class_t cls = corefs_inode_class(scan->inode);
+    mark_used(ctx, inode_block, COREFS_CLASS_META);
+    for (uint32_t i = 0; i < scan->inode->blocks_used && i < COREFS_MAX_BLOCKS; i++) {
+        if (scan->inode->block_list[i] != 0) {
+            mark_used(ctx, scan->inode->block_list[i], cls);
+        }
+    }
+    
+    if (scan->inode->inode_num >= ctx->next_inode_num) {
+        ctx->next_inode_num = scan->inode->inode_num + 1;
+    }
+    
+    scan->files++;
+    return true;
+}
+
+/**
+ * Rebuild allocation bitmap and clone reference counts by walking all
+ * inodes reachable from the directory and from every snapshot. Called
+ * on mount since both only live in RAM.
+ */
+esp_err_t corefs_block_scan(corefs_ctx_t* ctx) {
+    if (!ctx || !ctx->block_bitmap) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    block_scan_t scan = { .ctx = ctx, .files = 0 };
+    scan.inode = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
+    if (!scan.inode) {
         return ESP_ERR_NO_MEM;
     }
     
-    // Load wear table from flash (if available)
-    uint32_t wear_offset = ctx->sb->wear_table_block * COREFS_BLOCK_SIZE;
-    size_t wear_size = ctx->sb->block_count * sizeof(uint16_t);
+    ctx->sb->blocks_used = ctx->sb->metadata_blocks;
+    esp_err_t ret = corefs_btree_iterate(ctx, scan_file, &scan);
     
-    esp_err_t ret = esp_partition_read(ctx->partition, wear_offset, 
-                                       ctx->wear_table, wear_size);
-    if (ret != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to load wear table, using zeros");
-        memset(ctx->wear_table, 0, wear_size);
+    // A snapshot mount already walked its own directory as the root
+    for (uint32_t i = 0; i < COREFS_MAX_SNAPSHOTS; i++) {
+        uint32_t root = ctx->sb->snapshots[i];
+        if (root == 0 || root == ctx->root_active) {
+            continue;
+        }
+        mark_used(ctx, root, COREFS_CLASS_META);
+        if (corefs_btree_iterate_at(ctx, root, scan_file, &scan) != ESP_OK) {
+            ESP_LOGW(TAG, "Snapshot %u unreadable at block %u", i + 1, root);
+        }
     }
+    corefs_mem_free(ctx, scan.inode);
+    corefs_wear_recount(ctx);
     
-    ESP_LOGI(TAG, "Block manager initialized: %u blocks", ctx->sb->block_count);
-    return ESP_OK;
+    ESP_LOGI(TAG, "Bitmap rebuilt: %u files, %u blocks used", 
+             scan.files, ctx->sb->blocks_used);
+    return ret;
 }
 
 void corefs_block_cleanup(corefs_ctx_t* ctx) {
     if (ctx->block_bitmap) {
-        free(ctx->block_bitmap);
+        corefs_mem_free(ctx, ctx->block_bitmap);
         ctx->block_bitmap = NULL;
     }
-    if (ctx->wear_table) {
-        free(ctx->wear_table);
-        ctx->wear_table = NULL;
+    if (ctx->block_class) {
+        corefs_mem_free(ctx, ctx->block_class);
+        ctx->block_class = NULL;
+    }
+    if (ctx->block_refs) {
+        corefs_mem_free(ctx, ctx->block_refs);
+        ctx->block_refs = NULL;
     }
+    corefs_elevator_cleanup(ctx);
+    corefs_dedup_cleanup(ctx);
+    cache_cleanup(ctx);
+    corefs_wear_cleanup(ctx);
 }
 
 // ============================================
 // ALLOCATION
 // ============================================
 
-uint32_t corefs_block_alloc(corefs_ctx_t* ctx) {
-    if (!ctx || !ctx->block_bitmap || !ctx->wear_table) {
-        return 0;
-    }
-    
-    // Find block with lowest wear count
+static uint32_t block_alloc_any(corefs_ctx_t* ctx) {
+    // Lowest-wear free block, narrowed down by region summary. The last
+    // free sectors are left for rescue copies while a half will do.
     uint32_t best_block = 0;
-    uint16_t min_wear = 0xFFFF;
-    
-    for (uint32_t i = COREFS_METADATA_BLOCKS; i < ctx->sb->block_count; i++) {
-        // Check if free
-        uint32_t byte_idx = i / 8;
-        uint32_t bit_idx = i % 8;
-        
-        if (!(ctx->block_bitmap[byte_idx] & (1 << bit_idx))) {
-            // Free block found - check wear
-            if (ctx->wear_table[i] < min_wear) {
-                min_wear = ctx->wear_table[i];
-                best_block = i;
-            }
-        }
+    if (ctx->wear_free_sectors <= COREFS_RESCUE_RESERVE) {
+        best_block = corefs_wear_get_best_half(ctx);
+    }
+    if (best_block == 0) {
+        best_block = corefs_wear_get_best_block(ctx);
+    }
+    if (best_block == 0) {
+        // Region counts were stale; retry once after recount
+        best_block = corefs_wear_get_best_block(ctx);
     }
     
     if (best_block == 0) {
@@ -105,33 +210,227 @@ uint32_t corefs_block_alloc(corefs_ctx_t* ctx) {
     uint32_t bit_idx = best_block % 8;
     ctx->block_bitmap[byte_idx] |= (1 << bit_idx);
     ctx->sb->blocks_used++;
+    corefs_wear_note_alloc(ctx, best_block, true);
     
-    ESP_LOGD(TAG, "Allocated block %u (wear: %u)", best_block, min_wear);
+    ESP_LOGD(TAG, "Allocated block %u (wear: %u)", best_block, 
+             (unsigned)corefs_wear_get(ctx, best_block));
     return best_block;
 }
 
+static bool block_reserve(corefs_ctx_t* ctx, uint32_t block) {
+    if (block < ctx->sb->metadata_blocks || block >= ctx->sb->block_count ||
+        corefs_block_is_allocated(ctx, block)) {
+        return false;
+    }
+    
+    ctx->block_bitmap[block / 8] |= (1 << (block % 8));
+    ctx->sb->blocks_used++;
+    corefs_wear_note_alloc(ctx, block, true);
+    
+    ESP_LOGD(TAG, "Reserved block %u", block);
+    return true;
+}
+
+uint32_t corefs_block_alloc(corefs_ctx_t* ctx) {
+    if (!ctx || !ctx->block_bitmap || !ctx->wear_regions) {
+        return 0;
+    }
+    
+    corefs_alloc_lock(ctx);
+    uint32_t block = block_alloc_any(ctx);
+    corefs_alloc_unlock(ctx);
+    return block;
+}
+
+/**
+ * Allocate a block for a placement class. A block alone in its sector
+ * is rewritten without copying a live sibling, so empty sectors are kept
+ * for hot data and inodes. Cold data is written once and packs two per
+ * sector next to other cold data. When no empty sector is left, blocks
+ * pair with a live block of the same class where possible. The last
+ * COREFS_RESCUE_RESERVE empty sectors are kept for rescue copies (see
+ * the rescue log) as long as another block is free.
+ */
+uint32_t corefs_block_alloc_class(corefs_ctx_t* ctx, corefs_class_t cls) {
+    if (!ctx || !ctx->block_bitmap || cls >= COREFS_CLASS_COUNT) {
+        return 0;
+    }
+    
+    uint32_t block = 0;
+    corefs_alloc_lock(ctx);
+    
+    if (cls == COREFS_CLASS_COLD) {
+        block = corefs_wear_get_best_pair(ctx, cls);
+    }
+    if (block == 0 && ctx->wear_free_sectors > COREFS_RESCUE_RESERVE) {
+        block = corefs_wear_get_best_sector(ctx);
+    }
+    if (block == 0 && cls != COREFS_CLASS_COLD) {
+        block = corefs_wear_get_best_pair(ctx, cls);
+    }
+    
+    if (block == 0 || !block_reserve(ctx, block)) {
+        // Only sectors shared with other classes left
+        block = block_alloc_any(ctx);
+    }
+    
+    if (block != 0) {
+        corefs_block_set_class(ctx, block, cls);
+        ctx->io_stats.class_allocs[cls]++;
+        ESP_LOGD(TAG, "Allocated block %u for class %d", block, cls);
+    }
+    
+    corefs_alloc_unlock(ctx);
+    return block;
+}
+
+/**
+ * Allocate count consecutive blocks for preallocation, starting on a
+ * sector boundary so the run fills whole sectors. Of the free runs
+ * that fit, the one starting in the least worn sector wins. Returns
+ * the first block, or 0 when no free run is long enough.
+ */
+uint32_t corefs_block_alloc_run(corefs_ctx_t* ctx, uint32_t count, corefs_class_t cls) {
+    if (!ctx || !ctx->block_bitmap || count == 0 || cls >= COREFS_CLASS_COUNT) {
+        return 0;
+    }
+    
+    corefs_alloc_lock(ctx);
+    
+    uint32_t best = 0;
+    uint32_t best_wear = UINT32_MAX;
+    uint32_t start = (ctx->sb->metadata_blocks + 1) & ~1u;
+    
+    while (start + count <= ctx->sb->block_count) {
+        uint32_t len = 0;
+        while (len < count && !corefs_block_is_allocated(ctx, start + len)) {
+            len++;
+        }
+        
+        if (len == count) {
+            uint32_t wear = corefs_wear_get(ctx, start);
+            if (wear < best_wear) {
+                best = start;
+                best_wear = wear;
+            }
+            start += (count + 1) & ~1u;
+        } else {
+            // Next sector after the allocated block
+            start = (start + len + 2) & ~1u;
+        }
+    }
+    
+    for (uint32_t i = 0; best != 0 && i < count; i++) {
+        block_reserve(ctx, best + i);
+        corefs_block_set_class(ctx, best + i, cls);
+    }
+    if (best != 0) {
+        ctx->io_stats.class_allocs[cls] += count;
+        ESP_LOGD(TAG, "Allocated run of %u blocks at %u for class %d", count, best, cls);
+    }
+    
+    corefs_alloc_unlock(ctx);
+    return best;
+}
+
+bool corefs_block_reserve(corefs_ctx_t* ctx, uint32_t block) {
+    if (!ctx || !ctx->block_bitmap) {
+        return false;
+    }
+    
+    corefs_alloc_lock(ctx);
+    bool ok = block_reserve(ctx, block);
+    corefs_alloc_unlock(ctx);
+    return ok;
+}
+
 void corefs_block_free(corefs_ctx_t* ctx, uint32_t block) {
     if (!ctx || !ctx->block_bitmap) {
         return;
     }
     
-    if (block < COREFS_METADATA_BLOCKS || block >= ctx->sb->block_count) {
+    if (block < ctx->sb->metadata_blocks || block >= ctx->sb->block_count) {
         ESP_LOGE(TAG, "Invalid block %u", block);
         return;
     }
     
-    // Mark as free
-    uint32_t byte_idx = block / 8;
-    uint32_t bit_idx = block % 8;
-    ctx->block_bitmap[byte_idx] &= ~(1 << bit_idx);
+    // One alloc_lock section: corefs_dedup_share() takes its reference
+    // under the same lock, so it sees the index entry and a used block
+    // or neither. The queue is held around it (lock order).
+    corefs_elevator_lock(ctx);
+    corefs_alloc_lock(ctx);
+    bool shared = (ctx->block_refs && ctx->block_refs[block] > 0);
+    if (shared) {
+        // A shared block only loses one reference
+        ctx->block_refs[block]--;
+    } else {
+        // Its index entry is obsolete once the block is reused
+        corefs_dedup_forget(ctx, block);
+        
+        // Mark as free
+        uint32_t byte_idx = block / 8;
+        uint32_t bit_idx = block % 8;
+        if (ctx->block_bitmap[byte_idx] & (1 << bit_idx)) {
+            corefs_wear_note_alloc(ctx, block, false);
+        }
+        ctx->block_bitmap[byte_idx] &= ~(1 << bit_idx);
+        
+        if (ctx->sb->blocks_used > 0) {
+            ctx->sb->blocks_used--;
+        }
+    }
+    corefs_alloc_unlock(ctx);
     
-    if (ctx->sb->blocks_used > 0) {
-        ctx->sb->blocks_used--;
+    // A queued write to a freed block is obsolete as well
+    if (!shared) {
+        corefs_elevator_drop(ctx, block);
+    }
+    corefs_elevator_unlock(ctx);
+    
+    if (shared) {
+        ESP_LOGD(TAG, "Unshared block %u", block);
+    } else {
+        ESP_LOGD(TAG, "Freed block %u", block);
+    }
+}
+
+/**
+ * Add a reference to an allocated data block (clone). Fails when the
+ * block is free or the count would overflow.
+ */
+bool corefs_block_share(corefs_ctx_t* ctx, uint32_t block) {
+    if (!ctx || !ctx->block_refs || block < ctx->sb->metadata_blocks ||
+        block >= ctx->sb->block_count) {
+        return false;
     }
     
-    ESP_LOGD(TAG, "Freed block %u", block);
+    corefs_alloc_lock(ctx);
+    bool ok = corefs_block_is_allocated(ctx, block) && ctx->block_refs[block] < UINT8_MAX;
+    if (ok) {
+        ctx->block_refs[block]++;
+        ctx->io_stats.shared_blocks++;
+    }
+    corefs_alloc_unlock(ctx);
+    return ok;
 }
 
+// More than one inode references the block: copy before writing
+bool corefs_block_is_shared(corefs_ctx_t* ctx, uint32_t block) {
+    if (!ctx || !ctx->block_refs || block >= ctx->sb->block_count) {
+        return false;
+    }
+    
+    corefs_alloc_lock(ctx);
+    bool shared = ctx->block_refs[block] > 0;
+    corefs_alloc_unlock(ctx);
+    return shared;
+}
+
+/**
+ * Lock-free bitmap test. Callers that act on the answer (allocator,
+ * wear selection, sibling copy) hold the alloc lock; others tolerate a
+ * stale result.
+ */
 bool corefs_block_is_allocated(corefs_ctx_t* ctx, uint32_t block) {
     if (!ctx || !ctx->block_bitmap) {
         return false;
@@ -147,10 +446,111 @@ bool corefs_block_is_allocated(corefs_ctx_t* ctx, uint32_t block) {
     return (ctx->block_bitmap[byte_idx] & (1 << bit_idx)) != 0;
 }
 
+// ============================================
+// BLOCK CACHE
+// ============================================
+// Small per-instance LRU of recently read blocks (config.cache_blocks).
+// Entries are filled and updated under the block's sector lock, so a
+// cached copy always matches flash; the table itself is guarded by
+// the alloc lock.
+
+static esp_err_t cache_init(corefs_ctx_t* ctx) {
+    uint32_t n = ctx->config.cache_blocks;
+    if (n == 0) {
+        return ESP_OK;
+    }
+    
+    ctx->cache = corefs_mem_carve(ctx, n * sizeof(corefs_cache_entry_t));
+    ctx->cache_data = corefs_mem_carve(ctx, n * COREFS_BLOCK_SIZE);
+    if (!ctx->cache || !ctx->cache_data) {
+        cache_cleanup(ctx);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    for (uint32_t i = 0; i < n; i++) {
+        ctx->cache[i].block = UINT32_MAX;
+    }
+    ctx->cache_tick = 0;
+    return ESP_OK;
+}
+
+static void cache_cleanup(corefs_ctx_t* ctx) {
+    corefs_mem_free(ctx, ctx->cache);
+    corefs_mem_free(ctx, ctx->cache_data);
+    ctx->cache = NULL;
+    ctx->cache_data = NULL;
+}
+
+static int cache_find(corefs_ctx_t* ctx, uint32_t block) {
+    for (uint32_t i = 0; i < ctx->config.cache_blocks; i++) {
+        if (ctx->cache[i].block == block) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static bool cache_get(corefs_ctx_t* ctx, uint32_t block, void* buf) {
+    if (!ctx->cache) {
+        return false;
+    }
+    
+    corefs_alloc_lock(ctx);
+    int i = cache_find(ctx, block);
+    if (i >= 0) {
+        memcpy(buf, ctx->cache_data + i * COREFS_BLOCK_SIZE, COREFS_BLOCK_SIZE);
+        ctx->cache[i].used = ++ctx->cache_tick;
+    }
+    corefs_alloc_unlock(ctx);
+    return i >= 0;
+}
+
+// Caller holds the sector lock of block
+static void cache_put(corefs_ctx_t* ctx, uint32_t block, const void* buf) {
+    if (!ctx->cache) {
+        return;
+    }
+    
+    corefs_alloc_lock(ctx);
+    int i = cache_find(ctx, block);
+    if (i < 0) {
+        // Evict least recently used
+        i = 0;
+        for (uint32_t j = 1; j < ctx->config.cache_blocks; j++) {
+            if (ctx->cache[j].used < ctx->cache[i].used) {
+                i = (int)j;
+            }
+        }
+        ctx->cache[i].block = block;
+    }
+    memcpy(ctx->cache_data + i * COREFS_BLOCK_SIZE, buf, COREFS_BLOCK_SIZE);
+    ctx->cache[i].used = ++ctx->cache_tick;
+    corefs_alloc_unlock(ctx);
+}
+
+static void cache_drop(corefs_ctx_t* ctx, uint32_t block) {
+    if (!ctx->cache) {
+        return;
+    }
+    
+    corefs_alloc_lock(ctx);
+    int i = cache_find(ctx, block);
+    if (i >= 0) {
+        ctx->cache[i].block = UINT32_MAX;
+        ctx->cache[i].used = 0;
+    }
+    corefs_alloc_unlock(ctx);
+}
+
 // ============================================
 // I/O OPERATIONS
 // ============================================
 
+// Both blocks of a sector map to the same stripe
+static corefs_rwlock_t* sector_lock(corefs_ctx_t* ctx, uint32_t block) {
+    return &ctx->sector_locks[(block / 2) % COREFS_SECTOR_LOCKS];
+}
+
 esp_err_t corefs_block_read(corefs_ctx_t* ctx, uint32_t block, void* buf) {
     if (!ctx || !buf) {
         return ESP_ERR_INVALID_ARG;
@@ -160,10 +560,510 @@ esp_err_t corefs_block_read(corefs_ctx_t* ctx, uint32_t block, void* buf) {
         return ESP_ERR_INVALID_ARG;
     }
     
+    // Queued writes are newer than flash and the cache
+    if (corefs_elevator_read(ctx, block, buf) || cache_get(ctx, block, buf)) {
+        return ESP_OK;
+    }
+    
     uint32_t offset = block * COREFS_BLOCK_SIZE;
-    return esp_partition_read(ctx->partition, offset, buf, COREFS_BLOCK_SIZE);
+    corefs_rwlock_t* lock = sector_lock(ctx, block);
+    
+    corefs_rwlock_rdlock(lock);
+    esp_err_t ret = esp_partition_read(ctx->partition, offset, buf, COREFS_BLOCK_SIZE);
+    if (ret == ESP_OK) {
+        cache_put(ctx, block, buf);
+    }
+    corefs_rwlock_rdunlock(lock);
+    
+    return ret;
+}
+
+// Bytes of a block image that need programming: the erased sector already
+// reads 0xFF, so a trailing run of it (short blocks, compressed chunks)
+// is left out. Rounded up to whole flash words.
+static uint32_t program_length(const uint8_t* buf) {
+    uint32_t len = COREFS_BLOCK_SIZE;
+    while (len > 0 && buf[len - 1] == 0xFF) {
+        len--;
+    }
+    return (len + 3) & ~3u;
+}
+
+// Caller holds alloc_lock
+static void count_erase(corefs_ctx_t* ctx, uint32_t block) {
+    corefs_wear_increment(ctx, block & ~1u);
+    ctx->io_stats.erased_bytes += COREFS_SECTOR_SIZE;
 }
 
+// ============================================
+// RESCUE LOG
+// ============================================
+// Rewriting one half of a sector erases the other half too. A live
+// other half is first saved to a sector of its own and the save is
+// recorded in the rescue log; the entry is retired once the sector is
+// programmed again, so a power cut in between loses nothing: mount
+// puts the image back (corefs_block_rescue_recover()).
+//
+// The image goes to the least worn free sector, which is reserved for
+// as long as the entry is open, so sibling saves wear the data area
+// like any other write instead of one fixed sector. Only when no
+// sector is free as a whole does the spare sector after the log take
+// it. Log entries are 32 bytes and the log sector is erased only when
+// it is full, once per COREFS_RESCUE_ENTRIES saves.
+
+static void rescue_take(corefs_ctx_t* ctx) {
+    if (ctx->rescue_lock) {
+        xSemaphoreTake((SemaphoreHandle_t)ctx->rescue_lock, portMAX_DELAY);
+    }
+}
+
+static void rescue_give(corefs_ctx_t* ctx) {
+    if (ctx->rescue_lock) {
+        xSemaphoreGive((SemaphoreHandle_t)ctx->rescue_lock);
+    }
+}
+
+static uint32_t rescue_spare(corefs_ctx_t* ctx) {
+    return ctx->sb->rescue_block + 2;
+}
+
+static uint32_t rescue_entry_offset(corefs_ctx_t* ctx, uint32_t pos) {
+    return ctx->sb->rescue_block * COREFS_BLOCK_SIZE + pos * sizeof(corefs_rescue_entry_t);
+}
+
+static uint32_t rescue_checksum(const corefs_rescue_hdr_t* hdr, const void* image) {
+    uint32_t crc = crc32_update(0xFFFFFFFF, &hdr->block, sizeof(hdr->block) + sizeof(hdr->seq));
+    return crc32_finalize(crc32_update(crc, image, COREFS_BLOCK_SIZE));
+}
+
+static uint32_t rescue_entry_check(const corefs_rescue_entry_t* entry) {
+    return crc32(&entry->seq, sizeof(entry->seq) + sizeof(entry->sector));
+}
+
+// Reserve the least worn free sector for an image, the spare one if
+// every free block shares its sector with live data
+static uint32_t rescue_target(corefs_ctx_t* ctx) {
+    corefs_alloc_lock(ctx);
+    uint32_t first = corefs_wear_get_best_sector(ctx);
+    if (first != 0 && !(block_reserve(ctx, first) && block_reserve(ctx, first + 1))) {
+        first = 0;  // Not reached: both halves were free under the lock
+    }
+    corefs_alloc_unlock(ctx);
+    return first != 0 ? first : rescue_spare(ctx);
+}
+
+// Hand a data sector back to the allocator once its entry is retired
+static void rescue_release(corefs_ctx_t* ctx, uint32_t first) {
+    if (first == rescue_spare(ctx)) {
+        return;
+    }
+
+    cache_drop(ctx, first);
+    cache_drop(ctx, first + 1);
+    corefs_alloc_lock(ctx);
+    for (uint32_t block = first; block <= first + 1; block++) {
+        if (corefs_block_is_allocated(ctx, block)) {
+            corefs_wear_note_alloc(ctx, block, false);
+            ctx->block_bitmap[block / 8] &= ~(1 << (block % 8));
+            ctx->sb->blocks_used--;
+        }
+    }
+    corefs_alloc_unlock(ctx);
+}
+
+// Caller holds rescue_lock until the entry is retired. The sector
+// holding the image is returned in out_first, the log entry in out_pos.
+static esp_err_t rescue_save(corefs_ctx_t* ctx, uint32_t block, const uint8_t* image,
+                             uint32_t* out_first, uint32_t* out_pos) {
+    // Every entry of a full log is retired, erasing it drops nothing
+    if (ctx->rescue_pos >= COREFS_RESCUE_ENTRIES) {
+        esp_err_t ret = esp_partition_erase_range(ctx->partition, rescue_entry_offset(ctx, 0),
+                                                  COREFS_SECTOR_SIZE);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        ctx->rescue_pos = 0;
+        corefs_alloc_lock(ctx);
+        count_erase(ctx, ctx->sb->rescue_block);
+        corefs_alloc_unlock(ctx);
+    }
+
+    uint32_t first = rescue_target(ctx);
+    uint32_t offset = first * COREFS_BLOCK_SIZE;
+    *out_first = first;
+    *out_pos = ctx->rescue_pos;
+
+    corefs_rescue_hdr_t hdr = {
+        .magic = COREFS_RESCUE_MAGIC,
+        .block = block,
+        .seq = ++ctx->rescue_seq,
+    };
+    hdr.checksum = rescue_checksum(&hdr, image);
+
+    corefs_rescue_entry_t entry;
+    memset(&entry, 0xFF, sizeof(entry));
+    entry.magic = COREFS_RESCUE_LOG_MAGIC;
+    entry.seq = hdr.seq;
+    entry.sector = first;
+    entry.check = rescue_entry_check(&entry);
+
+    esp_err_t ret = esp_partition_erase_range(ctx->partition, offset, COREFS_SECTOR_SIZE);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    uint32_t len = program_length(image);
+    if (len) {
+        ret = esp_partition_write(ctx->partition, offset + COREFS_BLOCK_SIZE, image, len);
+    }
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(ctx->partition, offset, &hdr, sizeof(hdr));
+    }
+    // The entry makes the save count; a cut before it leaves the
+    // sibling untouched on flash
+    if (ret == ESP_OK) {
+        ret = esp_partition_write(ctx->partition, rescue_entry_offset(ctx, ctx->rescue_pos),
+                                  &entry, offsetof(corefs_rescue_entry_t, done));
+        ctx->rescue_pos++;
+    }
+
+    corefs_alloc_lock(ctx);
+    count_erase(ctx, first);
+    ctx->io_stats.programmed_bytes += len + sizeof(hdr) + offsetof(corefs_rescue_entry_t, done);
+    corefs_alloc_unlock(ctx);
+
+    return ret;
+}
+
+static esp_err_t rescue_retire(corefs_ctx_t* ctx, uint32_t pos) {
+    uint32_t done = 0;
+    return esp_partition_write(ctx->partition,
+                               rescue_entry_offset(ctx, pos) +
+                               offsetof(corefs_rescue_entry_t, done),
+                               &done, sizeof(done));
+}
+
+/**
+ * Erase the rescue log and spare sector (format). Leftovers of an
+ * earlier filesystem must not be replayed.
+ */
+esp_err_t corefs_block_rescue_format(corefs_ctx_t* ctx) {
+    for (uint32_t sector = 0; sector < COREFS_RESCUE_SECTORS; sector++) {
+        uint32_t first = ctx->sb->rescue_block + sector * 2;
+        esp_err_t ret = esp_partition_erase_range(ctx->partition, first * COREFS_BLOCK_SIZE,
+                                                  COREFS_SECTOR_SIZE);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        count_erase(ctx, first);
+    }
+    ctx->rescue_pos = 0;
+    return ESP_OK;
+}
+
+// Rewrite the sector of hdr->block with the saved image and the other
+// half as found on flash
+static esp_err_t rescue_restore(corefs_ctx_t* ctx, const corefs_rescue_hdr_t* hdr,
+                                const uint8_t* image, uint8_t* other) {
+    uint32_t block = hdr->block;
+    uint32_t partner = block ^ 1u;
+
+    esp_err_t ret = esp_partition_read(ctx->partition, partner * COREFS_BLOCK_SIZE,
+                                       other, COREFS_BLOCK_SIZE);
+    if (ret == ESP_OK) {
+        ret = esp_partition_erase_range(ctx->partition, (block & ~1u) * COREFS_BLOCK_SIZE,
+                                        COREFS_SECTOR_SIZE);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    count_erase(ctx, block);
+
+    uint32_t len = program_length(image);
+    if (len) {
+        ret = esp_partition_write(ctx->partition, block * COREFS_BLOCK_SIZE, image, len);
+    }
+    len = program_length(other);
+    if (ret == ESP_OK && len) {
+        ret = esp_partition_write(ctx->partition, partner * COREFS_BLOCK_SIZE, other, len);
+    }
+    return ret;
+}
+
+// Replay one open log entry: the image must be intact and belong to it
+static esp_err_t rescue_replay(corefs_ctx_t* ctx, const corefs_rescue_entry_t* entry,
+                               uint8_t* image, uint8_t* other) {
+    corefs_rescue_hdr_t hdr;
+    uint32_t offset = entry->sector * COREFS_BLOCK_SIZE;
+    esp_err_t ret = esp_partition_read(ctx->partition, offset, &hdr, sizeof(hdr));
+    if (ret == ESP_OK) {
+        ret = esp_partition_read(ctx->partition, offset + COREFS_BLOCK_SIZE, image,
+                                 COREFS_BLOCK_SIZE);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (hdr.magic != COREFS_RESCUE_MAGIC || hdr.seq != entry->seq ||
+        hdr.block < ctx->sb->metadata_blocks || hdr.block >= ctx->sb->block_count ||
+        rescue_checksum(&hdr, image) != hdr.checksum) {
+        ESP_LOGW(TAG, "Rescue entry %u has no valid image", entry->seq);
+        return ESP_OK;
+    }
+
+    ret = esp_partition_read(ctx->partition, hdr.block * COREFS_BLOCK_SIZE, other,
+                             COREFS_BLOCK_SIZE);
+    if (ret != ESP_OK || memcmp(image, other, COREFS_BLOCK_SIZE) == 0) {
+        return ret;
+    }
+    if (ctx->read_only) {
+        ESP_LOGW(TAG, "Block %u awaits restore from the rescue log", hdr.block);
+        return ESP_OK;
+    }
+    ret = rescue_restore(ctx, &hdr, image, other);
+    if (ret == ESP_OK) {
+        ESP_LOGW(TAG, "Restored block %u from the rescue log", hdr.block);
+    }
+    return ret;
+}
+
+// An entry still open, naming a sector that can hold an image
+static bool rescue_entry_open(corefs_ctx_t* ctx, const corefs_rescue_entry_t* entry) {
+    return entry->magic == COREFS_RESCUE_LOG_MAGIC && entry->done == 0xFFFFFFFF &&
+           entry->check == rescue_entry_check(entry) && !(entry->sector & 1) &&
+           (entry->sector == rescue_spare(ctx) || entry->sector >= ctx->sb->metadata_blocks) &&
+           entry->sector + 1 < ctx->sb->block_count;
+}
+
+/**
+ * Put back sector halves whose rewrite was cut short (mount, before the
+ * directory is read). The log is appended in sequence order, so open
+ * entries are replayed oldest first. The sector an image sits in is
+ * not reserved on flash; it is free again once the directory has been
+ * scanned.
+ */
+esp_err_t corefs_block_rescue_recover(corefs_ctx_t* ctx) {
+    corefs_rescue_entry_t* log = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    uint8_t* image = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    uint8_t* other = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!log || !image || !other) {
+        corefs_mem_free(ctx, log);
+        corefs_mem_free(ctx, image);
+        corefs_mem_free(ctx, other);
+        return ESP_ERR_NO_MEM;
+    }
+
+    const uint32_t per_block = COREFS_BLOCK_SIZE / sizeof(corefs_rescue_entry_t);
+    esp_err_t ret = ESP_OK;
+
+    ctx->rescue_seq = 0;
+    ctx->rescue_pos = 0;
+    for (uint32_t pos = 0; ret == ESP_OK && pos < COREFS_RESCUE_ENTRIES; pos++) {
+        const corefs_rescue_entry_t* entry = &log[pos % per_block];
+        if (pos % per_block == 0) {
+            ret = esp_partition_read(ctx->partition, rescue_entry_offset(ctx, pos), log,
+                                     COREFS_BLOCK_SIZE);
+            if (ret != ESP_OK) {
+                break;
+            }
+        }
+
+        // Appending resumes behind the last entry that is not erased,
+        // torn ones included
+        const uint8_t* raw = (const uint8_t*)entry;
+        for (uint32_t i = 0; i < sizeof(*entry); i++) {
+            if (raw[i] != 0xFF) {
+                ctx->rescue_pos = pos + 1;
+                break;
+            }
+        }
+        if (entry->magic == COREFS_RESCUE_LOG_MAGIC && entry->check == rescue_entry_check(entry) &&
+            entry->seq > ctx->rescue_seq) {
+            ctx->rescue_seq = entry->seq;
+        }
+
+        if (rescue_entry_open(ctx, entry)) {
+            ret = rescue_replay(ctx, entry, image, other);
+            if (ret == ESP_OK && !ctx->read_only) {
+                ret = rescue_retire(ctx, pos);
+            }
+        }
+    }
+
+    corefs_mem_free(ctx, log);
+    corefs_mem_free(ctx, image);
+    corefs_mem_free(ctx, other);
+    return ret;
+}
+
+// ============================================
+// PROGRAM / ERASE
+// ============================================
+
+/**
+ * Erase the sector of block and program it. With sibling_buf the other
+ * half is programmed from it in the same erase (merged write); without,
+ * a live other half is saved to the rescue log and programmed back
+ * from there. Metadata blocks have their sector to themselves.
+ */
+esp_err_t corefs_block_program(corefs_ctx_t* ctx, uint32_t block, const void* buf,
+                               const void* sibling_buf) {
+    if (!ctx || !buf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (block >= ctx->sb->block_count || (sibling_buf && (block ^ 1u) >= ctx->sb->block_count)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    // A snapshot mount never touches flash
+    if (ctx->read_only) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    // Two blocks share one erase sector: preserve the other half if live
+    uint32_t first = block & ~1u;
+    uint32_t sibling = block ^ 1u;
+    uint32_t sector_offset = first * COREFS_BLOCK_SIZE;
+    uint8_t* keep = NULL;
+    uint32_t rescue = 0;
+    uint32_t rescue_pos = 0;
+    bool flush = false;
+    
+    // Readers of either half must not see the sector mid-rewrite. The
+    // sibling check sits under the lock so a concurrent first write of
+    // the other half cannot slip in between the check and the erase.
+    corefs_rwlock_t* lock = sector_lock(ctx, block);
+    corefs_rwlock_wrlock(lock);
+    
+    corefs_alloc_lock(ctx);
+    bool copy = (!sibling_buf && sibling >= ctx->sb->metadata_blocks &&
+                 sibling < ctx->sb->block_count && corefs_block_is_allocated(ctx, sibling));
+    corefs_alloc_unlock(ctx);
+    
+    esp_err_t ret = ESP_OK;
+    
+    if (copy) {
+        keep = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+        if (!keep) {
+            ret = ESP_ERR_NO_MEM;
+        } else {
+            ret = esp_partition_read(ctx->partition, sibling * COREFS_BLOCK_SIZE, 
+                                     keep, COREFS_BLOCK_SIZE);
+        }
+        rescue_take(ctx);
+        if (ret == ESP_OK) {
+            ret = rescue_save(ctx, sibling, keep, &rescue, &rescue_pos);
+        }
+    }
+    
+    if (ret == ESP_OK) {
+        ret = esp_partition_erase_range(ctx->partition, sector_offset, COREFS_SECTOR_SIZE);
+    }
+    
+    uint32_t len = 0;
+    uint32_t other_len = 0;
+    if (ret == ESP_OK) {
+        const void* other = sibling_buf ? sibling_buf : keep;
+        len = program_length(buf);
+        other_len = other ? program_length(other) : 0;
+        // The rescued half goes back first, its entry is retired as
+        // soon as it is on flash again
+        if (other_len) {
+            ret = esp_partition_write(ctx->partition, sibling * COREFS_BLOCK_SIZE, 
+                                      other, other_len);
+        }
+        if (ret == ESP_OK && rescue) {
+            ret = rescue_retire(ctx, rescue_pos);
+        }
+        if (ret == ESP_OK && len) {
+            ret = esp_partition_write(ctx->partition, block * COREFS_BLOCK_SIZE, buf, len);
+        }
+        
+        if (ret == ESP_OK) {
+            cache_put(ctx, block, buf);
+        } else {
+            cache_drop(ctx, block);
+        }
+        if (ret == ESP_OK && sibling_buf) {
+            cache_put(ctx, sibling, sibling_buf);
+        } else if (ret != ESP_OK || !copy) {
+            cache_drop(ctx, sibling);  // Erased with the sector
+        }
+        
+        // Count the erase for both blocks in this sector
+        corefs_alloc_lock(ctx);
+        count_erase(ctx, first);
+        ctx->io_stats.programmed_bytes += len + other_len;
+        if (copy) {
+            ctx->io_stats.sibling_copies++;
+        }
+        flush = corefs_wear_flush_due(ctx);
+        corefs_alloc_unlock(ctx);
+    }
+    
+    if (copy) {
+        // A failed rewrite keeps the image until mount replays it
+        if (ret == ESP_OK) {
+            rescue_release(ctx, rescue);
+        }
+        rescue_give(ctx);
+    }
+    corefs_rwlock_wrunlock(lock);
+    corefs_mem_free(ctx, keep);
+    
+    // Append wear deltas once enough erases have accumulated
+    if (ret == ESP_OK && flush) {
+        corefs_wear_save(ctx);
+    }
+    
+    return ret;
+}
+
+/**
+ * Erase the sector of block without programming it, leaving both halves
+ * for corefs_block_append(). Both blocks must belong to the caller and
+ * have nothing queued in the elevator.
+ */
+esp_err_t corefs_block_erase(corefs_ctx_t* ctx, uint32_t block) {
+    if (!ctx || (block | 1u) >= ctx->sb->block_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (ctx->read_only) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t first = block & ~1u;
+    corefs_rwlock_t* lock = sector_lock(ctx, block);
+    corefs_rwlock_wrlock(lock);
+
+    esp_err_t ret = esp_partition_erase_range(ctx->partition, first * COREFS_BLOCK_SIZE,
+                                              COREFS_SECTOR_SIZE);
+    cache_drop(ctx, first);
+    cache_drop(ctx, first + 1);
+
+    bool flush = false;
+    if (ret == ESP_OK) {
+        corefs_alloc_lock(ctx);
+        count_erase(ctx, first);
+        flush = corefs_wear_flush_due(ctx);
+        corefs_alloc_unlock(ctx);
+    }
+
+    corefs_rwlock_wrunlock(lock);
+
+    if (ret == ESP_OK && flush) {
+        corefs_wear_save(ctx);
+    }
+
+    return ret;
+}
+
+/**
+ * Data blocks go through the elevator when it is enabled. Metadata
+ * (superblock area, root, txn log, inodes) is a barrier: queued data is
+ * flushed first so nothing on flash points at unwritten blocks.
+ */
 esp_err_t corefs_block_write(corefs_ctx_t* ctx, uint32_t block, const void* buf) {
     if (!ctx || !buf) {
         return ESP_ERR_INVALID_ARG;
@@ -173,26 +1073,87 @@ esp_err_t corefs_block_write(corefs_ctx_t* ctx, uint32_t block, const void* buf)
         return ESP_ERR_INVALID_ARG;
     }
     
-    uint32_t offset = block * COREFS_BLOCK_SIZE;
-    
-    // Erase sector if this is first block in sector
-    if (offset % COREFS_SECTOR_SIZE == 0) {
-        esp_err_t ret = esp_partition_erase_range(ctx->partition, offset, 
-                                                   COREFS_SECTOR_SIZE);
-        if (ret != ESP_OK) {
-            return ret;
+    if (ctx->wq_blocks) {
+        corefs_alloc_lock(ctx);
+        bool meta = (block < ctx->sb->metadata_blocks ||
+                     corefs_block_get_class(ctx, block) == COREFS_CLASS_META);
+        corefs_alloc_unlock(ctx);
+        if (!meta) {
+            return corefs_elevator_write(ctx, block, buf);
         }
         
-        // Increment wear count for both blocks in this sector
-        if (ctx->wear_table) {
-            ctx->wear_table[block]++;
-            if (block + 1 < ctx->sb->block_count) {
-                ctx->wear_table[block + 1]++;
-            }
+        esp_err_t ret = corefs_elevator_flush(ctx);
+        if (ret != ESP_OK) {
+            return ret;
         }
     }
     
-    return esp_partition_write(ctx->partition, offset, buf, COREFS_BLOCK_SIZE);
+    return corefs_block_program(ctx, block, buf, NULL);
+}
+
+/**
+ * Program len bytes at offset within block without an erase. The range
+ * must still be erased since the block was last written (NOR only
+ * clears bits); the caller guarantees that.
+ */
+esp_err_t corefs_block_append(corefs_ctx_t* ctx, uint32_t block, uint32_t offset,
+                              const void* data, uint32_t len) {
+    if (!ctx || !data || block >= ctx->sb->block_count ||
+        offset > COREFS_BLOCK_SIZE || len > COREFS_BLOCK_SIZE - offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (ctx->read_only) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    // Not on flash yet: the queued copy reaches it in one piece
+    if (corefs_elevator_patch(ctx, block, offset, data, len)) {
+        return ESP_OK;
+    }
+    
+    corefs_rwlock_t* lock = sector_lock(ctx, block);
+    corefs_rwlock_wrlock(lock);
+    
+    esp_err_t ret = esp_partition_write(ctx->partition, block * COREFS_BLOCK_SIZE + offset,
+                                        data, len);
+    
+    corefs_alloc_lock(ctx);
+    int i = ctx->cache ? cache_find(ctx, block) : -1;
+    if (i >= 0 && ret == ESP_OK) {
+        memcpy(ctx->cache_data + i * COREFS_BLOCK_SIZE + offset, data, len);
+    } else if (i >= 0) {
+        ctx->cache[i].block = UINT32_MAX;
+        ctx->cache[i].used = 0;
+    }
+    if (ret == ESP_OK) {
+        ctx->io_stats.programmed_bytes += len;
+    }
+    corefs_alloc_unlock(ctx);
+    
+    corefs_rwlock_wrunlock(lock);
+    return ret;
+}
+
+corefs_class_t corefs_block_get_class(corefs_ctx_t* ctx, uint32_t block) {
+    if (!ctx || !ctx->block_class || block >= ctx->sb->block_count) {
+        return COREFS_CLASS_META;
+    }
+    
+    return (corefs_class_t)((ctx->block_class[block / 4] >> ((block % 4) * 2)) & 0x03);
+}
+
+void corefs_block_set_class(corefs_ctx_t* ctx, uint32_t block, corefs_class_t cls) {
+    if (!ctx || !ctx->block_class || block >= ctx->sb->block_count) {
+        return;
+    }
+    
+    // Four blocks share a byte
+    uint32_t shift = (block % 4) * 2;
+    corefs_alloc_lock(ctx);
+    ctx->block_class[block / 4] &= ~(0x03 << shift);
+    ctx->block_class[block / 4] |= (cls & 0x03) << shift;
+    corefs_alloc_unlock(ctx);
 }
 
 uint32_t corefs_block_get_flash_addr(corefs_ctx_t* ctx, uint32_t block) {
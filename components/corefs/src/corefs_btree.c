@@ -1,6 +1,12 @@
 /**
  * CoreFS - B-Tree Directory Index
  * FIXED: Correct array bounds for entry names
+ *
+ * The root lives in two slots (superblock root_block / root_alt_block,
+ * a sector each). Every change is written to the slot not in use with
+ * the next sequence number; mount takes the valid slot with the higher
+ * one. A torn write fails the checksum and leaves the previous root
+ * live, so each root write is an atomic commit.
  */
 
 #include "corefs.h"
@@ -31,13 +37,48 @@ static uint32_t hash_name(const char* name) {
 // INITIALIZATION
 // ============================================
 
+static uint32_t node_checksum(corefs_btree_node_t* node) {
+    uint32_t stored = node->checksum;
+    node->checksum = 0;
+    uint32_t crc = crc32(node, sizeof(*node));
+    node->checksum = stored;
+    return crc;
+}
+
+static bool root_valid(corefs_btree_node_t* node) {
+    return node->magic == COREFS_BTREE_MAGIC && node->count <= COREFS_BTREE_ORDER - 1 &&
+           node->checksum == node_checksum(node);
+}
+
+/**
+ * Write node as the new root: it goes to the slot not in use with the
+ * next sequence number. The block write is the commit point. A failed
+ * write still uses up its number, so a later root never repeats it.
+ */
+esp_err_t corefs_btree_commit(corefs_ctx_t* ctx, corefs_btree_node_t* node) {
+    if (!ctx || !node) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    uint32_t target = (ctx->root_active == ctx->sb->root_block) ?
+                      ctx->sb->root_alt_block : ctx->sb->root_block;
+    node->seq = ++ctx->root_seq;
+    node->checksum = node_checksum(node);
+    
+    esp_err_t ret = corefs_block_write(ctx, target, node);
+    if (ret == ESP_OK) {
+        ctx->root_active = target;
+    }
+    return ret;
+}
+
 esp_err_t corefs_btree_init(corefs_ctx_t* ctx) {
     if (!ctx) {
         return ESP_ERR_INVALID_ARG;
     }
     
     // Create empty root node
-    corefs_btree_node_t* root = calloc(1, sizeof(corefs_btree_node_t));
+    corefs_btree_node_t* root = corefs_mem_calloc(ctx, sizeof(corefs_btree_node_t));
     if (!root) {
         return ESP_ERR_NO_MEM;
     }
@@ -47,9 +88,14 @@ esp_err_t corefs_btree_init(corefs_ctx_t* ctx) {
     root->count = 0;
     root->parent = 0;
     
-    // Write to block 1
-    esp_err_t ret = corefs_block_write(ctx, ctx->sb->root_block, root);
-    free(root);
+    // Both slots, so no root of an earlier format survives in either
+    ctx->root_active = ctx->sb->root_block;
+    ctx->root_seq = 0;
+    esp_err_t ret = corefs_btree_commit(ctx, root);
+    if (ret == ESP_OK) {
+        ret = corefs_btree_commit(ctx, root);
+    }
+    corefs_mem_free(ctx, root);
     
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "B-Tree initialized");
@@ -58,28 +104,43 @@ esp_err_t corefs_btree_init(corefs_ctx_t* ctx) {
     return ret;
 }
 
+/**
+ * Find the live root slot. Sets root_active and root_seq.
+ */
 esp_err_t corefs_btree_load(corefs_ctx_t* ctx) {
     if (!ctx) {
         return ESP_ERR_INVALID_ARG;
     }
     
-    // Read root node to verify it exists
-    corefs_btree_node_t* root = calloc(1, sizeof(corefs_btree_node_t));
+    corefs_btree_node_t* root = corefs_mem_calloc(ctx, sizeof(corefs_btree_node_t));
     if (!root) {
         return ESP_ERR_NO_MEM;
     }
     
-    esp_err_t ret = corefs_block_read(ctx, ctx->sb->root_block, root);
-    if (ret == ESP_OK) {
-        if (root->magic != COREFS_BTREE_MAGIC) {
-            ESP_LOGE(TAG, "Invalid B-Tree root magic");
-            ret = ESP_ERR_INVALID_STATE;
-        } else {
-            ESP_LOGI(TAG, "B-Tree loaded: %u entries", root->count);
+    const uint32_t slots[2] = { ctx->sb->root_block, ctx->sb->root_alt_block };
+    uint32_t count = 0;
+    bool found = false;
+    esp_err_t ret = ESP_OK;
+    
+    for (int i = 0; i < 2 && ret == ESP_OK; i++) {
+        ret = corefs_block_read(ctx, slots[i], root);
+        if (ret == ESP_OK && root_valid(root) && (!found || root->seq > ctx->root_seq)) {
+            ctx->root_active = slots[i];
+            ctx->root_seq = root->seq;
+            count = root->count;
+            found = true;
         }
     }
     
-    free(root);
+    if (ret == ESP_OK && !found) {
+        ESP_LOGE(TAG, "No valid B-Tree root");
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "B-Tree loaded: %u entries (root block %u, seq %u)",
+                 count, ctx->root_active, ctx->root_seq);
+    }
+    
+    corefs_mem_free(ctx, root);
     return ret;
 }
 
@@ -99,14 +160,14 @@ int32_t corefs_btree_find(corefs_ctx_t* ctx, const char* path) {
     }
     
     // Read root node
-    corefs_btree_node_t* node = calloc(1, sizeof(corefs_btree_node_t));
+    corefs_btree_node_t* node = corefs_mem_calloc(ctx, sizeof(corefs_btree_node_t));
     if (!node) {
         return -1;
     }
     
-    esp_err_t ret = corefs_block_read(ctx, ctx->sb->root_block, node);
+    esp_err_t ret = corefs_block_read(ctx, ctx->root_active, node);
     if (ret != ESP_OK) {
-        free(node);
+        corefs_mem_free(ctx, node);
         return -1;
     }
     
@@ -118,12 +179,12 @@ int32_t corefs_btree_find(corefs_ctx_t* ctx, const char* path) {
             strcmp(node->entries[i].name, filename) == 0) {
             
             uint32_t inode_block = node->entries[i].inode_block;
-            free(node);
+            corefs_mem_free(ctx, node);
             return inode_block;
         }
     }
     
-    free(node);
+    corefs_mem_free(ctx, node);
     return -1;  // Not found
 }
 
@@ -146,21 +207,21 @@ esp_err_t corefs_btree_insert(corefs_ctx_t* ctx, const char* path, uint32_t inod
     }
     
     // Read root node
-    corefs_btree_node_t* node = calloc(1, sizeof(corefs_btree_node_t));
+    corefs_btree_node_t* node = corefs_mem_calloc(ctx, sizeof(corefs_btree_node_t));
     if (!node) {
         return ESP_ERR_NO_MEM;
     }
     
-    esp_err_t ret = corefs_block_read(ctx, ctx->sb->root_block, node);
+    esp_err_t ret = corefs_block_read(ctx, ctx->root_active, node);
     if (ret != ESP_OK) {
-        free(node);
+        corefs_mem_free(ctx, node);
         return ret;
     }
     
     // Check if node is full
     if (node->count >= (COREFS_BTREE_ORDER - 1)) {
         ESP_LOGE(TAG, "B-Tree node full (split not implemented)");
-        free(node);
+        corefs_mem_free(ctx, node);
         return ESP_ERR_NO_MEM;
     }
     
@@ -169,7 +230,7 @@ esp_err_t corefs_btree_insert(corefs_ctx_t* ctx, const char* path, uint32_t inod
     for (int i = 0; i < node->count; i++) {
         if (node->entries[i].name_hash == hash &&
             strcmp(node->entries[i].name, filename) == 0) {
-            free(node);
+            corefs_mem_free(ctx, node);
             return ESP_ERR_INVALID_STATE;  // Already exists
         }
     }
@@ -186,8 +247,8 @@ esp_err_t corefs_btree_insert(corefs_ctx_t* ctx, const char* path, uint32_t inod
     node->count++;
     
     // Write back
-    ret = corefs_block_write(ctx, ctx->sb->root_block, node);
-    free(node);
+    ret = corefs_btree_commit(ctx, node);
+    corefs_mem_free(ctx, node);
     
     if (ret == ESP_OK) {
         ESP_LOGD(TAG, "Inserted '%s' -> inode block %u", filename, inode_block);
@@ -208,14 +269,14 @@ esp_err_t corefs_btree_delete(corefs_ctx_t* ctx, const char* path) {
     const char* filename = path + 1;
     
     // Read root node
-    corefs_btree_node_t* node = calloc(1, sizeof(corefs_btree_node_t));
+    corefs_btree_node_t* node = corefs_mem_calloc(ctx, sizeof(corefs_btree_node_t));
     if (!node) {
         return ESP_ERR_NO_MEM;
     }
     
-    esp_err_t ret = corefs_block_read(ctx, ctx->sb->root_block, node);
+    esp_err_t ret = corefs_block_read(ctx, ctx->root_active, node);
     if (ret != ESP_OK) {
-        free(node);
+        corefs_mem_free(ctx, node);
         return ret;
     }
     
@@ -232,7 +293,7 @@ esp_err_t corefs_btree_delete(corefs_ctx_t* ctx, const char* path) {
     }
     
     if (found_idx < 0) {
-        free(node);
+        corefs_mem_free(ctx, node);
         return ESP_ERR_NOT_FOUND;
     }
     
@@ -245,12 +306,208 @@ esp_err_t corefs_btree_delete(corefs_ctx_t* ctx, const char* path) {
     node->count--;
     
     // Write back
-    ret = corefs_block_write(ctx, ctx->sb->root_block, node);
-    free(node);
+    ret = corefs_btree_commit(ctx, node);
+    corefs_mem_free(ctx, node);
     
     if (ret == ESP_OK) {
         ESP_LOGD(TAG, "Deleted '%s'", filename);
     }
     
     return ret;
-}
\ No newline at end of file
+}
+
+// ============================================
+// UPDATE
+// ============================================
+
+esp_err_t corefs_btree_update(corefs_ctx_t* ctx, const char* path, uint32_t inode_block) {
+    if (!ctx || !path || path[0] != '/') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    const char* filename = path + 1;
+    
+    // Read root node
+    corefs_btree_node_t* node = corefs_mem_calloc(ctx, sizeof(corefs_btree_node_t));
+    if (!node) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    esp_err_t ret = corefs_block_read(ctx, ctx->root_active, node);
+    if (ret != ESP_OK) {
+        corefs_mem_free(ctx, node);
+        return ret;
+    }
+    
+    // Find entry and repoint it
+    uint32_t hash = hash_name(filename);
+    ret = ESP_ERR_NOT_FOUND;
+    
+    for (int i = 0; i < node->count; i++) {
+        if (node->entries[i].name_hash == hash &&
+            strcmp(node->entries[i].name, filename) == 0) {
+            node->entries[i].inode_block = inode_block;
+            ret = ESP_OK;
+            break;
+        }
+    }
+    
+    // Single block write keeps the update atomic
+    if (ret == ESP_OK) {
+        ret = corefs_btree_commit(ctx, node);
+    }
+    corefs_mem_free(ctx, node);
+    
+    if (ret == ESP_OK) {
+        ESP_LOGD(TAG, "Updated '%s' -> inode block %u", filename, inode_block);
+    }
+    
+    return ret;
+}
+
+// ============================================
+// RENAME
+// ============================================
+
+/**
+ * Move the entry at old_path to new_path in one root commit, so either
+ * name set is live and never neither. An entry already at new_path
+ * is replaced; its inode block is returned in *replaced (-1 if none)
+ * and left to the caller to free.
+ */
+esp_err_t corefs_btree_rename(corefs_ctx_t* ctx, const char* old_path, const char* new_path,
+                              int32_t* replaced) {
+    if (!ctx || !old_path || !new_path || !replaced ||
+        old_path[0] != '/' || new_path[0] != '/') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    const char* old_name = old_path + 1;
+    const char* new_name = new_path + 1;
+    *replaced = -1;
+    
+    if (strlen(new_name) == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(new_name) >= 64) {
+        ESP_LOGE(TAG, "Filename too long (max 63 chars): %s", new_name);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    // Read root node
+    corefs_btree_node_t* node = corefs_mem_calloc(ctx, sizeof(corefs_btree_node_t));
+    if (!node) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    esp_err_t ret = corefs_block_read(ctx, ctx->root_active, node);
+    if (ret != ESP_OK) {
+        corefs_mem_free(ctx, node);
+        return ret;
+    }
+    
+    uint32_t old_hash = hash_name(old_name);
+    uint32_t new_hash = hash_name(new_name);
+    int src = -1;
+    int dst = -1;
+    
+    for (int i = 0; i < node->count; i++) {
+        if (node->entries[i].name_hash == old_hash &&
+            strcmp(node->entries[i].name, old_name) == 0) {
+            src = i;
+        }
+        if (node->entries[i].name_hash == new_hash &&
+            strcmp(node->entries[i].name, new_name) == 0) {
+            dst = i;
+        }
+    }
+    
+    if (src < 0) {
+        corefs_mem_free(ctx, node);
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    if (src == dst) {
+        corefs_mem_free(ctx, node);
+        return ESP_OK;
+    }
+    
+    if (dst >= 0) {
+        // Target keeps its slot and takes the source inode
+        *replaced = (int32_t)node->entries[dst].inode_block;
+        node->entries[dst].inode_block = node->entries[src].inode_block;
+        
+        if (src < node->count - 1) {
+            memmove(&node->entries[src],
+                    &node->entries[src + 1],
+                    (node->count - src - 1) * sizeof(node->entries[0]));
+        }
+        node->count--;
+    } else {
+        node->entries[src].name_hash = new_hash;
+        memset(node->entries[src].name, 0, sizeof(node->entries[src].name));
+        strncpy(node->entries[src].name, new_name, 63);
+    }
+    
+    // Root switch: the commit point of the rename
+    ret = corefs_btree_commit(ctx, node);
+    corefs_mem_free(ctx, node);
+    
+    if (ret == ESP_OK) {
+        ESP_LOGD(TAG, "Renamed '%s' -> '%s'", old_name, new_name);
+    } else {
+        *replaced = -1;
+    }
+    
+    return ret;
+}
+
+// ============================================
+// ITERATE
+// ============================================
+
+esp_err_t corefs_btree_iterate(corefs_ctx_t* ctx, corefs_btree_iter_cb_t cb, void* arg) {
+    if (!ctx) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    return corefs_btree_iterate_at(ctx, ctx->root_active, cb, arg);
+}
+
+/**
+ * Walk the directory stored at root_block (the live root or a
+ * snapshot's copy of it).
+ */
+esp_err_t corefs_btree_iterate_at(corefs_ctx_t* ctx, uint32_t root_block,
+                                  corefs_btree_iter_cb_t cb, void* arg) {
+    if (!ctx || !cb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    corefs_btree_node_t* node = corefs_mem_calloc(ctx, sizeof(corefs_btree_node_t));
+    if (!node) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    esp_err_t ret = corefs_block_read(ctx, root_block, node);
+    if (ret != ESP_OK) {
+        corefs_mem_free(ctx, node);
+        return ret;
+    }
+    
+    if (node->magic != COREFS_BTREE_MAGIC) {
+        corefs_mem_free(ctx, node);
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    // Callback may modify the tree, so walk a snapshot of the node
+    for (int i = 0; i < node->count && i < COREFS_BTREE_ORDER - 1; i++) {
+        node->entries[i].name[63] = '\0';
+        if (!cb(node->entries[i].name, node->entries[i].inode_block, arg)) {
+            break;
+        }
+    }
+    
+    corefs_mem_free(ctx, node);
+    return ESP_OK;
+}
@@ -10,9 +10,12 @@
 
 static const char* TAG = "corefs";
 
-// Global context (single instance)
+// Default instance behind the path-only API
 corefs_ctx_t g_ctx = {0};
 
+// Mounted instances, to refuse mounting one partition twice
+static corefs_ctx_t* s_mounts[COREFS_MAX_MOUNTS];
+
 // Forward declarations (from other files)
 extern esp_err_t corefs_superblock_init(corefs_ctx_t* ctx);
 extern esp_err_t corefs_superblock_read(corefs_ctx_t* ctx);
@@ -30,240 +33,486 @@ corefs_ctx_t* corefs_get_context(void) {
     return &g_ctx;
 }
 
-// ============================================
-// FORMAT
-// ============================================
-
-esp_err_t corefs_format(const esp_partition_t* partition) {
-    if (!partition) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    
-    ESP_LOGI(TAG, "Formatting CoreFS at 0x%X, size %u KB", 
-             partition->address, partition->size / 1024);
+static bool register_mount(corefs_ctx_t* ctx) {
+    int slot = -1;
     
-    // Validate partition alignment
-    if (partition->size % COREFS_SECTOR_SIZE != 0) {
-        ESP_LOGE(TAG, "Partition size not sector-aligned!");
-        return ESP_ERR_INVALID_SIZE;
+    for (int i = 0; i < COREFS_MAX_MOUNTS; i++) {
+        if (s_mounts[i] && s_mounts[i]->partition == ctx->partition) {
+            ESP_LOGE(TAG, "Partition at 0x%X already mounted", ctx->partition->address);
+            return false;
+        }
+        if (!s_mounts[i] && slot < 0) {
+            slot = i;
+        }
     }
     
-    if (partition->address % COREFS_SECTOR_SIZE != 0) {
-        ESP_LOGE(TAG, "Partition offset not sector-aligned!");
-        return ESP_ERR_INVALID_SIZE;
+    if (slot < 0) {
+        ESP_LOGE(TAG, "Too many mounted instances (max %d)", COREFS_MAX_MOUNTS);
+        return false;
     }
     
-    // Setup temporary context
-    corefs_ctx_t ctx = {0};
-    ctx.partition = partition;
+    s_mounts[slot] = ctx;
+    return true;
+}
+
+static void unregister_mount(corefs_ctx_t* ctx) {
+    for (int i = 0; i < COREFS_MAX_MOUNTS; i++) {
+        if (s_mounts[i] == ctx) {
+            s_mounts[i] = NULL;
+        }
+    }
+}
+
+// ============================================
+// FORMAT
+// ============================================
+
+// Format with a temporary context (too large for the caller's stack)
+static esp_err_t format_partition(corefs_ctx_t* ctx, const esp_partition_t* partition) {
+    ctx->partition = partition;
     
     // Allocate superblock
-    ctx.sb = calloc(1, sizeof(corefs_superblock_t));
-    if (!ctx.sb) {
+    ctx->sb = calloc(1, sizeof(corefs_superblock_t));
+    if (!ctx->sb) {
         return ESP_ERR_NO_MEM;
     }
     
     // Initialize superblock
-    ctx.sb->magic = COREFS_MAGIC;
-    ctx.sb->version = COREFS_VERSION;
-    ctx.sb->block_size = COREFS_BLOCK_SIZE;
-    ctx.sb->block_count = partition->size / COREFS_BLOCK_SIZE;
-    ctx.sb->blocks_used = COREFS_METADATA_BLOCKS;
-    ctx.sb->root_block = 1;
-    ctx.sb->txn_log_block = 2;
-    ctx.sb->wear_table_block = 3;
-    ctx.sb->mount_count = 0;
-    ctx.sb->clean_unmount = 1;
+    ctx->sb->magic = COREFS_MAGIC;
+    ctx->sb->version = COREFS_VERSION;
+    ctx->sb->block_size = COREFS_BLOCK_SIZE;
+    ctx->sb->block_count = partition->size / COREFS_BLOCK_SIZE;
+    // One sector each, so rewriting one never erases another
+    ctx->sb->root_block = 4;         // Superblock slots occupy sectors 0 and 1 (blocks 0-3)
+    ctx->sb->root_alt_block = 6;
+    ctx->sb->txn_log_block = 8;
+    ctx->sb->rescue_block = 10;
+    ctx->sb->wear_table_block = COREFS_METADATA_BLOCKS;
+    ctx->sb->wear_log_blocks = corefs_wear_region_blocks(ctx->sb->block_count);
+    ctx->sb->metadata_blocks = COREFS_METADATA_BLOCKS + ctx->sb->wear_log_blocks;
+    ctx->sb->blocks_used = ctx->sb->metadata_blocks;
+    ctx->sb->mount_count = 0;
+    ctx->sb->clean_unmount = 1;
+    ctx->sb->seq = 1;
     
     // Calculate checksum (✓ FIXED: correct signature)
-    ctx.sb->checksum = 0;
-    ctx.sb->checksum = crc32(ctx.sb, sizeof(corefs_superblock_t));
+    ctx->sb->checksum = 0;
+    ctx->sb->checksum = crc32(ctx->sb, sizeof(corefs_superblock_t));
     
-    // Write superblock
-    esp_err_t ret = esp_partition_erase_range(partition, 0, COREFS_SECTOR_SIZE);
+    // Write superblock to slot 0; an old copy left in slot 1 could
+    // carry a higher sequence, so both slots are erased
+    esp_err_t ret = esp_partition_erase_range(partition, 0,
+                                              COREFS_SUPERBLOCK_SLOTS * COREFS_SECTOR_SIZE);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to erase superblock sector: %s", esp_err_to_name(ret));
-        free(ctx.sb);
+        free(ctx->sb);
         return ret;
     }
     
-    ret = esp_partition_write(partition, 0, ctx.sb, sizeof(corefs_superblock_t));
+    ret = esp_partition_write(partition, 0, ctx->sb, sizeof(corefs_superblock_t));
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write superblock: %s", esp_err_to_name(ret));
-        free(ctx.sb);
+        free(ctx->sb);
         return ret;
     }
     
     // Initialize block bitmap
-    ret = corefs_block_init(&ctx);
+    ret = corefs_block_init(ctx);
     if (ret != ESP_OK) {
-        free(ctx.sb);
+        free(ctx->sb);
         return ret;
     }
     
-    // Initialize B-Tree root
-    ret = corefs_btree_init(&ctx);
+    
+    ret = corefs_block_rescue_format(ctx);
     if (ret != ESP_OK) {
-        corefs_block_cleanup(&ctx);
-        free(ctx.sb);
+        ESP_LOGE(TAG, "Failed to erase rescue log: %s", esp_err_to_name(ret));
+        corefs_block_cleanup(ctx);
+        free(ctx->sb);
         return ret;
     }
     
-    // Initialize wear table (all zeros)
-    uint16_t* wear_table = calloc(ctx.sb->block_count, sizeof(uint16_t));
-    if (wear_table) {
-        // Erase wear table block
-        uint32_t wear_offset = ctx.sb->wear_table_block * COREFS_BLOCK_SIZE;
-        esp_partition_erase_range(partition, wear_offset, COREFS_SECTOR_SIZE);
-        esp_partition_write(partition, wear_offset, wear_table, 
-                           ctx.sb->block_count * sizeof(uint16_t));
-        free(wear_table);
+    // Initialize B-Tree root
+    ret = corefs_btree_init(ctx);
+    if (ret != ESP_OK) {
+        corefs_block_cleanup(ctx);
+        free(ctx->sb);
+        return ret;
     }
     
-    // Cleanup
-    corefs_block_cleanup(&ctx);
-    free(ctx.sb);
+    // Write initial (all zero) wear checkpoint
+    ret = corefs_wear_compact(ctx);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize wear log: %s", esp_err_to_name(ret));
+        corefs_block_cleanup(ctx);
+        free(ctx->sb);
+        return ret;
+    }
     
     ESP_LOGI(TAG, "Format complete: %u blocks total, %u KB free",
-             ctx.sb->block_count, 
-             (ctx.sb->block_count - COREFS_METADATA_BLOCKS) * 2);
+             ctx->sb->block_count, 
+             (ctx->sb->block_count - ctx->sb->metadata_blocks) * 2);
+    
+    // Cleanup
+    corefs_block_cleanup(ctx);
+    free(ctx->sb);
     
     return ESP_OK;
 }
 
+esp_err_t corefs_format(const esp_partition_t* partition) {
+    if (!partition) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    ESP_LOGI(TAG, "Formatting CoreFS at 0x%X, size %u KB", 
+             partition->address, partition->size / 1024);
+    
+    // Validate partition alignment
+    if (partition->size % COREFS_SECTOR_SIZE != 0) {
+        ESP_LOGE(TAG, "Partition size not sector-aligned!");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    if (partition->address % COREFS_SECTOR_SIZE != 0) {
+        ESP_LOGE(TAG, "Partition offset not sector-aligned!");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    
+    corefs_ctx_t* ctx = calloc(1, sizeof(corefs_ctx_t));
+    if (!ctx) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    esp_err_t ret = format_partition(ctx, partition);
+    free(ctx);
+    return ret;
+}
+
 // ============================================
 // MOUNT
 // ============================================
 
-esp_err_t corefs_mount(const esp_partition_t* partition) {
-    if (!partition) {
-        return ESP_ERR_INVALID_ARG;
-    }
+static void apply_config(corefs_ctx_t* ctx, const corefs_config_t* config) {
+    corefs_config_t defaults = COREFS_CONFIG_DEFAULT();
+    ctx->config = config ? *config : defaults;
     
-    if (g_ctx.mounted) {
-        ESP_LOGW(TAG, "Already mounted");
-        return ESP_OK;
+    if (ctx->config.cache_blocks > COREFS_CACHE_MAX_BLOCKS) {
+        ctx->config.cache_blocks = COREFS_CACHE_MAX_BLOCKS;
+    }
+    if (ctx->config.write_queue_blocks > COREFS_WQ_MAX_BLOCKS) {
+        ctx->config.write_queue_blocks = COREFS_WQ_MAX_BLOCKS;
+    }
+    if (ctx->config.dedup_slots > COREFS_DEDUP_MAX_SLOTS) {
+        ctx->config.dedup_slots = COREFS_DEDUP_MAX_SLOTS;
+    }
+    // The index is masked by hash: round down to a power of two
+    while (ctx->config.dedup_slots & (ctx->config.dedup_slots - 1)) {
+        ctx->config.dedup_slots &= ctx->config.dedup_slots - 1;
+    }
+    if (ctx->config.max_files == 0) {
+        ctx->config.max_files = COREFS_MAX_FILES;
+    } else if (ctx->config.max_files > COREFS_MAX_FILES_LIMIT) {
+        ctx->config.max_files = COREFS_MAX_FILES_LIMIT;
+    }
+    if (ctx->config.arena_buffers == 0) {
+        ctx->config.arena_buffers = COREFS_ARENA_BUFFERS;
+    } else if (ctx->config.arena_buffers > COREFS_ARENA_MAX_BUFFERS) {
+        ctx->config.arena_buffers = COREFS_ARENA_MAX_BUFFERS;
+    }
+    if (ctx->config.inode_cache == 0) {
+        ctx->config.inode_cache = COREFS_INODE_CACHE;
+    }
+    // Cached inodes live in buffer slots; leave half for I/O
+    if (ctx->config.arena && ctx->config.inode_cache > ctx->config.arena_buffers / 2) {
+        ctx->config.inode_cache = (ctx->config.arena_buffers >= 2) ? ctx->config.arena_buffers / 2 : 1;
     }
     
+    // Pending table is sized for the largest threshold
+    if (ctx->config.wear_flush_threshold == 0 ||
+        ctx->config.wear_flush_threshold > COREFS_WEAR_FLUSH_THRESHOLD) {
+        ctx->config.wear_flush_threshold = COREFS_WEAR_FLUSH_THRESHOLD;
+    }
+}
+
+static esp_err_t mount_abort(corefs_ctx_t* ctx, esp_err_t ret) {
+    corefs_mem_free(ctx, ctx->sb);
+    ctx->sb = NULL;
+    unregister_mount(ctx);
+    return ret;
+}
+
+static esp_err_t mount_instance(corefs_ctx_t* ctx, const esp_partition_t* partition,
+                                const corefs_config_t* config) {
     ESP_LOGI(TAG, "Mounting CoreFS at 0x%X", partition->address);
     
     // Setup context
-    g_ctx.partition = partition;
-    g_ctx.mounted = false;
+    ctx->partition = partition;
+    ctx->mounted = false;
+    ctx->read_only = false;
+    apply_config(ctx, config);
     
-    // Allocate superblock
-    g_ctx.sb = calloc(1, sizeof(corefs_superblock_t));
-    if (!g_ctx.sb) {
-        return ESP_ERR_NO_MEM;
+    if (!register_mount(ctx)) {
+        return ESP_ERR_INVALID_STATE;
     }
     
-    // Read superblock
-    esp_err_t ret = esp_partition_read(partition, 0, g_ctx.sb, 
-                                       sizeof(corefs_superblock_t));
+    // Slabs come first in the arena, mount carves the rest
+    esp_err_t ret = corefs_mem_init(ctx);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to read superblock: %s", esp_err_to_name(ret));
-        free(g_ctx.sb);
+        unregister_mount(ctx);
         return ret;
     }
     
-    // Verify magic
-    if (g_ctx.sb->magic != COREFS_MAGIC) {
-        ESP_LOGE(TAG, "Invalid magic: 0x%08X (expected 0x%08X)", 
-                 g_ctx.sb->magic, COREFS_MAGIC);
-        free(g_ctx.sb);
-        return ESP_ERR_INVALID_STATE;
+    // Allocate superblock
+    ctx->sb = corefs_mem_carve(ctx, sizeof(corefs_superblock_t));
+    if (!ctx->sb) {
+        unregister_mount(ctx);
+        return ESP_ERR_NO_MEM;
     }
     
-    // Verify checksum (✓ FIXED: correct signature)
-    uint32_t stored_csum = g_ctx.sb->checksum;
-    g_ctx.sb->checksum = 0;
-    uint32_t calc_csum = crc32(g_ctx.sb, sizeof(corefs_superblock_t));
-    g_ctx.sb->checksum = stored_csum;
+    // Read the live superblock slot (magic and checksum verified)
+    ret = corefs_superblock_read(ctx);
+    if (ret != ESP_OK) {
+        return mount_abort(ctx, ret);
+    }
     
-    if (stored_csum != calc_csum) {
-        ESP_LOGE(TAG, "Checksum mismatch: 0x%08X != 0x%08X", 
-                 stored_csum, calc_csum);
-        free(g_ctx.sb);
-        return ESP_ERR_INVALID_CRC;
+    // Older layouts share metadata sectors, have a single root or a
+    // single superblock, or leave compressed blocks to be told by content
+    if (ctx->sb->version != COREFS_VERSION ||
+        ctx->sb->metadata_blocks < COREFS_METADATA_BLOCKS) {
+        ESP_LOGE(TAG, "Unsupported on-disk layout - reformat required");
+        return mount_abort(ctx, ESP_ERR_INVALID_VERSION);
+    }
+    
+    // A snapshot is mounted through its own directory copy, read-only
+    uint32_t snapshot = ctx->config.snapshot;
+    if (snapshot != 0) {
+        if (snapshot > COREFS_MAX_SNAPSHOTS || ctx->sb->snapshots[snapshot - 1] == 0) {
+            ESP_LOGE(TAG, "No snapshot %u", snapshot);
+            return mount_abort(ctx, ESP_ERR_NOT_FOUND);
+        }
+        ctx->read_only = true;
+        ESP_LOGI(TAG, "Snapshot %u, read-only", snapshot);
     }
     
     // Check clean unmount
-    if (g_ctx.sb->clean_unmount == 0) {
+    if (ctx->sb->clean_unmount == 0) {
         ESP_LOGW(TAG, "Unclean unmount detected - may need recovery");
     }
     
-    // Initialize block manager
-    ret = corefs_block_init(&g_ctx);
+    // Initialize block manager (bitmap, wear map, block cache)
+    ret = corefs_block_init(ctx);
     if (ret != ESP_OK) {
-        free(g_ctx.sb);
-        return ret;
+        return mount_abort(ctx, ret);
+    }
+    
+    // Restore wear counters from checkpoint + delta log
+    ret = corefs_wear_load(ctx);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Wear log unreadable, counters restart at zero");
+    }
+    
+    // Finish sector rewrites a power loss interrupted
+    ret = corefs_block_rescue_recover(ctx);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Rescue log recovery failed: %s", esp_err_to_name(ret));
+        corefs_block_cleanup(ctx);
+        return mount_abort(ctx, ret);
     }
     
     // Load B-Tree
-    ret = corefs_btree_load(&g_ctx);
+    ctx->next_inode_num = 1;
+    ret = corefs_btree_load(ctx);
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "Failed to load B-Tree: %s", esp_err_to_name(ret));
         // Continue anyway - B-Tree might be empty
+    } else {
+        if (snapshot != 0) {
+            ctx->root_active = ctx->sb->snapshots[snapshot - 1];
+        } else {
+            // Resolve a transaction the last session left on flash. The
+            // clean flag only reaches flash at unmount, so always look.
+            corefs_recovery_scan(ctx);
+        }
+        // Bitmap is not persisted - rebuild it from the directory
+        corefs_block_scan(ctx);
     }
     
     // Mark as dirty (will be set to clean on unmount)
-    g_ctx.sb->clean_unmount = 0;
-    g_ctx.sb->mount_count++;
+    ctx->sb->clean_unmount = 0;
+    ctx->sb->mount_count++;
     
-    // Initialize file handles
-    memset(g_ctx.open_files, 0, sizeof(g_ctx.open_files));
-    g_ctx.next_inode_num = 1;
+    // Initialize file handles and locks
+    ret = corefs_file_table_init(ctx);
+    if (ret == ESP_OK) {
+        ret = corefs_lock_init(ctx);
+    }
+    if (ret == ESP_OK) {
+        ret = corefs_elevator_init(ctx);
+        if (ret == ESP_OK) {
+            ret = corefs_dedup_init(ctx);
+        }
+        if (ret != ESP_OK) {
+            corefs_lock_deinit(ctx);
+        }
+    }
+    if (ret != ESP_OK) {
+        corefs_file_table_cleanup(ctx);
+        corefs_block_cleanup(ctx);
+        return mount_abort(ctx, ret);
+    }
+    memset(&ctx->wear_stats, 0, sizeof(ctx->wear_stats));
+    memset(&ctx->io_stats, 0, sizeof(ctx->io_stats));
     
-    g_ctx.mounted = true;
+    ctx->mounted = true;
     
     ESP_LOGI(TAG, "Mount complete: %u KB total, %u KB used, %u KB free",
-             g_ctx.sb->block_count * 2,
-             g_ctx.sb->blocks_used * 2,
-             (g_ctx.sb->block_count - g_ctx.sb->blocks_used) * 2);
+             ctx->sb->block_count * 2,
+             ctx->sb->blocks_used * 2,
+             (ctx->sb->block_count - ctx->sb->blocks_used) * 2);
     
     return ESP_OK;
 }
 
+esp_err_t corefs_mount(const esp_partition_t* partition) {
+    if (!partition) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (g_ctx.mounted) {
+        ESP_LOGW(TAG, "Already mounted");
+        return ESP_OK;
+    }
+    
+    return mount_instance(&g_ctx, partition, NULL);
+}
+
+esp_err_t corefs_fs_mount(const esp_partition_t* partition, const corefs_config_t* config,
+                          corefs_ctx_t** out_fs) {
+    if (!partition || !out_fs) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    corefs_ctx_t* ctx = corefs_mem_new_context(config);
+    if (!ctx) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    esp_err_t ret = mount_instance(ctx, partition, config);
+    if (ret != ESP_OK) {
+        corefs_mem_delete_context(ctx);
+        return ret;
+    }
+    
+    *out_fs = ctx;
+    return ESP_OK;
+}
+
+// ============================================
+// SYNC
+// ============================================
+
+esp_err_t corefs_fs_sync(corefs_ctx_t* fs) {
+    if (!fs || !fs->mounted) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (fs->read_only) {
+        return ESP_OK;
+    }
+    
+    // Write back queued data and inodes of open files, then the
+    // buffered wear deltas
+    esp_err_t ret = corefs_elevator_flush(fs);
+    
+    corefs_rwlock_wrlock(&fs->dir_lock);
+    for (uint32_t i = 0; i < fs->files_cap; i++) {
+        corefs_file_t* file = fs->files[i];
+        if (!file || !file->dirty) {
+            continue;
+        }
+        
+        esp_err_t err = corefs_file_store(file);
+        if (err != ESP_OK) {
+            ret = err;
+        }
+    }
+    corefs_rwlock_wrunlock(&fs->dir_lock);
+    
+    esp_err_t err = corefs_wear_save(fs);
+    return ret != ESP_OK ? ret : err;
+}
+
+esp_err_t corefs_sync(void) {
+    return corefs_fs_sync(&g_ctx);
+}
+
 // ============================================
 // UNMOUNT
 // ============================================
 
-esp_err_t corefs_unmount(void) {
-    if (!g_ctx.mounted) {
+static esp_err_t unmount_instance(corefs_ctx_t* ctx) {
+    if (!ctx->mounted) {
         return ESP_ERR_INVALID_STATE;
     }
     
     ESP_LOGI(TAG, "Unmounting CoreFS...");
     
+    // Finish queued async requests, then stop background wear leveling
+    corefs_fs_aio_stop(ctx);
+    corefs_fs_wear_stop(ctx);
+    
     // Close all open files
-    for (int i = 0; i < COREFS_MAX_OPEN_FILES; i++) {
-        if (g_ctx.open_files[i]) {
-            corefs_close(g_ctx.open_files[i]);
+    for (uint32_t i = 0; i < ctx->files_cap; i++) {
+        if (ctx->files[i]) {
+            corefs_close(ctx->files[i]);
         }
     }
     
-    // Mark as clean
-    g_ctx.sb->clean_unmount = 1;
-    
-    // Update superblock checksum (✓ FIXED: correct signature)
-    g_ctx.sb->checksum = 0;
-    g_ctx.sb->checksum = crc32(g_ctx.sb, sizeof(corefs_superblock_t));
-    
-    // Write superblock
-    esp_partition_erase_range(g_ctx.partition, 0, COREFS_SECTOR_SIZE);
-    esp_partition_write(g_ctx.partition, 0, g_ctx.sb, 
-                       sizeof(corefs_superblock_t));
+    // Write queued data, then persist outstanding wear deltas
+    corefs_elevator_flush(ctx);
+    corefs_wear_save(ctx);
+    
+    // A snapshot mount changed nothing (and its root is not the live one)
+    if (!ctx->read_only) {
+        // Mark as clean
+        ctx->sb->clean_unmount = 1;
+        
+        // Write superblock (the slot not in use)
+        corefs_superblock_write(ctx);
+    }
     
     // Cleanup
-    corefs_block_cleanup(&g_ctx);
-    free(g_ctx.sb);
-    g_ctx.sb = NULL;
-    g_ctx.mounted = false;
+    corefs_file_table_cleanup(ctx);
+    corefs_block_cleanup(ctx);
+    corefs_mem_free(ctx, ctx->sb);
+    ctx->sb = NULL;
+    ctx->mounted = false;
+    corefs_lock_deinit(ctx);
+    unregister_mount(ctx);
     
     ESP_LOGI(TAG, "Unmount complete");
     return ESP_OK;
 }
 
+esp_err_t corefs_unmount(void) {
+    return unmount_instance(&g_ctx);
+}
+
+esp_err_t corefs_fs_unmount(corefs_ctx_t* fs) {
+    if (!fs) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    esp_err_t ret = unmount_instance(fs);
+    
+    // The default instance is static; others were allocated by corefs_fs_mount()
+    if (ret == ESP_OK && fs != &g_ctx) {
+        corefs_mem_delete_context(fs);
+    }
+    return ret;
+}
+
 // ============================================
 // STATUS
 // ============================================
@@ -272,19 +521,54 @@ bool corefs_is_mounted(void) {
     return g_ctx.mounted;
 }
 
-esp_err_t corefs_info(corefs_info_t* info) {
-    if (!g_ctx.mounted || !info) {
+esp_err_t corefs_fs_info(corefs_ctx_t* fs, corefs_info_t* info) {
+    if (!fs || !fs->mounted || !info) {
         return ESP_ERR_INVALID_STATE;
     }
     
-    info->block_size = g_ctx.sb->block_size;
-    info->block_count = g_ctx.sb->block_count;
-    info->blocks_used = g_ctx.sb->blocks_used;
-    info->mount_count = g_ctx.sb->mount_count;
+    corefs_alloc_lock(fs);
+    info->block_size = fs->sb->block_size;
+    info->block_count = fs->sb->block_count;
+    info->blocks_used = fs->sb->blocks_used;
+    info->mount_count = fs->sb->mount_count;
     
-    info->total_bytes = (uint64_t)g_ctx.sb->block_count * COREFS_BLOCK_SIZE;
-    info->used_bytes = (uint64_t)g_ctx.sb->blocks_used * COREFS_BLOCK_SIZE;
+    info->total_bytes = (uint64_t)fs->sb->block_count * COREFS_BLOCK_SIZE;
+    info->used_bytes = (uint64_t)fs->sb->blocks_used * COREFS_BLOCK_SIZE;
     info->free_bytes = info->total_bytes - info->used_bytes;
+    corefs_alloc_unlock(fs);
     
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t corefs_info(corefs_info_t* info) {
+    return corefs_fs_info(&g_ctx, info);
+}
+
+esp_err_t corefs_fs_get_io_stats(corefs_ctx_t* fs, corefs_io_stats_t* stats) {
+    if (!fs || !fs->mounted || !stats) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    corefs_alloc_lock(fs);
+    *stats = fs->io_stats;
+    corefs_alloc_unlock(fs);
+    return ESP_OK;
+}
+
+esp_err_t corefs_get_io_stats(corefs_io_stats_t* stats) {
+    return corefs_fs_get_io_stats(&g_ctx, stats);
+}
+
+void corefs_fs_reset_io_stats(corefs_ctx_t* fs) {
+    if (!fs) {
+        return;
+    }
+    
+    corefs_alloc_lock(fs);
+    memset(&fs->io_stats, 0, sizeof(fs->io_stats));
+    corefs_alloc_unlock(fs);
+}
+
+void corefs_reset_io_stats(void) {
+    corefs_fs_reset_io_stats(&g_ctx);
+}
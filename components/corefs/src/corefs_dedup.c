@@ -0,0 +1,135 @@
+/**
+ * CoreFS - Block Deduplication
+ *
+ * A small RAM index (config.dedup_slots, direct-mapped by CRC32) remembers
+ * recently written data blocks. A block write whose contents match an
+ * indexed block takes a reference to that block instead of programming
+ * its own: the same reference counts clones use (block_refs), so the
+ * first write to either copy goes through copy-on-write as usual, and
+ * mount rebuilds the counts from the inodes. The index is not persisted;
+ * after a mount it refills as files are written.
+ *
+ * A hash match is only a candidate. The block is read back and compared
+ * before it is shared, and the slot must still hold the same entry
+ * (stamp) at that point: an entry is removed before its block is
+ * rewritten in place or freed, so a block cannot change between the
+ * compare and the new reference.
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char* TAG = "corefs_dedup";
+
+// ============================================
+// LIFECYCLE
+// ============================================
+
+esp_err_t corefs_dedup_init(corefs_ctx_t* ctx) {
+    uint32_t n = ctx->config.dedup_slots;
+    ctx->dedup_stamp = 0;
+    if (n == 0) {
+        return ESP_OK;
+    }
+
+    ctx->dedup = corefs_mem_carve(ctx, n * sizeof(corefs_dedup_entry_t));
+    if (!ctx->dedup) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(ctx->dedup, 0, n * sizeof(corefs_dedup_entry_t));
+
+    ESP_LOGD(TAG, "Dedup index: %u slots", n);
+    return ESP_OK;
+}
+
+void corefs_dedup_cleanup(corefs_ctx_t* ctx) {
+    corefs_mem_free(ctx, ctx->dedup);
+    ctx->dedup = NULL;
+}
+
+// ============================================
+// INDEX
+// ============================================
+
+static corefs_dedup_entry_t* slot_of(corefs_ctx_t* ctx, uint32_t hash) {
+    return &ctx->dedup[hash & (ctx->config.dedup_slots - 1)];
+}
+
+/**
+ * Look for a block holding exactly buf (hash = crc32 of buf) and take a
+ * reference to it. Returns the block, now shared, or 0.
+ */
+uint32_t corefs_dedup_share(corefs_ctx_t* ctx, uint32_t hash, const void* buf) {
+    if (!ctx->dedup) {
+        return 0;
+    }
+
+    corefs_alloc_lock(ctx);
+    corefs_dedup_entry_t seen = *slot_of(ctx, hash);
+    corefs_alloc_unlock(ctx);
+
+    if (seen.block == 0 || seen.hash != hash) {
+        return 0;
+    }
+
+    uint8_t* data = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!data) {
+        return 0;
+    }
+    bool same = (corefs_block_read(ctx, seen.block, data) == ESP_OK &&
+                 memcmp(data, buf, COREFS_BLOCK_SIZE) == 0);
+    corefs_mem_free(ctx, data);
+    if (!same) {
+        return 0;
+    }
+
+    // Unchanged since the compare: the entry would be gone otherwise
+    corefs_alloc_lock(ctx);
+    corefs_dedup_entry_t* e = slot_of(ctx, hash);
+    bool ok = (e->block == seen.block && e->stamp == seen.stamp &&
+               corefs_block_is_allocated(ctx, seen.block) &&
+               ctx->block_refs[seen.block] < UINT8_MAX);
+    if (ok) {
+        ctx->block_refs[seen.block]++;
+        ctx->io_stats.dedup_hits++;
+    }
+    corefs_alloc_unlock(ctx);
+
+    if (ok) {
+        ESP_LOGD(TAG, "Block %u shared by content", seen.block);
+    }
+    return ok ? seen.block : 0;
+}
+
+// Remember block as holding contents with this hash; evicts the slot
+void corefs_dedup_insert(corefs_ctx_t* ctx, uint32_t hash, uint32_t block) {
+    if (!ctx->dedup) {
+        return;
+    }
+
+    corefs_alloc_lock(ctx);
+    corefs_dedup_entry_t* e = slot_of(ctx, hash);
+    e->hash = hash;
+    e->block = block;
+    e->stamp = ++ctx->dedup_stamp;
+    corefs_alloc_unlock(ctx);
+}
+
+/**
+ * Drop block from the index before its contents change (in-place
+ * rewrite or free). Scans the table: it is small and keyed by hash.
+ */
+void corefs_dedup_forget(corefs_ctx_t* ctx, uint32_t block) {
+    if (!ctx->dedup) {
+        return;
+    }
+
+    corefs_alloc_lock(ctx);
+    for (uint32_t i = 0; i < ctx->config.dedup_slots; i++) {
+        if (ctx->dedup[i].block == block) {
+            ctx->dedup[i].block = 0;
+        }
+    }
+    corefs_alloc_unlock(ctx);
+}
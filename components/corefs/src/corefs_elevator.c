@@ -0,0 +1,287 @@
+/**
+ * CoreFS - Write Elevator
+ *
+ * Data block writes are held in a small per-instance queue
+ * (config.write_queue_blocks) instead of going to flash one by one:
+ *   - a block written again while queued replaces the queued copy, so
+ *     a log tail rewritten by every append reaches flash once
+ *   - a block freed while queued is dropped
+ *   - on flush the queue is sorted by block, and both halves of a
+ *     sector are programmed after a single erase
+ *
+ * Ordering: metadata writes (inodes, root, txn log) are barriers. Queued
+ * data is flushed before any of them, so flash never references a block
+ * whose contents are still in RAM. Data still queued on power loss is
+ * lost like unsynced data in a page cache; corefs_fs_flush(),
+ * corefs_fs_sync(), close and unmount push it out.
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* TAG = "corefs_elevator";
+
+static void wq_lock(corefs_ctx_t* ctx) {
+    xSemaphoreTake((SemaphoreHandle_t)ctx->wq_lock, portMAX_DELAY);
+}
+
+static void wq_unlock(corefs_ctx_t* ctx) {
+    xSemaphoreGive((SemaphoreHandle_t)ctx->wq_lock);
+}
+
+static int wq_find(corefs_ctx_t* ctx, uint32_t block) {
+    for (uint32_t i = 0; i < ctx->wq_count; i++) {
+        if (ctx->wq_blocks[i] == block) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static uint8_t* wq_slot(corefs_ctx_t* ctx, uint32_t i) {
+    return ctx->wq_data + i * COREFS_BLOCK_SIZE;
+}
+
+static void wq_remove(corefs_ctx_t* ctx, uint32_t i) {
+    uint32_t last = --ctx->wq_count;
+    if (i != last) {
+        ctx->wq_blocks[i] = ctx->wq_blocks[last];
+        memcpy(wq_slot(ctx, i), wq_slot(ctx, last), COREFS_BLOCK_SIZE);
+    }
+}
+
+// ============================================
+// LIFECYCLE
+// ============================================
+
+esp_err_t corefs_elevator_init(corefs_ctx_t* ctx) {
+    uint32_t n = ctx->config.write_queue_blocks;
+    ctx->wq_count = 0;
+    if (n == 0 || !ctx->wq_lock) {
+        return ESP_OK;
+    }
+
+    ctx->wq_blocks = corefs_mem_carve(ctx, n * sizeof(uint32_t));
+    ctx->wq_data = corefs_mem_carve(ctx, n * COREFS_BLOCK_SIZE);
+    if (!ctx->wq_blocks || !ctx->wq_data) {
+        corefs_elevator_cleanup(ctx);
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGD(TAG, "Write queue: %u blocks", n);
+    return ESP_OK;
+}
+
+void corefs_elevator_cleanup(corefs_ctx_t* ctx) {
+    if (ctx->wq_count > 0) {
+        ESP_LOGW(TAG, "Discarding %u queued writes", ctx->wq_count);
+    }
+    corefs_mem_free(ctx, ctx->wq_blocks);
+    corefs_mem_free(ctx, ctx->wq_data);
+    ctx->wq_blocks = NULL;
+    ctx->wq_data = NULL;
+    ctx->wq_count = 0;
+}
+
+// ============================================
+// FLUSH
+// ============================================
+
+// Caller holds wq_lock
+static esp_err_t flush_locked(corefs_ctx_t* ctx) {
+    uint32_t n = ctx->wq_count;
+    if (n == 0) {
+        return ESP_OK;
+    }
+
+    // Sort slot indices by block; the queue is small
+    uint8_t order[COREFS_WQ_MAX_BLOCKS];
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t j = i;
+        while (j > 0 && ctx->wq_blocks[order[j - 1]] > ctx->wq_blocks[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = (uint8_t)i;
+    }
+
+    esp_err_t ret = ESP_OK;
+    uint32_t done = 0;
+    uint32_t merged = 0;
+
+    while (done < n) {
+        uint32_t a = order[done];
+        uint32_t block = ctx->wq_blocks[a];
+        const uint8_t* sibling_buf = NULL;
+
+        // Both halves of one sector queued: one erase for the pair
+        if (done + 1 < n && (block & 1u) == 0 &&
+            ctx->wq_blocks[order[done + 1]] == block + 1) {
+            sibling_buf = wq_slot(ctx, order[done + 1]);
+        }
+
+        ret = corefs_block_program(ctx, block, wq_slot(ctx, a), sibling_buf);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Flush of block %u failed: %s", block, esp_err_to_name(ret));
+            break;
+        }
+
+        if (sibling_buf) {
+            merged++;
+            done++;
+        }
+        done++;
+    }
+
+    if (done == n) {
+        ctx->wq_count = 0;
+    } else {
+        // Keep only what did not reach flash
+        uint32_t flushed[COREFS_WQ_MAX_BLOCKS];
+        for (uint32_t i = 0; i < done; i++) {
+            flushed[i] = ctx->wq_blocks[order[i]];
+        }
+        for (uint32_t i = 0; i < done; i++) {
+            wq_remove(ctx, (uint32_t)wq_find(ctx, flushed[i]));
+        }
+    }
+
+    if (merged > 0) {
+        corefs_alloc_lock(ctx);
+        ctx->io_stats.merged_writes += merged;
+        corefs_alloc_unlock(ctx);
+    }
+
+    return ret;
+}
+
+esp_err_t corefs_elevator_flush(corefs_ctx_t* ctx) {
+    if (!ctx || !ctx->wq_blocks) {
+        return ESP_OK;
+    }
+
+    wq_lock(ctx);
+    esp_err_t ret = flush_locked(ctx);
+    wq_unlock(ctx);
+    return ret;
+}
+
+// ============================================
+// QUEUE
+// ============================================
+
+esp_err_t corefs_elevator_write(corefs_ctx_t* ctx, uint32_t block, const void* buf) {
+    if (!ctx->wq_blocks) {
+        return corefs_block_program(ctx, block, buf, NULL);
+    }
+
+    wq_lock(ctx);
+
+    esp_err_t ret = ESP_OK;
+    int i = wq_find(ctx, block);
+    if (i >= 0) {
+        // Overwritten before it reached flash
+        corefs_alloc_lock(ctx);
+        ctx->io_stats.dropped_writes++;
+        corefs_alloc_unlock(ctx);
+    } else {
+        if (ctx->wq_count == ctx->config.write_queue_blocks) {
+            ret = flush_locked(ctx);
+        }
+        if (ret == ESP_OK) {
+            i = (int)ctx->wq_count++;
+            ctx->wq_blocks[i] = block;
+        }
+    }
+
+    if (ret == ESP_OK) {
+        memcpy(wq_slot(ctx, (uint32_t)i), buf, COREFS_BLOCK_SIZE);
+    }
+
+    wq_unlock(ctx);
+    return ret;
+}
+
+bool corefs_elevator_read(corefs_ctx_t* ctx, uint32_t block, void* buf) {
+    if (!ctx->wq_blocks) {
+        return false;
+    }
+
+    wq_lock(ctx);
+    int i = wq_find(ctx, block);
+    if (i >= 0) {
+        memcpy(buf, wq_slot(ctx, (uint32_t)i), COREFS_BLOCK_SIZE);
+    }
+    wq_unlock(ctx);
+    return i >= 0;
+}
+
+/**
+ * Hold the queue across freeing a block and corefs_elevator_drop(): a
+ * write queued for the block once it is allocated again waits, so it
+ * is not the one dropped. Comes before alloc_lock.
+ */
+void corefs_elevator_lock(corefs_ctx_t* ctx) {
+    if (ctx->wq_blocks) {
+        wq_lock(ctx);
+    }
+}
+
+void corefs_elevator_unlock(corefs_ctx_t* ctx) {
+    if (ctx->wq_blocks) {
+        wq_unlock(ctx);
+    }
+}
+
+// Caller holds the queue (corefs_elevator_lock())
+void corefs_elevator_drop(corefs_ctx_t* ctx, uint32_t block) {
+    if (!ctx->wq_blocks) {
+        return;
+    }
+
+    int i = wq_find(ctx, block);
+    if (i >= 0) {
+        wq_remove(ctx, (uint32_t)i);
+        corefs_alloc_lock(ctx);
+        ctx->io_stats.dropped_writes++;
+        corefs_alloc_unlock(ctx);
+    }
+}
+
+/**
+ * Apply a partial update to block if it is still queued. Returns false
+ * when it is not; the caller then programs flash itself.
+ */
+bool corefs_elevator_patch(corefs_ctx_t* ctx, uint32_t block, uint32_t offset,
+                           const void* data, uint32_t len) {
+    if (!ctx->wq_blocks) {
+        return false;
+    }
+
+    wq_lock(ctx);
+    int i = wq_find(ctx, block);
+    if (i >= 0) {
+        memcpy(wq_slot(ctx, (uint32_t)i) + offset, data, len);
+    }
+    wq_unlock(ctx);
+    return i >= 0;
+}
+
+// ============================================
+// PUBLIC API
+// ============================================
+
+esp_err_t corefs_fs_flush(corefs_ctx_t* fs) {
+    if (!fs || !fs->mounted) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return corefs_elevator_flush(fs);
+}
+
+esp_err_t corefs_flush(void) {
+    return corefs_fs_flush(corefs_get_context());
+}
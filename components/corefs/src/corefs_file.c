@@ -4,479 +4,3570 @@
 
 #include "corefs.h"
 #include "esp_log.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 static const char *TAG = "corefs_file";
 
+// Transaction operation (codes shared with corefs_transaction.c)
+#define TXN_OP_RENAME 5
+
 // Forward declarations
 extern corefs_ctx_t *corefs_get_context(void);
 extern int32_t corefs_btree_find(corefs_ctx_t *ctx, const char *path);
 extern esp_err_t corefs_btree_insert(corefs_ctx_t *ctx, const char *path, uint32_t inode_block);
 extern esp_err_t corefs_btree_delete(corefs_ctx_t *ctx, const char *path);
+extern esp_err_t corefs_btree_update(corefs_ctx_t *ctx, const char *path, uint32_t inode_block);
 extern esp_err_t corefs_inode_create(corefs_ctx_t *ctx, const char *filename, uint32_t *out_inode_block);
 extern esp_err_t corefs_inode_read(corefs_ctx_t *ctx, uint32_t inode_block, corefs_inode_t *inode);
 extern esp_err_t corefs_inode_write(corefs_ctx_t *ctx, uint32_t inode_block, const corefs_inode_t *inode);
+extern esp_err_t corefs_inode_relocate(corefs_ctx_t *ctx, const corefs_inode_t *inode, uint32_t *out_inode_block);
 extern esp_err_t corefs_inode_delete(corefs_ctx_t *ctx, uint32_t inode_block);
-extern uint32_t corefs_block_alloc(corefs_ctx_t *ctx);
+extern corefs_class_t corefs_inode_class(const corefs_inode_t *inode);
+extern uint32_t corefs_block_alloc_class(corefs_ctx_t *ctx, corefs_class_t cls);
 extern void corefs_block_free(corefs_ctx_t *ctx, uint32_t block);
 extern esp_err_t corefs_block_read(corefs_ctx_t *ctx, uint32_t block, void *buf);
 extern esp_err_t corefs_block_write(corefs_ctx_t *ctx, uint32_t block, const void *buf);
+extern void corefs_block_set_class(corefs_ctx_t *ctx, uint32_t block, corefs_class_t cls);
+
+static esp_err_t records_recover(corefs_ctx_t *ctx, corefs_inode_t *inode);
+static esp_err_t node_store(corefs_ctx_t *ctx, corefs_node_t *node);
+static esp_err_t record_checkpoint(corefs_file_t *file);
+static void set_chunk(corefs_inode_t *inode, uint32_t slot, bool chunk);
 
 // ============================================
-// OPEN
+// PLACEMENT
 // ============================================
 
-corefs_file_t *corefs_open(const char *path, uint32_t flags)
+static void note_rewrite(corefs_file_t *file)
 {
-    corefs_ctx_t *ctx = corefs_get_context();
-
-    if (!ctx->mounted || !path)
+    if (file->node->inode->rewrites < UINT16_MAX)
     {
-        return NULL;
+        file->node->inode->rewrites++;
     }
+}
 
-    // Find free file slot
-    int slot = -1;
-    for (int i = 0; i < COREFS_MAX_OPEN_FILES; i++)
-    {
-        if (ctx->open_files[i] == NULL)
-        {
-            slot = i;
-            break;
-        }
-    }
+// A ring file owns a fixed set of blocks, all allocated when it is
+// created, and only appends. inode->size is the end of the stream of
+// appended bytes; stream byte p lives in block_list[(p / BLOCK_SIZE) %
+// blocks_used]. Writing into a block again drops what the previous lap
+// left there, so the oldest valid byte follows from the end alone and
+// the inode's size is all that is persisted. Callers' offsets count
+// from the oldest byte.
+static bool is_ring(const corefs_inode_t *inode)
+{
+    return (inode->flags & COREFS_INODE_RING) && inode->blocks_used > 0;
+}
 
-    if (slot < 0)
+// Stream offset of the first byte callers see (oldest byte of a ring)
+static uint32_t file_base(const corefs_inode_t *inode)
+{
+    uint32_t end = (uint32_t)inode->size;
+    if (!is_ring(inode) || end == 0)
     {
-        ESP_LOGE(TAG, "Too many open files");
-        return NULL;
+        return 0;
     }
 
-    // Extract filename
-    const char *filename = path + 1; // Skip leading '/'
-
-    // Try to find existing file
-    int32_t inode_block = corefs_btree_find(ctx, path);
-
-    // If not found and CREAT flag set, create new
-    if (inode_block < 0 && (flags & COREFS_O_CREAT))
-    {
-        uint32_t new_inode_block = 0;
-        esp_err_t ret = corefs_inode_create(ctx, filename, &new_inode_block);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGE(TAG, "Failed to create inode: %s", esp_err_to_name(ret));
-            return NULL;
-        }
+    uint32_t newest = (end - 1) / COREFS_BLOCK_SIZE;
+    return (newest >= inode->blocks_used) ? (newest - inode->blocks_used + 1) * COREFS_BLOCK_SIZE : 0;
+}
 
-        // Insert into B-Tree
-        ret = corefs_btree_insert(ctx, path, new_inode_block);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGE(TAG, "Failed to insert into B-Tree: %s", esp_err_to_name(ret));
-            corefs_inode_delete(ctx, new_inode_block);
-            return NULL;
-        }
+// Bytes callers can read
+static uint32_t file_length(const corefs_inode_t *inode)
+{
+    return (uint32_t)inode->size - file_base(inode);
+}
 
-        inode_block = new_inode_block;
-    }
+// Block list slot holding stream offset pos
+static uint32_t block_slot(const corefs_inode_t *inode, uint32_t pos)
+{
+    uint32_t idx = pos / COREFS_BLOCK_SIZE;
+    return is_ring(inode) ? idx % inode->blocks_used : idx;
+}
 
-    if (inode_block < 0)
+// Keeps a ring's stream end below two laps (it only matters modulo
+// one lap once the ring has wrapped), so offsets stay 32-bit
+static void ring_rebase(corefs_inode_t *inode)
+{
+    uint32_t lap = inode->blocks_used * COREFS_BLOCK_SIZE;
+    while (inode->size >= 2 * (uint64_t)lap)
     {
-        ESP_LOGE(TAG, "File not found: %s", path);
-        return NULL;
+        inode->size -= lap;
     }
+}
 
-    // Allocate file handle
-    corefs_file_t *file = calloc(1, sizeof(corefs_file_t));
-    if (!file)
+// Drops the blocks past length. Caller holds the node lock exclusively.
+static void shrink_to(corefs_file_t *file, uint32_t length)
+{
+    corefs_inode_t *inode = file->node->inode;
+    uint32_t keep = (length + COREFS_BLOCK_SIZE - 1) / COREFS_BLOCK_SIZE;
+
+    for (uint32_t i = keep; i < inode->blocks_used; i++)
     {
-        return NULL;
+        if (inode->block_list[i] != 0)
+        {
+            corefs_block_free(file->ctx, inode->block_list[i]);
+        }
     }
-
-    // Load inode
-    file->inode = malloc(sizeof(corefs_inode_t));
-    if (!file->inode)
+    memset(&inode->block_list[keep], 0, (COREFS_MAX_BLOCKS - keep) * sizeof(uint32_t));
+    for (uint32_t i = keep; i < COREFS_MAX_BLOCKS; i++)
     {
-        free(file);
-        return NULL;
+        set_chunk(inode, i, false);
     }
 
-    esp_err_t ret = corefs_inode_read(ctx, inode_block, file->inode);
-    if (ret != ESP_OK)
+    if (inode->blocks_used > keep)
     {
-        free(file->inode);
-        free(file);
-        return NULL;
+        inode->blocks_used = keep;
     }
+    inode->size = length;
+}
 
-    // Setup file handle
-    strncpy(file->path, path, sizeof(file->path) - 1);
-    file->inode_block = inode_block;
-    file->position = 0;
-    file->flags = flags;
-    file->dirty = false;
+// Caller holds the node lock exclusively
+static void mark_dirty(corefs_file_t *file)
+{
+    corefs_ctx_t *ctx = file->ctx;
 
-    // Truncate if requested
-    if (flags & COREFS_O_TRUNC)
+    // A replacement reaches flash through corefs_replace_commit() only
+    if (file->flags & COREFS_O_REPLACE)
     {
-        // Free all data blocks
-        for (uint32_t i = 0; i < file->inode->blocks_used; i++)
-        {
-            if (file->inode->block_list[i] != 0)
-            {
-                corefs_block_free(ctx, file->inode->block_list[i]);
-            }
-        }
-        file->inode->size = 0;
-        file->inode->blocks_used = 0;
-        memset(file->inode->block_list, 0, sizeof(file->inode->block_list));
-        file->dirty = true;
+        return;
     }
 
-    // Append: seek to end
-    if (flags & COREFS_O_APPEND)
+    file->dirty = true;
+
+    // Write-through instances persist the new size and block list now
+    if (ctx->config.write_policy == COREFS_WRITE_THROUGH && node_store(ctx, file->node) == ESP_OK)
     {
-        file->position = file->inode->size;
+        file->dirty = false;
     }
-
-    ctx->open_files[slot] = file;
-
-    ESP_LOGD(TAG, "Opened '%s' at inode block %u (size: %llu)",
-             path, inode_block, file->inode->size);
-
-    return file;
 }
 
 // ============================================
-// READ
+// OPEN INODE TABLE
 // ============================================
-
-int corefs_read(corefs_file_t *file, void *buf, size_t size)
+// Handles to the same file share one node. ctx->nodes grows like the
+// descriptor table and is changed under dir_lock exclusively. A node
+// only holds its inode while a call uses it (pinned by node_rdlock()
+// or node_wrlock()) or while it is one of the config.inode_cache most
+// recently used; an idle one is written back if it changed and dropped,
+// and read again on next use. node_lock guards residency; a node's
+// rwlock is one of ctx->node_locks, picked by its inode block.
+
+static uint32_t node_crc(corefs_inode_t *inode)
 {
-    if (!file || !file->inode || !buf)
-    {
-        return -1;
-    }
-
-    corefs_ctx_t *ctx = corefs_get_context();
-    if (!ctx->mounted)
-    {
-        return -1;
-    }
+    uint32_t stored = inode->checksum;
+    inode->checksum = 0;
+    uint32_t crc = crc32(inode, sizeof(corefs_inode_t));
+    inode->checksum = stored;
+    return crc;
+}
 
-    // Check read permission
-    if ((file->flags & 0x03) == COREFS_O_WRONLY)
+// Writes the node's inode and remembers it as the copy on flash
+static esp_err_t node_store(corefs_ctx_t *ctx, corefs_node_t *node)
+{
+    esp_err_t ret = corefs_inode_write(ctx, node->inode_block, node->inode);
+    if (ret == ESP_OK)
     {
-        ESP_LOGE(TAG, "File not opened for reading");
-        return -1;
+        node->crc = node_crc(node->inode);
     }
+    return ret;
+}
 
-    // Check EOF
-    if (file->position >= file->inode->size)
+// Writes inode to a new block and points path's entry at it with one
+// root write (corefs_btree_update()), then frees the old *inode_block.
+// A power cut leaves the old inode or the new one; an in-place write
+// erases the only copy first. Caller holds dir_lock exclusively.
+static esp_err_t inode_commit(corefs_ctx_t *ctx, const char *path, uint32_t *inode_block,
+                              const corefs_inode_t *inode)
+{
+    uint32_t block = 0;
+    esp_err_t ret = corefs_inode_relocate(ctx, inode, &block);
+    if (ret == ESP_OK)
     {
-        return 0;
+        ret = corefs_btree_update(ctx, path, block);
+        if (ret != ESP_OK)
+        {
+            corefs_block_free(ctx, block);
+        }
     }
 
-    // Limit to available data
-    size_t available = file->inode->size - file->position;
-    if (size > available)
+    if (ret == ESP_OK)
     {
-        size = available;
+        corefs_block_free(ctx, *inode_block);
+        *inode_block = block;
     }
+    return ret;
+}
 
-    size_t total_read = 0;
-    uint8_t *dst = (uint8_t *)buf;
+// node_store() through inode_commit(). The node keeps its lock stripe
+// and is found by the new block. Caller holds dir_lock exclusively and
+// the node's write lock.
+static esp_err_t node_commit(corefs_ctx_t *ctx, corefs_node_t *node)
+{
+    char path[sizeof(node->name) + 1];
+    snprintf(path, sizeof(path), "/%s", node->name);
 
-    // Allocate block buffer
-    uint8_t *block_buf = malloc(COREFS_BLOCK_SIZE);
-    if (!block_buf)
+    esp_err_t ret = inode_commit(ctx, path, &node->inode_block, node->inode);
+    if (ret == ESP_OK)
     {
-        return -1;
+        node->crc = node_crc(node->inode);
     }
+    return ret;
+}
 
-    while (size > 0 && file->position < file->inode->size)
+// Drops the inode of the least recently used idle node. Caller holds
+// node_lock.
+static bool node_evict(corefs_ctx_t *ctx)
+{
+    corefs_node_t *victim = NULL;
+    for (uint32_t i = 0; i < ctx->nodes_cap; i++)
     {
-        uint32_t block_idx = file->position / COREFS_BLOCK_SIZE;
-        uint32_t block_offset = file->position % COREFS_BLOCK_SIZE;
-
-        if (block_idx >= file->inode->blocks_used)
-        {
-            break;
-        }
-
-        uint32_t block_num = file->inode->block_list[block_idx];
-        if (block_num == 0)
-        {
-            break;
-        }
-
-        // Read block
-        esp_err_t ret = corefs_block_read(ctx, block_num, block_buf);
-        if (ret != ESP_OK)
-        {
-            free(block_buf);
-            return -1;
-        }
-
-        // Copy data
-        size_t to_read = COREFS_BLOCK_SIZE - block_offset;
-        if (to_read > size)
+        corefs_node_t *node = ctx->nodes[i];
+        if (node && node->inode && node->users == 0 &&
+            (!victim || (int32_t)(node->used - victim->used) < 0))
         {
-            to_read = size;
+            victim = node;
         }
-
-        memcpy(dst, block_buf + block_offset, to_read);
-
-        dst += to_read;
-        file->position += to_read;
-        total_read += to_read;
-        size -= to_read;
     }
-
-    free(block_buf);
-    return (int)total_read;
-}
-
-// ============================================
-// WRITE
-// ============================================
-
-int corefs_write(corefs_file_t *file, const void *buf, size_t size)
-{
-    if (!file || !file->inode || !buf)
+    if (!victim)
     {
-        return -1;
+        return false;
     }
 
-    corefs_ctx_t *ctx = corefs_get_context();
-    if (!ctx->mounted)
+    // Changes not yet on flash would be lost; a failed write keeps them
+    if (!ctx->read_only && node_crc(victim->inode) != victim->crc &&
+        node_store(ctx, victim) != ESP_OK)
     {
-        return -1;
+        return false;
     }
 
-    // Check write permission
-    if ((file->flags & COREFS_O_RDONLY))
-    {
-        ESP_LOGE(TAG, "File not open for writing");
-        return -1;
-    }
+    corefs_mem_free(ctx, victim->inode);
+    victim->inode = NULL;
+    ctx->nodes_resident--;
+    return true;
+}
 
-    size_t total_written = 0;
-    const uint8_t *src = (const uint8_t *)buf;
+// Makes the inode resident until node_unpin()
+static esp_err_t node_pin(corefs_ctx_t *ctx, corefs_node_t *node)
+{
+    esp_err_t ret = ESP_OK;
 
-    // Allocate block buffer
-    uint8_t *block_buf = malloc(COREFS_BLOCK_SIZE);
-    if (!block_buf)
-    {
-        return -1;
-    }
+    corefs_node_lock(ctx);
+    node->users++;
+    node->used = ++ctx->nodes_tick;
 
-    while (size > 0)
+    if (!node->inode)
     {
-        uint32_t block_idx = file->position / COREFS_BLOCK_SIZE;
-        uint32_t block_offset = file->position % COREFS_BLOCK_SIZE;
-
-        // Check if we need a new block
-        if (block_idx >= file->inode->blocks_used)
+        // Past the limit only while every cached inode is in use
+        while (ctx->nodes_resident >= ctx->config.inode_cache)
         {
-            if (block_idx >= COREFS_MAX_BLOCKS)
-            {
-                ESP_LOGE(TAG, "File too large (max %u blocks)", COREFS_MAX_BLOCKS);
-                free(block_buf);
-                return (total_written > 0) ? (int)total_written : -1;
-            }
-
-            // Allocate new block
-            uint32_t new_block = corefs_block_alloc(ctx);
-            if (new_block == 0)
+            if (!node_evict(ctx))
             {
-                ESP_LOGE(TAG, "No free blocks");
-                free(block_buf);
-                return (total_written > 0) ? (int)total_written : -1;
+                break;
             }
-
-            file->inode->block_list[block_idx] = new_block;
-            file->inode->blocks_used++;
         }
 
-        uint32_t block_num = file->inode->block_list[block_idx];
-
-        // Read-modify-write
-        memset(block_buf, 0, COREFS_BLOCK_SIZE);
-        if (block_offset != 0 || size < COREFS_BLOCK_SIZE)
+        corefs_inode_t *inode = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
+        while (!inode && node_evict(ctx))
         {
-            // Partial block write - read existing data
-            corefs_block_read(ctx, block_num, block_buf);
+            inode = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
         }
 
-        // Copy new data
-        size_t to_write = COREFS_BLOCK_SIZE - block_offset;
-        if (to_write > size)
+        ret = inode ? corefs_inode_read(ctx, node->inode_block, inode) : ESP_ERR_NO_MEM;
+        if (ret == ESP_OK)
         {
-            to_write = size;
+            // Records found past the inode's end are found again on the
+            // next load, so they alone don't make it worth a write
+            ret = records_recover(ctx, inode);
+            node->crc = node_crc(inode);
         }
 
-        memcpy(block_buf + block_offset, src, to_write);
-
-        // Write block
-        esp_err_t ret = corefs_block_write(ctx, block_num, block_buf);
-        if (ret != ESP_OK)
+        if (ret == ESP_OK)
         {
-            free(block_buf);
-            return (total_written > 0) ? (int)total_written : -1;
+            node->inode = inode;
+            ctx->nodes_resident++;
         }
-
-        src += to_write;
-        file->position += to_write;
-        total_written += to_write;
-        size -= to_write;
-
-        // Update file size
-        if (file->position > file->inode->size)
+        else
         {
-            file->inode->size = file->position;
+            corefs_mem_free(ctx, inode);
+            node->users--;
         }
     }
+    corefs_node_unlock(ctx);
+    return ret;
+}
 
-    free(block_buf);
-    file->dirty = true;
+static void node_unpin(corefs_ctx_t *ctx, corefs_node_t *node)
+{
+    corefs_node_lock(ctx);
+    node->users--;
+    corefs_node_unlock(ctx);
+}
 
-    return (int)total_written;
+// node->inode may be used between a successful lock and its unlock
+static esp_err_t node_rdlock(corefs_ctx_t *ctx, corefs_node_t *node)
+{
+    corefs_rwlock_rdlock(node->lock);
+    esp_err_t ret = node_pin(ctx, node);
+    if (ret != ESP_OK)
+    {
+        corefs_rwlock_rdunlock(node->lock);
+    }
+    return ret;
 }
 
-// ============================================
-// SEEK
-// ============================================
+static void node_rdunlock(corefs_ctx_t *ctx, corefs_node_t *node)
+{
+    node_unpin(ctx, node);
+    corefs_rwlock_rdunlock(node->lock);
+}
 
-int corefs_seek(corefs_file_t *file, int offset, int whence)
+static esp_err_t node_wrlock(corefs_ctx_t *ctx, corefs_node_t *node)
 {
-    if (!file || !file->inode)
+    corefs_rwlock_wrlock(node->lock);
+    esp_err_t ret = node_pin(ctx, node);
+    if (ret != ESP_OK)
     {
-        return -1;
+        corefs_rwlock_wrunlock(node->lock);
     }
+    return ret;
+}
 
-    int new_pos = file->position;
+static void node_wrunlock(corefs_ctx_t *ctx, corefs_node_t *node)
+{
+    node_unpin(ctx, node);
+    corefs_rwlock_wrunlock(node->lock);
+}
 
-    switch (whence)
+static bool node_grow(corefs_ctx_t *ctx)
+{
+    uint32_t cap = ctx->nodes_cap ? ctx->nodes_cap * 2 : COREFS_FD_TABLE_MIN;
+    if (cap > ctx->config.max_files)
     {
-    case COREFS_SEEK_SET:
-        new_pos = offset;
-        break;
-    case COREFS_SEEK_CUR:
-        new_pos += offset;
-        break;
-    case COREFS_SEEK_END:
-        new_pos = file->inode->size + offset;
-        break;
-    default:
-        return -1;
+        cap = ctx->config.max_files;
+    }
+    if (cap <= ctx->nodes_cap)
+    {
+        return false;
     }
 
-    if (new_pos < 0)
+    corefs_node_t **nodes = corefs_mem_alloc(ctx, cap * sizeof(corefs_node_t *));
+    if (!nodes)
     {
-        new_pos = 0;
+        return false;
     }
 
-    file->position = new_pos;
-    return new_pos;
-}
+    if (ctx->nodes_cap > 0)
+    {
+        memcpy(nodes, ctx->nodes, ctx->nodes_cap * sizeof(corefs_node_t *));
+    }
+    memset(nodes + ctx->nodes_cap, 0, (cap - ctx->nodes_cap) * sizeof(corefs_node_t *));
+    corefs_mem_free(ctx, ctx->nodes);
 
-size_t corefs_tell(corefs_file_t *file)
-{
-    return file ? file->position : 0;
+    ctx->nodes = nodes;
+    ctx->nodes_cap = cap;
+    return true;
 }
 
-size_t corefs_size(corefs_file_t *file)
+// Open node of inode_block, or NULL. Caller holds dir_lock.
+static corefs_node_t *node_find(corefs_ctx_t *ctx, uint32_t inode_block)
 {
-    return (file && file->inode) ? file->inode->size : 0;
+    for (uint32_t i = 0; i < ctx->nodes_cap; i++)
+    {
+        if (ctx->nodes[i] && ctx->nodes[i]->inode_block == inode_block)
+        {
+            return ctx->nodes[i];
+        }
+    }
+    return NULL;
 }
 
-// ============================================
-// CLOSE
-// ============================================
-
-esp_err_t corefs_close(corefs_file_t *file)
+static corefs_node_t *node_get(corefs_ctx_t *ctx, uint32_t inode_block, const char *name)
 {
-    if (!file)
+    corefs_node_t *node = node_find(ctx, inode_block);
+    if (node)
     {
-        return ESP_ERR_INVALID_ARG;
+        node->refs++;
+        return node;
     }
 
-    corefs_ctx_t *ctx = corefs_get_context();
-
-    // Write inode if modified
-    if (file->dirty)
+    uint32_t slot = 0;
+    while (slot < ctx->nodes_cap && ctx->nodes[slot])
+    {
+        slot++;
+    }
+    if (slot == ctx->nodes_cap && !node_grow(ctx))
     {
-        corefs_inode_write(ctx, file->inode_block, file->inode);
+        return NULL;
     }
 
-    // Remove from open files
-    for (int i = 0; i < COREFS_MAX_OPEN_FILES; i++)
+    node = corefs_mem_calloc(ctx, sizeof(corefs_node_t));
+    if (!node)
     {
-        if (ctx->open_files[i] == file)
-        {
-            ctx->open_files[i] = NULL;
-            break;
-        }
+        return NULL;
     }
 
-    // Free resources
-    if (file->inode)
+    node->inode_block = inode_block;
+    node->refs = 1;
+    node->lock = &ctx->node_locks[inode_block % COREFS_NODE_LOCKS];
+    strncpy(node->name, name, sizeof(node->name) - 1);
+
+    // Not shared yet: loading it checks the inode before it goes in
+    if (node_pin(ctx, node) != ESP_OK)
     {
-        free(file->inode);
+        corefs_mem_free(ctx, node);
+        return NULL;
     }
-    free(file);
+    node_unpin(ctx, node);
 
-    return ESP_OK;
+    ctx->nodes[slot] = node;
+    return node;
+}
+
+static void node_put(corefs_ctx_t *ctx, corefs_node_t *node)
+{
+    if (--node->refs > 0)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < ctx->nodes_cap; i++)
+    {
+        if (ctx->nodes[i] == node)
+        {
+            ctx->nodes[i] = NULL;
+            break;
+        }
+    }
+
+    corefs_node_lock(ctx);
+    if (node->inode)
+    {
+        corefs_mem_free(ctx, node->inode);
+        ctx->nodes_resident--;
+    }
+    corefs_node_unlock(ctx);
+    corefs_mem_free(ctx, node);
+}
+
+/**
+ * Whether inode_block is open. Caller holds dir_lock.
+ */
+bool corefs_file_is_open(corefs_ctx_t *ctx, uint32_t inode_block)
+{
+    return node_find(ctx, inode_block) != NULL;
+}
+
+/**
+ * Write file's inode if the handle changed it; a record file's goes out
+ * of place. Caller holds dir_lock exclusively, which keeps file open.
+ */
+esp_err_t corefs_file_store(corefs_file_t *file)
+{
+    if (!file->dirty)
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = node_wrlock(file->ctx, file->node);
+    if (ret == ESP_OK)
+    {
+        ret = (file->node->inode->flags & COREFS_INODE_RECORDS) ? node_commit(file->ctx, file->node)
+                                                               : node_store(file->ctx, file->node);
+        if (ret == ESP_OK)
+        {
+            file->dirty = false;
+        }
+        node_wrunlock(file->ctx, file->node);
+    }
+    return ret;
+}
+
+/**
+ * Inode flags (COREFS_INODE_*) of an open file, 0 on error
+ */
+uint16_t corefs_file_inode_flags(corefs_file_t *file)
+{
+    if (!file || !file->node || node_rdlock(file->ctx, file->node) != ESP_OK)
+    {
+        return 0;
+    }
+
+    uint16_t flags = file->node->inode->flags;
+    node_rdunlock(file->ctx, file->node);
+    return flags;
+}
+
+// ============================================
+// DESCRIPTOR TABLE
+// ============================================
+// ctx->files is indexed by descriptor, so a lookup is a bounds check
+// and a load. The table doubles on demand up to config.max_files (in
+// arena mode it is carved at full size on mount); the lowest free
+// descriptor is handed out first. Callers hold dir_lock exclusively,
+// lookups hold it shared.
+
+esp_err_t corefs_file_table_init(corefs_ctx_t *ctx)
+{
+    ctx->files = NULL;
+    ctx->files_cap = 0;
+    ctx->files_free = 0;
+    ctx->nodes = NULL;
+    ctx->nodes_cap = 0;
+    ctx->nodes_resident = 0;
+    ctx->nodes_tick = 0;
+
+    if (ctx->arena.base)
+    {
+        ctx->files = corefs_mem_carve(ctx, ctx->config.max_files * sizeof(corefs_file_t *));
+        ctx->nodes = corefs_mem_carve(ctx, ctx->config.max_files * sizeof(corefs_node_t *));
+        if (!ctx->files || !ctx->nodes)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        ctx->files_cap = ctx->config.max_files;
+        ctx->nodes_cap = ctx->config.max_files;
+    }
+    return ESP_OK;
+}
+
+void corefs_file_table_cleanup(corefs_ctx_t *ctx)
+{
+    corefs_mem_free(ctx, ctx->files);
+    ctx->files = NULL;
+    ctx->files_cap = 0;
+    ctx->files_free = 0;
+    corefs_mem_free(ctx, ctx->nodes);
+    ctx->nodes = NULL;
+    ctx->nodes_cap = 0;
+}
+
+static bool fd_grow(corefs_ctx_t *ctx)
+{
+    uint32_t cap = ctx->files_cap ? ctx->files_cap * 2 : COREFS_FD_TABLE_MIN;
+    if (cap > ctx->config.max_files)
+    {
+        cap = ctx->config.max_files;
+    }
+    if (cap <= ctx->files_cap)
+    {
+        return false;
+    }
+
+    corefs_file_t **files = corefs_mem_alloc(ctx, cap * sizeof(corefs_file_t *));
+    if (!files)
+    {
+        return false;
+    }
+
+    if (ctx->files_cap > 0)
+    {
+        memcpy(files, ctx->files, ctx->files_cap * sizeof(corefs_file_t *));
+    }
+    memset(files + ctx->files_cap, 0, (cap - ctx->files_cap) * sizeof(corefs_file_t *));
+    corefs_mem_free(ctx, ctx->files);
+
+    ctx->files = files;
+    ctx->files_cap = cap;
+    return true;
+}
+
+static int fd_alloc(corefs_ctx_t *ctx, corefs_file_t *file)
+{
+    uint32_t fd = ctx->files_free;
+    while (fd < ctx->files_cap && ctx->files[fd])
+    {
+        fd++;
+    }
+
+    if (fd == ctx->files_cap && !fd_grow(ctx))
+    {
+        return -1;
+    }
+
+    ctx->files[fd] = file;
+    ctx->files_free = fd + 1;
+    return (int)fd;
+}
+
+static void fd_release(corefs_ctx_t *ctx, int fd)
+{
+    ctx->files[fd] = NULL;
+    if ((uint32_t)fd < ctx->files_free)
+    {
+        ctx->files_free = fd;
+    }
+}
+
+corefs_file_t *corefs_fs_get_file(corefs_ctx_t *ctx, int fd)
+{
+    if (!ctx || !ctx->mounted || fd < 0)
+    {
+        return NULL;
+    }
+
+    corefs_rwlock_rdlock(&ctx->dir_lock);
+    corefs_file_t *file = ((uint32_t)fd < ctx->files_cap) ? ctx->files[fd] : NULL;
+    corefs_rwlock_rdunlock(&ctx->dir_lock);
+    return file;
+}
+
+int corefs_fileno(corefs_file_t *file)
+{
+    return file ? file->fd : -1;
+}
+
+// Name of the directory entry the file was opened through, kept in the
+// shared node and updated by corefs_rename()
+const char *corefs_name(corefs_file_t *file)
+{
+    return (file && file->node) ? file->node->name : NULL;
+}
+
+// ============================================
+// OPEN
+// ============================================
+
+// Caller holds dir_lock, which is released
+static corefs_file_t *open_abort(corefs_ctx_t *ctx, corefs_file_t *file)
+{
+    fd_release(ctx, file->fd);
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+    corefs_mem_free(ctx, file);
+    return NULL;
+}
+
+corefs_file_t *corefs_fs_open(corefs_ctx_t *ctx, const char *path, uint32_t flags)
+{
+    if (!ctx || !ctx->mounted || !path)
+    {
+        return NULL;
+    }
+
+    // A snapshot mount only opens files for reading
+    if (ctx->read_only && (flags & (COREFS_O_WRONLY | COREFS_O_CREAT | COREFS_O_TRUNC | COREFS_O_APPEND)))
+    {
+        ESP_LOGE(TAG, "Read-only snapshot: %s", path);
+        return NULL;
+    }
+
+    // Allocate file handle
+    corefs_file_t *file = corefs_mem_calloc(ctx, sizeof(corefs_file_t));
+    if (!file)
+    {
+        return NULL;
+    }
+
+    corefs_rwlock_wrlock(&ctx->dir_lock);
+
+    // Take a descriptor before anything is created on flash
+    file->fd = fd_alloc(ctx, file);
+    if (file->fd < 0)
+    {
+        ESP_LOGE(TAG, "Too many open files");
+        corefs_rwlock_wrunlock(&ctx->dir_lock);
+        corefs_mem_free(ctx, file);
+        return NULL;
+    }
+
+    // Extract filename
+    const char *filename = path + 1; // Skip leading '/'
+
+    // Try to find existing file
+    int32_t inode_block = corefs_btree_find(ctx, path);
+
+    // If not found and CREAT flag set, create new
+    if (inode_block < 0 && (flags & COREFS_O_CREAT))
+    {
+        uint32_t new_inode_block = 0;
+        esp_err_t ret = corefs_inode_create(ctx, filename, &new_inode_block);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to create inode: %s", esp_err_to_name(ret));
+            return open_abort(ctx, file);
+        }
+
+        // Insert into B-Tree
+        ret = corefs_btree_insert(ctx, path, new_inode_block);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to insert into B-Tree: %s", esp_err_to_name(ret));
+            corefs_inode_delete(ctx, new_inode_block);
+            return open_abort(ctx, file);
+        }
+
+        inode_block = new_inode_block;
+    }
+
+    if (inode_block < 0)
+    {
+        ESP_LOGD(TAG, "File not found: %s", path);
+        return open_abort(ctx, file);
+    }
+
+    // Share the inode with other handles of this file
+    file->node = node_get(ctx, inode_block, path + 1);
+    if (!file->node)
+    {
+        return open_abort(ctx, file);
+    }
+
+    // Setup file handle
+    file->ctx = ctx;
+    file->position = 0;
+    file->flags = (uint16_t)(flags & ~(COREFS_O_REPLACE | COREFS_O_RING));
+    file->dirty = false;
+
+    if (node_wrlock(ctx, file->node) != ESP_OK)
+    {
+        node_put(ctx, file->node);
+        return open_abort(ctx, file);
+    }
+
+    // Placement hint sticks to the inode
+    if (flags & (COREFS_O_HOT | COREFS_O_COLD))
+    {
+        file->node->inode->flags &= ~(COREFS_INODE_HOT | COREFS_INODE_COLD);
+        file->node->inode->flags |= (flags & COREFS_O_HOT) ? COREFS_INODE_HOT : COREFS_INODE_COLD;
+        file->dirty = true;
+    }
+
+    // So does compression; framed records are appended as they are
+    if ((flags & COREFS_O_COMPRESS) &&
+        !(file->node->inode->flags & (COREFS_INODE_COMPRESSED | COREFS_INODE_RECORDS)))
+    {
+        file->node->inode->flags |= COREFS_INODE_COMPRESSED;
+        file->dirty = true;
+    }
+
+    // Truncate if requested
+    if (flags & COREFS_O_TRUNC)
+    {
+        // Replacing contents counts as a rewrite
+        if (file->node->inode->size > 0)
+        {
+            note_rewrite(file);
+        }
+
+        // Free all data blocks; a ring keeps its blocks and only empties
+        if (is_ring(file->node->inode))
+        {
+            file->node->inode->size = 0;
+        }
+        else
+        {
+            shrink_to(file, 0);
+        }
+        file->dirty = true;
+    }
+
+    if (is_ring(file->node->inode))
+    {
+        file->flags |= COREFS_O_RING;
+    }
+
+    // Append: seek to end
+    if (flags & COREFS_O_APPEND)
+    {
+        file->position = file_length(file->node->inode);
+    }
+
+    ESP_LOGD(TAG, "Opened '%s' at inode block %u (size: %llu)",
+             path, inode_block, file->node->inode->size);
+
+    node_wrunlock(ctx, file->node);
+
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+
+    return file;
+}
+
+corefs_file_t *corefs_open(const char *path, uint32_t flags)
+{
+    return corefs_fs_open(corefs_get_context(), path, flags);
+}
+
+// Gives an empty file the fixed block set of a ring. Caller holds the
+// node lock exclusively.
+static esp_err_t ring_setup(corefs_file_t *file, uint32_t max_size)
+{
+    corefs_ctx_t *ctx = file->ctx;
+    corefs_inode_t *inode = file->node->inode;
+    corefs_class_t cls = corefs_inode_class(inode);
+
+    // One block is always being overwritten, so two is the least useful
+    uint32_t count = (max_size + COREFS_BLOCK_SIZE - 1) / COREFS_BLOCK_SIZE;
+    if (count < 2)
+    {
+        count = 2;
+    }
+    if (count > COREFS_MAX_BLOCKS)
+    {
+        count = COREFS_MAX_BLOCKS;
+    }
+
+    // One run keeps the lap on as few sectors as possible
+    uint32_t run = corefs_block_alloc_run(ctx, count, cls);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t block = run ? run + i : corefs_block_alloc_class(ctx, cls);
+        if (block == 0)
+        {
+            ESP_LOGE(TAG, "No free blocks for a %u block ring", count);
+            for (uint32_t j = 0; j < i; j++)
+            {
+                corefs_block_free(ctx, inode->block_list[j]);
+                inode->block_list[j] = 0;
+            }
+            return ESP_ERR_NO_MEM;
+        }
+        inode->block_list[i] = block;
+        set_chunk(inode, i, false);
+    }
+
+    inode->blocks_used = count;
+    inode->size = 0;
+    inode->flags |= COREFS_INODE_RING;
+    file->flags |= COREFS_O_RING;
+
+    // The block set is the file's shape; don't leave it to the write policy
+    esp_err_t ret = node_store(ctx, file->node);
+    if (ret == ESP_OK)
+    {
+        file->dirty = false;
+    }
+    return ret;
+}
+
+/**
+ * Open path as a ring file: appends go to the end as usual, but once
+ * max_size (rounded up to whole blocks) is reached each new block
+ * overwrites the oldest one in place. Reads and seeks count from the
+ * oldest byte still held. An empty or newly created file becomes a
+ * ring; an existing ring keeps its capacity; any other file is refused.
+ */
+corefs_file_t *corefs_fs_open_ring(corefs_ctx_t *ctx, const char *path, uint32_t flags,
+                                   uint32_t max_size)
+{
+    corefs_file_t *file = corefs_fs_open(ctx, path, flags);
+    if (!file || (file->flags & COREFS_O_RING))
+    {
+        return file;
+    }
+
+    esp_err_t ret = node_wrlock(ctx, file->node);
+    if (ret == ESP_OK)
+    {
+        corefs_inode_t *inode = file->node->inode;
+        ret = ESP_ERR_INVALID_STATE;
+        if (inode->size == 0 && inode->blocks_used == 0 && (file->flags & 0x03) != COREFS_O_RDONLY)
+        {
+            ret = ring_setup(file, max_size);
+        }
+        node_wrunlock(ctx, file->node);
+    }
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot open '%s' as a ring: %s", path, esp_err_to_name(ret));
+        corefs_close(file);
+        return NULL;
+    }
+    return file;
+}
+
+corefs_file_t *corefs_open_ring(const char *path, uint32_t flags, uint32_t max_size)
+{
+    return corefs_fs_open_ring(corefs_get_context(), path, flags, max_size);
+}
+
+// ============================================
+// SCATTER / GATHER
+// ============================================
+// Reads and writes walk the target blocks once and copy segments in and
+// out through a cursor, so each block is programmed once per call no
+// matter how many segments land in it.
+
+typedef struct
+{
+    const struct iovec *iov;
+    int iovcnt;
+    int index;
+    size_t offset; // Within iov[index]
+} iov_cursor_t;
+
+// Total length, or -1 if the array is invalid or too long for an int
+static int iov_total(const struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+
+    if (!iov || iovcnt < 0)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < iovcnt; i++)
+    {
+        if (!iov[i].iov_base && iov[i].iov_len > 0)
+        {
+            return -1;
+        }
+        if (iov[i].iov_len > (size_t)INT32_MAX - total)
+        {
+            return -1;
+        }
+        total += iov[i].iov_len;
+    }
+
+    return (int)total;
+}
+
+static void iov_gather(iov_cursor_t *cur, uint8_t *dst, size_t n)
+{
+    while (n > 0 && cur->index < cur->iovcnt)
+    {
+        const struct iovec *v = &cur->iov[cur->index];
+        size_t chunk = v->iov_len - cur->offset;
+        if (chunk > n)
+        {
+            chunk = n;
+        }
+
+        memcpy(dst, (const uint8_t *)v->iov_base + cur->offset, chunk);
+        dst += chunk;
+        n -= chunk;
+        cur->offset += chunk;
+
+        if (cur->offset == v->iov_len)
+        {
+            cur->index++;
+            cur->offset = 0;
+        }
+    }
+}
+
+static void iov_scatter(iov_cursor_t *cur, const uint8_t *src, size_t n)
+{
+    while (n > 0 && cur->index < cur->iovcnt)
+    {
+        const struct iovec *v = &cur->iov[cur->index];
+        size_t chunk = v->iov_len - cur->offset;
+        if (chunk > n)
+        {
+            chunk = n;
+        }
+
+        memcpy((uint8_t *)v->iov_base + cur->offset, src, chunk);
+        src += chunk;
+        n -= chunk;
+        cur->offset += chunk;
+
+        if (cur->offset == v->iov_len)
+        {
+            cur->index++;
+            cur->offset = 0;
+        }
+    }
+}
+
+// Caller memory for the next n bytes if they lie in the current
+// segment, so whole blocks skip the bounce buffer
+static uint8_t *iov_direct(const iov_cursor_t *cur, size_t n)
+{
+    if (cur->index >= cur->iovcnt)
+    {
+        return NULL;
+    }
+
+    const struct iovec *v = &cur->iov[cur->index];
+    if (v->iov_len - cur->offset < n)
+    {
+        return NULL;
+    }
+    return (uint8_t *)v->iov_base + cur->offset;
+}
+
+// Consumes n bytes returned by iov_direct()
+static void iov_advance(iov_cursor_t *cur, size_t n)
+{
+    cur->offset += n;
+    if (cur->offset == cur->iov[cur->index].iov_len)
+    {
+        cur->index++;
+        cur->offset = 0;
+    }
+}
+
+// ============================================
+// COMPRESSION
+// ============================================
+
+static bool is_compressed(const corefs_inode_t *inode)
+{
+    return (inode->flags & COREFS_INODE_COMPRESSED) != 0;
+}
+
+// Whether block slot of a compressed file was written as a chunk
+static bool is_chunk(const corefs_inode_t *inode, uint32_t slot)
+{
+    return (inode->chunks[slot / 8] >> (slot % 8)) & 1;
+}
+
+static void set_chunk(corefs_inode_t *inode, uint32_t slot, bool chunk)
+{
+    if (chunk)
+    {
+        inode->chunks[slot / 8] |= (uint8_t)(1u << (slot % 8));
+    }
+    else
+    {
+        inode->chunks[slot / 8] &= (uint8_t)~(1u << (slot % 8));
+    }
+}
+
+// Expands a chunk into buf; false if it is damaged
+static bool chunk_unpack(const uint8_t *chunk, uint8_t *buf)
+{
+    const corefs_chunk_hdr_t *hdr = (const corefs_chunk_hdr_t *)chunk;
+    if (hdr->magic != COREFS_CHUNK_MAGIC || hdr->len > COREFS_CHUNK_MAX)
+    {
+        return false;
+    }
+
+    uint32_t crc = crc32_update(0xFFFFFFFF, &hdr->len, sizeof(hdr->len));
+    crc = crc32_finalize(crc32_update(crc, hdr + 1, hdr->len));
+    return crc == hdr->crc &&
+           corefs_lz_decompress((const uint8_t *)(hdr + 1), hdr->len, buf,
+                                COREFS_BLOCK_SIZE) == COREFS_BLOCK_SIZE;
+}
+
+// Reads the contents of block slot into buf. A compressed file's
+// blocks are chunks where their bit is set, raw where the data did not
+// shrink (or came from before the flag was set).
+static esp_err_t data_read(corefs_ctx_t *ctx, const corefs_inode_t *inode, uint32_t slot,
+                           uint32_t block, uint8_t *buf)
+{
+    if (!is_compressed(inode) || !is_chunk(inode, slot))
+    {
+        return corefs_block_read(ctx, block, buf);
+    }
+
+    uint8_t *chunk = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!chunk)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = corefs_block_read(ctx, block, chunk);
+    if (ret == ESP_OK && !chunk_unpack(chunk, buf))
+    {
+        ESP_LOGE(TAG, "'%s': damaged chunk in block %u", inode->name, block);
+        ret = ESP_ERR_INVALID_CRC;
+    }
+
+    corefs_mem_free(ctx, chunk);
+    return ret;
+}
+
+// Writes block slot from buf, compressed if the file asks for it and
+// the chunk comes out smaller than the block; the slot's chunk bit
+// records which. A block still holding file data (blank is false) is
+// not switched between the two in place, or the inode on flash would
+// read the new contents the old way: they go to a new block, *block,
+// and *moved receives the old one for the caller to free once the
+// inode is on flash. The erased rest of a chunk's block is not
+// programmed.
+static esp_err_t data_write(corefs_ctx_t *ctx, corefs_inode_t *inode, uint32_t slot,
+                            uint32_t *block, bool blank, const uint8_t *buf, uint32_t *moved)
+{
+    *moved = 0;
+    if (!is_compressed(inode))
+    {
+        return corefs_block_write(ctx, *block, buf);
+    }
+
+    uint8_t *chunk = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    uint16_t *table = corefs_mem_alloc(ctx, sizeof(uint16_t) << COREFS_LZ_HASH_BITS);
+    if (!chunk || !table)
+    {
+        corefs_mem_free(ctx, chunk);
+        corefs_mem_free(ctx, table);
+        return ESP_ERR_NO_MEM;
+    }
+
+    corefs_chunk_hdr_t *hdr = (corefs_chunk_hdr_t *)chunk;
+    uint32_t len = corefs_lz_compress(buf, COREFS_BLOCK_SIZE, (uint8_t *)(hdr + 1),
+                                      COREFS_CHUNK_MAX, table);
+    if (len)
+    {
+        hdr->magic = COREFS_CHUNK_MAGIC;
+        hdr->len = (uint16_t)len;
+        uint32_t crc = crc32_update(0xFFFFFFFF, &hdr->len, sizeof(hdr->len));
+        hdr->crc = crc32_finalize(crc32_update(crc, hdr + 1, len));
+        memset((uint8_t *)(hdr + 1) + len, 0xFF, COREFS_CHUNK_MAX - len);
+    }
+
+    esp_err_t ret = ESP_OK;
+    uint32_t target = *block;
+    if (!blank && (len != 0) != is_chunk(inode, slot))
+    {
+        target = corefs_block_alloc_class(ctx, corefs_inode_class(inode));
+        if (target == 0)
+        {
+            ESP_LOGE(TAG, "No free blocks");
+            ret = ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (ret == ESP_OK)
+    {
+        ret = corefs_block_write(ctx, target, len ? chunk : buf);
+        if (ret != ESP_OK && target != *block)
+        {
+            corefs_block_free(ctx, target);
+        }
+    }
+
+    if (ret == ESP_OK)
+    {
+        if (target != *block)
+        {
+            inode->block_list[slot] = target;
+            *moved = *block;
+            *block = target;
+        }
+        set_chunk(inode, slot, len != 0);
+
+        corefs_alloc_lock(ctx);
+        ctx->io_stats.compress_in += COREFS_BLOCK_SIZE;
+        ctx->io_stats.compress_out += len ? sizeof(*hdr) + len : COREFS_BLOCK_SIZE;
+        corefs_alloc_unlock(ctx);
+    }
+
+    corefs_mem_free(ctx, table);
+    corefs_mem_free(ctx, chunk);
+    return ret;
+}
+
+// ============================================
+// READ
+// ============================================
+
+// Reads at an explicit offset under the shared node lock; the handle
+// itself is not modified
+static int file_read_at(corefs_file_t *file, iov_cursor_t *dst, size_t size, uint32_t offset)
+{
+    corefs_ctx_t *ctx = file->ctx;
+
+    // Shared: other readers of this file proceed in parallel
+    if (node_rdlock(ctx, file->node) != ESP_OK)
+    {
+        return -1;
+    }
+
+    // Check EOF
+    uint32_t length = file_length(file->node->inode);
+    if (offset >= length)
+    {
+        node_rdunlock(ctx, file->node);
+        return 0;
+    }
+
+    // Limit to available data
+    size_t available = length - offset;
+    if (size > available)
+    {
+        size = available;
+    }
+
+    // Ring files: offset 0 is the oldest byte
+    uint32_t base = file_base(file->node->inode);
+
+    size_t total_read = 0;
+
+    // Allocate block buffer
+    uint8_t *block_buf = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!block_buf)
+    {
+        node_rdunlock(ctx, file->node);
+        return -1;
+    }
+
+    while (size > 0)
+    {
+        uint32_t block_idx = block_slot(file->node->inode, base + offset);
+        uint32_t block_offset = (base + offset) % COREFS_BLOCK_SIZE;
+
+        size_t to_read = COREFS_BLOCK_SIZE - block_offset;
+        if (to_read > size)
+        {
+            to_read = size;
+        }
+
+        // A hole reads as zeros
+        uint32_t block_num = (block_idx < file->node->inode->blocks_used)
+                                 ? file->node->inode->block_list[block_idx]
+                                 : 0;
+        if (block_num == 0)
+        {
+            memset(block_buf, 0, to_read);
+            iov_scatter(dst, block_buf, to_read);
+            offset += to_read;
+            total_read += to_read;
+            size -= to_read;
+            continue;
+        }
+
+        // A whole block goes straight into the caller's buffer
+        uint8_t *direct = (to_read == COREFS_BLOCK_SIZE) ? iov_direct(dst, to_read) : NULL;
+
+        // Read block
+        esp_err_t ret = data_read(ctx, file->node->inode, block_idx, block_num,
+                                  direct ? direct : block_buf);
+        if (ret != ESP_OK)
+        {
+            corefs_mem_free(ctx, block_buf);
+            node_rdunlock(ctx, file->node);
+            return -1;
+        }
+
+        // Copy data
+        if (direct)
+        {
+            iov_advance(dst, to_read);
+        }
+        else
+        {
+            iov_scatter(dst, block_buf + block_offset, to_read);
+        }
+
+        offset += to_read;
+        total_read += to_read;
+        size -= to_read;
+    }
+
+    corefs_mem_free(ctx, block_buf);
+    node_rdunlock(ctx, file->node);
+    return (int)total_read;
+}
+
+static bool file_readable(corefs_file_t *file)
+{
+    if (!file->ctx->mounted)
+    {
+        return false;
+    }
+
+    // Check read permission
+    if ((file->flags & 0x03) == COREFS_O_WRONLY)
+    {
+        ESP_LOGE(TAG, "File not opened for reading");
+        return false;
+    }
+
+    return true;
+}
+
+int corefs_read(corefs_file_t *file, void *buf, size_t size)
+{
+    if (!file || !file->node || !buf || !file_readable(file))
+    {
+        return -1;
+    }
+
+    struct iovec v = {.iov_base = buf, .iov_len = size};
+    iov_cursor_t dst = {.iov = &v, .iovcnt = 1};
+    int n = file_read_at(file, &dst, size, file->position);
+    if (n > 0)
+    {
+        file->position += n;
+    }
+    return n;
+}
+
+int corefs_pread(corefs_file_t *file, void *buf, size_t size, uint32_t offset)
+{
+    if (!file || !file->node || !buf || !file_readable(file))
+    {
+        return -1;
+    }
+
+    struct iovec v = {.iov_base = buf, .iov_len = size};
+    iov_cursor_t dst = {.iov = &v, .iovcnt = 1};
+    return file_read_at(file, &dst, size, offset);
+}
+
+int corefs_readv(corefs_file_t *file, const struct iovec *iov, int iovcnt)
+{
+    int size = iov_total(iov, iovcnt);
+    if (!file || !file->node || size < 0 || !file_readable(file))
+    {
+        return -1;
+    }
+
+    iov_cursor_t dst = {.iov = iov, .iovcnt = iovcnt};
+    int n = file_read_at(file, &dst, size, file->position);
+    if (n > 0)
+    {
+        file->position += n;
+    }
+    return n;
+}
+
+// ============================================
+// WRITE
+// ============================================
+
+// Writes size bytes gathered from src (zeros if src is NULL) at offset.
+// Caller holds the node lock exclusively. Returns bytes written.
+static size_t write_span(corefs_file_t *file, iov_cursor_t *src, size_t size,
+                         uint32_t offset, uint8_t *block_buf, bool *failed)
+{
+    corefs_ctx_t *ctx = file->ctx;
+    corefs_class_t cls = corefs_inode_class(file->node->inode);
+    size_t total_written = 0;
+
+    // Rings keep a fixed block set; compressed chunks are not compared
+    bool dedup = ctx->dedup &&
+                 !(file->node->inode->flags & (COREFS_INODE_RING | COREFS_INODE_COMPRESSED));
+
+    while (size > 0)
+    {
+        uint32_t block_idx = block_slot(file->node->inode, offset);
+        uint32_t block_offset = offset % COREFS_BLOCK_SIZE;
+        bool fresh = false;
+
+        size_t to_write = COREFS_BLOCK_SIZE - block_offset;
+        if (to_write > size)
+        {
+            to_write = size;
+        }
+
+        if (block_idx >= COREFS_MAX_BLOCKS)
+        {
+            ESP_LOGE(TAG, "File too large (max %u blocks)", COREFS_MAX_BLOCKS);
+            *failed = true;
+            break;
+        }
+
+        // Past the block list or a hole: needs a new block
+        if (block_idx >= file->node->inode->blocks_used ||
+            file->node->inode->block_list[block_idx] == 0)
+        {
+            // A block left partly filled will be rewritten by the next
+            // append, so it is placed as hot until the file moves on
+            bool tail = (block_offset + to_write < COREFS_BLOCK_SIZE);
+            uint32_t new_block = corefs_block_alloc_class(ctx, tail ? COREFS_CLASS_HOT : cls);
+            if (new_block == 0)
+            {
+                ESP_LOGE(TAG, "No free blocks");
+                *failed = true;
+                break;
+            }
+
+            file->node->inode->block_list[block_idx] = new_block;
+            if (block_idx >= file->node->inode->blocks_used)
+            {
+                file->node->inode->blocks_used = block_idx + 1;
+            }
+            fresh = true;
+        }
+
+        uint32_t block_num = file->node->inode->block_list[block_idx];
+
+        // Nothing of the file in it yet (new, preallocated or a ring
+        // block starting its next lap): no read
+        bool blank = fresh || offset - block_offset >= file->node->inode->size;
+
+        // A whole block is programmed from the caller's buffer
+        const uint8_t *direct = NULL;
+        if (src && to_write == COREFS_BLOCK_SIZE)
+        {
+            direct = iov_direct(src, to_write);
+        }
+
+        if (!direct)
+        {
+            // Read-modify-write
+            memset(block_buf, 0, COREFS_BLOCK_SIZE);
+            if (!blank && to_write < COREFS_BLOCK_SIZE)
+            {
+                // Partial block write - read existing data
+                data_read(ctx, file->node->inode, block_idx, block_num, block_buf);
+            }
+
+            // Copy new data
+            if (src)
+            {
+                iov_gather(src, block_buf + block_offset, to_write);
+            }
+            else
+            {
+                memset(block_buf + block_offset, 0, to_write);
+            }
+        }
+
+        // Same contents as a block on flash: take a reference to that
+        // one instead of programming this one
+        const uint8_t *image = direct ? direct : block_buf;
+        uint32_t hash = dedup ? crc32(image, COREFS_BLOCK_SIZE) : 0;
+        uint32_t same = dedup ? corefs_dedup_share(ctx, hash, image) : 0;
+        if (same)
+        {
+            file->node->inode->block_list[block_idx] = same;
+            corefs_block_free(ctx, block_num);
+            block_num = same;
+        }
+        else
+        {
+            // Not indexed while its contents change
+            if (!fresh)
+            {
+                corefs_dedup_forget(ctx, block_num);
+            }
+
+            // Shared with a clone: the data goes to a private copy
+            uint32_t shared = 0;
+            if (!fresh && corefs_block_is_shared(ctx, block_num))
+            {
+                uint32_t copy = corefs_block_alloc_class(ctx, cls);
+                if (copy == 0)
+                {
+                    ESP_LOGE(TAG, "No free blocks");
+                    *failed = true;
+                    break;
+                }
+                shared = block_num;
+                block_num = copy;
+            }
+
+            // Write block
+            uint32_t moved = 0;
+            esp_err_t ret = data_write(ctx, file->node->inode, block_idx, &block_num,
+                                       blank || shared, image, &moved);
+            if (ret != ESP_OK)
+            {
+                if (shared)
+                {
+                    corefs_block_free(ctx, block_num);
+                }
+                *failed = true;
+                break;
+            }
+
+            // The inode on flash reads the old block until it is
+            // rewritten, so that goes first; if it fails the old block
+            // stays allocated until mount rebuilds the bitmap
+            if (moved && node_store(ctx, file->node) == ESP_OK)
+            {
+                corefs_block_free(ctx, moved);
+            }
+
+            if (shared)
+            {
+                file->node->inode->block_list[block_idx] = block_num;
+                corefs_block_free(ctx, shared);
+
+                corefs_alloc_lock(ctx);
+                ctx->io_stats.cow_copies++;
+                corefs_alloc_unlock(ctx);
+            }
+
+            if (dedup)
+            {
+                corefs_dedup_insert(ctx, hash, block_num);
+            }
+        }
+
+        if (direct)
+        {
+            iov_advance(src, to_write);
+        }
+
+        // A filled tail settles into the file's own class
+        if (!same && block_offset + to_write == COREFS_BLOCK_SIZE)
+        {
+            corefs_block_set_class(ctx, block_num, cls);
+        }
+
+        offset += to_write;
+        total_written += to_write;
+        size -= to_write;
+
+        // Update file size
+        if (offset > file->node->inode->size)
+        {
+            file->node->inode->size = offset;
+        }
+    }
+
+    return total_written;
+}
+
+// Makes [size, new_size) read as zeros before the file grows over it.
+// The rest of the last block may hold stale bytes (shrunk file) and is
+// zeroed; preallocated blocks further out were never written and go
+// back to being holes. Caller holds the node lock exclusively.
+static void clear_gap(corefs_file_t *file, uint32_t new_size, uint8_t *block_buf, bool *failed)
+{
+    corefs_inode_t *inode = file->node->inode;
+    uint32_t size = inode->size;
+    uint32_t block_idx = size / COREFS_BLOCK_SIZE;
+
+    if (size % COREFS_BLOCK_SIZE != 0 && block_idx < inode->blocks_used &&
+        inode->block_list[block_idx] != 0)
+    {
+        uint32_t end = (block_idx + 1) * COREFS_BLOCK_SIZE;
+        if (end > new_size)
+        {
+            end = new_size;
+        }
+        if (write_span(file, NULL, end - size, size, block_buf, failed) != end - size)
+        {
+            *failed = true;
+            return;
+        }
+    }
+
+    uint32_t first = (size + COREFS_BLOCK_SIZE - 1) / COREFS_BLOCK_SIZE;
+    uint32_t last = (new_size + COREFS_BLOCK_SIZE - 1) / COREFS_BLOCK_SIZE;
+    for (uint32_t i = first; i < last && i < inode->blocks_used; i++)
+    {
+        if (inode->block_list[i] != 0)
+        {
+            corefs_block_free(file->ctx, inode->block_list[i]);
+            inode->block_list[i] = 0;
+            set_chunk(inode, i, false);
+        }
+    }
+}
+
+// Writes at an explicit offset (or at end of file for append handles)
+// under the exclusive node lock. Returns bytes written or -1, and the
+// offset after the data in *end.
+static int file_write_at(corefs_file_t *file, iov_cursor_t *src, size_t size,
+                         uint32_t offset, bool append, uint32_t *end)
+{
+    corefs_ctx_t *ctx = file->ctx;
+    size_t total_written = 0;
+    bool failed = false;
+
+    // Allocate block buffer
+    uint8_t *block_buf = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!block_buf)
+    {
+        return -1;
+    }
+
+    // Exclusive: size and block list change under readers' feet otherwise
+    if (node_wrlock(ctx, file->node) != ESP_OK)
+    {
+        corefs_mem_free(ctx, block_buf);
+        return -1;
+    }
+
+    // Framed records would be cut by raw bytes
+    if (file->node->inode->flags & COREFS_INODE_RECORDS)
+    {
+        ESP_LOGE(TAG, "'%s' takes framed records only", file->node->name);
+        node_wrunlock(ctx, file->node);
+        corefs_mem_free(ctx, block_buf);
+        return -1;
+    }
+
+    // Appends land at the current end, even with other writers. Ring
+    // files take nothing but appends.
+    bool ring = is_ring(file->node->inode);
+    if (append || ring)
+    {
+        offset = file->node->inode->size;
+    }
+
+    if (size > 0 && offset < file->node->inode->size)
+    {
+        note_rewrite(file);
+    }
+
+    // Writing past the end leaves a hole
+    if (size > 0 && offset > file->node->inode->size)
+    {
+        clear_gap(file, offset, block_buf, &failed);
+    }
+
+    if (!failed)
+    {
+        total_written = write_span(file, src, size, offset, block_buf, &failed);
+    }
+
+    *end = offset + total_written;
+    if (ring)
+    {
+        ring_rebase(file->node->inode);
+        *end = file_length(file->node->inode);
+    }
+
+    if (total_written > 0 || failed)
+    {
+        mark_dirty(file);
+    }
+    node_wrunlock(ctx, file->node);
+    corefs_mem_free(ctx, block_buf);
+
+    corefs_alloc_lock(ctx);
+    ctx->io_stats.logical_bytes += total_written;
+    corefs_alloc_unlock(ctx);
+
+    return (failed && total_written == 0) ? -1 : (int)total_written;
+}
+
+static bool file_writable(corefs_file_t *file)
+{
+    if (!file->ctx->mounted)
+    {
+        return false;
+    }
+
+    // Check write permission (O_RDWR shares the O_RDONLY bit)
+    if ((file->flags & 0x03) == COREFS_O_RDONLY)
+    {
+        ESP_LOGE(TAG, "File not open for writing");
+        return false;
+    }
+
+    return true;
+}
+
+int corefs_write(corefs_file_t *file, const void *buf, size_t size)
+{
+    if (!file || !file->node || !buf || !file_writable(file))
+    {
+        return -1;
+    }
+
+    struct iovec v = {.iov_base = (void *)buf, .iov_len = size};
+    iov_cursor_t src = {.iov = &v, .iovcnt = 1};
+    uint32_t end = 0;
+    int n = file_write_at(file, &src, size, file->position,
+                          (file->flags & COREFS_O_APPEND) != 0, &end);
+    if (n > 0)
+    {
+        file->position = end;
+    }
+    return n;
+}
+
+int corefs_pwrite(corefs_file_t *file, const void *buf, size_t size, uint32_t offset)
+{
+    if (!file || !file->node || !buf || !file_writable(file))
+    {
+        return -1;
+    }
+
+    struct iovec v = {.iov_base = (void *)buf, .iov_len = size};
+    iov_cursor_t src = {.iov = &v, .iovcnt = 1};
+    uint32_t end = 0;
+    return file_write_at(file, &src, size, offset, false, &end);
+}
+
+int corefs_writev(corefs_file_t *file, const struct iovec *iov, int iovcnt)
+{
+    int size = iov_total(iov, iovcnt);
+    if (!file || !file->node || size < 0 || !file_writable(file))
+    {
+        return -1;
+    }
+
+    iov_cursor_t src = {.iov = iov, .iovcnt = iovcnt};
+    uint32_t end = 0;
+    int n = file_write_at(file, &src, size, file->position,
+                          (file->flags & COREFS_O_APPEND) != 0, &end);
+    if (n > 0)
+    {
+        file->position = end;
+    }
+    return n;
+}
+
+// ============================================
+// COPY
+// ============================================
+
+// Shares src's block at src_offset into dst at dst_offset, both block
+// aligned, for len bytes (a whole block, or src's tail when it becomes
+// dst's tail too). Returns len, or 0 if the block has to be copied.
+static size_t share_block(corefs_file_t *src, uint32_t src_offset,
+                          corefs_file_t *dst, uint32_t dst_offset, size_t len)
+{
+    corefs_ctx_t *ctx = dst->ctx;
+    uint32_t src_idx = src_offset / COREFS_BLOCK_SIZE;
+    uint32_t dst_idx = dst_offset / COREFS_BLOCK_SIZE;
+    size_t shared = 0;
+
+    // Two node locks: always in stripe order, once if both share a stripe
+    corefs_rwlock_t *first = (src->node->lock < dst->node->lock) ? src->node->lock : dst->node->lock;
+    corefs_rwlock_t *second = (src->node->lock < dst->node->lock) ? dst->node->lock : src->node->lock;
+    corefs_rwlock_wrlock(first);
+    if (second != first)
+    {
+        corefs_rwlock_wrlock(second);
+    }
+
+    bool pinned = (node_pin(ctx, src->node) == ESP_OK);
+    if (pinned && node_pin(ctx, dst->node) != ESP_OK)
+    {
+        node_unpin(ctx, src->node);
+        pinned = false;
+    }
+
+    corefs_inode_t *from = pinned ? src->node->inode : NULL;
+    corefs_inode_t *to = pinned ? dst->node->inode : NULL;
+    bool whole = pinned && (len == COREFS_BLOCK_SIZE && src_offset + len <= from->size);
+    bool tail = pinned && (src_offset + len == from->size && dst_offset + len >= to->size);
+    uint32_t block = (pinned && src_idx < from->blocks_used) ? from->block_list[src_idx] : 0;
+
+    // No gap may open up in dst, and no block index past the list
+    if ((whole || tail) && block != 0 && dst_offset <= to->size &&
+        dst_idx < COREFS_MAX_BLOCKS && corefs_block_share(ctx, block))
+    {
+        uint32_t old = (dst_idx < to->blocks_used) ? to->block_list[dst_idx] : 0;
+        to->block_list[dst_idx] = block;
+        set_chunk(to, dst_idx, is_compressed(from) && is_chunk(from, src_idx));
+        if (dst_idx >= to->blocks_used)
+        {
+            to->blocks_used = dst_idx + 1;
+        }
+        if (old != 0)
+        {
+            corefs_block_free(ctx, old);
+        }
+
+        if (dst_offset + len > to->size)
+        {
+            to->size = dst_offset + len;
+        }
+        mark_dirty(dst);
+        shared = len;
+    }
+
+    if (pinned)
+    {
+        node_unpin(ctx, dst->node);
+        node_unpin(ctx, src->node);
+    }
+    if (second != first)
+    {
+        corefs_rwlock_wrunlock(second);
+    }
+    corefs_rwlock_wrunlock(first);
+    return shared;
+}
+
+/**
+ * Copy len bytes from src at src_offset to dst at dst_offset. Block
+ * aligned whole blocks of the same instance are shared instead of
+ * copied (copy-on-write); the rest goes through a block buffer.
+ * Returns bytes copied (short at src's end of file) or -1.
+ */
+int corefs_copy_range(corefs_file_t *src, uint32_t src_offset,
+                      corefs_file_t *dst, uint32_t dst_offset, size_t len)
+{
+    if (!src || !src->node || !dst || !dst->node ||
+        !file_readable(src) || !file_writable(dst) || len > INT32_MAX)
+    {
+        return -1;
+    }
+
+    // Overlapping ranges of one file would read what was just written
+    bool same = (src->node == dst->node);
+    if (same && src_offset < dst_offset + len && dst_offset < src_offset + len)
+    {
+        return -1;
+    }
+
+    // Ring blocks hold whatever lap wrote them last; only copy those.
+    // Record files refuse the copy in corefs_pwrite(). A compressed
+    // chunk means nothing to a plain file, while a compressed file
+    // reads raw blocks fine.
+    bool can_share = (src->ctx == dst->ctx && !same &&
+                      !(dst->flags & (COREFS_O_APPEND | COREFS_O_RING)) &&
+                      !(src->flags & COREFS_O_RING) &&
+                      !(corefs_file_inode_flags(dst) & COREFS_INODE_RECORDS) &&
+                      (!(corefs_file_inode_flags(src) & COREFS_INODE_COMPRESSED) ||
+                       (corefs_file_inode_flags(dst) & COREFS_INODE_COMPRESSED)));
+    uint8_t *buf = NULL;
+    size_t total = 0;
+    bool failed = false;
+
+    while (len > 0)
+    {
+        size_t chunk = COREFS_BLOCK_SIZE - (src_offset % COREFS_BLOCK_SIZE);
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+
+        size_t n = 0;
+        if (can_share && src_offset % COREFS_BLOCK_SIZE == 0 && dst_offset % COREFS_BLOCK_SIZE == 0)
+        {
+            n = share_block(src, src_offset, dst, dst_offset, chunk);
+        }
+
+        if (n == 0)
+        {
+            if (!buf)
+            {
+                buf = corefs_mem_alloc(src->ctx, COREFS_BLOCK_SIZE);
+                if (!buf)
+                {
+                    failed = true;
+                    break;
+                }
+            }
+
+            int r = corefs_pread(src, buf, chunk, src_offset);
+            if (r <= 0)
+            {
+                failed = (r < 0);
+                break;  // End of file
+            }
+
+            int w = corefs_pwrite(dst, buf, r, dst_offset);
+            if (w != r)
+            {
+                total += (w > 0) ? w : 0;
+                failed = true;
+                break;
+            }
+            n = r;
+        }
+
+        src_offset += n;
+        dst_offset += n;
+        total += n;
+        len -= n;
+    }
+
+    corefs_mem_free(src->ctx, buf);
+    return (failed && total == 0) ? -1 : (int)total;
+}
+
+// ============================================
+// SEEK
+// ============================================
+
+int corefs_seek(corefs_file_t *file, int offset, int whence)
+{
+    if (!file || !file->node)
+    {
+        return -1;
+    }
+
+    int new_pos = file->position;
+
+    switch (whence)
+    {
+    case COREFS_SEEK_SET:
+        new_pos = offset;
+        break;
+    case COREFS_SEEK_CUR:
+        new_pos += offset;
+        break;
+    case COREFS_SEEK_END:
+        if (node_rdlock(file->ctx, file->node) != ESP_OK)
+        {
+            return -1;
+        }
+        new_pos = file_length(file->node->inode) + offset;
+        node_rdunlock(file->ctx, file->node);
+        break;
+    default:
+        return -1;
+    }
+
+    if (new_pos < 0)
+    {
+        new_pos = 0;
+    }
+
+    file->position = new_pos;
+    return new_pos;
+}
+
+size_t corefs_tell(corefs_file_t *file)
+{
+    return file ? file->position : 0;
+}
+
+size_t corefs_size(corefs_file_t *file)
+{
+    if (!file || !file->node)
+    {
+        return 0;
+    }
+
+    if (node_rdlock(file->ctx, file->node) != ESP_OK)
+    {
+        return 0;
+    }
+    size_t size = file_length(file->node->inode);
+    node_rdunlock(file->ctx, file->node);
+    return size;
+}
+
+// ============================================
+// STATUS
+// ============================================
+
+static void fill_stat(const corefs_inode_t *inode, corefs_stat_t *st)
+{
+    st->size = file_length(inode);
+    st->blocks = 0;
+    for (uint32_t i = 0; i < inode->blocks_used && i < COREFS_MAX_BLOCKS; i++)
+    {
+        st->blocks += (inode->block_list[i] != 0);
+    }
+    st->created = inode->created;
+    st->modified = inode->modified;
+    st->mode = inode->mode;
+}
+
+esp_err_t corefs_fstat(corefs_file_t *file, corefs_stat_t *st)
+{
+    if (!file || !file->node || !st)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = node_rdlock(file->ctx, file->node);
+    if (ret == ESP_OK)
+    {
+        fill_stat(file->node->inode, st);
+        node_rdunlock(file->ctx, file->node);
+    }
+    return ret;
+}
+
+esp_err_t corefs_fs_stat(corefs_ctx_t *ctx, const char *path, corefs_stat_t *st)
+{
+    if (!ctx || !ctx->mounted || !path || !st)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    corefs_rwlock_rdlock(&ctx->dir_lock);
+
+    int32_t inode_block = corefs_btree_find(ctx, path);
+    if (inode_block < 0)
+    {
+        corefs_rwlock_rdunlock(&ctx->dir_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // An open file may have a newer size than its inode on flash
+    corefs_node_t *node = node_find(ctx, inode_block);
+    if (node)
+    {
+        esp_err_t ret = node_rdlock(ctx, node);
+        if (ret == ESP_OK)
+        {
+            fill_stat(node->inode, st);
+            node_rdunlock(ctx, node);
+        }
+        corefs_rwlock_rdunlock(&ctx->dir_lock);
+        return ret;
+    }
+
+    corefs_inode_t *inode = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
+    esp_err_t ret = inode ? corefs_inode_read(ctx, inode_block, inode) : ESP_ERR_NO_MEM;
+    if (ret == ESP_OK)
+    {
+        fill_stat(inode, st);
+    }
+    corefs_mem_free(ctx, inode);
+
+    corefs_rwlock_rdunlock(&ctx->dir_lock);
+    return ret;
+}
+
+esp_err_t corefs_stat(const char *path, corefs_stat_t *st)
+{
+    return corefs_fs_stat(corefs_get_context(), path, st);
+}
+
+// ============================================
+// SYNC / TRUNCATE
+// ============================================
+
+esp_err_t corefs_fsync(corefs_file_t *file)
+{
+    if (!file || !file->node || !file->ctx->mounted)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    corefs_ctx_t *ctx = file->ctx;
+
+    esp_err_t ret = node_wrlock(ctx, file->node);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    // Queued data first, the inode must not reference blocks still in RAM
+    ret = corefs_elevator_flush(ctx);
+    bool records = (file->node->inode->flags & COREFS_INODE_RECORDS) != 0;
+    if (ret == ESP_OK && file->dirty && !records)
+    {
+        ret = node_store(ctx, file->node);
+        if (ret == ESP_OK)
+        {
+            file->dirty = false;
+        }
+    }
+
+    node_wrunlock(ctx, file->node);
+
+    // A record file checkpoints out of place, which needs dir_lock first
+    if (ret == ESP_OK && file->dirty && records)
+    {
+        ret = record_checkpoint(file);
+    }
+    return ret;
+}
+
+esp_err_t corefs_ftruncate(corefs_file_t *file, uint32_t length)
+{
+    if (!file || !file->node || !file_writable(file))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (length > COREFS_MAX_BLOCKS * COREFS_BLOCK_SIZE)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    corefs_ctx_t *ctx = file->ctx;
+    bool failed = false;
+
+    uint8_t *block_buf = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!block_buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = node_wrlock(ctx, file->node);
+    if (ret != ESP_OK)
+    {
+        corefs_mem_free(ctx, block_buf);
+        return ret;
+    }
+
+    // A ring can only be emptied; its blocks stay
+    if (is_ring(file->node->inode))
+    {
+        ret = ESP_ERR_NOT_SUPPORTED;
+        if (length == 0)
+        {
+            file->node->inode->size = 0;
+            mark_dirty(file);
+            ret = ESP_OK;
+        }
+        node_wrunlock(ctx, file->node);
+        corefs_mem_free(ctx, block_buf);
+        return ret;
+    }
+
+    // Records go after the end, into flash that must still be erased
+    if ((file->node->inode->flags & COREFS_INODE_RECORDS) && length != 0)
+    {
+        node_wrunlock(ctx, file->node);
+        corefs_mem_free(ctx, block_buf);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint32_t size = file->node->inode->size;
+    uint32_t blocks = file->node->inode->blocks_used;
+    if (length < size)
+    {
+        note_rewrite(file);
+        shrink_to(file, length);
+    }
+    else if (length == size)
+    {
+        // Drops blocks preallocated past the end
+        shrink_to(file, length);
+    }
+    else if (length > size)
+    {
+        // Grows like a write past the end: a hole, no blocks
+        clear_gap(file, length, block_buf, &failed);
+        if (!failed)
+        {
+            file->node->inode->size = length;
+        }
+    }
+
+    if (length != size || file->node->inode->blocks_used != blocks)
+    {
+        mark_dirty(file);
+    }
+
+    node_wrunlock(ctx, file->node);
+    corefs_mem_free(ctx, block_buf);
+
+    // The handle position is left alone, as with POSIX ftruncate()
+    return failed ? ESP_FAIL : ESP_OK;
+}
+
+/**
+ * Reserve blocks for [offset, offset + len) without changing the file
+ * size (like fallocate() with FALLOC_FL_KEEP_SIZE). The holes in the
+ * range get one run of consecutive blocks when the bitmap has one, so
+ * writing the range later neither allocates nor scatters. Blocks past
+ * the end are given back by corefs_ftruncate().
+ */
+esp_err_t corefs_fallocate(corefs_file_t *file, uint32_t offset, uint32_t len)
+{
+    if (!file || !file->node || !file_writable(file))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (len == 0)
+    {
+        return ESP_OK;
+    }
+    if (offset > COREFS_MAX_BLOCKS * COREFS_BLOCK_SIZE ||
+        len > COREFS_MAX_BLOCKS * COREFS_BLOCK_SIZE - offset)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    corefs_ctx_t *ctx = file->ctx;
+    uint32_t first = offset / COREFS_BLOCK_SIZE;
+    uint32_t last = (offset + len - 1) / COREFS_BLOCK_SIZE;
+    esp_err_t ret = node_wrlock(ctx, file->node);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    corefs_inode_t *inode = file->node->inode;
+    corefs_class_t cls = corefs_inode_class(inode);
+
+    // Every block of a ring is allocated when it is created
+    if (is_ring(inode))
+    {
+        node_wrunlock(ctx, file->node);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint32_t holes = 0;
+    for (uint32_t i = first; i <= last; i++)
+    {
+        holes += (i >= inode->blocks_used || inode->block_list[i] == 0);
+    }
+
+    // Without a long enough free run, single blocks still spare the
+    // writer the allocation
+    uint32_t run = holes ? corefs_block_alloc_run(ctx, holes, cls) : 0;
+
+    // A hole inside the file reads as zeros and has to stay that way
+    uint8_t *zeros = NULL;
+
+    uint32_t taken = 0;  // Blocks of the run handed out
+    uint32_t added = 0;
+    for (uint32_t i = first; i <= last && taken < holes; i++)
+    {
+        if (i < inode->blocks_used && inode->block_list[i] != 0)
+        {
+            continue;
+        }
+
+        uint32_t block = run ? run + taken : corefs_block_alloc_class(ctx, cls);
+        taken++;
+        if (block == 0)
+        {
+            ESP_LOGE(TAG, "No free blocks");
+            ret = ESP_ERR_NO_MEM;
+            break;
+        }
+
+        if ((uint64_t)i * COREFS_BLOCK_SIZE < inode->size)
+        {
+            if (!zeros)
+            {
+                zeros = corefs_mem_calloc(ctx, COREFS_BLOCK_SIZE);
+            }
+            ret = zeros ? corefs_block_write(ctx, block, zeros) : ESP_ERR_NO_MEM;
+        }
+
+        if (ret != ESP_OK)
+        {
+            corefs_block_free(ctx, block);
+            break;
+        }
+
+        inode->block_list[i] = block;
+        set_chunk(inode, i, false);
+        if (i >= inode->blocks_used)
+        {
+            inode->blocks_used = i + 1;
+        }
+        added++;
+    }
+
+    // Blocks of the run left over after a failure
+    for (uint32_t i = taken; run && i < holes; i++)
+    {
+        corefs_block_free(ctx, run + i);
+    }
+
+    if (added > 0)
+    {
+        mark_dirty(file);
+    }
+
+    node_wrunlock(ctx, file->node);
+    corefs_mem_free(ctx, zeros);
+    return ret;
+}
+
+// ============================================
+// RECORDS
+// ============================================
+// corefs_append_record() frames each record (magic, length, sequence
+// number, CRC) and programs it into the erased rest of the file's last
+// block: one flash program per record, no erase, no inode write. A
+// record that does not fit starts the next block. A growing file takes
+// COREFS_RECORD_RESERVE blocks at a time, erased up front, so starting
+// a block is a program as well; the inode write that puts the run into
+// the block list is the checkpoint. Blocks that still hold data (ring
+// laps, torn frames) are written whole and checkpointed too. Between
+// checkpoints the size and record_seq on flash lag behind;
+// records_recover() scans forward from them when the file is opened
+// and takes frames while their sequence numbers continue, so a frame
+// left by an earlier lap or a block nothing was carried into ends the
+// scan. Close and fsync checkpoint as well. A checkpoint writes the
+// inode to a new block and commits it with the root (node_commit()),
+// so a power cut leaves the previous one.
+
+static uint32_t record_size(uint32_t len)
+{
+    return (sizeof(corefs_record_hdr_t) + len + 3) & ~3u;
+}
+
+static uint32_t record_crc(const corefs_record_hdr_t *hdr, const void *payload)
+{
+    // len and seq are adjacent in the packed header
+    uint32_t crc = crc32_update(0xFFFFFFFF, &hdr->len, sizeof(hdr->len) + sizeof(hdr->seq));
+    crc = crc32_update(crc, payload, hdr->len);
+    return crc32_finalize(crc);
+}
+
+// Intact frame at buf + off, or NULL
+static const corefs_record_hdr_t *record_at(const uint8_t *buf, uint32_t off)
+{
+    if (off + sizeof(corefs_record_hdr_t) > COREFS_BLOCK_SIZE)
+    {
+        return NULL;
+    }
+
+    const corefs_record_hdr_t *hdr = (const corefs_record_hdr_t *)(buf + off);
+    if (hdr->magic != COREFS_RECORD_MAGIC || hdr->len > COREFS_RECORD_MAX ||
+        off + record_size(hdr->len) > COREFS_BLOCK_SIZE ||
+        hdr->crc != record_crc(hdr, hdr + 1))
+    {
+        return NULL;
+    }
+    return hdr;
+}
+
+static bool erased(const uint8_t *p, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (p[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Moves size and record_seq of a record file past the records appended
+// since its last checkpoint. Called on the inode just read from flash.
+static esp_err_t records_recover(corefs_ctx_t *ctx, corefs_inode_t *inode)
+{
+    if (!(inode->flags & COREFS_INODE_RECORDS) || inode->blocks_used == 0)
+    {
+        return ESP_OK;
+    }
+
+    uint8_t *buf = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t end = (uint32_t)inode->size;
+    uint32_t pos = end;
+    uint32_t loaded = UINT32_MAX; // Stream block in buf
+    uint32_t found = 0;
+    esp_err_t ret = ESP_OK;
+
+    while (true)
+    {
+        uint32_t idx = pos / COREFS_BLOCK_SIZE;
+        uint32_t off = pos % COREFS_BLOCK_SIZE;
+        uint32_t slot = block_slot(inode, pos);
+        if ((!is_ring(inode) && idx >= COREFS_MAX_BLOCKS) ||
+            slot >= inode->blocks_used || inode->block_list[slot] == 0)
+        {
+            break;
+        }
+
+        if (idx != loaded)
+        {
+            ret = corefs_block_read(ctx, inode->block_list[slot], buf);
+            if (ret != ESP_OK)
+            {
+                break;
+            }
+            loaded = idx;
+        }
+
+        const corefs_record_hdr_t *hdr = record_at(buf, off);
+        if (hdr && hdr->seq == inode->record_seq)
+        {
+            // Time-series: the index of a block rolled forward into
+            uint64_t ts;
+            if ((inode->flags & COREFS_INODE_TIMESERIES) && hdr->len >= sizeof(ts))
+            {
+                memcpy(&ts, hdr + 1, sizeof(ts));
+                inode->ts_last = ts;
+                if (off == 0)
+                {
+                    inode->ts_index[slot] = ts;
+                }
+            }
+
+            inode->record_seq++;
+            pos += record_size(hdr->len);
+            end = pos;
+            found++;
+            continue;
+        }
+
+        if (off == 0)
+        {
+            break; // Nothing was carried on into this block
+        }
+
+        // The next record may not have fitted here
+        if (erased(buf + off, COREFS_BLOCK_SIZE - off))
+        {
+            pos += COREFS_BLOCK_SIZE - off;
+            continue;
+        }
+
+        // Torn frame: this block can take no more programs, but the
+        // next one may carry on
+        pos += COREFS_BLOCK_SIZE - off;
+        end = pos;
+    }
+
+    if (ret == ESP_OK && end != inode->size)
+    {
+        ESP_LOGI(TAG, "'%s': %u records past the checkpoint", inode->name, found);
+        inode->size = end;
+        if (is_ring(inode))
+        {
+            ring_rebase(inode);
+        }
+    }
+
+    corefs_mem_free(ctx, buf);
+    return ret;
+}
+
+// Writes the frame of a record with payload [ts] data at dst
+static void record_frame(uint8_t *dst, uint32_t seq, const uint64_t *ts,
+                         const void *data, size_t len)
+{
+    corefs_record_hdr_t hdr = {
+        .magic = COREFS_RECORD_MAGIC,
+        .len = (uint16_t)(len + (ts ? sizeof(*ts) : 0)),
+        .seq = seq,
+    };
+
+    uint8_t *payload = dst + sizeof(hdr);
+    if (ts)
+    {
+        memcpy(payload, ts, sizeof(*ts));
+    }
+    memcpy(payload + (ts ? sizeof(*ts) : 0), data, len);
+
+    hdr.crc = record_crc(&hdr, payload);
+    memcpy(dst, &hdr, sizeof(hdr));
+}
+
+// Grows a record file by an erased run of blocks from slot on, so that
+// the records starting them need no erase. Returns the first block, or
+// 0 when no run is free (the caller falls back to a single block).
+static uint32_t record_reserve(corefs_file_t *file, uint32_t slot)
+{
+    corefs_ctx_t *ctx = file->ctx;
+    corefs_inode_t *inode = file->node->inode;
+
+    // Whole sectors only: the erase takes both halves
+    uint32_t count = COREFS_RECORD_RESERVE;
+    if (count > COREFS_MAX_BLOCKS - slot)
+    {
+        count = (COREFS_MAX_BLOCKS - slot) & ~1u;
+    }
+    uint32_t run = (count >= 2) ? corefs_block_alloc_run(ctx, count, corefs_inode_class(inode)) : 0;
+    if (run == 0)
+    {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i += 2)
+    {
+        if (corefs_block_erase(ctx, run + i) != ESP_OK)
+        {
+            for (uint32_t j = 0; j < count; j++)
+            {
+                corefs_block_free(ctx, run + j);
+            }
+            return 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        inode->block_list[slot + i] = run + i;
+    }
+    inode->blocks_used = slot + count;
+    file->dirty = true;
+    return run;
+}
+
+// Checkpoints a record file. dir_lock comes before the node lock, so
+// the caller has dropped that; records appended in between go out with
+// this checkpoint.
+static esp_err_t record_checkpoint(corefs_file_t *file)
+{
+    corefs_ctx_t *ctx = file->ctx;
+    corefs_rwlock_wrlock(&ctx->dir_lock);
+    esp_err_t ret = node_wrlock(ctx, file->node);
+    if (ret == ESP_OK)
+    {
+        ret = node_commit(ctx, file->node);
+        file->dirty = (ret != ESP_OK);
+        node_wrunlock(ctx, file->node);
+    }
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+    return ret;
+}
+
+// Appends a record; ts is set for time-series files and prefixes the
+// payload. *at receives the stream offset of the frame.
+static esp_err_t record_append(corefs_file_t *file, const uint64_t *ts, const void *data, size_t len,
+                               uint32_t *at)
+{
+    if (!file || !file->node || !data || len == 0 || !file_writable(file))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len + (ts ? sizeof(*ts) : 0) > COREFS_RECORD_MAX)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (file->flags & COREFS_O_REPLACE)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    corefs_ctx_t *ctx = file->ctx;
+    uint8_t *buf = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = node_wrlock(ctx, file->node);
+    if (ret != ESP_OK)
+    {
+        corefs_mem_free(ctx, buf);
+        return ret;
+    }
+
+    corefs_inode_t *inode = file->node->inode;
+
+    // The first record sets the kind of an empty file
+    uint16_t kind = COREFS_INODE_RECORDS | (ts ? COREFS_INODE_TIMESERIES : 0);
+    if (inode->size == 0)
+    {
+        inode->flags = (inode->flags & ~(COREFS_INODE_TIMESERIES | COREFS_INODE_COMPRESSED)) | kind;
+    }
+    else if ((inode->flags & (COREFS_INODE_RECORDS | COREFS_INODE_TIMESERIES)) != kind)
+    {
+        ESP_LOGE(TAG, "'%s' holds %s", inode->name,
+                 !(inode->flags & COREFS_INODE_RECORDS) ? "unframed data" :
+                 ts ? "records without timestamps" : "time-series records");
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else if (ts && *ts < inode->ts_last)
+    {
+        // corefs_ts_seek() relies on the order
+        ESP_LOGE(TAG, "'%s': timestamp goes backwards", inode->name);
+        ret = ESP_ERR_INVALID_ARG;
+    }
+
+    // A record that does not fit leaves the rest of the block erased
+    uint32_t need = record_size(len + (ts ? sizeof(*ts) : 0));
+    uint32_t pos = (uint32_t)inode->size;
+    uint32_t off = pos % COREFS_BLOCK_SIZE;
+    bool start = (off == 0 || off + need > COREFS_BLOCK_SIZE);
+    if (start)
+    {
+        pos += (COREFS_BLOCK_SIZE - off) % COREFS_BLOCK_SIZE;
+        off = 0;
+    }
+
+    if (ret == ESP_OK && !is_ring(inode) && pos / COREFS_BLOCK_SIZE >= COREFS_MAX_BLOCKS)
+    {
+        ret = ESP_ERR_NO_MEM;
+    }
+
+    uint32_t slot = block_slot(inode, pos);
+    uint32_t block = (slot < inode->blocks_used) ? inode->block_list[slot] : 0;
+    bool shared = corefs_block_is_shared(ctx, block);
+
+    bool reserved = false;
+    bool checkpoint = false;
+    if (ret == ESP_OK && start && slot >= inode->blocks_used && !is_ring(inode))
+    {
+        block = record_reserve(file, slot);
+        reserved = (block != 0);
+    }
+
+    // A block erased in advance takes its first record without an erase
+    bool fresh = reserved;
+    if (ret == ESP_OK && start && block != 0 && !shared && !fresh)
+    {
+        ret = corefs_block_read(ctx, block, buf);
+        fresh = (ret == ESP_OK && erased(buf, COREFS_BLOCK_SIZE));
+    }
+
+    // A block shared with a clone or snapshot is copied, not programmed
+    bool rewrite = (start && !fresh) || shared;
+
+    if (ret == ESP_OK && !rewrite)
+    {
+        memset(buf, 0xFF, need);
+        record_frame(buf, inode->record_seq, ts, data, len);
+        ret = corefs_block_append(ctx, block, off, buf, need);
+    }
+    else if (ret == ESP_OK)
+    {
+        if (start)
+        {
+            memset(buf, 0xFF, COREFS_BLOCK_SIZE);
+        }
+        else
+        {
+            ret = corefs_block_read(ctx, block, buf);
+        }
+        record_frame(buf + off, inode->record_seq, ts, data, len);
+
+        // Rings and preallocated blocks are rewritten in place
+        uint32_t target = block;
+        if (ret == ESP_OK && (block == 0 || corefs_block_is_shared(ctx, block)))
+        {
+            target = corefs_block_alloc_class(ctx, corefs_inode_class(inode));
+            ret = target ? ESP_OK : ESP_ERR_NO_MEM;
+        }
+        if (ret == ESP_OK)
+        {
+            ret = corefs_block_write(ctx, target, buf);
+            if (ret != ESP_OK && target != block)
+            {
+                corefs_block_free(ctx, target);
+            }
+        }
+
+        if (ret == ESP_OK && target != block)
+        {
+            if (block)
+            {
+                corefs_block_free(ctx, block);
+            }
+            inode->block_list[slot] = target;
+            if (slot >= inode->blocks_used)
+            {
+                inode->blocks_used = slot + 1;
+            }
+        }
+    }
+
+    if (ret == ESP_OK)
+    {
+        inode->size = pos + need;
+        inode->record_seq++;
+        if (at)
+        {
+            *at = pos;
+        }
+        if (is_ring(inode))
+        {
+            ring_rebase(inode);
+        }
+
+        // A new block's first timestamp goes into the index
+        if (ts)
+        {
+            inode->ts_last = *ts;
+            if (start)
+            {
+                inode->ts_index[slot] = *ts;
+            }
+        }
+
+        // Checkpoint: new blocks have to be in the block list on flash,
+        // and a rewritten block must not be taken for older records
+        file->dirty = true;
+        checkpoint = (rewrite || reserved);
+
+        corefs_alloc_lock(ctx);
+        ctx->io_stats.logical_bytes += len;
+        if (!rewrite)
+        {
+            ctx->io_stats.record_appends++;
+        }
+        corefs_alloc_unlock(ctx);
+    }
+
+    node_wrunlock(ctx, file->node);
+    corefs_mem_free(ctx, buf);
+
+    if (checkpoint)
+    {
+        ret = record_checkpoint(file);
+    }
+    return ret;
+}
+
+/**
+ * Append one framed record of len bytes (1..COREFS_RECORD_MAX). The
+ * first record turns an empty file into a record file, which refuses
+ * plain writes from then on; on a ring (corefs_open_ring()) the oldest
+ * records make way. Most records cost a single flash program: the
+ * inode is only written when the file grows by a run of blocks or a
+ * block is rewritten, whatever the write policy, and recovered on the
+ * next open otherwise. pos (may be NULL) receives the stream offset of
+ * the record, as reported by corefs_record_iter_t.at.
+ */
+esp_err_t corefs_append_record(corefs_file_t *file, const void *data, size_t len, uint32_t *pos)
+{
+    return record_append(file, NULL, data, len, pos);
+}
+
+void corefs_record_iter_init(corefs_record_iter_t *it, corefs_file_t *file)
+{
+    memset(it, 0, sizeof(*it));
+    it->file = file;
+}
+
+// Next record of it; ts is set for time-series files and receives the
+// timestamp stripped from the payload
+static int record_next(corefs_record_iter_t *it, uint64_t *ts, void *buf, size_t size)
+{
+    if (!it || !it->file || !it->file->node || !buf || !file_readable(it->file))
+    {
+        return -1;
+    }
+
+    corefs_file_t *file = it->file;
+    uint8_t *block_buf = corefs_mem_alloc(file->ctx, COREFS_BLOCK_SIZE);
+    if (!block_buf)
+    {
+        return -1;
+    }
+
+    if (node_rdlock(file->ctx, file->node) != ESP_OK)
+    {
+        corefs_mem_free(file->ctx, block_buf);
+        return -1;
+    }
+
+    corefs_inode_t *inode = file->node->inode;
+    uint32_t base = file_base(inode);
+    uint32_t end = (uint32_t)inode->size;
+    uint32_t loaded = UINT32_MAX;
+    uint32_t pos = it->pos;
+    int result = 0;
+
+    // Only time-series records carry a timestamp to strip
+    if (ts && !(inode->flags & COREFS_INODE_TIMESERIES))
+    {
+        node_rdunlock(file->ctx, file->node);
+        corefs_mem_free(file->ctx, block_buf);
+        return -1;
+    }
+
+    // Overwritten, or moved by a ring rebase or a reset
+    bool restarted = (!it->started || pos < base || pos > end);
+    if (restarted)
+    {
+        pos = base;
+    }
+
+    while (pos < end)
+    {
+        uint32_t off = pos % COREFS_BLOCK_SIZE;
+        uint32_t slot = block_slot(inode, pos);
+        uint32_t block = (slot < inode->blocks_used) ? inode->block_list[slot] : 0;
+        if (block == 0)
+        {
+            pos += COREFS_BLOCK_SIZE - off;
+            continue;
+        }
+
+        if (pos / COREFS_BLOCK_SIZE != loaded)
+        {
+            if (corefs_block_read(file->ctx, block, block_buf) != ESP_OK)
+            {
+                result = -1;
+                break;
+            }
+            loaded = pos / COREFS_BLOCK_SIZE;
+        }
+
+        // Erased rest of a block, or a frame torn by a power cut
+        const corefs_record_hdr_t *hdr = record_at(block_buf, off);
+        if (!hdr)
+        {
+            pos += COREFS_BLOCK_SIZE - off;
+            continue;
+        }
+
+        // Already returned: positions shifted since the last call
+        if (it->started && (int32_t)(hdr->seq - it->seq) <= 0)
+        {
+            if (restarted)
+            {
+                pos += record_size(hdr->len);
+            }
+            else
+            {
+                pos = base;
+                restarted = true;
+            }
+            continue;
+        }
+
+        uint32_t skip = ts ? sizeof(*ts) : 0;
+        if (hdr->len < skip || hdr->len - skip > size)
+        {
+            result = -1;
+            break;
+        }
+
+        const uint8_t *payload = (const uint8_t *)(hdr + 1);
+        if (ts)
+        {
+            memcpy(ts, payload, sizeof(*ts));
+        }
+        memcpy(buf, payload + skip, hdr->len - skip);
+        it->seq = hdr->seq;
+        it->at = pos;
+        it->started = true;
+        pos += record_size(hdr->len);
+        result = hdr->len - skip;
+        break;
+    }
+
+    it->pos = pos;
+
+    node_rdunlock(file->ctx, file->node);
+    corefs_mem_free(file->ctx, block_buf);
+    return result;
+}
+
+/**
+ * Copy the next record into buf and return its length: the oldest
+ * record first, 0 once the iterator has caught up with the writer. -1
+ * on errors or when size is too small for the record (the iterator
+ * stays on it). On a ring that overwrote records before they were
+ * read, the oldest one left comes next and it->seq skips ahead.
+ */
+int corefs_record_next(corefs_record_iter_t *it, void *buf, size_t size)
+{
+    return record_next(it, NULL, buf, size);
+}
+
+// ============================================
+// TIME SERIES
+// ============================================
+// A time-series file is a record file whose payloads start with a
+// 64-bit timestamp that never goes backwards. Every record that starts
+// a block stores its timestamp in inode->ts_index[slot], which is
+// written by the checkpoint that block costs anyway; recovery fills in
+// the blocks it rolls forward into. corefs_ts_seek() binary searches
+// the index in RAM and reads one block.
+
+/**
+ * Append a record stamped ts (not older than the last one) to a
+ * time-series file; an empty file becomes one. len is at most
+ * COREFS_TS_RECORD_MAX.
+ */
+esp_err_t corefs_ts_append(corefs_file_t *file, uint64_t ts, const void *data, size_t len)
+{
+    return record_append(file, &ts, data, len, NULL);
+}
+
+/**
+ * Like corefs_record_next() on a time-series file: the timestamp goes
+ * to *ts and the rest of the record into buf.
+ */
+int corefs_ts_next(corefs_record_iter_t *it, uint64_t *ts, void *buf, size_t size)
+{
+    if (!ts)
+    {
+        return -1;
+    }
+    return record_next(it, ts, buf, size);
+}
+
+/**
+ * Set up it on file so that corefs_ts_next() returns the first record
+ * stamped t or later first, or nothing until newer records arrive.
+ */
+esp_err_t corefs_ts_seek(corefs_file_t *file, uint64_t t, corefs_record_iter_t *it)
+{
+    if (!file || !file->node || !it || !file_readable(file))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    corefs_record_iter_init(it, file);
+
+    uint8_t *buf = corefs_mem_alloc(file->ctx, COREFS_BLOCK_SIZE);
+    if (!buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = node_rdlock(file->ctx, file->node);
+    if (ret != ESP_OK)
+    {
+        corefs_mem_free(file->ctx, buf);
+        return ret;
+    }
+
+    corefs_inode_t *inode = file->node->inode;
+    uint32_t end = (uint32_t)inode->size;
+    uint32_t lo = file_base(inode) / COREFS_BLOCK_SIZE;
+    uint32_t hi = end ? (end - 1) / COREFS_BLOCK_SIZE : lo; // Last block
+
+    if (!(inode->flags & COREFS_INODE_TIMESERIES) && end > 0)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else if (end == 0 || inode->ts_last < t)
+    {
+        // Nothing that new yet
+        it->pos = end;
+        it->seq = inode->record_seq - 1;
+        it->started = true;
+    }
+    else if (inode->ts_index[block_slot(inode, lo * COREFS_BLOCK_SIZE)] < t)
+    {
+        // Last block whose first record is older than t
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            if (inode->ts_index[block_slot(inode, mid * COREFS_BLOCK_SIZE)] < t)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid - 1;
+            }
+        }
+
+        // The record is in this block, or starts the next one
+        uint32_t pos = lo * COREFS_BLOCK_SIZE;
+        uint32_t seq = 0;
+        ret = corefs_block_read(file->ctx, inode->block_list[block_slot(inode, pos)], buf);
+        for (uint32_t off = 0; ret == ESP_OK && pos < end;)
+        {
+            const corefs_record_hdr_t *hdr = record_at(buf, off);
+            if (!hdr)
+            {
+                pos += COREFS_BLOCK_SIZE - off;
+                break;
+            }
+
+            uint64_t stamp;
+            memcpy(&stamp, hdr + 1, sizeof(stamp));
+            seq = hdr->seq;
+            if (stamp >= t)
+            {
+                break;
+            }
+
+            off += record_size(hdr->len);
+            pos += record_size(hdr->len);
+            seq++;
+        }
+
+        it->pos = (pos < end) ? pos : end;
+        it->seq = seq - 1;
+        it->started = true;
+    }
+
+    node_rdunlock(file->ctx, file->node);
+    corefs_mem_free(file->ctx, buf);
+    return ret;
+}
+
+// ============================================
+// REPLACE
+// ============================================
+// A replace handle writes into a private shadow node whose inode starts
+// out empty; it is never shared, so its lock is one without semaphores
+// (no-op), and it stays out of the open inode table. Commit
+// moves the shadow's block list into a new inode block and the root
+// write that points the entry at it publishes the lot: readers and a
+// power cut see the old or the new contents, never a mix or neither,
+// and the data is written once. Old blocks go back to the bitmap, which
+// needs no flash I/O.
+
+static corefs_rwlock_t shadow_lock;
+
+// Caller holds dir_lock exclusively. Frees whatever blocks the shadow
+// holds: the old contents after a commit, the new ones otherwise.
+static void replace_release(corefs_ctx_t *ctx, corefs_file_t *file)
+{
+    corefs_inode_t *shadow = file->node->inode;
+
+    for (uint32_t i = 0; i < shadow->blocks_used; i++)
+    {
+        if (shadow->block_list[i] != 0)
+        {
+            corefs_block_free(ctx, shadow->block_list[i]);
+        }
+    }
+
+    fd_release(ctx, file->fd);
+    corefs_mem_free(ctx, shadow);
+    corefs_mem_free(ctx, file->node);
+    corefs_mem_free(ctx, file);
+}
+
+static void swap_contents(corefs_inode_t *a, corefs_inode_t *b)
+{
+    uint64_t size = a->size;
+    a->size = b->size;
+    b->size = size;
+
+    uint32_t used = a->blocks_used;
+    a->blocks_used = b->blocks_used;
+    b->blocks_used = used;
+
+    for (int i = 0; i < COREFS_MAX_BLOCKS; i++)
+    {
+        uint32_t block = a->block_list[i];
+        a->block_list[i] = b->block_list[i];
+        b->block_list[i] = block;
+    }
+
+    uint8_t chunks[sizeof(a->chunks)];
+    memcpy(chunks, a->chunks, sizeof(chunks));
+    memcpy(a->chunks, b->chunks, sizeof(chunks));
+    memcpy(b->chunks, chunks, sizeof(chunks));
+}
+
+// Existing file: its inode takes the shadow's blocks, written out of
+// place (inode_commit())
+static esp_err_t replace_swap(corefs_ctx_t *ctx, const char *path, uint32_t inode_block,
+                              corefs_inode_t *shadow)
+{
+    // Open handles see the new contents through the shared node
+    corefs_node_t *node = node_find(ctx, inode_block);
+    if (node)
+    {
+        esp_err_t ret = node_wrlock(ctx, node);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        uint16_t rewrites = node->inode->rewrites;
+        swap_contents(node->inode, shadow);
+        if (rewrites < UINT16_MAX)
+        {
+            node->inode->rewrites++;
+        }
+        ret = node_commit(ctx, node);
+        if (ret != ESP_OK)
+        {
+            swap_contents(node->inode, shadow);
+            node->inode->rewrites = rewrites;
+        }
+        node_wrunlock(ctx, node);
+        return ret;
+    }
+
+    corefs_inode_t *inode = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
+    if (!inode)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = corefs_inode_read(ctx, inode_block, inode);
+    if (ret == ESP_OK)
+    {
+        swap_contents(inode, shadow);
+
+        // Replacing contents counts as a rewrite
+        if (inode->rewrites < UINT16_MAX)
+        {
+            inode->rewrites++;
+        }
+
+        ret = inode_commit(ctx, path, &inode_block, inode);
+        if (ret != ESP_OK)
+        {
+            swap_contents(inode, shadow);
+        }
+    }
+
+    corefs_mem_free(ctx, inode);
+    return ret;
+}
+
+// New file: complete inode first, the directory insert publishes it
+static esp_err_t replace_create(corefs_ctx_t *ctx, const char *path, corefs_inode_t *shadow)
+{
+    uint32_t inode_block = 0;
+    esp_err_t ret = corefs_inode_create(ctx, shadow->name, &inode_block);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    corefs_inode_t *inode = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
+    ret = inode ? corefs_inode_read(ctx, inode_block, inode) : ESP_ERR_NO_MEM;
+    if (ret == ESP_OK)
+    {
+        swap_contents(inode, shadow);
+        inode->flags = shadow->flags;
+
+        ret = corefs_inode_write(ctx, inode_block, inode);
+        if (ret == ESP_OK)
+        {
+            ret = corefs_btree_insert(ctx, path, inode_block);
+        }
+        if (ret != ESP_OK)
+        {
+            swap_contents(inode, shadow);
+        }
+    }
+
+    // Not in the directory: only the inode block itself to give back
+    if (ret != ESP_OK)
+    {
+        corefs_block_free(ctx, inode_block);
+    }
+
+    corefs_mem_free(ctx, inode);
+    return ret;
+}
+
+/**
+ * Start rewriting path as a whole. Data written to the returned handle
+ * goes to freshly allocated blocks; the file keeps its old contents
+ * until corefs_replace_commit(). Closing the handle instead discards
+ * the new data. path need not exist yet.
+ */
+corefs_file_t *corefs_fs_replace_begin(corefs_ctx_t *ctx, const char *path)
+{
+    if (!ctx || !ctx->mounted || ctx->read_only || !path || path[0] != '/')
+    {
+        return NULL;
+    }
+
+    // Same limits as a directory entry
+    size_t len = strlen(path + 1);
+    if (len == 0 || len >= 64)
+    {
+        return NULL;
+    }
+
+    corefs_file_t *file = corefs_mem_calloc(ctx, sizeof(corefs_file_t));
+    corefs_node_t *node = corefs_mem_calloc(ctx, sizeof(corefs_node_t));
+    corefs_inode_t *shadow = corefs_mem_calloc(ctx, sizeof(corefs_inode_t));
+    if (!file || !node || !shadow)
+    {
+        corefs_mem_free(ctx, file);
+        corefs_mem_free(ctx, node);
+        corefs_mem_free(ctx, shadow);
+        return NULL;
+    }
+
+    node->inode = shadow;
+    node->refs = 1;
+    node->lock = &shadow_lock;
+    strncpy(node->name, path + 1, sizeof(node->name) - 1);
+    file->ctx = ctx;
+    file->node = node;
+    file->flags = COREFS_O_RDWR | COREFS_O_REPLACE;
+
+    corefs_rwlock_wrlock(&ctx->dir_lock);
+
+    file->fd = fd_alloc(ctx, file);
+    esp_err_t ret = (file->fd < 0) ? ESP_ERR_NO_MEM : ESP_OK;
+
+    int32_t inode_block = corefs_btree_find(ctx, path);
+    if (ret == ESP_OK && inode_block >= 0)
+    {
+        // Name, placement hints and history carry over; contents do not
+        corefs_node_t *open = node_find(ctx, inode_block);
+        if (open)
+        {
+            ret = node_rdlock(ctx, open);
+            if (ret == ESP_OK)
+            {
+                memcpy(shadow, open->inode, sizeof(corefs_inode_t));
+                node_rdunlock(ctx, open);
+            }
+        }
+        else
+        {
+            ret = corefs_inode_read(ctx, inode_block, shadow);
+        }
+
+        // A ring keeps its fixed block set and a record file takes
+        // records only; reset either with O_TRUNC instead
+        if (ret == ESP_OK && (shadow->flags & (COREFS_INODE_RING | COREFS_INODE_RECORDS)))
+        {
+            ret = ESP_ERR_NOT_SUPPORTED;
+        }
+
+        shadow->size = 0;
+        shadow->blocks_used = 0;
+        memset(shadow->block_list, 0, sizeof(shadow->block_list));
+        memset(shadow->chunks, 0, sizeof(shadow->chunks));
+        node->inode_block = inode_block;
+    }
+    else if (ret == ESP_OK)
+    {
+        // Created on commit; inode block 0 marks a new file
+        shadow->magic = COREFS_FILE_MAGIC;
+        shadow->mode = 0644;
+        strncpy(shadow->name, path + 1, COREFS_MAX_FILENAME - 1);
+    }
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot replace '%s': %s", path, esp_err_to_name(ret));
+        if (file->fd >= 0)
+        {
+            fd_release(ctx, file->fd);
+        }
+        corefs_rwlock_wrunlock(&ctx->dir_lock);
+        corefs_mem_free(ctx, file);
+        corefs_mem_free(ctx, node);
+        corefs_mem_free(ctx, shadow);
+        return NULL;
+    }
+
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+    return file;
+}
+
+corefs_file_t *corefs_replace_begin(const char *path)
+{
+    return corefs_fs_replace_begin(corefs_get_context(), path);
+}
+
+/**
+ * Publish the data written to a corefs_replace_begin() handle and close
+ * it. On failure the file keeps its old contents and the new data is
+ * discarded; the handle is closed either way.
+ */
+esp_err_t corefs_replace_commit(corefs_file_t *file)
+{
+    if (!file || !file->node || !(file->flags & COREFS_O_REPLACE))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    corefs_ctx_t *ctx = file->ctx;
+    corefs_inode_t *shadow = file->node->inode;
+    uint32_t inode_block = file->node->inode_block;
+    char path[COREFS_MAX_FILENAME + 2];
+    snprintf(path, sizeof(path), "/%s", shadow->name);
+
+    corefs_rwlock_wrlock(&ctx->dir_lock);
+
+    // The name must still lead to the file the handle was opened for
+    int32_t found = corefs_btree_find(ctx, path);
+    esp_err_t ret;
+    if (inode_block == 0 ? found >= 0 : found != (int32_t)inode_block)
+    {
+        ESP_LOGE(TAG, "'%s' changed during replace", path);
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else if (inode_block == 0)
+    {
+        ret = replace_create(ctx, path, shadow);
+    }
+    else
+    {
+        ret = replace_swap(ctx, path, inode_block, shadow);
+    }
+
+    replace_release(ctx, file);
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+
+    if (ret == ESP_OK)
+    {
+        ESP_LOGD(TAG, "Replaced '%s'", path);
+    }
+    return ret;
 }
 
 // ============================================
-// FILE MANAGEMENT
+// CLOSE
 // ============================================
 
-esp_err_t corefs_unlink(const char *path)
+esp_err_t corefs_close(corefs_file_t *file)
 {
-    corefs_ctx_t *ctx = corefs_get_context();
+    if (!file)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    corefs_ctx_t *ctx = file->ctx;
+
+    corefs_rwlock_wrlock(&ctx->dir_lock);
+
+    // An uncommitted replacement is dropped, the file keeps its contents
+    if (file->flags & COREFS_O_REPLACE)
+    {
+        replace_release(ctx, file);
+        corefs_rwlock_wrunlock(&ctx->dir_lock);
+        return ESP_OK;
+    }
+
+    // Write inode if modified
+    corefs_file_store(file);
+
+    // Free the descriptor
+    fd_release(ctx, file->fd);
+
+    // Drop the shared inode, last handle frees it
+    node_put(ctx, file->node);
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+
+    corefs_mem_free(ctx, file);
+
+    return ESP_OK;
+}
 
-    if (!ctx->mounted || !path)
+// ============================================
+// FILE MANAGEMENT
+// ============================================
+
+esp_err_t corefs_fs_unlink(corefs_ctx_t *ctx, const char *path)
+{
+    if (!ctx || !ctx->mounted || !path)
     {
         return ESP_ERR_INVALID_ARG;
     }
 
+    if (ctx->read_only)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    corefs_rwlock_wrlock(&ctx->dir_lock);
+
     // Find file
     int32_t inode_block = corefs_btree_find(ctx, path);
     if (inode_block < 0)
     {
+        corefs_rwlock_wrunlock(&ctx->dir_lock);
         return ESP_ERR_NOT_FOUND;
     }
 
+    // Blocks of an open file cannot be freed under its handles
+    if (node_find(ctx, inode_block))
+    {
+        ESP_LOGE(TAG, "Cannot unlink open file: %s", path);
+        corefs_rwlock_wrunlock(&ctx->dir_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
     // Delete inode (frees all data blocks)
     esp_err_t ret = corefs_inode_delete(ctx, inode_block);
-    if (ret != ESP_OK)
+    if (ret == ESP_OK)
     {
-        return ret;
+        // Remove from B-Tree
+        ret = corefs_btree_delete(ctx, path);
     }
 
-    // Remove from B-Tree
-    return corefs_btree_delete(ctx, path);
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+    return ret;
 }
 
-bool corefs_exists(const char *path)
+esp_err_t corefs_unlink(const char *path)
 {
-    corefs_ctx_t *ctx = corefs_get_context();
+    return corefs_fs_unlink(corefs_get_context(), path);
+}
 
-    if (!ctx->mounted || !path)
+bool corefs_fs_exists(corefs_ctx_t *ctx, const char *path)
+{
+    if (!ctx || !ctx->mounted || !path)
     {
         return false;
     }
 
-    return corefs_btree_find(ctx, path) >= 0;
+    corefs_rwlock_rdlock(&ctx->dir_lock);
+    bool found = corefs_btree_find(ctx, path) >= 0;
+    corefs_rwlock_rdunlock(&ctx->dir_lock);
+    return found;
+}
+
+bool corefs_exists(const char *path)
+{
+    return corefs_fs_exists(corefs_get_context(), path);
+}
+
+/**
+ * Rename old_path to new_path, replacing a file already there. Only the
+ * directory entry moves: the intent goes to the txn log first, then the
+ * new root is written to the other root slot, and that write is the
+ * commit point. new_path names the old or the new file at any moment and
+ * data is never copied; a mount after a power cut resolves the log
+ * (corefs_recovery_scan()). The replaced file's blocks are freed after
+ * the root write.
+ */
+esp_err_t corefs_fs_rename(corefs_ctx_t *ctx, const char *old_path, const char *new_path)
+{
+    if (!ctx || !ctx->mounted || !old_path || !new_path)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (ctx->read_only)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Same limits as a directory entry, checked before anything is logged
+    size_t len = strlen(new_path + 1);
+    if (new_path[0] != '/' || len == 0 || len >= 64)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    corefs_rwlock_wrlock(&ctx->dir_lock);
+
+    int32_t src = corefs_btree_find(ctx, old_path);
+    if (src < 0)
+    {
+        corefs_rwlock_wrunlock(&ctx->dir_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Same file under both names: nothing to do
+    int32_t dst = corefs_btree_find(ctx, new_path);
+    if (dst == src)
+    {
+        corefs_rwlock_wrunlock(&ctx->dir_lock);
+        return ESP_OK;
+    }
+
+    // Blocks of an open file cannot be freed under its handles
+    if (dst >= 0 && node_find(ctx, dst))
+    {
+        ESP_LOGE(TAG, "Cannot replace open file: %s", new_path);
+        corefs_rwlock_wrunlock(&ctx->dir_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    corefs_txn_begin(ctx);
+    corefs_txn_log(ctx, TXN_OP_RENAME, src, dst >= 0 ? dst : 0);
+
+    int32_t replaced = -1;
+    esp_err_t ret = corefs_txn_prepare(ctx);
+    if (ret == ESP_OK)
+    {
+        ret = corefs_btree_rename(ctx, old_path, new_path, &replaced);
+    }
+    if (ret == ESP_OK)
+    {
+        corefs_txn_commit(ctx);
+    }
+    else
+    {
+        corefs_txn_rollback(ctx);
+    }
+
+    if (ret == ESP_OK && replaced >= 0)
+    {
+        corefs_inode_delete(ctx, replaced);
+    }
+
+    // Open handles report the new name
+    corefs_node_t *node = (ret == ESP_OK) ? node_find(ctx, src) : NULL;
+    if (node)
+    {
+        corefs_rwlock_wrlock(node->lock);
+        memset(node->name, 0, sizeof(node->name));
+        strncpy(node->name, new_path + 1, sizeof(node->name) - 1);
+        corefs_rwlock_wrunlock(node->lock);
+    }
+
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+    return ret;
 }
 
 esp_err_t corefs_rename(const char *old_path, const char *new_path)
 {
-    // TODO: Implement rename
-    return ESP_ERR_NOT_SUPPORTED;
+    return corefs_fs_rename(corefs_get_context(), old_path, new_path);
+}
+
+/**
+ * Write a new inode for filename that shares every data block of the
+ * inode at inode_block (copy-on-write). An open file's node is newer
+ * than its inode on flash and is used instead. Caller holds dir_lock.
+ */
+esp_err_t corefs_file_share(corefs_ctx_t *ctx, uint32_t inode_block, const char *filename,
+                            uint32_t *out_block)
+{
+    corefs_inode_t *inode = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
+    if (!inode)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // The node lock keeps writers out until the blocks are shared
+    esp_err_t ret;
+    corefs_node_t *node = node_find(ctx, inode_block);
+    if (node)
+    {
+        ret = node_rdlock(ctx, node);
+        if (ret == ESP_OK)
+        {
+            memcpy(inode, node->inode, sizeof(corefs_inode_t));
+        }
+        else
+        {
+            node = NULL;
+        }
+    }
+    else
+    {
+        ret = corefs_inode_read(ctx, inode_block, inode);
+    }
+
+    // One more reference on every data block
+    uint32_t shared = 0;
+    while (ret == ESP_OK && shared < inode->blocks_used && shared < COREFS_MAX_BLOCKS)
+    {
+        uint32_t block = inode->block_list[shared];
+        if (block != 0 && !corefs_block_share(ctx, block))
+        {
+            ret = ESP_ERR_NO_MEM;
+            break;
+        }
+        shared++;
+    }
+
+    if (ret == ESP_OK)
+    {
+        ret = corefs_inode_clone(ctx, filename, inode, out_block);
+    }
+
+    if (node)
+    {
+        node_rdunlock(ctx, node);
+    }
+
+    // Give back the references taken so far
+    if (ret != ESP_OK)
+    {
+        for (uint32_t i = 0; i < shared; i++)
+        {
+            if (inode->block_list[i] != 0)
+            {
+                corefs_block_free(ctx, inode->block_list[i]);
+            }
+        }
+    }
+
+    corefs_mem_free(ctx, inode);
+    return ret;
+}
+
+/**
+ * Create dst_path sharing all data blocks of src_path: one inode write
+ * and one directory insert, no data copied. Writes to either file copy
+ * the affected block first (copy-on-write). dst_path must not exist.
+ */
+esp_err_t corefs_fs_clone(corefs_ctx_t *ctx, const char *src_path, const char *dst_path)
+{
+    if (!ctx || !ctx->mounted || !src_path || !dst_path || dst_path[0] != '/')
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (ctx->read_only)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    corefs_rwlock_wrlock(&ctx->dir_lock);
+
+    esp_err_t ret = ESP_OK;
+    int32_t src = corefs_btree_find(ctx, src_path);
+    if (src < 0)
+    {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    else if (corefs_btree_find(ctx, dst_path) >= 0)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t inode_block = 0;
+    if (ret == ESP_OK)
+    {
+        ret = corefs_file_share(ctx, src, dst_path + 1, &inode_block);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = corefs_btree_insert(ctx, dst_path, inode_block);
+        if (ret != ESP_OK)
+        {
+            corefs_inode_delete(ctx, inode_block);
+        }
+    }
+
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+    return ret;
+}
+
+esp_err_t corefs_clone(const char *src_path, const char *dst_path)
+{
+    return corefs_fs_clone(corefs_get_context(), src_path, dst_path);
 }
\ No newline at end of file
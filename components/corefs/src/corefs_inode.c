@@ -13,27 +13,24 @@ static const char* TAG = "corefs_inode";
 // External declarations (from other components)
 extern esp_err_t corefs_block_read(corefs_ctx_t* ctx, uint32_t block, void* buf);
 extern esp_err_t corefs_block_write(corefs_ctx_t* ctx, uint32_t block, const void* buf);
-extern uint32_t corefs_block_alloc(corefs_ctx_t* ctx);
+extern uint32_t corefs_block_alloc_class(corefs_ctx_t* ctx, corefs_class_t cls);
 extern void corefs_block_free(corefs_ctx_t* ctx, uint32_t block);
 
 /**
- * Create new inode
+ * Write a new inode for filename. Contents (size, block list, placement
+ * flags, mode, record state) come from tmpl, or start empty without one.
  */
-esp_err_t corefs_inode_create(corefs_ctx_t* ctx, const char* filename,
-                               uint32_t* out_inode_block) {
-    if (!ctx || !filename || !out_inode_block) {
-        return ESP_ERR_INVALID_ARG;
-    }
-
-    // Allocate block for inode
-    uint32_t inode_block = corefs_block_alloc(ctx);
+static esp_err_t inode_new(corefs_ctx_t* ctx, const char* filename,
+                           const corefs_inode_t* tmpl, uint32_t* out_inode_block) {
+    // Allocate block for inode (kept apart from file data)
+    uint32_t inode_block = corefs_block_alloc_class(ctx, COREFS_CLASS_META);
     if (inode_block == 0) {
         ESP_LOGE(TAG, "Failed to allocate block for inode");
         return ESP_ERR_NO_MEM;
     }
 
     // Create inode structure
-    corefs_inode_t* inode = calloc(1, sizeof(corefs_inode_t));
+    corefs_inode_t* inode = corefs_mem_calloc(ctx, sizeof(corefs_inode_t));
     if (!inode) {
         corefs_block_free(ctx, inode_block);
         return ESP_ERR_NO_MEM;
@@ -49,6 +46,18 @@ esp_err_t corefs_inode_create(corefs_ctx_t* ctx, const char* filename,
     inode->mode = 0644;
     inode->flags = 0;
 
+    if (tmpl) {
+        inode->size = tmpl->size;
+        inode->blocks_used = tmpl->blocks_used;
+        memcpy(inode->block_list, tmpl->block_list, sizeof(inode->block_list));
+        inode->mode = tmpl->mode;
+        inode->flags = tmpl->flags;
+        inode->rewrites = tmpl->rewrites;
+        inode->record_seq = tmpl->record_seq;
+        inode->ts_last = tmpl->ts_last;
+        memcpy(inode->ts_index, tmpl->ts_index, sizeof(inode->ts_index));
+    }
+
     // Copy filename into inode
     strncpy(inode->name, filename, COREFS_MAX_FILENAME - 1);
     inode->name[COREFS_MAX_FILENAME - 1] = '\0';
@@ -62,7 +71,7 @@ esp_err_t corefs_inode_create(corefs_ctx_t* ctx, const char* filename,
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to write inode to block %lu", inode_block);
         corefs_block_free(ctx, inode_block);
-        free(inode);
+        corefs_mem_free(ctx, inode);
         return ret;
     }
 
@@ -70,7 +79,58 @@ esp_err_t corefs_inode_create(corefs_ctx_t* ctx, const char* filename,
              inode->inode_num, inode_block, filename);
 
     *out_inode_block = inode_block;
-    free(inode);
+    corefs_mem_free(ctx, inode);
+    return ESP_OK;
+}
+
+/**
+ * Create new inode
+ */
+esp_err_t corefs_inode_create(corefs_ctx_t* ctx, const char* filename,
+                               uint32_t* out_inode_block) {
+    if (!ctx || !filename || !out_inode_block) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return inode_new(ctx, filename, NULL, out_inode_block);
+}
+
+/**
+ * Create an inode referencing the same data blocks as src (one inode
+ * write). The caller takes the extra block references.
+ */
+esp_err_t corefs_inode_clone(corefs_ctx_t* ctx, const char* filename,
+                              const corefs_inode_t* src, uint32_t* out_inode_block) {
+    if (!ctx || !filename || !src || !out_inode_block) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return inode_new(ctx, filename, src, out_inode_block);
+}
+
+/**
+ * Write inode unchanged to a newly allocated block. The caller points
+ * the directory at *out_inode_block and frees the block it replaces.
+ */
+esp_err_t corefs_inode_relocate(corefs_ctx_t* ctx, const corefs_inode_t* inode,
+                                 uint32_t* out_inode_block) {
+    if (!ctx || !inode || !out_inode_block) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t inode_block = corefs_block_alloc_class(ctx, COREFS_CLASS_META);
+    if (inode_block == 0) {
+        ESP_LOGE(TAG, "Failed to allocate block for inode");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = corefs_inode_write(ctx, inode_block, inode);
+    if (ret != ESP_OK) {
+        corefs_block_free(ctx, inode_block);
+        return ret;
+    }
+
+    *out_inode_block = inode_block;
     return ESP_OK;
 }
 
@@ -122,7 +182,7 @@ esp_err_t corefs_inode_write(corefs_ctx_t* ctx, uint32_t inode_block,
     }
 
     // Create writable copy
-    corefs_inode_t* inode_copy = malloc(sizeof(corefs_inode_t));
+    corefs_inode_t* inode_copy = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
     if (!inode_copy) {
         return ESP_ERR_NO_MEM;
     }
@@ -143,7 +203,7 @@ esp_err_t corefs_inode_write(corefs_ctx_t* ctx, uint32_t inode_block,
                  inode_copy->inode_num, inode_block);
     }
 
-    free(inode_copy);
+    corefs_mem_free(ctx, inode_copy);
     return ret;
 }
 
@@ -156,14 +216,14 @@ esp_err_t corefs_inode_delete(corefs_ctx_t* ctx, uint32_t inode_block) {
     }
 
     // Read inode
-    corefs_inode_t* inode = malloc(sizeof(corefs_inode_t));
+    corefs_inode_t* inode = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
     if (!inode) {
         return ESP_ERR_NO_MEM;
     }
 
     esp_err_t ret = corefs_inode_read(ctx, inode_block, inode);
     if (ret != ESP_OK) {
-        free(inode);
+        corefs_mem_free(ctx, inode);
         return ret;
     }
 
@@ -182,6 +242,19 @@ esp_err_t corefs_inode_delete(corefs_ctx_t* ctx, uint32_t inode_block) {
     ESP_LOGI(TAG, "Deleted inode %lu (freed %lu blocks)",
              inode->inode_num, inode->blocks_used + 1);
 
-    free(inode);
+    corefs_mem_free(ctx, inode);
     return ESP_OK;
-}
\ No newline at end of file
+}
+/**
+ * Placement class for a file's data blocks: caller hint first, then
+ * rewrite history
+ */
+corefs_class_t corefs_inode_class(const corefs_inode_t* inode) {
+    if (inode->flags & COREFS_INODE_HOT) {
+        return COREFS_CLASS_HOT;
+    }
+    if (inode->flags & COREFS_INODE_COLD) {
+        return COREFS_CLASS_COLD;
+    }
+    return (inode->rewrites >= COREFS_HOT_REWRITES) ? COREFS_CLASS_HOT : COREFS_CLASS_COLD;
+}
@@ -0,0 +1,747 @@
+/**
+ * CoreFS - Key-Value Store
+ *
+ * A store is one record file (corefs_append_record()) used as a log.
+ * Each record is an atomic batch of entries, put or delete, each a
+ * corefs_kv_entry_t followed by the key and the value; a single put is
+ * a batch of one. Small values pack densely: most puts cost one flash
+ * program of the record, with no erase and no inode write.
+ *
+ * The index lives in RAM in corefs_kv_t: an open-addressing hash table
+ * that maps a key's hash to the record and offset of its newest entry.
+ * Keys are not kept in RAM; a hash match is confirmed by reading the
+ * entry back. Opening a store replays the log to rebuild the index.
+ *
+ * Compaction writes the live entries, packed, to "<path>~" and renames
+ * it over the log, so a power cut leaves either log complete. It runs
+ * when dead entries take COREFS_KV_COMPACT_PCT of the log, or the log
+ * is full; with corefs_kv_compact_start() a background task does it
+ * instead of the call that crossed the threshold. Compaction needs a
+ * free directory entry for the temporary file.
+ *
+ * kv->lock serializes all calls on one store and is taken before any
+ * filesystem lock.
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char* TAG = "corefs_kv";
+
+#define KV_OP_PUT      1
+#define KV_OP_DELETE   2
+
+#define KV_EMPTY       0
+#define KV_DELETED     1
+
+static void kv_lock(corefs_kv_t* kv) {
+    xSemaphoreTake((SemaphoreHandle_t)kv->lock, portMAX_DELAY);
+}
+
+static void kv_unlock(corefs_kv_t* kv) {
+    xSemaphoreGive((SemaphoreHandle_t)kv->lock);
+}
+
+// FNV-1a; the two marker values are never used for a key
+static uint32_t kv_hash(const char* key, uint32_t len) {
+    uint32_t h = 2166136261u;
+    for (uint32_t i = 0; i < len; i++) {
+        h ^= (uint8_t)key[i];
+        h *= 16777619u;
+    }
+    return (h <= KV_DELETED) ? h + 2 : h;
+}
+
+static bool key_valid(const char* key) {
+    if (!key) {
+        return false;
+    }
+    size_t len = strlen(key);
+    return len > 0 && len <= COREFS_KV_KEY_MAX;
+}
+
+// Reads the first n bytes of the entry in slot
+static esp_err_t read_entry(corefs_kv_t* kv, const corefs_kv_slot_t* slot, void* buf, uint32_t n) {
+    uint32_t at = slot->pos + sizeof(corefs_record_hdr_t) + slot->off;
+    return corefs_pread(kv->file, buf, n, at) == (int)n ? ESP_OK : ESP_FAIL;
+}
+
+// ============================================
+// INDEX
+// ============================================
+
+/**
+ * Probe for key. *idx receives the slot holding it (*found set), or the
+ * slot a new entry would take: the first deleted one passed, else the
+ * empty one that ended the probe (-1 when the table has none). With
+ * entry set, a match leaves the whole entry there.
+ */
+static esp_err_t index_find(corefs_kv_t* kv, const char* key, uint32_t key_len, uint32_t hash,
+                            uint8_t* entry, int* idx, bool* found) {
+    uint8_t head[sizeof(corefs_kv_entry_t) + COREFS_KV_KEY_MAX];
+    int free_idx = -1;
+
+    *found = false;
+    for (uint32_t n = 0; n < COREFS_KV_SLOTS; n++) {
+        uint32_t i = (hash + n) & (COREFS_KV_SLOTS - 1);
+        const corefs_kv_slot_t* slot = &kv->slots[i];
+
+        if (slot->hash == KV_EMPTY) {
+            if (free_idx < 0) {
+                free_idx = (int)i;
+            }
+            break;
+        }
+        if (slot->hash == KV_DELETED) {
+            if (free_idx < 0) {
+                free_idx = (int)i;
+            }
+            continue;
+        }
+        if (slot->hash != hash || slot->len < sizeof(corefs_kv_entry_t) + key_len) {
+            continue;
+        }
+
+        // Same hash: the key on flash decides
+        uint8_t* buf = entry ? entry : head;
+        uint32_t n_read = entry ? slot->len : sizeof(corefs_kv_entry_t) + key_len;
+        esp_err_t ret = read_entry(kv, slot, buf, n_read);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        const corefs_kv_entry_t* e = (const corefs_kv_entry_t*)buf;
+        if (e->key_len == key_len && memcmp(e + 1, key, key_len) == 0) {
+            *idx = (int)i;
+            *found = true;
+            return ESP_OK;
+        }
+    }
+
+    *idx = free_idx;
+    return ESP_OK;
+}
+
+/**
+ * Point the index at the entries of a record at stream offset pos. Run
+ * on every record once it is on flash, and on replay.
+ */
+static esp_err_t index_apply(corefs_kv_t* kv, const uint8_t* payload, uint32_t len, uint32_t pos) {
+    uint32_t off = 0;
+    while (off + sizeof(corefs_kv_entry_t) <= len) {
+        const corefs_kv_entry_t* e = (const corefs_kv_entry_t*)(payload + off);
+        uint32_t size = sizeof(*e) + e->key_len + e->value_len;
+        if (e->key_len == 0 || e->key_len > COREFS_KV_KEY_MAX || size > len - off ||
+            (e->op != KV_OP_PUT && e->op != KV_OP_DELETE)) {
+            ESP_LOGE(TAG, "'%s': bad entry at %u+%u", kv->path, pos, off);
+            return ESP_ERR_INVALID_STATE;
+        }
+
+        const char* key = (const char*)(e + 1);
+        uint32_t hash = kv_hash(key, e->key_len);
+        int idx;
+        bool found;
+        esp_err_t ret = index_find(kv, key, e->key_len, hash, NULL, &idx, &found);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        corefs_kv_slot_t* slot = (idx >= 0) ? &kv->slots[idx] : NULL;
+        if (found) {
+            kv->live_bytes -= slot->len;
+        }
+
+        if (e->op == KV_OP_PUT) {
+            if (!found && (!slot || kv->keys >= COREFS_KV_MAX_KEYS)) {
+                ESP_LOGE(TAG, "'%s': index full", kv->path);
+                return ESP_ERR_NO_MEM;
+            }
+            if (!found) {
+                kv->deleted -= (slot->hash == KV_DELETED);
+                kv->keys++;
+            }
+            slot->hash = hash;
+            slot->pos = pos;
+            slot->off = (uint16_t)off;
+            slot->len = (uint16_t)size;
+            kv->live_bytes += size;
+        } else if (found) {
+            slot->hash = KV_DELETED;
+            kv->keys--;
+            kv->deleted++;
+        }
+
+        off += size;
+    }
+    return ESP_OK;
+}
+
+// Rebuilds the index from the log; buf is block-sized scratch
+static esp_err_t index_load(corefs_kv_t* kv, uint8_t* buf) {
+    memset(kv->slots, 0, sizeof(kv->slots));
+    kv->keys = 0;
+    kv->deleted = 0;
+    kv->live_bytes = 0;
+
+    corefs_record_iter_t it;
+    corefs_record_iter_init(&it, kv->file);
+
+    int n;
+    uint32_t records = 0;
+    while ((n = corefs_record_next(&it, buf, COREFS_BLOCK_SIZE)) > 0) {
+        esp_err_t ret = index_apply(kv, buf, (uint32_t)n, it.at);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        records++;
+    }
+    if (n < 0) {
+        return ESP_FAIL;
+    }
+
+    ESP_LOGD(TAG, "'%s': %u keys from %u records", kv->path, kv->keys, records);
+    return ESP_OK;
+}
+
+// ============================================
+// COMPACTION
+// ============================================
+
+static bool needs_compaction(corefs_kv_t* kv) {
+    uint32_t log = (uint32_t)corefs_size(kv->file);
+    if (kv->deleted > COREFS_KV_SLOTS / 4) {
+        return true;
+    }
+    return log >= COREFS_KV_COMPACT_MIN &&
+           (uint64_t)(log - kv->live_bytes) * 100 >= (uint64_t)log * COREFS_KV_COMPACT_PCT;
+}
+
+// Writes the live entries to tmp, packed into as few records as fit
+static esp_err_t write_live(corefs_kv_t* kv, const char* tmp, uint8_t* buf) {
+    corefs_file_t* out = corefs_fs_open(kv->fs, tmp, COREFS_O_RDWR | COREFS_O_CREAT |
+                                                     COREFS_O_TRUNC | COREFS_O_HOT);
+    if (!out) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ESP_OK;
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < COREFS_KV_SLOTS && ret == ESP_OK; i++) {
+        const corefs_kv_slot_t* slot = &kv->slots[i];
+        if (slot->hash <= KV_DELETED) {
+            continue;
+        }
+
+        if (len + slot->len > COREFS_RECORD_MAX) {
+            ret = corefs_append_record(out, buf, len, NULL);
+            len = 0;
+        }
+        if (ret == ESP_OK) {
+            ret = read_entry(kv, slot, buf + len, slot->len);
+        }
+        len += slot->len;
+    }
+    if (ret == ESP_OK && len > 0) {
+        ret = corefs_append_record(out, buf, len, NULL);
+    }
+
+    esp_err_t close_ret = corefs_close(out);
+    return (ret == ESP_OK) ? close_ret : ret;
+}
+
+// kv->buf is left alone: a commit may hold its record there
+static esp_err_t compact_locked(corefs_kv_t* kv) {
+    char tmp[sizeof(kv->path) + 1];
+    snprintf(tmp, sizeof(tmp), "%s~", kv->path);
+
+    uint8_t* buf = corefs_mem_alloc(kv->fs, COREFS_BLOCK_SIZE);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t before = (uint32_t)corefs_size(kv->file);
+    esp_err_t ret = write_live(kv, tmp, buf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "'%s': compaction failed: %s", kv->path, esp_err_to_name(ret));
+        corefs_fs_unlink(kv->fs, tmp);
+        corefs_mem_free(kv->fs, buf);
+        return ret;
+    }
+
+    // Rename refuses to replace an open file
+    corefs_close(kv->file);
+    ret = corefs_fs_rename(kv->fs, tmp, kv->path);
+    if (ret != ESP_OK) {
+        corefs_fs_unlink(kv->fs, tmp);
+    }
+
+    // After a failed rename the old log and its index still hold
+    kv->file = corefs_fs_open(kv->fs, kv->path, COREFS_O_RDWR | COREFS_O_HOT);
+    if (!kv->file) {
+        ESP_LOGE(TAG, "'%s': cannot reopen", kv->path);
+        ret = ESP_FAIL;
+    } else if (ret == ESP_OK) {
+        ret = index_load(kv, buf);
+    }
+
+    if (ret == ESP_OK) {
+        kv->compactions++;
+        ESP_LOGI(TAG, "'%s': compacted %u -> %u bytes (%u keys)", kv->path,
+                 before, (uint32_t)corefs_size(kv->file), kv->keys);
+    }
+    corefs_mem_free(kv->fs, buf);
+    return ret;
+}
+
+/**
+ * Drop dead entries from the log now, whatever the thresholds.
+ */
+esp_err_t corefs_kv_compact(corefs_kv_t* kv) {
+    if (!kv || !kv->lock) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    kv_lock(kv);
+    esp_err_t ret = kv->file ? compact_locked(kv) : ESP_ERR_INVALID_STATE;
+    kv_unlock(kv);
+    return ret;
+}
+
+static void compact_task(void* arg) {
+    corefs_kv_t* kv = (corefs_kv_t*)arg;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (kv->stop) {
+            break;
+        }
+
+        kv_lock(kv);
+        if (kv->file && needs_compaction(kv)) {
+            compact_locked(kv);
+        }
+        kv_unlock(kv);
+    }
+
+    kv->task = NULL;
+    vTaskDelete(NULL);
+}
+
+/**
+ * Compact in a background task from now on; puts and deletes that
+ * cross the threshold wake it instead of compacting themselves. The
+ * task ends with corefs_kv_close().
+ */
+esp_err_t corefs_kv_compact_start(corefs_kv_t* kv) {
+    if (!kv || !kv->lock) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (kv->task) {
+        return ESP_OK;
+    }
+
+    kv->stop = false;
+
+    TaskHandle_t task = NULL;
+    if (xTaskCreate(compact_task, "corefs_kv", COREFS_KV_STACK_SIZE, kv,
+                    tskIDLE_PRIORITY + 1, &task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start compaction task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    kv->task = task;
+    return ESP_OK;
+}
+
+// ============================================
+// COMMIT
+// ============================================
+
+/**
+ * Append the entries in payload as one record and index them. The
+ * record is the commit point: after a power cut the whole batch is
+ * there on replay, or none of it.
+ */
+static esp_err_t commit_locked(corefs_kv_t* kv, const uint8_t* payload, uint32_t len) {
+    if (!kv->file) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Keys the batch adds must fit the index before the record is written
+    uint32_t added = 0;
+    for (uint32_t off = 0; off < len; ) {
+        const corefs_kv_entry_t* e = (const corefs_kv_entry_t*)(payload + off);
+        const char* key = (const char*)(e + 1);
+        int idx;
+        bool found;
+        esp_err_t ret = index_find(kv, key, e->key_len, kv_hash(key, e->key_len), NULL,
+                                   &idx, &found);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        added += (e->op == KV_OP_PUT && !found);
+        off += sizeof(*e) + e->key_len + e->value_len;
+    }
+    if (kv->keys + added > COREFS_KV_MAX_KEYS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t pos = 0;
+    esp_err_t ret = corefs_append_record(kv->file, payload, len, &pos);
+    if (ret == ESP_ERR_NO_MEM) {
+        // Log full: make room and try once more
+        ret = compact_locked(kv);
+        if (ret == ESP_OK) {
+            ret = corefs_append_record(kv->file, payload, len, &pos);
+        }
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ret = index_apply(kv, payload, len, pos);
+
+    if (ret == ESP_OK && needs_compaction(kv)) {
+        if (kv->task) {
+            xTaskNotifyGive((TaskHandle_t)kv->task);
+        } else {
+            compact_locked(kv);
+        }
+    }
+    return ret;
+}
+
+// Writes one entry at dst and returns its size
+static uint32_t put_entry(uint8_t* dst, uint8_t op, const char* key, const void* value, size_t len) {
+    corefs_kv_entry_t e = {
+        .op = op,
+        .key_len = (uint8_t)strlen(key),
+        .value_len = (uint16_t)len,
+    };
+    memcpy(dst, &e, sizeof(e));
+    memcpy(dst + sizeof(e), key, e.key_len);
+    if (len > 0) {
+        memcpy(dst + sizeof(e) + e.key_len, value, len);
+    }
+    return sizeof(e) + e.key_len + len;
+}
+
+// ============================================
+// LIFECYCLE
+// ============================================
+
+/**
+ * Open the store kept in the file at path, creating it if missing, and
+ * build its index. kv is owned by the caller (about 6 KB, mostly the
+ * index) and stays in use until corefs_kv_close().
+ */
+esp_err_t corefs_fs_kv_open(corefs_ctx_t* fs, const char* path, corefs_kv_t* kv) {
+    if (!fs || !fs->mounted || !path || !kv) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Room for the "~" of the compaction file
+    if (strlen(path) + 1 >= sizeof(kv->path)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memset(kv, 0, sizeof(*kv));
+    kv->fs = fs;
+    strcpy(kv->path, path);
+
+    // A compaction cut short by a power loss; the log is intact
+    char tmp[sizeof(kv->path) + 1];
+    snprintf(tmp, sizeof(tmp), "%s~", path);
+    if (corefs_fs_exists(fs, tmp)) {
+        ESP_LOGW(TAG, "Dropping unfinished compaction '%s'", tmp);
+        corefs_fs_unlink(fs, tmp);
+    }
+
+    kv->lock = xSemaphoreCreateMutex();
+    kv->buf = corefs_mem_alloc(fs, COREFS_BLOCK_SIZE);
+    kv->file = corefs_fs_open(fs, path, COREFS_O_RDWR | COREFS_O_CREAT | COREFS_O_HOT);
+
+    esp_err_t ret = ESP_OK;
+    if (!kv->lock || !kv->buf) {
+        ret = ESP_ERR_NO_MEM;
+    } else if (!kv->file) {
+        ret = ESP_FAIL;
+    } else if (corefs_size(kv->file) > 0 &&
+               (corefs_file_inode_flags(kv->file) & (COREFS_INODE_RECORDS | COREFS_INODE_TIMESERIES |
+                                                     COREFS_INODE_RING)) != COREFS_INODE_RECORDS) {
+        ESP_LOGE(TAG, "'%s' is not a key-value store", path);
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        ret = index_load(kv, kv->buf);
+    }
+
+    if (ret != ESP_OK) {
+        corefs_kv_close(kv);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "'%s': %u keys, %u of %u log bytes live", path, kv->keys,
+             kv->live_bytes, (uint32_t)corefs_size(kv->file));
+    return ESP_OK;
+}
+
+esp_err_t corefs_kv_open(const char* path, corefs_kv_t* kv) {
+    return corefs_fs_kv_open(corefs_get_context(), path, kv);
+}
+
+/**
+ * Stop the compaction task and close the log. Everything put is on
+ * flash already; the close only checkpoints the log's inode.
+ */
+esp_err_t corefs_kv_close(corefs_kv_t* kv) {
+    if (!kv) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (kv->task) {
+        kv->stop = true;
+        xTaskNotifyGive((TaskHandle_t)kv->task);
+        while (kv->task) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+
+    esp_err_t ret = ESP_OK;
+    if (kv->file) {
+        ret = corefs_close(kv->file);
+        kv->file = NULL;
+    }
+    if (kv->buf) {
+        corefs_mem_free(kv->fs, kv->buf);
+        kv->buf = NULL;
+    }
+    if (kv->lock) {
+        vSemaphoreDelete((SemaphoreHandle_t)kv->lock);
+        kv->lock = NULL;
+    }
+    return ret;
+}
+
+// ============================================
+// ACCESS
+// ============================================
+
+/**
+ * Copy the value of key into buf. *len (may be NULL) receives the value
+ * length, also when buf is too small (ESP_ERR_INVALID_SIZE) so that a
+ * call with size 0 asks for it. ESP_ERR_NOT_FOUND when key is not set.
+ */
+esp_err_t corefs_kv_get(corefs_kv_t* kv, const char* key, void* buf, size_t size, size_t* len) {
+    if (!kv || !kv->lock || !key_valid(key) || (!buf && size > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    kv_lock(kv);
+
+    uint32_t key_len = strlen(key);
+    int idx = -1;
+    bool found = false;
+    esp_err_t ret = kv->file ? index_find(kv, key, key_len, kv_hash(key, key_len), kv->buf,
+                                          &idx, &found)
+                             : ESP_ERR_INVALID_STATE;
+    if (ret == ESP_OK && !found) {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+
+    if (ret == ESP_OK) {
+        const corefs_kv_entry_t* e = (const corefs_kv_entry_t*)kv->buf;
+        if (len) {
+            *len = e->value_len;
+        }
+        if (e->value_len > size) {
+            ret = ESP_ERR_INVALID_SIZE;
+        } else if (e->value_len > 0) {
+            memcpy(buf, kv->buf + sizeof(*e) + key_len, e->value_len);
+        }
+    }
+
+    kv_unlock(kv);
+    return ret;
+}
+
+/**
+ * Set key to len bytes of value (len up to COREFS_KV_VALUE_MAX, 0 for
+ * an empty value). On flash once this returns.
+ */
+esp_err_t corefs_kv_put(corefs_kv_t* kv, const char* key, const void* value, size_t len) {
+    if (!kv || !kv->lock || !key_valid(key) || (!value && len > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (len > COREFS_KV_VALUE_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    kv_lock(kv);
+    uint32_t n = put_entry(kv->buf, KV_OP_PUT, key, value, len);
+    esp_err_t ret = commit_locked(kv, kv->buf, n);
+    kv_unlock(kv);
+    return ret;
+}
+
+/**
+ * Remove key. ESP_ERR_NOT_FOUND when it is not set.
+ */
+esp_err_t corefs_kv_delete(corefs_kv_t* kv, const char* key) {
+    if (!kv || !kv->lock || !key_valid(key)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    kv_lock(kv);
+
+    uint32_t key_len = strlen(key);
+    int idx;
+    bool found = false;
+    esp_err_t ret = kv->file ? index_find(kv, key, key_len, kv_hash(key, key_len), NULL,
+                                          &idx, &found)
+                             : ESP_ERR_INVALID_STATE;
+    if (ret == ESP_OK && !found) {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+    if (ret == ESP_OK) {
+        uint32_t n = put_entry(kv->buf, KV_OP_DELETE, key, NULL, 0);
+        ret = commit_locked(kv, kv->buf, n);
+    }
+
+    kv_unlock(kv);
+    return ret;
+}
+
+/**
+ * Call cb for every key, in no particular order. cb must not call into
+ * the same store.
+ */
+esp_err_t corefs_kv_iterate(corefs_kv_t* kv, corefs_kv_iter_cb_t cb, void* arg) {
+    if (!kv || !kv->lock || !cb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    kv_lock(kv);
+
+    esp_err_t ret = kv->file ? ESP_OK : ESP_ERR_INVALID_STATE;
+    for (uint32_t i = 0; i < COREFS_KV_SLOTS && ret == ESP_OK; i++) {
+        const corefs_kv_slot_t* slot = &kv->slots[i];
+        if (slot->hash <= KV_DELETED) {
+            continue;
+        }
+
+        ret = read_entry(kv, slot, kv->buf, slot->len);
+        if (ret != ESP_OK) {
+            break;
+        }
+
+        const corefs_kv_entry_t* e = (const corefs_kv_entry_t*)kv->buf;
+        char key[COREFS_KV_KEY_MAX + 1];
+        memcpy(key, e + 1, e->key_len);
+        key[e->key_len] = '\0';
+        if (!cb(key, kv->buf + sizeof(*e) + e->key_len, e->value_len, arg)) {
+            break;
+        }
+    }
+
+    kv_unlock(kv);
+    return ret;
+}
+
+esp_err_t corefs_kv_get_stats(corefs_kv_t* kv, corefs_kv_stats_t* stats) {
+    if (!kv || !kv->lock || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    kv_lock(kv);
+    stats->keys = kv->keys;
+    stats->live_bytes = kv->live_bytes;
+    stats->log_bytes = kv->file ? (uint32_t)corefs_size(kv->file) : 0;
+    stats->compactions = kv->compactions;
+    kv_unlock(kv);
+    return ESP_OK;
+}
+
+// ============================================
+// BATCHES
+// ============================================
+// A batch collects puts and deletes in RAM and commits them as one
+// record, so they reach flash together or not at all. It holds up to
+// COREFS_RECORD_MAX bytes of entries.
+
+esp_err_t corefs_kv_batch_begin(corefs_kv_t* kv, corefs_kv_batch_t* batch) {
+    if (!kv || !kv->lock || !batch) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(batch, 0, sizeof(*batch));
+    batch->buf = corefs_mem_alloc(kv->fs, COREFS_BLOCK_SIZE);
+    if (!batch->buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    batch->kv = kv;
+    return ESP_OK;
+}
+
+static esp_err_t batch_add(corefs_kv_batch_t* batch, uint8_t op, const char* key,
+                           const void* value, size_t len) {
+    if (!batch || !batch->buf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+    if (!key_valid(key) || (!value && len > 0)) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else if (sizeof(corefs_kv_entry_t) + strlen(key) + len > COREFS_RECORD_MAX - batch->len) {
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+
+    if (ret == ESP_OK) {
+        batch->len += put_entry(batch->buf + batch->len, op, key, value, len);
+    } else if (batch->err == ESP_OK) {
+        batch->err = ret;
+    }
+    return ret;
+}
+
+esp_err_t corefs_kv_batch_put(corefs_kv_batch_t* batch, const char* key, const void* value,
+                              size_t len) {
+    return batch_add(batch, KV_OP_PUT, key, value, len);
+}
+
+// Deleting a key that is not set is not an error in a batch
+esp_err_t corefs_kv_batch_delete(corefs_kv_batch_t* batch, const char* key) {
+    return batch_add(batch, KV_OP_DELETE, key, NULL, 0);
+}
+
+/**
+ * Write the batch, or nothing when an earlier put or delete failed
+ * (that error is returned). The batch is released either way.
+ */
+esp_err_t corefs_kv_batch_commit(corefs_kv_batch_t* batch) {
+    if (!batch || !batch->buf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    corefs_kv_t* kv = batch->kv;
+    esp_err_t ret = batch->err;
+    if (ret == ESP_OK && batch->len > 0) {
+        kv_lock(kv);
+        ret = commit_locked(kv, batch->buf, batch->len);
+        kv_unlock(kv);
+    }
+
+    corefs_kv_batch_abort(batch);
+    return ret;
+}
+
+void corefs_kv_batch_abort(corefs_kv_batch_t* batch) {
+    if (batch && batch->buf) {
+        corefs_mem_free(batch->kv->fs, batch->buf);
+        batch->buf = NULL;
+        batch->len = 0;
+    }
+}
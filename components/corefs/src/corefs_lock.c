@@ -0,0 +1,232 @@
+/**
+ * CoreFS - Locking
+ *
+ * Lock order (outer to inner), never taken the other way round:
+ *   1. dir_lock      rwlock  directory (root node), open/close/unlink,
+ *                            open inode table, static wear leveling
+ *   2. node->lock    rwlock  one open inode: size, block list, data;
+ *                            striped (ctx->node_locks), so at most one
+ *                            is held, or two taken in stripe order
+ *      node_lock     mutex   which open inodes are in RAM, held while
+ *                            one is loaded or written back
+ *   3. sector lock   rwlock  striped by sector, held across flash I/O
+ *                            so a read never sees a half-rewritten sector
+ *      rescue_lock   mutex   rescue log, held from saving a sibling
+ *                            until its sector is programmed again
+ *   4. alloc_lock    mutex   bitmap, placement classes, wear map, stats
+ *                            (recursive, innermost, never held across
+ *                            a call that takes 1-3)
+ * txn_lock is held from corefs_txn_begin() to commit/rollback and only
+ * wraps block writes, so it sits between 2 and 3. wq_lock guards the
+ * write elevator and is held across its flush and across freeing a
+ * block (corefs_block_free()), so it sits after txn_lock and before 3.
+ *
+ * A key-value store's lock (corefs_kv_t.lock) is held across whole
+ * calls into the filesystem and comes before all of the above.
+ *
+ * aio_ctl serializes starting and stopping the I/O task and comes before
+ * everything (stop holds it while the task drains its queue). aio_lock
+ * only wraps a non-blocking queue send and takes nothing inside.
+ *
+ * Locks are only created for a mounted filesystem; with NULL handles
+ * (format, host tools) every helper is a no-op.
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+
+static const char* TAG = "corefs_lock";
+
+// ============================================
+// READER/WRITER LOCK
+// ============================================
+//
+// Reader preference: the first reader takes the write semaphore on
+// behalf of all readers, the last one gives it back. write is a binary
+// semaphore since it may be given by a different task than took it.
+
+static esp_err_t rwlock_init(corefs_rwlock_t* rw) {
+    rw->lock = xSemaphoreCreateMutex();
+    rw->write = xSemaphoreCreateBinary();
+    rw->readers = 0;
+
+    if (!rw->lock || !rw->write) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreGive((SemaphoreHandle_t)rw->write);
+    return ESP_OK;
+}
+
+static void rwlock_deinit(corefs_rwlock_t* rw) {
+    if (rw->lock) {
+        vSemaphoreDelete((SemaphoreHandle_t)rw->lock);
+        rw->lock = NULL;
+    }
+    if (rw->write) {
+        vSemaphoreDelete((SemaphoreHandle_t)rw->write);
+        rw->write = NULL;
+    }
+}
+
+void corefs_rwlock_rdlock(corefs_rwlock_t* rw) {
+    if (!rw->lock) {
+        return;
+    }
+
+    xSemaphoreTake((SemaphoreHandle_t)rw->lock, portMAX_DELAY);
+    if (++rw->readers == 1) {
+        xSemaphoreTake((SemaphoreHandle_t)rw->write, portMAX_DELAY);
+    }
+    xSemaphoreGive((SemaphoreHandle_t)rw->lock);
+}
+
+void corefs_rwlock_rdunlock(corefs_rwlock_t* rw) {
+    if (!rw->lock) {
+        return;
+    }
+
+    xSemaphoreTake((SemaphoreHandle_t)rw->lock, portMAX_DELAY);
+    if (--rw->readers == 0) {
+        xSemaphoreGive((SemaphoreHandle_t)rw->write);
+    }
+    xSemaphoreGive((SemaphoreHandle_t)rw->lock);
+}
+
+void corefs_rwlock_wrlock(corefs_rwlock_t* rw) {
+    if (rw->write) {
+        xSemaphoreTake((SemaphoreHandle_t)rw->write, portMAX_DELAY);
+    }
+}
+
+void corefs_rwlock_wrunlock(corefs_rwlock_t* rw) {
+    if (rw->write) {
+        xSemaphoreGive((SemaphoreHandle_t)rw->write);
+    }
+}
+
+// ============================================
+// ALLOCATOR LOCK
+// ============================================
+
+void corefs_alloc_lock(corefs_ctx_t* ctx) {
+    if (ctx && ctx->alloc_lock) {
+        xSemaphoreTakeRecursive((SemaphoreHandle_t)ctx->alloc_lock, portMAX_DELAY);
+    }
+}
+
+void corefs_alloc_unlock(corefs_ctx_t* ctx) {
+    if (ctx && ctx->alloc_lock) {
+        xSemaphoreGiveRecursive((SemaphoreHandle_t)ctx->alloc_lock);
+    }
+}
+
+// ============================================
+// NODE RESIDENCY LOCK
+// ============================================
+
+void corefs_node_lock(corefs_ctx_t* ctx) {
+    if (ctx->node_lock) {
+        xSemaphoreTake((SemaphoreHandle_t)ctx->node_lock, portMAX_DELAY);
+    }
+}
+
+void corefs_node_unlock(corefs_ctx_t* ctx) {
+    if (ctx->node_lock) {
+        xSemaphoreGive((SemaphoreHandle_t)ctx->node_lock);
+    }
+}
+
+// ============================================
+// LIFECYCLE
+// ============================================
+
+esp_err_t corefs_lock_init(corefs_ctx_t* ctx) {
+    if (!ctx) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_OK;
+
+    ctx->alloc_lock = xSemaphoreCreateRecursiveMutex();
+    ctx->txn_lock = xSemaphoreCreateMutex();
+    ctx->wq_lock = xSemaphoreCreateMutex();
+    ctx->rescue_lock = xSemaphoreCreateMutex();
+    ctx->aio_lock = xSemaphoreCreateMutex();
+    ctx->aio_ctl = xSemaphoreCreateMutex();
+    ctx->aio_exit = xSemaphoreCreateBinary();
+    ctx->node_lock = xSemaphoreCreateMutex();
+    if (!ctx->alloc_lock || !ctx->txn_lock || !ctx->wq_lock || !ctx->rescue_lock ||
+        !ctx->aio_lock || !ctx->aio_ctl || !ctx->aio_exit || !ctx->node_lock) {
+        ret = ESP_ERR_NO_MEM;
+    }
+
+    if (ret == ESP_OK) {
+        ret = rwlock_init(&ctx->dir_lock);
+    }
+    for (int i = 0; i < COREFS_SECTOR_LOCKS && ret == ESP_OK; i++) {
+        ret = rwlock_init(&ctx->sector_locks[i]);
+    }
+    for (int i = 0; i < COREFS_NODE_LOCKS && ret == ESP_OK; i++) {
+        ret = rwlock_init(&ctx->node_locks[i]);
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create locks");
+        corefs_lock_deinit(ctx);
+        return ret;
+    }
+
+    ESP_LOGD(TAG, "Locks initialized");
+    return ESP_OK;
+}
+
+void corefs_lock_deinit(corefs_ctx_t* ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    if (ctx->alloc_lock) {
+        vSemaphoreDelete((SemaphoreHandle_t)ctx->alloc_lock);
+        ctx->alloc_lock = NULL;
+    }
+    if (ctx->txn_lock) {
+        vSemaphoreDelete((SemaphoreHandle_t)ctx->txn_lock);
+        ctx->txn_lock = NULL;
+    }
+    if (ctx->wq_lock) {
+        vSemaphoreDelete((SemaphoreHandle_t)ctx->wq_lock);
+        ctx->wq_lock = NULL;
+    }
+    if (ctx->rescue_lock) {
+        vSemaphoreDelete((SemaphoreHandle_t)ctx->rescue_lock);
+        ctx->rescue_lock = NULL;
+    }
+    if (ctx->aio_lock) {
+        vSemaphoreDelete((SemaphoreHandle_t)ctx->aio_lock);
+        ctx->aio_lock = NULL;
+    }
+    if (ctx->aio_ctl) {
+        vSemaphoreDelete((SemaphoreHandle_t)ctx->aio_ctl);
+        ctx->aio_ctl = NULL;
+    }
+    if (ctx->aio_exit) {
+        vSemaphoreDelete((SemaphoreHandle_t)ctx->aio_exit);
+        ctx->aio_exit = NULL;
+    }
+    if (ctx->node_lock) {
+        vSemaphoreDelete((SemaphoreHandle_t)ctx->node_lock);
+        ctx->node_lock = NULL;
+    }
+
+    rwlock_deinit(&ctx->dir_lock);
+    for (int i = 0; i < COREFS_SECTOR_LOCKS; i++) {
+        rwlock_deinit(&ctx->sector_locks[i]);
+    }
+    for (int i = 0; i < COREFS_NODE_LOCKS; i++) {
+        rwlock_deinit(&ctx->node_locks[i]);
+    }
+}
@@ -0,0 +1,205 @@
+/**
+ * CoreFS - Block Compression
+ *
+ * A small LZ4 block-format codec for compressed files: greedy matching
+ * through a hash table of 4-byte sequences, no entropy stage, so both
+ * directions run close to memcpy speed. The output is plain LZ4 block
+ * data and decodes with any LZ4 decoder.
+ *
+ * The compressor works on one block at a time (offsets stay below
+ * 64 KB by construction) and gives up as soon as the output would not
+ * fit; the caller then stores the block raw. The decompressor checks
+ * every length and offset against both buffers, since its input comes
+ * from flash.
+ */
+
+#include "corefs.h"
+#include <string.h>
+
+#define LZ_MIN_MATCH     4
+#define LZ_LAST_LITERALS 5   // The format ends with at least this many literals
+#define LZ_MF_LIMIT      12  // No match starts within this many bytes of the end
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - COREFS_LZ_HASH_BITS);
+}
+
+// A length past the token's 15 continues in bytes of 255
+static bool put_length(uint8_t* dst, uint32_t cap, uint32_t* op, uint32_t len) {
+    while (len >= 255) {
+        if (*op >= cap) {
+            return false;
+        }
+        dst[(*op)++] = 255;
+        len -= 255;
+    }
+    if (*op >= cap) {
+        return false;
+    }
+    dst[(*op)++] = (uint8_t)len;
+    return true;
+}
+
+static bool put_sequence(uint8_t* dst, uint32_t cap, uint32_t* op,
+                         const uint8_t* lit, uint32_t lit_len,
+                         uint32_t offset, uint32_t match_len) {
+    if (*op >= cap) {
+        return false;
+    }
+    uint32_t token = *op;
+    uint32_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    dst[token] = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    (*op)++;
+
+    if (lit_len >= 15 && !put_length(dst, cap, op, lit_len - 15)) {
+        return false;
+    }
+    if (lit_len > cap - *op) {
+        return false;
+    }
+    memcpy(dst + *op, lit, lit_len);
+    *op += lit_len;
+
+    // The last sequence is literals only
+    if (!match_len) {
+        return true;
+    }
+    if (cap - *op < 2) {
+        return false;
+    }
+    dst[(*op)++] = (uint8_t)offset;
+    dst[(*op)++] = (uint8_t)(offset >> 8);
+    return ml < 15 || put_length(dst, cap, op, ml - 15);
+}
+
+/**
+ * Compress len bytes (at most 64 KB) into dst. table is scratch for
+ * 1 << COREFS_LZ_HASH_BITS entries. Returns the compressed size, or 0
+ * if it would exceed cap.
+ */
+uint32_t corefs_lz_compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap,
+                            uint16_t* table) {
+    if (!src || !dst || !table || len > UINT16_MAX) {
+        return 0;
+    }
+
+    // Entries hold position + 1; zero is an empty slot
+    memset(table, 0, sizeof(uint16_t) << COREFS_LZ_HASH_BITS);
+
+    uint32_t ip = 0;
+    uint32_t anchor = 0;
+    uint32_t op = 0;
+    const uint32_t limit = len > LZ_MF_LIMIT ? len - LZ_MF_LIMIT : 0;
+
+    while (ip < limit) {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = lz_hash(seq);
+        uint32_t ref = table[h];
+        table[h] = (uint16_t)(ip + 1);
+
+        if (!ref || read32(src + ref - 1) != seq) {
+            ip++;
+            continue;
+        }
+        ref--;
+
+        uint32_t match = LZ_MIN_MATCH;
+        while (ip + match < len - LZ_LAST_LITERALS && src[ref + match] == src[ip + match]) {
+            match++;
+        }
+        if (!put_sequence(dst, cap, &op, src + anchor, ip - anchor, ip - ref, match)) {
+            return 0;
+        }
+
+        ip += match;
+        anchor = ip;
+        // Seed the table inside the match so the next one can refer back
+        if (ip < limit) {
+            table[lz_hash(read32(src + ip - 2))] = (uint16_t)(ip - 1);
+        }
+    }
+
+    if (!put_sequence(dst, cap, &op, src + anchor, len - anchor, 0, 0)) {
+        return 0;
+    }
+    return op;
+}
+
+/**
+ * Decompress len bytes of LZ4 block data into dst. Returns the bytes
+ * produced, or -1 if the input is malformed or would overrun cap.
+ */
+int corefs_lz_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap) {
+    if (!src || !dst) {
+        return -1;
+    }
+
+    uint32_t ip = 0;
+    uint32_t op = 0;
+
+    while (ip < len) {
+        uint8_t token = src[ip++];
+
+        uint32_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= len) {
+                    return -1;
+                }
+                b = src[ip++];
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > len - ip || lit > cap - op) {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+
+        if (ip == len) {
+            break;
+        }
+
+        if (len - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = src[ip] | ((uint32_t)src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return -1;
+        }
+
+        uint32_t match = token & 15;
+        if (match == 15) {
+            uint8_t b;
+            do {
+                if (ip >= len) {
+                    return -1;
+                }
+                b = src[ip++];
+                match += b;
+            } while (b == 255);
+        }
+        match += LZ_MIN_MATCH;
+        if (match > cap - op) {
+            return -1;
+        }
+
+        // Byte by byte: a match may overlap the bytes it produces
+        const uint8_t* from = dst + op - offset;
+        for (uint32_t i = 0; i < match; i++) {
+            dst[op + i] = from[i];
+        }
+        op += match;
+    }
+
+    return (int)op;
+}
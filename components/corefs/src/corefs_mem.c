@@ -0,0 +1,275 @@
+/**
+ * CoreFS - Memory
+ *
+ * Without an arena every buffer comes from the heap. With
+ * corefs_config_t.arena set, the instance never calls malloc/free after
+ * mount:
+ *   - the context, superblock, bitmaps, wear map, cache and write queue
+ *     are carved from the arena once at mount (bump pointer)
+ *   - handles, open inode nodes and block-sized scratch buffers (I/O
+ *     bounce buffers, directory nodes, inode copies, the inodes open
+ *     files keep in RAM) come from fixed-size slabs carved right after
+ *     the context
+ * A slab that runs dry fails the call like an out-of-memory heap would.
+ * The arena is released as a whole by unmount; the caller owns it.
+ *
+ * Slabs are guarded by the alloc lock (innermost, so any caller may
+ * allocate).
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* TAG = "corefs_mem";
+
+static uint32_t align_up(uint32_t size) {
+    return (size + COREFS_ARENA_ALIGN - 1) & ~(uint32_t)(COREFS_ARENA_ALIGN - 1);
+}
+
+static void* arena_carve(corefs_arena_t* arena, uint32_t size) {
+    // base is aligned in corefs_mem_init(); keep every carve aligned too
+    size = align_up(size);
+    if (size > arena->size - arena->top) {
+        return NULL;
+    }
+    void* p = arena->base + arena->top;
+    arena->top += size;
+    memset(p, 0, size);
+    return p;
+}
+
+static esp_err_t slab_init(corefs_arena_t* arena, corefs_slab_t* slab,
+                           uint32_t slot_size, uint32_t count) {
+    slab->slot_size = align_up(slot_size);
+    slab->count = count;
+    slab->in_use = 0;
+    slab->peak = 0;
+    slab->used = arena_carve(arena, ((count + 31) / 32) * sizeof(uint32_t));
+    slab->base = arena_carve(arena, slab->slot_size * count);
+    return (slab->used && slab->base) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+// ============================================
+// LIFECYCLE
+// ============================================
+
+static bool arena_setup(corefs_arena_t* arena, void* mem, uint32_t size) {
+    uintptr_t start = (uintptr_t)mem;
+    uint32_t pad = (COREFS_ARENA_ALIGN - start % COREFS_ARENA_ALIGN) % COREFS_ARENA_ALIGN;
+    if (size < pad) {
+        return false;
+    }
+    arena->base = (uint8_t*)mem + pad;
+    arena->size = size - pad;
+    arena->top = 0;
+    arena->failures = 0;
+    return true;
+}
+
+/**
+ * Context for corefs_fs_mount(): the first thing carved from the
+ * arena, or calloc'd without one.
+ */
+corefs_ctx_t* corefs_mem_new_context(const corefs_config_t* config) {
+    if (!config || !config->arena) {
+        return calloc(1, sizeof(corefs_ctx_t));
+    }
+
+    corefs_arena_t arena;
+    if (!arena_setup(&arena, config->arena, config->arena_size)) {
+        return NULL;
+    }
+
+    corefs_ctx_t* ctx = arena_carve(&arena, sizeof(corefs_ctx_t));
+    if (ctx) {
+        ctx->arena = arena;
+    }
+    return ctx;
+}
+
+void corefs_mem_delete_context(corefs_ctx_t* ctx) {
+    if (ctx && !ctx->arena.base) {
+        free(ctx);
+    }
+}
+
+/**
+ * Set up the arena of a mounting instance: slabs first, then everything
+ * carved by mount follows.
+ */
+esp_err_t corefs_mem_init(corefs_ctx_t* ctx) {
+    corefs_arena_t* arena = &ctx->arena;
+
+    if (!ctx->config.arena) {
+        memset(arena, 0, sizeof(*arena));
+        return ESP_OK;
+    }
+
+    // Context not carved by corefs_mem_new_context()
+    if (!arena->base && !arena_setup(arena, ctx->config.arena, ctx->config.arena_size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t ret = slab_init(arena, &arena->slabs[COREFS_SLAB_HANDLE],
+                              sizeof(corefs_file_t), ctx->config.max_files);
+    if (ret == ESP_OK) {
+        ret = slab_init(arena, &arena->slabs[COREFS_SLAB_NODE],
+                        sizeof(corefs_node_t), ctx->config.max_files);
+    }
+    if (ret == ESP_OK) {
+        ret = slab_init(arena, &arena->slabs[COREFS_SLAB_BUFFER],
+                        COREFS_BLOCK_SIZE, ctx->config.arena_buffers);
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Arena of %u bytes too small for slabs", ctx->config.arena_size);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Arena: %u bytes, %u handles, %u buffers",
+             arena->size, ctx->config.max_files, ctx->config.arena_buffers);
+    return ESP_OK;
+}
+
+// ============================================
+// ALLOCATION
+// ============================================
+
+/**
+ * Memory kept until unmount (zeroed). Carved from the arena, or
+ * calloc'd without one.
+ */
+void* corefs_mem_carve(corefs_ctx_t* ctx, size_t size) {
+    if (!ctx || !ctx->arena.base) {
+        return calloc(1, size);
+    }
+
+    void* p = arena_carve(&ctx->arena, (uint32_t)size);
+    if (!p) {
+        ctx->arena.failures++;
+        ESP_LOGE(TAG, "Arena exhausted (%u bytes requested)", (uint32_t)size);
+    }
+    return p;
+}
+
+/**
+ * Short-lived or per-handle memory. Taken from the smallest slab that
+ * fits and has a free slot, or malloc'd without an arena.
+ */
+void* corefs_mem_alloc(corefs_ctx_t* ctx, size_t size) {
+    if (!ctx || !ctx->arena.base) {
+        return malloc(size);
+    }
+
+    void* p = NULL;
+    corefs_alloc_lock(ctx);
+    for (int c = 0; c < COREFS_SLAB_COUNT && !p; c++) {
+        corefs_slab_t* slab = &ctx->arena.slabs[c];
+        if (size > slab->slot_size || slab->in_use == slab->count) {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < slab->count; i++) {
+            if (!(slab->used[i / 32] & (1u << (i % 32)))) {
+                slab->used[i / 32] |= (1u << (i % 32));
+                if (++slab->in_use > slab->peak) {
+                    slab->peak = slab->in_use;
+                }
+                p = slab->base + i * slab->slot_size;
+                break;
+            }
+        }
+    }
+    if (!p) {
+        ctx->arena.failures++;
+    }
+    corefs_alloc_unlock(ctx);
+
+    if (!p) {
+        ESP_LOGW(TAG, "No free slab slot for %u bytes", (uint32_t)size);
+    }
+    return p;
+}
+
+void* corefs_mem_calloc(corefs_ctx_t* ctx, size_t size) {
+    void* p = corefs_mem_alloc(ctx, size);
+    if (p) {
+        memset(p, 0, size);
+    }
+    return p;
+}
+
+/**
+ * Release memory from corefs_mem_alloc() or corefs_mem_carve(). Carved
+ * arena memory is only reclaimed by unmount, so freeing it is a no-op.
+ */
+void corefs_mem_free(corefs_ctx_t* ctx, void* ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    if (!ctx || !ctx->arena.base) {
+        free(ptr);
+        return;
+    }
+
+    uint8_t* p = ptr;
+    corefs_alloc_lock(ctx);
+    for (int c = 0; c < COREFS_SLAB_COUNT; c++) {
+        corefs_slab_t* slab = &ctx->arena.slabs[c];
+        if (p >= slab->base && p < slab->base + slab->slot_size * slab->count) {
+            uint32_t i = (uint32_t)(p - slab->base) / slab->slot_size;
+            if (slab->used[i / 32] & (1u << (i % 32))) {
+                slab->used[i / 32] &= ~(1u << (i % 32));
+                slab->in_use--;
+            }
+            break;
+        }
+    }
+    corefs_alloc_unlock(ctx);
+}
+
+// ============================================
+// STATISTICS
+// ============================================
+
+esp_err_t corefs_fs_get_mem_stats(corefs_ctx_t* fs, corefs_mem_stats_t* stats) {
+    if (!fs || !fs->mounted || !stats) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    if (!fs->arena.base) {
+        return ESP_OK;
+    }
+
+    corefs_alloc_lock(fs);
+    const corefs_arena_t* arena = &fs->arena;
+    const corefs_slab_t* handles = &arena->slabs[COREFS_SLAB_HANDLE];
+    const corefs_slab_t* buffers = &arena->slabs[COREFS_SLAB_BUFFER];
+
+    stats->arena_size = arena->size;
+    stats->arena_used = arena->top;
+    stats->handles_in_use = handles->in_use;
+    stats->handles_peak = handles->peak;
+    stats->buffers_total = buffers->count;
+    stats->buffers_in_use = buffers->in_use;
+    stats->buffers_peak = buffers->peak;
+    stats->alloc_failures = arena->failures;
+
+    // Arena this workload needed: slots never used did not have to exist
+    stats->high_water = arena->top;
+    for (int c = 0; c < COREFS_SLAB_COUNT; c++) {
+        const corefs_slab_t* slab = &arena->slabs[c];
+        stats->high_water -= (slab->count - slab->peak) * slab->slot_size;
+    }
+    corefs_alloc_unlock(fs);
+
+    return ESP_OK;
+}
+
+esp_err_t corefs_get_mem_stats(corefs_mem_stats_t* stats) {
+    return corefs_fs_get_mem_stats(corefs_get_context(), stats);
+}
@@ -16,14 +16,37 @@ static const char* TAG = "corefs_recovery";
 #define TXN_OP_WRITE   2
 #define TXN_OP_DELETE  3
 #define TXN_OP_COMMIT  4
+#define TXN_OP_RENAME  5
 
 // External declarations
 extern corefs_ctx_t* corefs_get_context(void);
 extern esp_err_t corefs_block_read(corefs_ctx_t* ctx, uint32_t block, void* buf);
+extern esp_err_t corefs_block_write(corefs_ctx_t* ctx, uint32_t block, const void* buf);
 
 // ============================================================================
-// RECOVERY SCAN (called during mount on unclean shutdown)
+// RECOVERY SCAN (called during mount, after the root is loaded)
 // ============================================================================
+//
+// The txn log holds the last prepared transaction. Its COMMIT entry names
+// the root sequence that carries it: a live root at or past that
+// sequence means the operation took effect, otherwise the root write
+// never completed and the previous directory is intact. Either way the
+// directory is consistent; what is left over (the inode a rename
+// replaced) is unreachable and the bitmap rebuild that follows frees it.
+
+static void recovery_report(const corefs_txn_entry_t* entry, bool applied) {
+    if (entry->op == TXN_OP_RENAME) {
+        if (!applied) {
+            ESP_LOGW(TAG, "Rename of inode %lu did not reach the root, rolled back",
+                     entry->inode);
+        } else if (entry->block != 0) {
+            ESP_LOGI(TAG, "Rename of inode %lu completed, replaced inode %lu reclaimed",
+                     entry->inode, entry->block);
+        } else {
+            ESP_LOGI(TAG, "Rename of inode %lu completed", entry->inode);
+        }
+    }
+}
 
 esp_err_t corefs_recovery_scan(corefs_ctx_t* ctx) {
     if (!ctx || !ctx->sb) {
@@ -34,7 +57,7 @@ esp_err_t corefs_recovery_scan(corefs_ctx_t* ctx) {
     ESP_LOGI(TAG, "Starting filesystem recovery scan...");
     
     // Allocate buffer for transaction log
-    corefs_txn_entry_t* txn_log = malloc(COREFS_BLOCK_SIZE);
+    corefs_txn_entry_t* txn_log = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
     if (!txn_log) {
         ESP_LOGE(TAG, "Failed to allocate transaction log buffer");
         return ESP_ERR_NO_MEM;
@@ -44,39 +67,48 @@ esp_err_t corefs_recovery_scan(corefs_ctx_t* ctx) {
     esp_err_t ret = corefs_block_read(ctx, ctx->sb->txn_log_block, txn_log);
     if (ret != ESP_OK) {
         ESP_LOGW(TAG, "Failed to read transaction log: %s", esp_err_to_name(ret));
-        free(txn_log);
+        corefs_mem_free(ctx, txn_log);
         // Continue recovery even if log is unreadable
         return ESP_OK;
     }
     
-    // Analyze transaction log for incomplete transactions
-    bool incomplete = false;
-    int txn_count = 0;
+    // Find the prepared transaction: BEGIN ... COMMIT(root seq)
     int max_entries = COREFS_BLOCK_SIZE / sizeof(corefs_txn_entry_t);
+    int begin = -1;
+    int commit = -1;
     
-    for (int i = 0; i < max_entries; i++) {
+    for (int i = 0; i < max_entries && commit < 0; i++) {
         if (txn_log[i].op == TXN_OP_BEGIN) {
-            incomplete = true;
-            txn_count = 0;
-            ESP_LOGD(TAG, "Found transaction begin at entry %d", i);
-        } else if (txn_log[i].op == TXN_OP_COMMIT) {
-            incomplete = false;
-            ESP_LOGD(TAG, "Found transaction commit at entry %d (%d ops)", 
-                     i, txn_count);
-        } else if (txn_log[i].op != TXN_OP_NONE) {
-            txn_count++;
+            begin = i;
+        } else if (txn_log[i].op == TXN_OP_COMMIT && begin >= 0) {
+            commit = i;
         }
     }
     
-    if (incomplete) {
-        ESP_LOGW(TAG, "Found incomplete transaction with %d operations", txn_count);
-        ESP_LOGI(TAG, "Copy-on-write recovery: old data is still valid");
-        // Copy-on-write means old data is still valid, nothing to do!
+    if (commit < 0) {
+        // A torn log write: the root write it guards never started
+        ESP_LOGI(TAG, "No prepared transaction found");
     } else {
-        ESP_LOGI(TAG, "No incomplete transactions found");
+        uint32_t seq = txn_log[commit].block;
+        bool applied = (ctx->root_seq >= seq);
+        
+        for (int i = begin + 1; i < commit; i++) {
+            recovery_report(&txn_log[i], applied);
+        }
+        
+        if (!applied) {
+            // Its sequence must not be reached by a later, unrelated root
+            // write, which would make the log read as applied
+            ctx->root_seq = seq;
+            memset(txn_log, 0, COREFS_BLOCK_SIZE);
+            if (!ctx->read_only &&
+                corefs_block_write(ctx, ctx->sb->txn_log_block, txn_log) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to clear transaction log");
+            }
+        }
     }
     
-    free(txn_log);
+    corefs_mem_free(ctx, txn_log);
     
     // Verify superblock CRC (✓ FIXED: checksum field)
     uint32_t stored_csum = ctx->sb->checksum;
@@ -100,10 +132,8 @@ esp_err_t corefs_recovery_scan(corefs_ctx_t* ctx) {
 // FILESYSTEM CHECK (fsck)
 // ============================================================================
 
-esp_err_t corefs_check(void) {
-    corefs_ctx_t* ctx = corefs_get_context();
-    
-    if (!ctx->mounted) {
+esp_err_t corefs_fs_check(corefs_ctx_t* ctx) {
+    if (!ctx || !ctx->mounted) {
         ESP_LOGE(TAG, "Filesystem not mounted");
         return ESP_ERR_INVALID_STATE;
     }
@@ -151,4 +181,8 @@ esp_err_t corefs_check(void) {
     
     ESP_LOGI(TAG, "Filesystem check complete");
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t corefs_check(void) {
+    return corefs_fs_check(corefs_get_context());
+}
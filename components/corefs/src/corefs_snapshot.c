@@ -0,0 +1,284 @@
+/**
+ * CoreFS - Snapshots
+ *
+ * A snapshot is a copy of the root directory whose entries point at
+ * clones of the live inodes. A clone shares every data block of its
+ * file, so taking a snapshot writes one inode per file plus the
+ * directory copy, however much data the files hold. Writes to the live
+ * files afterwards copy the blocks they touch (copy-on-write).
+ *
+ * The snapshot directories are listed in superblock.snapshots, and the
+ * superblock write is the commit point of create and delete: it goes to
+ * the superblock slot not in use, so a power cut leaves the old table
+ * or the new one (corefs_superblock_write()). Rollback
+ * commits clones of the snapshot's inodes as the live root in one root
+ * write and keeps the snapshot for another rollback.
+ *
+ * Mounting with corefs_config_t.snapshot set uses the snapshot's
+ * directory as the root of a read-only instance.
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char* TAG = "corefs_snap";
+
+static bool snapshot_valid(corefs_ctx_t* ctx, uint32_t id) {
+    return id >= 1 && id <= COREFS_MAX_SNAPSHOTS && ctx->sb->snapshots[id - 1] != 0;
+}
+
+static esp_err_t read_dir(corefs_ctx_t* ctx, uint32_t block, corefs_btree_node_t* node) {
+    esp_err_t ret = corefs_block_read(ctx, block, node);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (node->magic != COREFS_BTREE_MAGIC || node->count > COREFS_BTREE_ORDER - 1) {
+        ESP_LOGE(TAG, "Invalid directory at block %u", block);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < node->count; i++) {
+        node->entries[i].name[63] = '\0';
+    }
+    return ESP_OK;
+}
+
+// Blocks_used must not change while the checksum is taken
+static esp_err_t write_superblock(corefs_ctx_t* ctx) {
+    corefs_alloc_lock(ctx);
+    esp_err_t ret = corefs_superblock_write(ctx);
+    corefs_alloc_unlock(ctx);
+    return ret;
+}
+
+// Drops the inodes of the first count entries (their blocks lose a reference)
+static void release_entries(corefs_ctx_t* ctx, const corefs_btree_node_t* node, int count) {
+    for (int i = 0; i < count; i++) {
+        corefs_inode_delete(ctx, node->entries[i].inode_block);
+    }
+}
+
+// Points every entry at a new clone of its inode. On failure the clones
+// made so far are dropped and the node is left half updated.
+static esp_err_t clone_entries(corefs_ctx_t* ctx, corefs_btree_node_t* node) {
+    for (int i = 0; i < node->count; i++) {
+        uint32_t clone = 0;
+        esp_err_t ret = corefs_file_share(ctx, node->entries[i].inode_block,
+                                          node->entries[i].name, &clone);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Cannot clone '%s': %s", node->entries[i].name, esp_err_to_name(ret));
+            release_entries(ctx, node, i);
+            return ret;
+        }
+        node->entries[i].inode_block = clone;
+    }
+    return ESP_OK;
+}
+
+// ============================================
+// CREATE
+// ============================================
+
+/**
+ * Freeze the current directory and file contents. Open files are taken
+ * as they are in RAM. *out_id receives the snapshot id (1-based).
+ */
+esp_err_t corefs_fs_snapshot_create(corefs_ctx_t* fs, uint32_t* out_id) {
+    if (!fs || !fs->mounted || !out_id) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (fs->read_only) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    corefs_btree_node_t* node = corefs_mem_alloc(fs, sizeof(corefs_btree_node_t));
+    if (!node) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    corefs_rwlock_wrlock(&fs->dir_lock);
+
+    uint32_t slot = 0;
+    while (slot < COREFS_MAX_SNAPSHOTS && fs->sb->snapshots[slot] != 0) {
+        slot++;
+    }
+
+    esp_err_t ret = ESP_OK;
+    if (slot == COREFS_MAX_SNAPSHOTS) {
+        ESP_LOGE(TAG, "All %d snapshot slots in use", COREFS_MAX_SNAPSHOTS);
+        ret = ESP_ERR_NO_MEM;
+    }
+    if (ret == ESP_OK) {
+        ret = read_dir(fs, fs->root_active, node);
+    }
+    if (ret == ESP_OK) {
+        ret = clone_entries(fs, node);
+    }
+
+    uint32_t block = 0;
+    if (ret == ESP_OK) {
+        block = corefs_block_alloc_class(fs, COREFS_CLASS_META);
+        ret = block ? corefs_block_write(fs, block, node) : ESP_ERR_NO_MEM;
+
+        if (ret == ESP_OK) {
+            fs->sb->snapshots[slot] = block;
+            ret = write_superblock(fs);
+            if (ret != ESP_OK) {
+                fs->sb->snapshots[slot] = 0;
+            }
+        }
+
+        if (ret != ESP_OK) {
+            if (block) {
+                corefs_block_free(fs, block);
+            }
+            release_entries(fs, node, node->count);
+        }
+    }
+
+    if (ret == ESP_OK) {
+        *out_id = slot + 1;
+        ESP_LOGI(TAG, "Snapshot %u: %u files, directory at block %u",
+                 slot + 1, node->count, block);
+    }
+
+    corefs_rwlock_wrunlock(&fs->dir_lock);
+    corefs_mem_free(fs, node);
+    return ret;
+}
+
+esp_err_t corefs_snapshot_create(uint32_t* out_id) {
+    return corefs_fs_snapshot_create(corefs_get_context(), out_id);
+}
+
+// ============================================
+// ROLLBACK
+// ============================================
+
+/**
+ * Make the live files exactly what they were when snapshot id was
+ * taken. The new directory is committed with one root write; files
+ * created since are dropped. Fails with ESP_ERR_INVALID_STATE while any
+ * file is open. The snapshot itself is kept.
+ */
+esp_err_t corefs_fs_snapshot_rollback(corefs_ctx_t* fs, uint32_t id) {
+    if (!fs || !fs->mounted) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (fs->read_only) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    corefs_btree_node_t* snap = corefs_mem_alloc(fs, sizeof(corefs_btree_node_t));
+    corefs_btree_node_t* live = corefs_mem_alloc(fs, sizeof(corefs_btree_node_t));
+    if (!snap || !live) {
+        corefs_mem_free(fs, snap);
+        corefs_mem_free(fs, live);
+        return ESP_ERR_NO_MEM;
+    }
+
+    corefs_rwlock_wrlock(&fs->dir_lock);
+
+    esp_err_t ret = ESP_OK;
+    if (!snapshot_valid(fs, id)) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else {
+        // Handles would keep using inodes that are about to go away
+        for (uint32_t i = 0; i < fs->files_cap; i++) {
+            if (fs->files[i]) {
+                ESP_LOGE(TAG, "Cannot roll back with open files");
+                ret = ESP_ERR_INVALID_STATE;
+                break;
+            }
+        }
+    }
+
+    if (ret == ESP_OK) {
+        ret = read_dir(fs, fs->sb->snapshots[id - 1], snap);
+    }
+    if (ret == ESP_OK) {
+        ret = read_dir(fs, fs->root_active, live);
+    }
+    if (ret == ESP_OK) {
+        ret = clone_entries(fs, snap);
+    }
+
+    if (ret == ESP_OK) {
+        // Root switch: the commit point of the rollback
+        ret = corefs_btree_commit(fs, snap);
+        if (ret == ESP_OK) {
+            release_entries(fs, live, live->count);
+            ESP_LOGI(TAG, "Rolled back to snapshot %u (%u files)", id, snap->count);
+        } else {
+            release_entries(fs, snap, snap->count);
+        }
+    }
+
+    corefs_rwlock_wrunlock(&fs->dir_lock);
+    corefs_mem_free(fs, snap);
+    corefs_mem_free(fs, live);
+    return ret;
+}
+
+esp_err_t corefs_snapshot_rollback(uint32_t id) {
+    return corefs_fs_snapshot_rollback(corefs_get_context(), id);
+}
+
+// ============================================
+// DELETE
+// ============================================
+
+/**
+ * Drop snapshot id. Blocks only it still references are freed.
+ */
+esp_err_t corefs_fs_snapshot_delete(corefs_ctx_t* fs, uint32_t id) {
+    if (!fs || !fs->mounted) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (fs->read_only) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    corefs_btree_node_t* node = corefs_mem_alloc(fs, sizeof(corefs_btree_node_t));
+    if (!node) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    corefs_rwlock_wrlock(&fs->dir_lock);
+
+    esp_err_t ret = ESP_OK;
+    uint32_t block = 0;
+    int count = 0;
+
+    if (!snapshot_valid(fs, id)) {
+        ret = ESP_ERR_NOT_FOUND;
+    } else {
+        block = fs->sb->snapshots[id - 1];
+
+        // An unreadable snapshot can still be dropped; its inodes stay
+        // allocated until the next mount rebuilds the bitmap
+        if (read_dir(fs, block, node) == ESP_OK) {
+            count = node->count;
+        }
+
+        fs->sb->snapshots[id - 1] = 0;
+        ret = write_superblock(fs);
+        if (ret != ESP_OK) {
+            fs->sb->snapshots[id - 1] = block;
+        }
+    }
+
+    if (ret == ESP_OK) {
+        release_entries(fs, node, count);
+        corefs_block_free(fs, block);
+        ESP_LOGI(TAG, "Deleted snapshot %u", id);
+    }
+
+    corefs_rwlock_wrunlock(&fs->dir_lock);
+    corefs_mem_free(fs, node);
+    return ret;
+}
+
+esp_err_t corefs_snapshot_delete(uint32_t id) {
+    return corefs_fs_snapshot_delete(corefs_get_context(), id);
+}
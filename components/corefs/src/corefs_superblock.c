@@ -10,70 +10,102 @@
 
 static const char* TAG = "corefs_sb";
 
+// The superblock has two slots, one sector each. A write goes to the
+// slot not in use with the next sequence number; mount takes the valid
+// slot with the higher one, so a power cut during a write leaves the
+// previous copy in charge.
+
+static bool superblock_valid(corefs_superblock_t* sb) {
+    if (sb->magic != COREFS_MAGIC) {
+        return false;
+    }
+
+    uint32_t stored_csum = sb->checksum;
+    sb->checksum = 0;
+    uint32_t calc_csum = crc32(sb, sizeof(corefs_superblock_t));
+    sb->checksum = stored_csum;
+    return stored_csum == calc_csum;
+}
+
+// Reads slot into ctx->sb (4 KB; no second buffer needed in arena mode)
+static esp_err_t read_slot(corefs_ctx_t* ctx, uint32_t slot, bool* valid) {
+    esp_err_t ret = esp_partition_read(ctx->partition, slot * COREFS_SECTOR_SIZE,
+                                       ctx->sb, sizeof(corefs_superblock_t));
+    *valid = (ret == ESP_OK && superblock_valid(ctx->sb));
+    return ret;
+}
+
 /**
- * Read superblock from flash and verify checksum
+ * Read the live superblock slot and verify its checksum. Sets sb_slot.
  */
 esp_err_t corefs_superblock_read(corefs_ctx_t* ctx) {
     if (!ctx || !ctx->partition || !ctx->sb) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Read from Block 0
-    esp_err_t ret = esp_partition_read(
-        ctx->partition,
-        0,  // Offset 0 = Block 0
-        ctx->sb,
-        sizeof(corefs_superblock_t)
-    );
-
+    // Slot 1 first, so ctx->sb holds slot 0 unless slot 1 is newer
+    bool valid_alt = false;
+    bool valid = false;
+    uint32_t seq_alt = 0;
+    esp_err_t ret = read_slot(ctx, 1, &valid_alt);
+    if (ret == ESP_OK) {
+        seq_alt = ctx->sb->seq;
+        ret = read_slot(ctx, 0, &valid);
+    }
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to read superblock: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    // Verify magic
-    if (ctx->sb->magic != COREFS_MAGIC) {
-        ESP_LOGE(TAG, "Invalid magic: 0x%08lX (expected 0x%08lX)",
-                 ctx->sb->magic, COREFS_MAGIC);
-        return ESP_ERR_INVALID_STATE;
+    ctx->sb_slot = 0;
+    if (valid_alt && (!valid || seq_alt > ctx->sb->seq)) {
+        ret = read_slot(ctx, 1, &valid);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read superblock: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        ctx->sb_slot = 1;
     }
 
-    // Verify checksum
-    uint32_t stored_csum = ctx->sb->checksum;  // ✓ FIXED: checksum field
-    ctx->sb->checksum = 0;
-    uint32_t calc_csum = crc32(ctx->sb, sizeof(corefs_superblock_t));
-    ctx->sb->checksum = stored_csum;
-
-    if (stored_csum != calc_csum) {
-        ESP_LOGE(TAG, "Checksum mismatch: 0x%08lX != 0x%08lX",
-                 stored_csum, calc_csum);
+    if (!valid) {
+        if (ctx->sb->magic != COREFS_MAGIC) {
+            ESP_LOGE(TAG, "Invalid magic: 0x%08lX (expected 0x%08lX)",
+                     ctx->sb->magic, COREFS_MAGIC);
+            return ESP_ERR_INVALID_STATE;
+        }
+        ESP_LOGE(TAG, "Checksum mismatch in both superblock slots");
         return ESP_ERR_INVALID_CRC;
     }
 
-    ESP_LOGI(TAG, "Superblock read OK (version 0x%04X, %lu blocks)",
-             ctx->sb->version, ctx->sb->block_count);
+    ESP_LOGI(TAG, "Superblock read OK (version 0x%04X, %lu blocks, slot %lu, seq %lu)",
+             ctx->sb->version, ctx->sb->block_count, ctx->sb_slot, ctx->sb->seq);
 
     return ESP_OK;
 }
 
 /**
- * Write superblock to flash with checksum
+ * Write superblock to the slot not in use, with checksum and the next
+ * sequence number. The write is the commit point of what changed in
+ * ctx->sb; on failure the other slot still holds the previous copy.
  */
 esp_err_t corefs_superblock_write(corefs_ctx_t* ctx) {
     if (!ctx || !ctx->partition || !ctx->sb) {
         return ESP_ERR_INVALID_ARG;
     }
 
+    uint32_t slot = ctx->sb_slot ^ 1;
+    ctx->sb->seq++;
+
     // Calculate checksum
     ctx->sb->checksum = 0;  // ✓ FIXED: checksum field
     ctx->sb->checksum = crc32(ctx->sb, sizeof(corefs_superblock_t));
 
-    ESP_LOGI(TAG, "Writing superblock (CRC: 0x%08lX)...", ctx->sb->checksum);
+    ESP_LOGI(TAG, "Writing superblock slot %lu (seq %lu, CRC: 0x%08lX)...",
+             slot, ctx->sb->seq, ctx->sb->checksum);
 
-    // Erase sector (Block 0 = Offset 0)
     esp_err_t ret = esp_partition_erase_range(
         ctx->partition,
-        0,
+        slot * COREFS_SECTOR_SIZE,
         COREFS_SECTOR_SIZE
     );
 
@@ -86,7 +118,7 @@ esp_err_t corefs_superblock_write(corefs_ctx_t* ctx) {
     // Write superblock
     ret = esp_partition_write(
         ctx->partition,
-        0,
+        slot * COREFS_SECTOR_SIZE,
         ctx->sb,
         sizeof(corefs_superblock_t)
     );
@@ -96,6 +128,7 @@ esp_err_t corefs_superblock_write(corefs_ctx_t* ctx) {
         return ret;
     }
 
+    ctx->sb_slot = slot;
     ESP_LOGI(TAG, "Superblock written successfully");
     return ESP_OK;
 }
@@ -1,5 +1,7 @@
 #include "corefs.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -15,21 +17,43 @@ extern esp_err_t corefs_block_write(corefs_ctx_t* ctx, uint32_t block, const voi
 #define TXN_OP_WRITE   2
 #define TXN_OP_DELETE  3
 #define TXN_OP_COMMIT  4
+#define TXN_OP_RENAME  5
 
-// In-memory transaction log (ring buffer)
-static corefs_txn_entry_t txn_log[COREFS_TXN_LOG_SIZE];
-static uint32_t txn_count = 0;
-static bool txn_active = false;
+// In-memory transaction log lives in the context (ctx->txn_log); one
+// transaction at a time, txn_lock is held from begin to commit/rollback.
+//
+// Write-ahead: corefs_txn_prepare() puts the log on flash with a COMMIT
+// entry naming the root sequence that will carry the operation (in its
+// block field). The caller's next root write is the commit point, so on
+// mount the operation took effect iff the live root has reached that
+// sequence (corefs_recovery_scan()).
 
-// Begin transaction
-void corefs_txn_begin(void) {
-    if (txn_active) {
+static void txn_release(corefs_ctx_t* ctx) {
+    ctx->txn_count = 0;
+    ctx->txn_active = false;
+    ctx->txn_prepared = false;
+    memset(ctx->txn_log, 0, sizeof(ctx->txn_log));
+    
+    if (ctx->txn_lock) {
+        xSemaphoreGive((SemaphoreHandle_t)ctx->txn_lock);
+    }
+}
+
+// Begin transaction (blocks while another task has one open)
+void corefs_txn_begin(corefs_ctx_t* ctx) {
+    if (!ctx) {
+        return;
+    }
+    
+    if (ctx->txn_lock) {
+        xSemaphoreTake((SemaphoreHandle_t)ctx->txn_lock, portMAX_DELAY);
+    } else if (ctx->txn_active) {
         ESP_LOGW(TAG, "Transaction already active, rolling back previous");
-        corefs_txn_rollback();
+        corefs_txn_rollback(ctx);
     }
     
-    txn_count = 0;
-    memset(txn_log, 0, sizeof(txn_log));
+    ctx->txn_count = 0;
+    memset(ctx->txn_log, 0, sizeof(ctx->txn_log));
     
     // Log BEGIN entry
     corefs_txn_entry_t entry = {
@@ -39,20 +63,20 @@ void corefs_txn_begin(void) {
         .timestamp = esp_log_timestamp()
     };
     
-    txn_log[txn_count++] = entry;
-    txn_active = true;
+    ctx->txn_log[ctx->txn_count++] = entry;
+    ctx->txn_active = true;
     
     ESP_LOGD(TAG, "Transaction begun");
 }
 
 // Log transaction operation
-void corefs_txn_log(uint32_t op, uint32_t inode, uint32_t block) {
-    if (!txn_active) {
+void corefs_txn_log(corefs_ctx_t* ctx, uint32_t op, uint32_t inode, uint32_t block) {
+    if (!ctx || !ctx->txn_active) {
         ESP_LOGW(TAG, "Cannot log operation: no active transaction");
         return;
     }
     
-    if (txn_count >= COREFS_TXN_LOG_SIZE) {
+    if (ctx->txn_count >= COREFS_TXN_LOG_SIZE) {
         ESP_LOGW(TAG, "Transaction log full (%d entries), cannot add more", 
                  COREFS_TXN_LOG_SIZE);
         return;
@@ -65,70 +89,107 @@ void corefs_txn_log(uint32_t op, uint32_t inode, uint32_t block) {
         .timestamp = esp_log_timestamp()
     };
     
-    txn_log[txn_count++] = entry;
+    ctx->txn_log[ctx->txn_count++] = entry;
     
     ESP_LOGD(TAG, "Logged operation %lu: inode=%lu, block=%lu", 
              op, inode, block);
 }
 
-// Commit transaction (write to flash atomically)
-esp_err_t corefs_txn_commit(corefs_ctx_t* ctx) {
-    if (!txn_active) {
-        ESP_LOGW(TAG, "Cannot commit: no active transaction");
-        return ESP_ERR_INVALID_STATE;
-    }
-    
+/**
+ * Write the log ahead of the root write that commits it. Call with
+ * dir_lock held exclusively, so that root write is the next one.
+ */
+esp_err_t corefs_txn_prepare(corefs_ctx_t* ctx) {
     if (!ctx || !ctx->sb) {
-        ESP_LOGE(TAG, "Invalid context for transaction commit");
+        ESP_LOGE(TAG, "Invalid context for transaction prepare");
         return ESP_ERR_INVALID_ARG;
     }
     
-    // Add COMMIT entry
+    if (!ctx->txn_active || ctx->txn_prepared) {
+        ESP_LOGW(TAG, "Cannot prepare: no open transaction");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    // Add COMMIT entry: the root sequence the operation takes effect with
     corefs_txn_entry_t commit_entry = {
         .op = TXN_OP_COMMIT,
         .inode = 0,
-        .block = 0,
+        .block = ctx->root_seq + 1,
         .timestamp = esp_log_timestamp()
     };
     
-    if (txn_count < COREFS_TXN_LOG_SIZE) {
-        txn_log[txn_count++] = commit_entry;
+    if (ctx->txn_count >= COREFS_TXN_LOG_SIZE) {
+        ESP_LOGE(TAG, "Transaction log full, cannot prepare");
+        return ESP_ERR_NO_MEM;
     }
+    ctx->txn_log[ctx->txn_count++] = commit_entry;
     
-    // Write entire log to flash atomically
-    esp_err_t ret = corefs_block_write(ctx, ctx->sb->txn_log_block, txn_log);
+    // Write entire log to flash in one block write
+    esp_err_t ret = corefs_block_write(ctx, ctx->sb->txn_log_block, ctx->txn_log);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit transaction log: %s", 
+        ESP_LOGE(TAG, "Failed to write transaction log: %s", 
                  esp_err_to_name(ret));
+        // Transaction stays open; caller rolls back
+        ctx->txn_count--;
         return ret;
     }
     
-    ESP_LOGI(TAG, "Transaction committed with %lu operations", txn_count);
+    ctx->txn_prepared = true;
+    return ESP_OK;
+}
+
+/**
+ * Close the transaction once its root write went through. A log not
+ * prepared yet is written first.
+ */
+esp_err_t corefs_txn_commit(corefs_ctx_t* ctx) {
+    if (!ctx || !ctx->sb) {
+        ESP_LOGE(TAG, "Invalid context for transaction commit");
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    if (!ctx->txn_active) {
+        ESP_LOGW(TAG, "Cannot commit: no active transaction");
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (!ctx->txn_prepared) {
+        esp_err_t ret = corefs_txn_prepare(ctx);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    
+    ESP_LOGI(TAG, "Transaction committed with %lu operations", ctx->txn_count);
     
     // Clear log
-    txn_count = 0;
-    txn_active = false;
-    memset(txn_log, 0, sizeof(txn_log));
+    txn_release(ctx);
     
     return ESP_OK;
 }
 
 // Rollback transaction (discard changes)
-void corefs_txn_rollback(void) {
-    if (!txn_active) {
+void corefs_txn_rollback(corefs_ctx_t* ctx) {
+    if (!ctx || !ctx->txn_active) {
         ESP_LOGD(TAG, "No active transaction to rollback");
         return;
     }
     
-    ESP_LOGW(TAG, "Rolling back transaction with %lu operations", txn_count);
+    ESP_LOGW(TAG, "Rolling back transaction with %lu operations", ctx->txn_count);
+    
+    // A prepared log would read as done once a later root write passes
+    // its sequence: replace it with an empty one
+    if (ctx->txn_prepared) {
+        memset(ctx->txn_log, 0, sizeof(ctx->txn_log));
+        if (corefs_block_write(ctx, ctx->sb->txn_log_block, ctx->txn_log) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to clear transaction log");
+        }
+    }
     
-    // Simply discard in-memory log
-    txn_count = 0;
-    txn_active = false;
-    memset(txn_log, 0, sizeof(txn_log));
+    txn_release(ctx);
 }
 
 // Check if transaction is active
-bool corefs_txn_is_active(void) {
-    return txn_active;
+bool corefs_txn_is_active(corefs_ctx_t* ctx) {
+    return ctx && ctx->txn_active;
 }
\ No newline at end of file
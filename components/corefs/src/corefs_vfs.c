@@ -1,92 +1,515 @@
 /**
- * corefs_vfs.c - VFS Integration (FIXED Signatures)
- * 
- * FIX: Remove void* ctx parameter from all callbacks
- * ESP-IDF VFS expects standard POSIX signatures without context
+ * CoreFS - VFS Integration
+ *
+ * Registered with ESP_VFS_FLAG_CONTEXT_PTR: every callback gets the
+ * instance it was registered for, and the local descriptors handed to
+ * the VFS are the instance's own (corefs_fileno()), so a lookup is an
+ * index into ctx->files. Errors are reported through errno.
+ *
+ * read/write/pread/pwrite pass the caller's buffer straight to the file
+ * layer, which moves whole blocks without a bounce copy. newlib gives a
+ * stream a buffer of st_blksize (one block): an fwrite of a block or
+ * more arrives here unchanged, but a buffered fread is always refilled
+ * one block at a time and copied out. For bulk reads use read() or
+ * setvbuf(f, NULL, _IONBF, 0), which passes every fread through.
+ *
+ * The directory is a single flat root, so opendir() accepts "/" only.
  */
 
 #include "corefs.h"
 #include "esp_vfs.h"
 #include "esp_log.h"
 #include <fcntl.h>
+#include <errno.h>
 #include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
 
 static const char* TAG = "corefs_vfs";
 
-// VFS wrappers (stub implementation with CORRECT signatures)
+// Private ioctl() requests carrying readv/writev through the VFS, which
+// has no hooks of its own for them (arg: vfs_iov_req_t*)
+#define COREFS_IOC_READV    0x43460001
+#define COREFS_IOC_WRITEV   0x43460002
 
-// CORRECT: int open(const char* path, int flags, int mode)
-static int vfs_open(const char* path, int flags, int mode) {
-    (void)mode;
-    
-    ESP_LOGW(TAG, "VFS open not fully implemented: %s", path);
-    
-    // TODO: Convert flags and call corefs_open()
-    return -1;
+typedef struct {
+    const struct iovec* iov;
+    int iovcnt;
+} vfs_iov_req_t;
+
+// Open directory stream; the VFS hands the DIR pointer back
+typedef struct {
+    DIR dir;                // Must be first
+    corefs_ctx_t* ctx;
+    long offset;            // Entries returned so far
+    struct dirent entry;
+} vfs_dir_t;
+
+static int vfs_errno(esp_err_t err) {
+    switch (err) {
+    case ESP_ERR_NOT_FOUND:
+        return ENOENT;
+    case ESP_ERR_INVALID_STATE:
+        return EBUSY;
+    case ESP_ERR_NO_MEM:
+        return ENOMEM;
+    case ESP_ERR_INVALID_ARG:
+        return EINVAL;
+    case ESP_ERR_INVALID_SIZE:
+        return EFBIG;
+    case ESP_ERR_NOT_SUPPORTED:
+        return ENOTSUP;
+    default:
+        return EIO;
+    }
 }
 
-// CORRECT: ssize_t read(int fd, void* buf, size_t size)
-static ssize_t vfs_read(int fd, void* buf, size_t size) {
-    (void)fd;
-    (void)buf;
-    (void)size;
-    
-    ESP_LOGW(TAG, "VFS read not implemented");
+static int vfs_fail(esp_err_t err) {
+    errno = vfs_errno(err);
     return -1;
 }
 
-// CORRECT: ssize_t write(int fd, const void* buf, size_t size)
-static ssize_t vfs_write(int fd, const void* buf, size_t size) {
-    (void)fd;
-    (void)buf;
-    (void)size;
-    
-    ESP_LOGW(TAG, "VFS write not implemented");
-    return -1;
+static corefs_file_t* vfs_get_file(corefs_ctx_t* ctx, int fd) {
+    corefs_file_t* file = corefs_fs_get_file(ctx, fd);
+    if (!file) {
+        errno = EBADF;
+    }
+    return file;
 }
 
-// CORRECT: int close(int fd)
-static int vfs_close(int fd) {
-    (void)fd;
-    
-    ESP_LOGW(TAG, "VFS close not implemented");
-    return -1;
+static void fill_stat(const corefs_stat_t* cst, struct stat* st) {
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IFREG | (cst->mode & 0777);
+    st->st_nlink = 1;
+    st->st_size = (off_t)cst->size;
+    st->st_blksize = COREFS_BLOCK_SIZE;
+    st->st_blocks = cst->blocks * (COREFS_BLOCK_SIZE / 512);
 }
 
-// CORRECT: off_t lseek(int fd, off_t offset, int whence)
-static off_t vfs_lseek(int fd, off_t offset, int whence) {
-    (void)fd;
-    (void)offset;
-    (void)whence;
-    
-    ESP_LOGW(TAG, "VFS lseek not implemented");
-    return -1;
+// ============================================
+// FILES
+// ============================================
+
+static int vfs_open(void* ctx, const char* path, int flags, int mode) {
+    (void)mode;
+
+    // O_RDONLY, O_WRONLY, O_RDWR are 0, 1, 2
+    uint32_t cflags = (uint32_t)(flags & O_ACCMODE) + 1;
+    if (flags & O_CREAT) {
+        cflags |= COREFS_O_CREAT;
+    }
+    if (flags & O_TRUNC) {
+        cflags |= COREFS_O_TRUNC;
+    }
+    if (flags & O_APPEND) {
+        cflags |= COREFS_O_APPEND;
+    }
+
+    // The open does the lookup; a second one only for O_EXCL or to
+    // tell the errors apart
+    if ((flags & O_CREAT) && (flags & O_EXCL) && corefs_fs_exists(ctx, path)) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    corefs_file_t* file = corefs_fs_open(ctx, path, cflags);
+    if (!file) {
+        // Missing, out of descriptors, or no room for a new file
+        bool exists = corefs_fs_exists(ctx, path);
+        errno = exists ? EMFILE : (flags & O_CREAT) ? ENOSPC : ENOENT;
+        return -1;
+    }
+
+    ESP_LOGD(TAG, "open %s -> %d", path, corefs_fileno(file));
+    return corefs_fileno(file);
 }
 
-// CORRECT: int unlink(const char* path)
-static int vfs_unlink(const char* path) {
-    ESP_LOGW(TAG, "VFS unlink not implemented: %s", path);
-    return -1;
+static ssize_t vfs_read(void* ctx, int fd, void* buf, size_t size) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+
+    int n = corefs_read(file, buf, size);
+    if (n < 0) {
+        errno = ((file->flags & 0x03) == COREFS_O_WRONLY) ? EBADF : EIO;
+    }
+    return n;
 }
 
-// Register CoreFS with ESP-IDF VFS
-esp_err_t corefs_vfs_register(const char* base_path) {
+static ssize_t vfs_write(void* ctx, int fd, const void* buf, size_t size) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+
+    int n = corefs_write(file, buf, size);
+    if (n < 0) {
+        errno = ((file->flags & 0x03) == COREFS_O_RDONLY) ? EBADF : ENOSPC;
+    }
+    return n;
+}
+
+static ssize_t vfs_pread(void* ctx, int fd, void* buf, size_t size, off_t offset) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+    if (offset < 0 || (uint64_t)offset > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int n = corefs_pread(file, buf, size, (uint32_t)offset);
+    if (n < 0) {
+        errno = ((file->flags & 0x03) == COREFS_O_WRONLY) ? EBADF : EIO;
+    }
+    return n;
+}
+
+static ssize_t vfs_pwrite(void* ctx, int fd, const void* buf, size_t size, off_t offset) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+    if (offset < 0 || (uint64_t)offset > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int n = corefs_pwrite(file, buf, size, (uint32_t)offset);
+    if (n < 0) {
+        errno = ((file->flags & 0x03) == COREFS_O_RDONLY) ? EBADF : ENOSPC;
+    }
+    return n;
+}
+
+static off_t vfs_lseek(void* ctx, int fd, off_t offset, int whence) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+
+    // SEEK_SET/CUR/END share their values with COREFS_SEEK_*
+    if (offset < INT32_MIN || offset > INT32_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    int pos = corefs_seek(file, (int)offset, whence);
+    if (pos < 0) {
+        errno = EINVAL;
+    }
+    return pos;
+}
+
+static int vfs_close(void* ctx, int fd) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+
+    esp_err_t ret = corefs_close(file);
+    return (ret == ESP_OK) ? 0 : vfs_fail(ret);
+}
+
+static int vfs_fstat(void* ctx, int fd, struct stat* st) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+
+    corefs_stat_t cst;
+    esp_err_t ret = corefs_fstat(file, &cst);
+    if (ret != ESP_OK) {
+        return vfs_fail(ret);
+    }
+    fill_stat(&cst, st);
+    return 0;
+}
+
+static int vfs_fsync(void* ctx, int fd) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+
+    esp_err_t ret = corefs_fsync(file);
+    return (ret == ESP_OK) ? 0 : vfs_fail(ret);
+}
+
+static int vfs_ftruncate(void* ctx, int fd, off_t length) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+    if (length < 0 || (uint64_t)length > UINT32_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    esp_err_t ret = corefs_ftruncate(file, (uint32_t)length);
+    return (ret == ESP_OK) ? 0 : vfs_fail(ret);
+}
+
+static int vfs_fcntl(void* ctx, int fd, int cmd, int arg) {
+    (void)arg;
+
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+
+    if (cmd != F_GETFL) {
+        errno = ENOSYS;
+        return -1;
+    }
+
+    int flags = (int)(file->flags & 0x03) - 1;
+    if (file->flags & COREFS_O_APPEND) {
+        flags |= O_APPEND;
+    }
+    return flags;
+}
+
+static int vfs_ioctl(void* ctx, int fd, int cmd, va_list args) {
+    corefs_file_t* file = vfs_get_file(ctx, fd);
+    if (!file) {
+        return -1;
+    }
+
+    if (cmd != COREFS_IOC_READV && cmd != COREFS_IOC_WRITEV) {
+        errno = ENOTTY;
+        return -1;
+    }
+
+    const vfs_iov_req_t* req = va_arg(args, const vfs_iov_req_t*);
+    if (!req || !req->iov || req->iovcnt < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Same errors as read()/write() on this descriptor
+    int n;
+    if (cmd == COREFS_IOC_READV) {
+        n = corefs_readv(file, req->iov, req->iovcnt);
+        if (n < 0) {
+            errno = ((file->flags & 0x03) == COREFS_O_WRONLY) ? EBADF : EIO;
+        }
+    } else {
+        n = corefs_writev(file, req->iov, req->iovcnt);
+        if (n < 0) {
+            errno = ((file->flags & 0x03) == COREFS_O_RDONLY) ? EBADF : ENOSPC;
+        }
+    }
+    return n;
+}
+
+// ============================================
+// PATHS
+// ============================================
+
+static int vfs_stat(void* ctx, const char* path, struct stat* st) {
+    // The root directory itself
+    if (strcmp(path, "/") == 0) {
+        memset(st, 0, sizeof(*st));
+        st->st_mode = S_IFDIR | 0755;
+        st->st_nlink = 1;
+        st->st_blksize = COREFS_BLOCK_SIZE;
+        return 0;
+    }
+
+    corefs_stat_t cst;
+    esp_err_t ret = corefs_fs_stat(ctx, path, &cst);
+    if (ret != ESP_OK) {
+        return vfs_fail(ret);
+    }
+    fill_stat(&cst, st);
+    return 0;
+}
+
+static int vfs_unlink(void* ctx, const char* path) {
+    esp_err_t ret = corefs_fs_unlink(ctx, path);
+    return (ret == ESP_OK) ? 0 : vfs_fail(ret);
+}
+
+static int vfs_rename(void* ctx, const char* src, const char* dst) {
+    esp_err_t ret = corefs_fs_rename(ctx, src, dst);
+    return (ret == ESP_OK) ? 0 : vfs_fail(ret);
+}
+
+// ============================================
+// DIRECTORY
+// ============================================
+
+typedef struct {
+    long skip;
+    struct dirent* entry;
+    bool found;
+} dir_walk_t;
+
+static bool dir_walk_cb(const char* name, uint32_t inode_block, void* arg) {
+    (void)inode_block;
+
+    dir_walk_t* walk = arg;
+    if (walk->skip-- > 0) {
+        return true;
+    }
+
+    strncpy(walk->entry->d_name, name, sizeof(walk->entry->d_name) - 1);
+    walk->entry->d_name[sizeof(walk->entry->d_name) - 1] = '\0';
+    walk->found = true;
+    return false;
+}
+
+static DIR* vfs_opendir(void* ctx, const char* name) {
+    corefs_ctx_t* fs = ctx;
+
+    if (strcmp(name, "/") != 0 && strcmp(name, "") != 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+    if (!fs->mounted) {
+        errno = ENODEV;
+        return NULL;
+    }
+
+    vfs_dir_t* dir = corefs_mem_calloc(fs, sizeof(vfs_dir_t));
+    if (!dir) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    dir->ctx = fs;
+    return &dir->dir;
+}
+
+static int vfs_readdir_r(void* ctx, DIR* pdir, struct dirent* entry, struct dirent** out) {
+    (void)ctx;
+
+    vfs_dir_t* dir = (vfs_dir_t*)pdir;
+    corefs_ctx_t* fs = dir->ctx;
+    dir_walk_t walk = {
+        .skip = dir->offset,
+        .entry = entry,
+    };
+
+    if (!fs->mounted) {
+        *out = NULL;
+        return EBADF;
+    }
+
+    corefs_rwlock_rdlock(&fs->dir_lock);
+    esp_err_t ret = corefs_btree_iterate(fs, dir_walk_cb, &walk);
+    corefs_rwlock_rdunlock(&fs->dir_lock);
+
+    if (ret != ESP_OK) {
+        *out = NULL;
+        return vfs_errno(ret);
+    }
+
+    if (!walk.found) {
+        *out = NULL;  // End of directory
+        return 0;
+    }
+
+    entry->d_ino = 0;
+    entry->d_type = DT_REG;
+    dir->offset++;
+    *out = entry;
+    return 0;
+}
+
+static struct dirent* vfs_readdir(void* ctx, DIR* pdir) {
+    vfs_dir_t* dir = (vfs_dir_t*)pdir;
+    struct dirent* out = NULL;
+
+    int err = vfs_readdir_r(ctx, pdir, &dir->entry, &out);
+    if (err != 0) {
+        errno = err;
+    }
+    return out;
+}
+
+static long vfs_telldir(void* ctx, DIR* pdir) {
+    (void)ctx;
+    return ((vfs_dir_t*)pdir)->offset;
+}
+
+static void vfs_seekdir(void* ctx, DIR* pdir, long offset) {
+    (void)ctx;
+    ((vfs_dir_t*)pdir)->offset = (offset < 0) ? 0 : offset;
+}
+
+static int vfs_closedir(void* ctx, DIR* pdir) {
+    (void)ctx;
+
+    vfs_dir_t* dir = (vfs_dir_t*)pdir;
+    corefs_mem_free(dir->ctx, dir);
+    return 0;
+}
+
+// ============================================
+// READV / WRITEV
+// ============================================
+
+// esp_vfs_t has no readv/writev hooks: these take a descriptor from
+// open() on a CoreFS mount point and reach the instance through ioctl()
+ssize_t corefs_vfs_readv(int fd, const struct iovec* iov, int iovcnt) {
+    vfs_iov_req_t req = {.iov = iov, .iovcnt = iovcnt};
+    return ioctl(fd, COREFS_IOC_READV, &req);
+}
+
+ssize_t corefs_vfs_writev(int fd, const struct iovec* iov, int iovcnt) {
+    vfs_iov_req_t req = {.iov = iov, .iovcnt = iovcnt};
+    return ioctl(fd, COREFS_IOC_WRITEV, &req);
+}
+
+// ============================================
+// REGISTRATION
+// ============================================
+
+esp_err_t corefs_fs_vfs_register(corefs_ctx_t* fs, const char* base_path) {
+    if (!fs || !fs->mounted || !base_path) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
     esp_vfs_t vfs = {
-        .flags = ESP_VFS_FLAG_DEFAULT,
-        .open = &vfs_open,
-        .read = &vfs_read,
-        .write = &vfs_write,
-        .close = &vfs_close,
-        .lseek = &vfs_lseek,
-        .unlink = &vfs_unlink,
+        .flags = ESP_VFS_FLAG_CONTEXT_PTR,
+        .open_p = &vfs_open,
+        .read_p = &vfs_read,
+        .write_p = &vfs_write,
+        .pread_p = &vfs_pread,
+        .pwrite_p = &vfs_pwrite,
+        .lseek_p = &vfs_lseek,
+        .close_p = &vfs_close,
+        .fstat_p = &vfs_fstat,
+        .fsync_p = &vfs_fsync,
+        .ftruncate_p = &vfs_ftruncate,
+        .fcntl_p = &vfs_fcntl,
+        .ioctl_p = &vfs_ioctl,
+        .stat_p = &vfs_stat,
+        .unlink_p = &vfs_unlink,
+        .rename_p = &vfs_rename,
+        .opendir_p = &vfs_opendir,
+        .readdir_p = &vfs_readdir,
+        .readdir_r_p = &vfs_readdir_r,
+        .telldir_p = &vfs_telldir,
+        .seekdir_p = &vfs_seekdir,
+        .closedir_p = &vfs_closedir,
     };
-    
+
     ESP_LOGI(TAG, "Registering VFS at: %s", base_path);
-    return esp_vfs_register(base_path, &vfs, NULL);
+    return esp_vfs_register(base_path, &vfs, fs);
+}
+
+esp_err_t corefs_vfs_register(const char* base_path) {
+    return corefs_fs_vfs_register(corefs_get_context(), base_path);
 }
 
 // Unregister VFS
 esp_err_t corefs_vfs_unregister(const char* base_path) {
     ESP_LOGI(TAG, "Unregistering VFS: %s", base_path);
     return esp_vfs_unregister(base_path);
-}
\ No newline at end of file
+}
@@ -6,11 +6,59 @@
 
 #include "corefs.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 static const char* TAG = "corefs_wear";
 
+// ============================================================================
+// WEAR MAP LAYOUT
+// ============================================================================
+//
+// Erases always hit a whole sector, so wear is counted per sector:
+//   - wear_base + uint8_t delta per sector (detail, bounded by
+//     COREFS_WEAR_DETAIL_MAX_SECTORS)
+//   - per-region summary (total erases, min delta, free blocks) that
+//     lets the allocator pick a low-wear region without a full scan
+// Exact per-sector counts always live on flash in the wear log; large
+// partitions keep only the region summary in RAM.
+
+static uint32_t wear_sector_count(uint32_t block_count) {
+    return (block_count + 1) / 2;
+}
+
+static uint32_t wear_region_of(uint32_t block) {
+    return (block / 2) / COREFS_WEAR_REGION_SECTORS;
+}
+
+static uint32_t wear_region_sectors(corefs_ctx_t* ctx, uint32_t region) {
+    uint32_t first = region * COREFS_WEAR_REGION_SECTORS;
+    uint32_t count = wear_sector_count(ctx->sb->block_count) - first;
+    return (count < COREFS_WEAR_REGION_SECTORS) ? count : COREFS_WEAR_REGION_SECTORS;
+}
+
+static void wear_pending_clear(corefs_ctx_t* ctx) {
+    ctx->wear_pending_count = 0;
+    ctx->wear_pending_total = 0;
+    ctx->wear_pending_peak = 0;
+}
+
+static void wear_region_update_min(corefs_ctx_t* ctx, uint32_t region) {
+    uint32_t first = region * COREFS_WEAR_REGION_SECTORS;
+    uint32_t count = wear_region_sectors(ctx, region);
+    uint8_t min_delta = 0xFF;
+    
+    for (uint32_t s = first; s < first + count; s++) {
+        if (ctx->wear_delta[s] < min_delta) {
+            min_delta = ctx->wear_delta[s];
+        }
+    }
+    ctx->wear_regions[region].min_delta = min_delta;
+}
+
 // ============================================================================
 // INITIALIZATION
 // ============================================================================
@@ -21,65 +69,358 @@ esp_err_t corefs_wear_init(corefs_ctx_t* ctx) {
         return ESP_ERR_INVALID_ARG;
     }
     
-    // Allocate wear table (2 bytes per block)
-    size_t table_size = ctx->sb->block_count * sizeof(uint16_t);
-    ctx->wear_table = calloc(1, table_size);
+    uint32_t sector_count = wear_sector_count(ctx->sb->block_count);
+    ctx->wear_region_count = (sector_count + COREFS_WEAR_REGION_SECTORS - 1) / 
+                             COREFS_WEAR_REGION_SECTORS;
+    ctx->wear_regions = corefs_mem_carve(ctx, ctx->wear_region_count * sizeof(corefs_wear_region_t));
     
-    if (!ctx->wear_table) {
-        ESP_LOGE(TAG, "Failed to allocate wear table (%zu bytes)", table_size);
+    // Per-sector detail only while it stays small
+    ctx->wear_delta = NULL;
+    if (sector_count <= COREFS_WEAR_DETAIL_MAX_SECTORS) {
+        ctx->wear_delta = corefs_mem_carve(ctx, sector_count);
+    }
+    
+    if (!ctx->wear_regions || (sector_count <= COREFS_WEAR_DETAIL_MAX_SECTORS && !ctx->wear_delta)) {
+        ESP_LOGE(TAG, "Failed to allocate wear map (%lu sectors)", sector_count);
+        corefs_wear_cleanup(ctx);
         return ESP_ERR_NO_MEM;
     }
     
-    // Initialize all wear counts to 0 (calloc does this)
-    ESP_LOGI(TAG, "Wear leveling initialized: %lu blocks tracked", 
-             ctx->sb->block_count);
+    ctx->wear_base = 0;
+    wear_pending_clear(ctx);
+    ctx->wear_log_pos = 0;
+    ctx->wear_saving = false;
+    corefs_wear_recount(ctx);
+    
+    ESP_LOGI(TAG, "Wear leveling initialized: %lu sectors, %lu regions (%s)", 
+             sector_count, ctx->wear_region_count,
+             ctx->wear_delta ? "detail" : "summary");
     
     return ESP_OK;
 }
 
+void corefs_wear_cleanup(corefs_ctx_t* ctx) {
+    if (ctx->wear_delta) {
+        corefs_mem_free(ctx, ctx->wear_delta);
+        ctx->wear_delta = NULL;
+    }
+    if (ctx->wear_regions) {
+        corefs_mem_free(ctx, ctx->wear_regions);
+        ctx->wear_regions = NULL;
+    }
+}
+
+// Recount free blocks per region from the allocation bitmap
+void corefs_wear_recount(corefs_ctx_t* ctx) {
+    if (!ctx || !ctx->wear_regions || !ctx->block_bitmap) {
+        return;
+    }
+    
+    for (uint32_t r = 0; r < ctx->wear_region_count; r++) {
+        ctx->wear_regions[r].free_blocks = 0;
+    }
+    ctx->wear_free_sectors = 0;
+    
+    for (uint32_t i = 0; i < ctx->sb->block_count; i++) {
+        if (!corefs_block_is_allocated(ctx, i)) {
+            ctx->wear_regions[wear_region_of(i)].free_blocks++;
+            if ((i & 1) && !corefs_block_is_allocated(ctx, i - 1)) {
+                ctx->wear_free_sectors++;
+            }
+        }
+    }
+}
+
+void corefs_wear_note_alloc(corefs_ctx_t* ctx, uint32_t block, bool allocated) {
+    if (!ctx || !ctx->wear_regions || block >= ctx->sb->block_count) {
+        return;
+    }
+    
+    corefs_wear_region_t* region = &ctx->wear_regions[wear_region_of(block)];
+    if (allocated) {
+        if (region->free_blocks > 0) {
+            region->free_blocks--;
+        }
+    } else {
+        region->free_blocks++;
+    }
+    
+    // The sibling decides whether a whole sector changes state
+    uint32_t sibling = block ^ 1u;
+    if (sibling < ctx->sb->block_count && !corefs_block_is_allocated(ctx, sibling)) {
+        if (!allocated) {
+            ctx->wear_free_sectors++;
+        } else if (ctx->wear_free_sectors > 0) {
+            ctx->wear_free_sectors--;
+        }
+    }
+}
+
 // ============================================================================
 // BLOCK SELECTION
 // ============================================================================
 
-uint32_t corefs_wear_get_best_block(corefs_ctx_t* ctx) {
-    if (!ctx || !ctx->wear_table || !ctx->block_bitmap) {
-        ESP_LOGE(TAG, "Invalid context for wear leveling");
+uint32_t corefs_wear_get(corefs_ctx_t* ctx, uint32_t block) {
+    if (!ctx || !ctx->wear_regions || block >= ctx->sb->block_count) {
         return 0;
     }
     
+    if (ctx->wear_delta) {
+        return ctx->wear_base + ctx->wear_delta[block / 2];
+    }
+    
+    // Summary only: average of the region
+    uint32_t region = wear_region_of(block);
+    return ctx->wear_regions[region].erases / wear_region_sectors(ctx, region);
+}
+
+static uint32_t wear_region_key(corefs_ctx_t* ctx, uint32_t region) {
+    if (ctx->wear_delta) {
+        return ctx->wear_regions[region].min_delta;
+    }
+    return ctx->wear_regions[region].erases / wear_region_sectors(ctx, region);
+}
+
+typedef enum {
+    PICK_ANY,           // Any free block
+    PICK_SECTOR,        // Free block whose sibling is free too
+    PICK_PAIR,          // Free block whose sibling is live and of one class
+    PICK_HALF           // Free block whose sibling is live
+} wear_pick_t;
+
+static bool wear_pick_match(corefs_ctx_t* ctx, uint32_t block, wear_pick_t mode, 
+                            corefs_class_t cls) {
+    uint32_t sibling = block ^ 1u;
+    bool sibling_free = sibling >= ctx->sb->block_count ? false : 
+                        !corefs_block_is_allocated(ctx, sibling);
+    
+    switch (mode) {
+    case PICK_SECTOR:
+        return !(block & 1) && sibling_free;
+    case PICK_PAIR:
+        return sibling < ctx->sb->block_count && !sibling_free &&
+               sibling >= ctx->sb->metadata_blocks &&
+               corefs_block_get_class(ctx, sibling) == cls;
+    case PICK_HALF:
+        return sibling < ctx->sb->block_count && !sibling_free;
+    default:
+        return true;
+    }
+}
+
+// Lowest-wear matching free block in one region, 0 if none
+static uint32_t wear_pick_in_region(corefs_ctx_t* ctx, uint32_t r, wear_pick_t mode,
+                                    corefs_class_t cls) {
+    corefs_wear_region_t* region = &ctx->wear_regions[r];
+    uint32_t sectors = wear_region_sectors(ctx, r);
+    uint32_t first = r * COREFS_WEAR_REGION_SECTORS * 2;
     uint32_t best_block = 0;
-    uint16_t min_wear = 0xFFFF;
+    uint32_t min_wear = UINT32_MAX;
     
-    // Search for free block with lowest wear count
-    for (uint32_t i = COREFS_METADATA_BLOCKS; i < ctx->sb->block_count; i++) {
-        // Check if block is free
-        uint32_t byte_idx = i / 8;
-        uint32_t bit_idx = i % 8;
+    for (uint32_t i = 0; i < sectors * 2; i++) {
+        // Summary mode rotates through the region instead of ranking
+        uint32_t block = ctx->wear_delta ? first + i : 
+                         first + (region->cursor * 2 + i) % (sectors * 2);
+        if (block < ctx->sb->metadata_blocks || block >= ctx->sb->block_count ||
+            corefs_block_is_allocated(ctx, block) || 
+            !wear_pick_match(ctx, block, mode, cls)) {
+            continue;
+        }
         
-        if (!(ctx->block_bitmap[byte_idx] & (1 << bit_idx))) {
-            // Block is free - check wear count
-            if (ctx->wear_table[i] < min_wear) {
-                min_wear = ctx->wear_table[i];
-                best_block = i;
-            }
+        if (!ctx->wear_delta) {
+            region->cursor = ((block - first) / 2 + 1) % sectors;
+            return block;
+        }
+        
+        if (ctx->wear_delta[block / 2] < min_wear) {
+            min_wear = ctx->wear_delta[block / 2];
+            best_block = block;
+        }
+    }
+    
+    return best_block;
+}
+
+static uint32_t wear_pick(corefs_ctx_t* ctx, wear_pick_t mode, corefs_class_t cls) {
+    if (!ctx || !ctx->wear_regions || !ctx->block_bitmap) {
+        ESP_LOGE(TAG, "Invalid context for wear leveling");
+        return 0;
+    }
+    
+    uint32_t min_free = (mode == PICK_SECTOR) ? 2 : 1;
+    
+    // Pick the least-worn region that still has free blocks
+    uint32_t best_region = UINT32_MAX;
+    uint32_t best_key = UINT32_MAX;
+    
+    for (uint32_t r = 0; r < ctx->wear_region_count; r++) {
+        if (ctx->wear_regions[r].free_blocks < min_free) {
+            continue;
+        }
+        uint32_t key = wear_region_key(ctx, r);
+        if (key < best_key) {
+            best_key = key;
+            best_region = r;
+        }
+    }
+    
+    if (best_region == UINT32_MAX) {
+        if (mode == PICK_ANY) {
+            ESP_LOGW(TAG, "No free blocks available");
+        }
+        return 0;
+    }
+    
+    uint32_t best_block = wear_pick_in_region(ctx, best_region, mode, cls);
+    
+    // No match in the best region; try the others in order
+    for (uint32_t r = 0; mode != PICK_ANY && best_block == 0 && r < ctx->wear_region_count; r++) {
+        if (r != best_region && ctx->wear_regions[r].free_blocks >= min_free) {
+            best_block = wear_pick_in_region(ctx, r, mode, cls);
         }
     }
     
     if (best_block > 0) {
-        ESP_LOGD(TAG, "Best block: %lu (wear count: %u)", best_block, min_wear);
-    } else {
-        ESP_LOGW(TAG, "No free blocks available");
+        ESP_LOGD(TAG, "Best block: %lu (wear count: %lu)", 
+                 best_block, corefs_wear_get(ctx, best_block));
+    } else if (mode == PICK_ANY) {
+        // Summary drifted from the bitmap
+        ESP_LOGW(TAG, "Region %lu has no free blocks, recounting", best_region);
+        corefs_wear_recount(ctx);
     }
     
     return best_block;
 }
 
+uint32_t corefs_wear_get_best_block(corefs_ctx_t* ctx) {
+    return wear_pick(ctx, PICK_ANY, COREFS_CLASS_META);
+}
+
+/**
+ * First block of the least-worn sector whose both halves are free,
+ * or 0 if every free block shares a sector with live data.
+ */
+uint32_t corefs_wear_get_best_sector(corefs_ctx_t* ctx) {
+    return wear_pick(ctx, PICK_SECTOR, COREFS_CLASS_META);
+}
+
+/**
+ * Least-worn free block sharing its sector with a live block of class
+ * cls, or 0 if there is none.
+ */
+uint32_t corefs_wear_get_best_pair(corefs_ctx_t* ctx, corefs_class_t cls) {
+    return wear_pick(ctx, PICK_PAIR, cls);
+}
+
+/**
+ * Least-worn free block sharing its sector with any live block, or 0
+ * if there is none. Taking it leaves the free sectors alone.
+ */
+uint32_t corefs_wear_get_best_half(corefs_ctx_t* ctx) {
+    return wear_pick(ctx, PICK_HALF, COREFS_CLASS_META);
+}
+
 // ============================================================================
 // WEAR TRACKING
 // ============================================================================
 
+// Fold the common minimum of all sector deltas into the base
+static bool wear_rebase(corefs_ctx_t* ctx) {
+    uint8_t min_delta = 0xFF;
+    for (uint32_t r = 0; r < ctx->wear_region_count; r++) {
+        if (ctx->wear_regions[r].min_delta < min_delta) {
+            min_delta = ctx->wear_regions[r].min_delta;
+        }
+    }
+    
+    if (min_delta == 0) {
+        return false;
+    }
+    
+    uint32_t sector_count = wear_sector_count(ctx->sb->block_count);
+    for (uint32_t s = 0; s < sector_count; s++) {
+        ctx->wear_delta[s] -= min_delta;
+    }
+    for (uint32_t r = 0; r < ctx->wear_region_count; r++) {
+        ctx->wear_regions[r].min_delta -= min_delta;
+    }
+    ctx->wear_base += min_delta;
+    
+    ESP_LOGD(TAG, "Wear base raised to %lu", ctx->wear_base);
+    return true;
+}
+
+static esp_err_t wear_save(corefs_ctx_t* ctx);
+
+// Unsaved erases of sector. A full table or a saturated counter is saved
+// right away (alloc_lock is held and recursive), an erase is never lost.
+static void wear_pending_add(corefs_ctx_t* ctx, uint32_t sector) {
+    int slot = -1;
+    for (uint32_t i = 0; i < ctx->wear_pending_count; i++) {
+        if (ctx->wear_pending[i].sector == sector) {
+            slot = (int)i;
+            break;
+        }
+    }
+    
+    if ((slot < 0 && ctx->wear_pending_count >= COREFS_WEAR_PENDING_SLOTS) ||
+        (slot >= 0 && ctx->wear_pending[slot].count == UINT16_MAX)) {
+        if (wear_save(ctx) != ESP_OK || ctx->wear_pending_count > 0) {
+            ESP_LOGE(TAG, "Wear deltas not saved, erase of sector %lu not persisted", sector);
+            return;
+        }
+        slot = -1;
+    }
+    
+    if (slot < 0) {
+        slot = (int)ctx->wear_pending_count++;
+        ctx->wear_pending[slot].sector = sector;
+        ctx->wear_pending[slot].count = 0;
+    }
+    ctx->wear_pending[slot].count++;
+    ctx->wear_pending_total++;
+    if (ctx->wear_pending[slot].count > ctx->wear_pending_peak) {
+        ctx->wear_pending_peak = ctx->wear_pending[slot].count;
+    }
+}
+
+/**
+ * Enough erases are pending to append them: config.wear_flush_threshold
+ * in total, or one sector's worth of a full record. Caller holds
+ * alloc_lock.
+ */
+bool corefs_wear_flush_due(corefs_ctx_t* ctx) {
+    return ctx->wear_pending_total >= ctx->config.wear_flush_threshold ||
+           ctx->wear_pending_peak >= 0xFF;
+}
+
+// Count an erase in the RAM map only
+static void wear_note_erase(corefs_ctx_t* ctx, uint32_t block) {
+    // One erase wears both blocks of the sector
+    uint32_t sector = block / 2;
+    uint32_t region = wear_region_of(block);
+    ctx->wear_regions[region].erases++;
+    
+    if (!ctx->wear_delta) {
+        return;
+    }
+    
+    if (ctx->wear_delta[sector] == 0xFF && !wear_rebase(ctx)) {
+        // Spread exceeds the delta range; flash still has the exact count
+        ESP_LOGW(TAG, "Sector %lu wear delta saturated", sector);
+        return;
+    }
+    
+    uint8_t old_delta = ctx->wear_delta[sector]++;
+    if (old_delta == ctx->wear_regions[region].min_delta) {
+        wear_region_update_min(ctx, region);
+    }
+    
+    ESP_LOGD(TAG, "Block %lu wear count: %lu", block, corefs_wear_get(ctx, block));
+}
+
 void corefs_wear_increment(corefs_ctx_t* ctx, uint32_t block) {
-    if (!ctx || !ctx->wear_table) {
+    if (!ctx || !ctx->wear_regions) {
         return;
     }
     
@@ -88,75 +429,454 @@ void corefs_wear_increment(corefs_ctx_t* ctx, uint32_t block) {
         return;
     }
     
-    if (ctx->wear_table[block] < 0xFFFF) {
-        ctx->wear_table[block]++;
-        ESP_LOGD(TAG, "Block %lu wear count: %u", block, ctx->wear_table[block]);
-    } else {
-        ESP_LOGW(TAG, "Block %lu wear count saturated at %u", block, 0xFFFF);
-    }
+    wear_note_erase(ctx, block);
+    wear_pending_add(ctx, block / 2);
 }
 
 // ============================================================================
-// PERSISTENCE (Optional - not currently used)
+// PERSISTENCE
 // ============================================================================
+//
+// The wear log region holds two slots (A/B). Each slot starts with a
+// checkpoint (header + one uint16_t per sector, relative to the header
+// base) followed by a delta log. Saving appends 4-byte records for dirty
+// sectors into erased flash, so no erase is needed until the log fills
+// up; then checkpoint + log + pending deltas are streamed into the other
+// slot with a higher sequence number. The header is programmed last, so a
+// torn compaction leaves the old slot in charge.
+
+#define WEAR_CHUNK_SECTORS  (COREFS_BLOCK_SIZE / sizeof(uint32_t))
+
+static uint32_t wear_checkpoint_sectors(uint32_t block_count) {
+    uint32_t bytes = sizeof(corefs_wear_header_t) + 
+                     wear_sector_count(block_count) * sizeof(uint16_t);
+    return (bytes + COREFS_SECTOR_SIZE - 1) / COREFS_SECTOR_SIZE;
+}
+
+static uint32_t wear_slot_sectors(uint32_t block_count) {
+    return wear_checkpoint_sectors(block_count) + COREFS_WEAR_LOG_SECTORS;
+}
+
+uint32_t corefs_wear_region_blocks(uint32_t block_count) {
+    return 2 * wear_slot_sectors(block_count) * (COREFS_SECTOR_SIZE / COREFS_BLOCK_SIZE);
+}
+
+static uint32_t wear_slot_offset(corefs_ctx_t* ctx, uint32_t slot) {
+    return ctx->sb->wear_table_block * COREFS_BLOCK_SIZE +
+           slot * wear_slot_sectors(ctx->sb->block_count) * COREFS_SECTOR_SIZE;
+}
+
+static uint32_t wear_log_offset(corefs_ctx_t* ctx, uint32_t slot) {
+    return wear_slot_offset(ctx, slot) + 
+           wear_checkpoint_sectors(ctx->sb->block_count) * COREFS_SECTOR_SIZE;
+}
+
+static uint32_t wear_log_capacity(void) {
+    return COREFS_WEAR_LOG_SECTORS * COREFS_SECTOR_SIZE / sizeof(corefs_wear_record_t);
+}
+
+static uint8_t wear_record_check(uint16_t sector, uint8_t delta) {
+    return (uint8_t)~((sector & 0xFF) ^ (sector >> 8) ^ delta);
+}
+
+static bool wear_record_valid(const corefs_wear_record_t* rec, uint32_t sector_count) {
+    return rec->check == wear_record_check(rec->sector, rec->delta) &&
+           rec->sector < sector_count;
+}
+
+// Verify a slot checkpoint header and CRC
+static esp_err_t wear_read_checkpoint(corefs_ctx_t* ctx, uint32_t slot, 
+                                      corefs_wear_header_t* hdr) {
+    uint32_t sector_count = wear_sector_count(ctx->sb->block_count);
+    uint32_t offset = wear_slot_offset(ctx, slot);
+    
+    esp_err_t ret = esp_partition_read(ctx->partition, offset, hdr, sizeof(*hdr));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    if (hdr->magic != COREFS_WEAR_MAGIC || hdr->sector_count != sector_count) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    
+    uint8_t* chunk = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!chunk) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    corefs_wear_header_t check = *hdr;
+    check.checksum = 0;
+    uint32_t crc = crc32_update(0xFFFFFFFF, &check, sizeof(check));
+    
+    uint32_t remaining = sector_count * sizeof(uint16_t);
+    offset += sizeof(*hdr);
+    while (remaining > 0 && ret == ESP_OK) {
+        uint32_t n = (remaining < COREFS_BLOCK_SIZE) ? remaining : COREFS_BLOCK_SIZE;
+        ret = esp_partition_read(ctx->partition, offset, chunk, n);
+        crc = crc32_update(crc, chunk, n);
+        offset += n;
+        remaining -= n;
+    }
+    
+    corefs_mem_free(ctx, chunk);
+    if (ret == ESP_OK && crc32_finalize(crc) != hdr->checksum) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ret;
+}
+
+// Exact erase counts for sectors [first, first + n): checkpoint of `slot`
+// (if valid) plus its first `log_records` deltas plus unsaved deltas
+static esp_err_t wear_stream_counts(corefs_ctx_t* ctx, int slot, uint32_t log_records,
+                                    uint32_t first, uint32_t n, uint32_t* counts) {
+    uint32_t sector_count = wear_sector_count(ctx->sb->block_count);
+    esp_err_t ret = ESP_OK;
+    
+    memset(counts, 0, n * sizeof(uint32_t));
+    
+    uint8_t* buf = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    
+    if (slot >= 0) {
+        corefs_wear_header_t hdr;
+        uint32_t offset = wear_slot_offset(ctx, slot);
+        ret = esp_partition_read(ctx->partition, offset, &hdr, sizeof(hdr));
+        
+        uint16_t* cp = (uint16_t*)buf;
+        if (ret == ESP_OK) {
+            ret = esp_partition_read(ctx->partition, 
+                                     offset + sizeof(hdr) + first * sizeof(uint16_t),
+                                     cp, n * sizeof(uint16_t));
+        }
+        for (uint32_t i = 0; i < n && ret == ESP_OK; i++) {
+            counts[i] = hdr.base + cp[i];
+        }
+        
+        // Add logged deltas that fall into this range
+        uint32_t per_chunk = COREFS_BLOCK_SIZE / sizeof(corefs_wear_record_t);
+        corefs_wear_record_t* recs = (corefs_wear_record_t*)buf;
+        for (uint32_t pos = 0; pos < log_records && ret == ESP_OK; pos += per_chunk) {
+            uint32_t m = (log_records - pos < per_chunk) ? log_records - pos : per_chunk;
+            ret = esp_partition_read(ctx->partition, 
+                                     wear_log_offset(ctx, slot) + pos * sizeof(*recs),
+                                     recs, m * sizeof(*recs));
+            for (uint32_t i = 0; i < m && ret == ESP_OK; i++) {
+                if (wear_record_valid(&recs[i], sector_count) &&
+                    recs[i].sector >= first && recs[i].sector < first + n) {
+                    counts[recs[i].sector - first] += recs[i].delta;
+                }
+            }
+        }
+    }
+    
+    for (uint32_t i = 0; i < ctx->wear_pending_count; i++) {
+        uint32_t s = ctx->wear_pending[i].sector;
+        if (s >= first && s < first + n) {
+            counts[s - first] += ctx->wear_pending[i].count;
+        }
+    }
+    
+    corefs_mem_free(ctx, buf);
+    return ret;
+}
+
+// Lowest exact count over all sectors
+static esp_err_t wear_stream_min(corefs_ctx_t* ctx, int slot, uint32_t log_records,
+                                 uint32_t* counts, uint32_t* out_min) {
+    uint32_t sector_count = wear_sector_count(ctx->sb->block_count);
+    uint32_t min_count = UINT32_MAX;
+    esp_err_t ret = ESP_OK;
+    
+    for (uint32_t s = 0; s < sector_count && ret == ESP_OK; s += WEAR_CHUNK_SECTORS) {
+        uint32_t n = (sector_count - s < WEAR_CHUNK_SECTORS) ? sector_count - s : WEAR_CHUNK_SECTORS;
+        ret = wear_stream_counts(ctx, slot, log_records, s, n, counts);
+        for (uint32_t i = 0; i < n; i++) {
+            if (counts[i] < min_count) {
+                min_count = counts[i];
+            }
+        }
+    }
+    
+    *out_min = (min_count == UINT32_MAX) ? 0 : min_count;
+    return ret;
+}
 
 esp_err_t corefs_wear_load(corefs_ctx_t* ctx) {
-    if (!ctx || !ctx->wear_table || !ctx->sb) {
+    if (!ctx || !ctx->wear_regions || !ctx->sb) {
         ESP_LOGE(TAG, "Invalid context for wear table load");
         return ESP_ERR_INVALID_ARG;
     }
     
-    size_t table_size = ctx->sb->block_count * sizeof(uint16_t);
+    // Pick the valid checkpoint with the highest sequence number
+    corefs_wear_header_t hdr[2];
+    bool valid[2];
+    for (uint32_t slot = 0; slot < 2; slot++) {
+        valid[slot] = (wear_read_checkpoint(ctx, slot, &hdr[slot]) == ESP_OK);
+    }
     
-    // Allocate temporary buffer
-    uint8_t* buf = malloc(COREFS_BLOCK_SIZE);
-    if (!buf) {
-        ESP_LOGE(TAG, "Failed to allocate read buffer");
+    int slot = -1;
+    if (valid[0] && (!valid[1] || hdr[0].seq > hdr[1].seq)) {
+        slot = 0;
+    } else if (valid[1]) {
+        slot = 1;
+    }
+    
+    uint32_t sector_count = wear_sector_count(ctx->sb->block_count);
+    wear_pending_clear(ctx);
+    ctx->wear_base = 0;
+    if (ctx->wear_delta) {
+        memset(ctx->wear_delta, 0, sector_count);
+    }
+    for (uint32_t r = 0; r < ctx->wear_region_count; r++) {
+        ctx->wear_regions[r].erases = 0;
+        ctx->wear_regions[r].min_delta = 0;
+    }
+    
+    if (slot < 0) {
+        ESP_LOGW(TAG, "No valid wear checkpoint, starting from zero");
+        ctx->wear_slot = 1;
+        ctx->wear_seq = 0;
+        return corefs_wear_compact(ctx);
+    }
+    
+    ctx->wear_slot = slot;
+    ctx->wear_seq = hdr[slot].seq;
+    
+    // Find the end of the delta log (first erased or torn record)
+    corefs_wear_record_t* recs = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    uint32_t* counts = corefs_mem_alloc(ctx, WEAR_CHUNK_SECTORS * sizeof(uint32_t));
+    if (!recs || !counts) {
+        corefs_mem_free(ctx, recs);
+        corefs_mem_free(ctx, counts);
         return ESP_ERR_NO_MEM;
     }
     
-    // Read wear table from flash (block 3)
-    esp_err_t ret = corefs_block_read(ctx, ctx->sb->wear_table_block, buf);
+    uint32_t per_chunk = COREFS_BLOCK_SIZE / sizeof(corefs_wear_record_t);
+    uint32_t capacity = wear_log_capacity();
+    uint32_t pos = 0;
+    bool torn = false;
+    esp_err_t ret = ESP_OK;
+    
+    while (pos < capacity && ret == ESP_OK) {
+        ret = esp_partition_read(ctx->partition, 
+                                 wear_log_offset(ctx, slot) + pos * sizeof(*recs),
+                                 recs, COREFS_BLOCK_SIZE);
+        uint32_t i = 0;
+        while (i < per_chunk && pos < capacity && wear_record_valid(&recs[i], sector_count)) {
+            i++;
+            pos++;
+        }
+        if (i < per_chunk && pos < capacity) {
+            torn = (recs[i].sector != 0xFFFF || recs[i].delta != 0xFF || recs[i].check != 0xFF);
+            break;
+        }
+    }
+    ctx->wear_log_pos = pos;
+    
+    // Rebuild RAM summary (and detail) relative to the lowest count
+    uint32_t base = 0;
     if (ret == ESP_OK) {
-        // Copy to wear table (limit to available data)
-        size_t copy_size = (table_size < COREFS_BLOCK_SIZE) ? table_size : COREFS_BLOCK_SIZE;
-        memcpy(ctx->wear_table, buf, copy_size);
-        
-        ESP_LOGI(TAG, "Wear table loaded from block %lu (%zu bytes)", 
-                 ctx->sb->wear_table_block, copy_size);
-    } else {
-        ESP_LOGW(TAG, "Failed to load wear table, using zeros");
-        memset(ctx->wear_table, 0, table_size);
+        ret = wear_stream_min(ctx, slot, pos, counts, &base);
     }
+    ctx->wear_base = ctx->wear_delta ? base : 0;
     
-    free(buf);
-    return ret;
+    for (uint32_t s = 0; s < sector_count && ret == ESP_OK; s += WEAR_CHUNK_SECTORS) {
+        uint32_t n = (sector_count - s < WEAR_CHUNK_SECTORS) ? sector_count - s : WEAR_CHUNK_SECTORS;
+        ret = wear_stream_counts(ctx, slot, pos, s, n, counts);
+        for (uint32_t i = 0; i < n; i++) {
+            ctx->wear_regions[(s + i) / COREFS_WEAR_REGION_SECTORS].erases += counts[i];
+            if (ctx->wear_delta) {
+                uint32_t delta = counts[i] - base;
+                ctx->wear_delta[s + i] = (delta > 0xFF) ? 0xFF : delta;
+            }
+        }
+    }
+    
+    if (ctx->wear_delta) {
+        for (uint32_t r = 0; r < ctx->wear_region_count; r++) {
+            wear_region_update_min(ctx, r);
+        }
+    }
+    
+    corefs_mem_free(ctx, recs);
+    corefs_mem_free(ctx, counts);
+    
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    ESP_LOGI(TAG, "Wear table loaded from slot %d (seq %lu, %lu deltas, base %lu)", 
+             slot, ctx->wear_seq, pos, base);
+    
+    // A torn record would block further appends - fold it away now
+    if (torn) {
+        return corefs_wear_compact(ctx);
+    }
+    
+    return ESP_OK;
+}
+
+esp_err_t corefs_wear_compact(corefs_ctx_t* ctx) {
+    if (!ctx || !ctx->wear_regions || !ctx->sb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    uint32_t sector_count = wear_sector_count(ctx->sb->block_count);
+    int old_slot = (ctx->wear_seq > 0) ? (int)ctx->wear_slot : -1;
+    uint32_t slot = ctx->wear_slot ^ 1;
+    uint32_t offset = wear_slot_offset(ctx, slot);
+    
+    // Erasing the new slot is itself wear; it is added to the checkpoint
+    // below directly, the pending table may be full
+    uint32_t slot_sectors = wear_slot_sectors(ctx->sb->block_count);
+    uint32_t slot_first = offset / COREFS_SECTOR_SIZE;
+    esp_err_t ret = esp_partition_erase_range(ctx->partition, offset, 
+                                              slot_sectors * COREFS_SECTOR_SIZE);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ctx->io_stats.erased_bytes += slot_sectors * COREFS_SECTOR_SIZE;
+    for (uint32_t i = 0; i < slot_sectors; i++) {
+        wear_note_erase(ctx, (slot_first + i) * 2);
+    }
+    
+    uint32_t* counts = corefs_mem_alloc(ctx, WEAR_CHUNK_SECTORS * sizeof(uint32_t));
+    uint16_t* out = corefs_mem_alloc(ctx, WEAR_CHUNK_SECTORS * sizeof(uint16_t));
+    if (!counts || !out) {
+        corefs_mem_free(ctx, counts);
+        corefs_mem_free(ctx, out);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    corefs_wear_header_t hdr = {
+        .magic = COREFS_WEAR_MAGIC,
+        .seq = ctx->wear_seq + 1,
+        .sector_count = sector_count,
+        .base = 0,
+        .checksum = 0
+    };
+    
+    uint32_t base = 0;
+    ret = wear_stream_min(ctx, old_slot, ctx->wear_log_pos, counts, &base);
+    hdr.base = base;
+    uint32_t crc = crc32_update(0xFFFFFFFF, &hdr, sizeof(hdr));
+    
+    // Table first, header last
+    uint32_t pos = offset + sizeof(hdr);
+    for (uint32_t s = 0; s < sector_count && ret == ESP_OK; s += WEAR_CHUNK_SECTORS) {
+        uint32_t n = (sector_count - s < WEAR_CHUNK_SECTORS) ? sector_count - s : WEAR_CHUNK_SECTORS;
+        ret = wear_stream_counts(ctx, old_slot, ctx->wear_log_pos, s, n, counts);
+        for (uint32_t i = 0; i < n; i++) {
+            if (s + i >= slot_first && s + i < slot_first + slot_sectors) {
+                counts[i]++;
+            }
+            uint32_t delta = counts[i] - base;
+            out[i] = (delta > 0xFFFF) ? 0xFFFF : delta;
+        }
+        crc = crc32_update(crc, out, n * sizeof(uint16_t));
+        if (ret == ESP_OK) {
+            ret = esp_partition_write(ctx->partition, pos, out, n * sizeof(uint16_t));
+            ctx->io_stats.programmed_bytes += n * sizeof(uint16_t);
+        }
+        pos += n * sizeof(uint16_t);
+    }
+    corefs_mem_free(ctx, counts);
+    corefs_mem_free(ctx, out);
+    
+    if (ret == ESP_OK) {
+        hdr.checksum = crc32_finalize(crc);
+        ret = esp_partition_write(ctx->partition, offset, &hdr, sizeof(hdr));
+        ctx->io_stats.programmed_bytes += sizeof(hdr);
+    }
+    
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to compact wear log: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    
+    ctx->wear_slot = slot;
+    ctx->wear_seq = hdr.seq;
+    ctx->wear_log_pos = 0;
+    wear_pending_clear(ctx);
+    
+    ESP_LOGI(TAG, "Wear checkpoint written to slot %lu (seq %lu, base %lu)", 
+             slot, hdr.seq, hdr.base);
+    return ESP_OK;
 }
 
 esp_err_t corefs_wear_save(corefs_ctx_t* ctx) {
-    if (!ctx || !ctx->wear_table || !ctx->sb) {
+    if (!ctx || !ctx->wear_regions || !ctx->sb) {
         ESP_LOGE(TAG, "Invalid context for wear table save");
         return ESP_ERR_INVALID_ARG;
     }
     
-    size_t table_size = ctx->sb->block_count * sizeof(uint16_t);
+    corefs_alloc_lock(ctx);
+    esp_err_t ret = wear_save(ctx);
+    corefs_alloc_unlock(ctx);
+    return ret;
+}
+
+static esp_err_t wear_save(corefs_ctx_t* ctx) {
+    if (ctx->wear_pending_count == 0 || ctx->wear_saving) {
+        return ESP_OK;
+    }
+    
+    ctx->wear_saving = true;
+    
+    // Counts above 255 need more than one record
+    uint32_t needed = 0;
+    for (uint32_t i = 0; i < ctx->wear_pending_count; i++) {
+        needed += (ctx->wear_pending[i].count + 0xFE) / 0xFF;
+    }
+    
+    esp_err_t ret = ESP_OK;
     
-    // For now, assume table fits in one block
-    if (table_size > COREFS_BLOCK_SIZE) {
-        ESP_LOGW(TAG, "Wear table size %zu exceeds block size %d, truncating", 
-                 table_size, COREFS_BLOCK_SIZE);
-        table_size = COREFS_BLOCK_SIZE;
+    if (ctx->wear_log_pos + needed > wear_log_capacity()) {
+        // Log full: write a fresh checkpoint instead of appending
+        ret = corefs_wear_compact(ctx);
+        ctx->wear_saving = false;
+        return ret;
+    }
+    
+    corefs_wear_record_t recs[COREFS_WEAR_PENDING_SLOTS];
+    uint32_t n = 0;
+    
+    for (uint32_t i = 0; i < ctx->wear_pending_count && ret == ESP_OK; i++) {
+        uint32_t count = ctx->wear_pending[i].count;
+        while (count > 0 && ret == ESP_OK) {
+            uint8_t delta = (count > 0xFF) ? 0xFF : count;
+            recs[n].sector = ctx->wear_pending[i].sector;
+            recs[n].delta = delta;
+            recs[n].check = wear_record_check(recs[n].sector, delta);
+            count -= delta;
+            n++;
+            
+            // Program a batch of records into erased log space
+            if (n == COREFS_WEAR_PENDING_SLOTS || (count == 0 && i + 1 == ctx->wear_pending_count)) {
+                ret = esp_partition_write(ctx->partition,
+                                          wear_log_offset(ctx, ctx->wear_slot) + 
+                                          ctx->wear_log_pos * sizeof(corefs_wear_record_t),
+                                          recs, n * sizeof(corefs_wear_record_t));
+                if (ret == ESP_OK) {
+                    ctx->wear_log_pos += n;
+                    ctx->io_stats.programmed_bytes += n * sizeof(corefs_wear_record_t);
+                }
+                n = 0;
+            }
+        }
     }
     
-    // Write wear table to flash
-    esp_err_t ret = corefs_block_write(ctx, ctx->sb->wear_table_block, ctx->wear_table);
     if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "Wear table saved to block %lu (%zu bytes)", 
-                 ctx->sb->wear_table_block, table_size);
+        ESP_LOGD(TAG, "Appended %lu wear deltas (log %lu/%lu)", 
+                 needed, ctx->wear_log_pos, wear_log_capacity());
+        wear_pending_clear(ctx);
     } else {
-        ESP_LOGE(TAG, "Failed to save wear table: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Failed to save wear deltas: %s", esp_err_to_name(ret));
     }
     
+    ctx->wear_saving = false;
     return ret;
 }
 
@@ -164,37 +884,342 @@ esp_err_t corefs_wear_save(corefs_ctx_t* ctx) {
 // STATISTICS & HEALTH CHECK
 // ============================================================================
 
-esp_err_t corefs_wear_check(corefs_ctx_t* ctx) {
-    if (!ctx || !ctx->wear_table || !ctx->sb) {
-        return ESP_ERR_INVALID_ARG;
-    }
-    
-    uint16_t min_wear = 0xFFFF;
-    uint16_t max_wear = 0;
-    uint32_t total_wear = 0;
+static void wear_min_max(corefs_ctx_t* ctx, uint32_t* out_min, uint32_t* out_max, 
+                         uint32_t* out_avg) {
+    uint32_t min_wear = UINT32_MAX;
+    uint32_t max_wear = 0;
+    uint64_t total_wear = 0;
     uint32_t count = 0;
     
-    // Calculate statistics
-    for (uint32_t i = COREFS_METADATA_BLOCKS; i < ctx->sb->block_count; i++) {
-        uint16_t wear = ctx->wear_table[i];
+    // Sector granularity is enough: both blocks always match
+    for (uint32_t i = ctx->sb->metadata_blocks & ~1u; i < ctx->sb->block_count; i += 2) {
+        uint32_t wear = corefs_wear_get(ctx, i);
         if (wear < min_wear) min_wear = wear;
         if (wear > max_wear) max_wear = wear;
         total_wear += wear;
         count++;
     }
     
-    uint16_t avg_wear = (count > 0) ? (total_wear / count) : 0;
-    uint16_t deviation = max_wear - min_wear;
+    *out_min = (count > 0) ? min_wear : 0;
+    *out_max = max_wear;
+    *out_avg = (count > 0) ? (uint32_t)(total_wear / count) : 0;
+}
+
+esp_err_t corefs_wear_check(corefs_ctx_t* ctx) {
+    if (!ctx || !ctx->wear_regions || !ctx->sb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    uint32_t min_wear, max_wear, avg_wear;
+    wear_min_max(ctx, &min_wear, &max_wear, &avg_wear);
+    uint32_t deviation = max_wear - min_wear;
+    
+    ctx->wear_stats.min_wear = min_wear;
+    ctx->wear_stats.max_wear = max_wear;
     
     ESP_LOGI(TAG, "Wear leveling stats:");
-    ESP_LOGI(TAG, "  Min: %u, Max: %u, Avg: %u", min_wear, max_wear, avg_wear);
-    ESP_LOGI(TAG, "  Deviation: %u", deviation);
+    ESP_LOGI(TAG, "  Min: %lu, Max: %lu, Avg: %lu", min_wear, max_wear, avg_wear);
+    ESP_LOGI(TAG, "  Deviation: %lu", deviation);
     
-    if (deviation > 1000) {
-        ESP_LOGW(TAG, "High wear deviation detected (%u), rebalancing recommended", 
+    if (deviation > COREFS_WEAR_STATIC_THRESHOLD) {
+        ESP_LOGW(TAG, "High wear deviation detected (%lu), rebalancing recommended", 
                  deviation);
         return ESP_ERR_INVALID_STATE;
     }
     
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+// ============================================================================
+// STATIC WEAR LEVELING
+// ============================================================================
+//
+// Dynamic leveling (lowest-wear free block on alloc) never touches blocks
+// that hold static data. Once the wear spread exceeds the threshold, move
+// the coldest live block onto the most-worn free block so the low-wear
+// block returns to the free pool for hot writes.
+
+extern corefs_ctx_t* corefs_get_context(void);
+
+typedef struct {
+    corefs_ctx_t* ctx;
+    corefs_inode_t* inode;
+    uint32_t block;             // Coldest live block found so far
+    uint32_t wear;
+    int32_t index;              // Index in block_list, -1 for the inode itself
+    uint32_t inode_block;
+    char path[COREFS_MAX_FILENAME + 2];
+} cold_search_t;
+
+static void consider_block(cold_search_t* search, const char* name, 
+                           uint32_t inode_block, uint32_t block, int32_t index) {
+    corefs_alloc_lock(search->ctx);
+    uint32_t wear = corefs_wear_get(search->ctx, block);
+    corefs_alloc_unlock(search->ctx);
+    
+    if (search->block == 0 || wear < search->wear) {
+        search->block = block;
+        search->wear = wear;
+        search->index = index;
+        search->inode_block = inode_block;
+        snprintf(search->path, sizeof(search->path), "/%s", name);
+    }
+}
+
+static bool find_cold_block(const char* name, uint32_t inode_block, void* arg) {
+    cold_search_t* search = (cold_search_t*)arg;
+    
+    // Open handles hold a private inode copy; leave their blocks alone
+    if (corefs_file_is_open(search->ctx, inode_block)) {
+        return true;
+    }
+    
+    if (corefs_inode_read(search->ctx, inode_block, search->inode) != ESP_OK) {
+        return true;
+    }
+    
+    consider_block(search, name, inode_block, inode_block, -1);
+    for (uint32_t i = 0; i < search->inode->blocks_used && i < COREFS_MAX_BLOCKS; i++) {
+        uint32_t block = search->inode->block_list[i];
+        // A shared block cannot be repointed in one inode only
+        if (block >= search->ctx->sb->metadata_blocks && block < search->ctx->sb->block_count &&
+            !corefs_block_is_shared(search->ctx, block)) {
+            consider_block(search, name, inode_block, block, (int32_t)i);
+        }
+    }
+    
+    return true;
+}
+
+static uint32_t find_hot_free_block(corefs_ctx_t* ctx, uint32_t* out_wear) {
+    uint32_t best_block = 0;
+    uint32_t max_wear = 0;
+    
+    corefs_alloc_lock(ctx);
+    for (uint32_t i = ctx->sb->metadata_blocks; i < ctx->sb->block_count; i++) {
+        if (!corefs_block_is_allocated(ctx, i) && 
+            (best_block == 0 || corefs_wear_get(ctx, i) > max_wear)) {
+            max_wear = corefs_wear_get(ctx, i);
+            best_block = i;
+        }
+    }
+    corefs_alloc_unlock(ctx);
+    
+    *out_wear = max_wear;
+    return best_block;
+}
+
+static esp_err_t relocate_block(corefs_ctx_t* ctx, cold_search_t* search, 
+                                uint32_t target, uint8_t* buf) {
+    esp_err_t ret = corefs_block_read(ctx, search->block, buf);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    
+    if (!corefs_block_reserve(ctx, target)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    corefs_block_set_class(ctx, target, corefs_block_get_class(ctx, search->block));
+    
+    // Copy first, then repoint the owner, then release the old block
+    ret = corefs_block_write(ctx, target, buf);
+    if (ret == ESP_OK) {
+        if (search->index < 0) {
+            ret = corefs_btree_update(ctx, search->path, target);
+        } else {
+            search->inode->block_list[search->index] = target;
+            ret = corefs_inode_write(ctx, search->inode_block, search->inode);
+        }
+    }
+    
+    if (ret != ESP_OK) {
+        corefs_block_free(ctx, target);
+        return ret;
+    }
+    
+    corefs_block_free(ctx, search->block);
+    return ESP_OK;
+}
+
+esp_err_t corefs_wear_static_step(corefs_ctx_t* ctx, uint32_t io_budget) {
+    if (!ctx || !ctx->wear_regions || !ctx->block_bitmap || !ctx->sb) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    // Each move reads the cold block, writes the copy and one metadata block
+    const uint32_t move_cost = 3 * COREFS_BLOCK_SIZE;
+    uint32_t spent = 0;
+    uint32_t moves = 0;
+    esp_err_t ret = ESP_OK;
+    
+    cold_search_t* search = corefs_mem_calloc(ctx, sizeof(cold_search_t));
+    uint8_t* buf = corefs_mem_alloc(ctx, COREFS_BLOCK_SIZE);
+    if (!search || !buf) {
+        corefs_mem_free(ctx, search);
+        corefs_mem_free(ctx, buf);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    search->inode = corefs_mem_alloc(ctx, sizeof(corefs_inode_t));
+    if (!search->inode) {
+        corefs_mem_free(ctx, search);
+        corefs_mem_free(ctx, buf);
+        return ESP_ERR_NO_MEM;
+    }
+    
+    // Keeps files from being opened or deleted while their blocks move
+    corefs_rwlock_wrlock(&ctx->dir_lock);
+    
+    while (spent + move_cost <= io_budget) {
+        corefs_inode_t* inode = search->inode;
+        memset(search, 0, sizeof(cold_search_t));
+        search->ctx = ctx;
+        search->inode = inode;
+        
+        ret = corefs_btree_iterate(ctx, find_cold_block, search);
+        if (ret != ESP_OK || search->block == 0) {
+            break;
+        }
+        
+        uint32_t hot_wear = 0;
+        uint32_t target = find_hot_free_block(ctx, &hot_wear);
+        if (target == 0 || hot_wear <= search->wear ||
+            hot_wear - search->wear <= COREFS_WEAR_STATIC_THRESHOLD) {
+            break;  // Spread within threshold
+        }
+        
+        // Inode was clobbered by the search; reload the owner
+        if (search->index >= 0) {
+            ret = corefs_inode_read(ctx, search->inode_block, search->inode);
+            if (ret != ESP_OK) {
+                break;
+            }
+        }
+        
+        ret = relocate_block(ctx, search, target, buf);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Relocation of block %lu failed: %s", 
+                     search->block, esp_err_to_name(ret));
+            break;
+        }
+        
+        ESP_LOGD(TAG, "Relocated cold block %lu (wear %lu) -> %lu (wear %lu)",
+                 search->block, search->wear, target, hot_wear);
+        
+        corefs_alloc_lock(ctx);
+        ctx->wear_stats.static_moves++;
+        ctx->wear_stats.bytes_relocated += COREFS_BLOCK_SIZE;
+        corefs_alloc_unlock(ctx);
+        spent += move_cost;
+        moves++;
+    }
+    
+    if (moves > 0) {
+        corefs_alloc_lock(ctx);
+        ctx->wear_stats.static_passes++;
+        corefs_alloc_unlock(ctx);
+        ESP_LOGI(TAG, "Static wear leveling: %lu blocks relocated", moves);
+    }
+    
+    corefs_rwlock_wrunlock(&ctx->dir_lock);
+    
+    corefs_mem_free(ctx, search->inode);
+    corefs_mem_free(ctx, search);
+    corefs_mem_free(ctx, buf);
+    return ret;
+}
+
+esp_err_t corefs_fs_wear_level(corefs_ctx_t* ctx, uint32_t io_budget) {
+    if (!ctx || !ctx->mounted || ctx->read_only) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    return corefs_wear_static_step(ctx, io_budget);
+}
+
+esp_err_t corefs_wear_level(uint32_t io_budget) {
+    return corefs_fs_wear_level(corefs_get_context(), io_budget);
+}
+
+// ============================================================================
+// BACKGROUND TASK
+// ============================================================================
+
+static void wear_task(void* arg) {
+    corefs_ctx_t* ctx = (corefs_ctx_t*)arg;
+    
+    while (!ctx->wear_stop) {
+        vTaskDelay(pdMS_TO_TICKS(ctx->wear_interval_ms));
+        if (!ctx->wear_stop && ctx->mounted) {
+            corefs_wear_static_step(ctx, ctx->wear_budget);
+        }
+    }
+    
+    ctx->wear_task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t corefs_fs_wear_start(corefs_ctx_t* ctx, uint32_t interval_ms, uint32_t io_budget) {
+    if (!ctx || !ctx->mounted || ctx->read_only) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    if (ctx->wear_task) {
+        return ESP_OK;
+    }
+    
+    ctx->wear_interval_ms = interval_ms ? interval_ms : COREFS_WEAR_STATIC_INTERVAL_MS;
+    ctx->wear_budget = io_budget ? io_budget : COREFS_WEAR_STATIC_BUDGET;
+    ctx->wear_stop = false;
+    
+    TaskHandle_t task = NULL;
+    if (xTaskCreate(wear_task, "corefs_wear", 3072, ctx, 
+                    tskIDLE_PRIORITY + 1, &task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start wear leveling task");
+        return ESP_ERR_NO_MEM;
+    }
+    
+    ctx->wear_task = task;
+    ESP_LOGI(TAG, "Static wear leveling every %lu ms (budget %lu bytes)",
+             ctx->wear_interval_ms, ctx->wear_budget);
+    return ESP_OK;
+}
+
+esp_err_t corefs_wear_start(uint32_t interval_ms, uint32_t io_budget) {
+    return corefs_fs_wear_start(corefs_get_context(), interval_ms, io_budget);
+}
+
+esp_err_t corefs_fs_wear_stop(corefs_ctx_t* ctx) {
+    if (!ctx) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    
+    // Let the task finish its current pass before returning
+    ctx->wear_stop = true;
+    while (ctx->wear_task) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    
+    return ESP_OK;
+}
+
+esp_err_t corefs_wear_stop(void) {
+    return corefs_fs_wear_stop(corefs_get_context());
+}
+
+esp_err_t corefs_fs_wear_get_stats(corefs_ctx_t* ctx, corefs_wear_stats_t* stats) {
+    if (!ctx || !ctx->mounted || !stats) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    
+    uint32_t avg_wear;
+    corefs_alloc_lock(ctx);
+    wear_min_max(ctx, &ctx->wear_stats.min_wear, &ctx->wear_stats.max_wear, &avg_wear);
+    *stats = ctx->wear_stats;
+    corefs_alloc_unlock(ctx);
+    return ESP_OK;
+}
+
+esp_err_t corefs_wear_get_stats(corefs_wear_stats_t* stats) {
+    return corefs_fs_wear_get_stats(corefs_get_context(), stats);
+}
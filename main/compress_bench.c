@@ -0,0 +1,166 @@
+/**
+ * CoreFS Kompression - Benchmark
+ *
+ * Zwei typische Korpora (Logzeilen und JSON-Datensätze, je BENCH_BYTES)
+ * werden einmal normal und einmal mit COREFS_O_COMPRESS geschrieben und
+ * zurückgelesen. Gemessen werden Schreib- und Lesedurchsatz (esp_timer,
+ * inklusive close bzw. open) und die auf Flash programmierten Bytes aus
+ * den CoreFS I/O-Statistiken; die Differenz ist die Ersparnis.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "corefs.h"
+#include "compress_bench.h"
+
+static const char* TAG = "compress_bench";
+
+#define BENCH_BYTES  (64 * 1024)
+#define BENCH_PATH   "/zbench"
+
+typedef struct {
+    int64_t write_us;
+    int64_t read_us;
+    uint32_t programmed;   // Bytes
+} bench_result_t;
+
+// ============================================
+// KORPORA
+// ============================================
+
+static void make_log(uint8_t* buf, size_t size) {
+    static const char* const tags[] = { "wifi", "mqtt", "sensor", "ota" };
+    size_t pos = 0;
+    char line[96];
+    for (uint32_t i = 0; pos < size; i++) {
+        int n = snprintf(line, sizeof(line), "I (%lu) %s: seq=%lu rssi=%d heap=%lu\n",
+                         (unsigned long)(1000 + i * 37), tags[i % 4], (unsigned long)i,
+                         -40 - (int)(i * 7 % 50), (unsigned long)(180000 - i % 4096));
+        size_t len = (size_t)n < size - pos ? (size_t)n : size - pos;
+        memcpy(buf + pos, line, len);
+        pos += len;
+    }
+}
+
+static void make_json(uint8_t* buf, size_t size) {
+    size_t pos = 0;
+    char rec[160];
+    for (uint32_t i = 0; pos < size; i++) {
+        int n = snprintf(rec, sizeof(rec),
+                         "{\"id\":%lu,\"device\":\"node-%02lu\",\"temp\":%ld.%lu,"
+                         "\"humidity\":%lu,\"status\":\"%s\"},\n",
+                         (unsigned long)i, (unsigned long)(i % 16), 18 + (long)(i % 9),
+                         (unsigned long)(i * 3 % 10), (unsigned long)(40 + i % 30),
+                         (i % 5) ? "ok" : "degraded");
+        size_t len = (size_t)n < size - pos ? (size_t)n : size - pos;
+        memcpy(buf + pos, rec, len);
+        pos += len;
+    }
+}
+
+// ============================================
+// MESSUNG
+// ============================================
+
+static esp_err_t bench_file(const uint8_t* data, uint8_t* check, uint32_t extra_flags,
+                            bench_result_t* r) {
+    corefs_unlink(BENCH_PATH);
+
+    corefs_io_stats_t before, after;
+    corefs_get_io_stats(&before);
+
+    int64_t t0 = esp_timer_get_time();
+    corefs_file_t* file = corefs_open(BENCH_PATH, COREFS_O_CREAT | COREFS_O_WRONLY | extra_flags);
+    if (!file) {
+        return ESP_FAIL;
+    }
+    int written = corefs_write(file, data, BENCH_BYTES);
+    esp_err_t ret = corefs_close(file);
+    r->write_us = esp_timer_get_time() - t0;
+
+    corefs_get_io_stats(&after);
+    r->programmed = (uint32_t)(after.programmed_bytes - before.programmed_bytes);
+
+    if (written != BENCH_BYTES || ret != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    t0 = esp_timer_get_time();
+    file = corefs_open(BENCH_PATH, COREFS_O_RDONLY);
+    if (!file) {
+        return ESP_FAIL;
+    }
+    int got = corefs_read(file, check, BENCH_BYTES);
+    corefs_close(file);
+    r->read_us = esp_timer_get_time() - t0;
+
+    corefs_unlink(BENCH_PATH);
+
+    if (got != BENCH_BYTES || memcmp(data, check, BENCH_BYTES) != 0) {
+        ESP_LOGE(TAG, "Gelesene Daten weichen ab");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static uint32_t mb_per_s_x100(int64_t us) {
+    return (uint32_t)((int64_t)BENCH_BYTES * 100 / (us ? us : 1));  // Bytes/µs = MB/s
+}
+
+static void report(const char* name, const bench_result_t* plain, const bench_result_t* zip) {
+    ESP_LOGI(TAG, "%-5s normal:   write %3lu.%02lu MB/s  read %3lu.%02lu MB/s  programmed %6lu B",
+             name,
+             (unsigned long)(mb_per_s_x100(plain->write_us) / 100), (unsigned long)(mb_per_s_x100(plain->write_us) % 100),
+             (unsigned long)(mb_per_s_x100(plain->read_us) / 100), (unsigned long)(mb_per_s_x100(plain->read_us) % 100),
+             (unsigned long)plain->programmed);
+    ESP_LOGI(TAG, "%-5s komprim.: write %3lu.%02lu MB/s  read %3lu.%02lu MB/s  programmed %6lu B (%ld%% gespart)",
+             name,
+             (unsigned long)(mb_per_s_x100(zip->write_us) / 100), (unsigned long)(mb_per_s_x100(zip->write_us) % 100),
+             (unsigned long)(mb_per_s_x100(zip->read_us) / 100), (unsigned long)(mb_per_s_x100(zip->read_us) % 100),
+             (unsigned long)zip->programmed,
+             plain->programmed ? (long)(100 - (int64_t)zip->programmed * 100 / plain->programmed) : 0L);
+}
+
+esp_err_t compress_bench_run(void) {
+    uint8_t* data = malloc(BENCH_BYTES);
+    uint8_t* check = malloc(BENCH_BYTES);
+    if (!data || !check) {
+        free(data);
+        free(check);
+        return ESP_ERR_NO_MEM;
+    }
+
+    static const struct {
+        const char* name;
+        void (*make)(uint8_t* buf, size_t size);
+    } corpora[] = {
+        { "Log",  make_log },
+        { "JSON", make_json },
+    };
+
+    ESP_LOGI(TAG, "%d KB pro Korpus", BENCH_BYTES / 1024);
+
+    esp_err_t ret = ESP_OK;
+    for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]) && ret == ESP_OK; i++) {
+        bench_result_t plain = {0};
+        bench_result_t zip = {0};
+
+        corpora[i].make(data, BENCH_BYTES);
+        ret = bench_file(data, check, 0, &plain);
+        if (ret == ESP_OK) {
+            ret = bench_file(data, check, COREFS_O_COMPRESS, &zip);
+        }
+        if (ret == ESP_OK) {
+            report(corpora[i].name, &plain, &zip);
+        } else {
+            ESP_LOGE(TAG, "%s: %s", corpora[i].name, esp_err_to_name(ret));
+        }
+    }
+
+    free(data);
+    free(check);
+    return ret;
+}
@@ -0,0 +1,10 @@
+/**
+ * CoreFS Kompression - Benchmark
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+// Braucht eine gemountete CoreFS Instanz
+esp_err_t compress_bench_run(void);
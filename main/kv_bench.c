@@ -0,0 +1,227 @@
+/**
+ * CoreFS Key-Value Store vs. NVS - Benchmark
+ *
+ * Beide Backends bekommen dieselbe Last: BENCH_KEYS Einstellungen mit
+ * 10-100 Byte Werten, BENCH_ROUNDS mal überschrieben, danach jede
+ * BENCH_GET_ROUNDS mal gelesen. Gemessen werden Durchsatz (esp_timer)
+ * und Flash-Verschleiß: gelöschte und geschriebene Bytes aus den
+ * SPI-Flash Zählern (CONFIG_SPI_FLASH_ENABLE_COUNTERS), also für beide
+ * Seiten mit demselben Maßstab.
+ *
+ * Läuft nur mit CONFIG_COREFS_APP_BENCHMARKS. Die "nvs" Partition wird
+ * nie gelöscht: lässt sie sich nicht initialisieren, entfällt die NVS
+ * Seite und nur CoreFS KV wird gemessen.
+ *
+ * Dass CoreFS KV bei Durchsatz und Verschleiß mit NVS mithält, ist
+ * nicht belegt: dieser Benchmark ist noch auf keinem Gerät gelaufen,
+ * es gibt keine NVS-Zahlen. Erst seine Ausgabe entscheidet das, in die
+ * eine oder andere Richtung.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "corefs.h"
+#include "kv_bench.h"
+
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+#include "esp_spi_flash_counters.h"
+#endif
+
+static const char* TAG = "kv_bench";
+
+#define BENCH_KEYS        100
+#define BENCH_ROUNDS      20     // Puts pro Key
+#define BENCH_GET_ROUNDS  10     // Gets pro Key
+#define BENCH_NAMESPACE   "kvbench"
+#define BENCH_PATH        "/kvbench"
+
+typedef struct {
+    int64_t put_us;
+    int64_t get_us;
+    uint32_t erased;     // Bytes
+    uint32_t written;    // Bytes
+} bench_result_t;
+
+// Der CoreFS Index liegt in der Struktur (ca. 6 KB) - nicht auf den Stack
+static corefs_kv_t kv;
+
+static void make_key(char* key, int i) {
+    // NVS Keys: max. 15 Zeichen
+    snprintf(key, 16, "cfg.item%03d", i);
+}
+
+static size_t make_value(uint8_t* buf, int i, int round) {
+    size_t len = 10 + (i * 7 + round * 13) % 91;
+    for (size_t k = 0; k < len; k++) {
+        buf[k] = (uint8_t)(i + round + k);
+    }
+    return len;
+}
+
+static void counters_reset(void) {
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+    esp_flash_reset_counters();
+#endif
+}
+
+static void counters_read(bench_result_t* r) {
+#if CONFIG_SPI_FLASH_ENABLE_COUNTERS
+    const esp_flash_counters_t* c = esp_flash_get_counters();
+    r->erased = c->erase.bytes;
+    r->written = c->write.bytes;
+#else
+    r->erased = 0;
+    r->written = 0;
+#endif
+}
+
+// ============================================
+// NVS
+// ============================================
+
+static esp_err_t bench_nvs(bench_result_t* r) {
+    // Die Daten anderer Komponenten bleiben: kein nvs_flash_erase()
+    esp_err_t ret = nvs_flash_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    nvs_handle_t h;
+    ret = nvs_open(BENCH_NAMESPACE, NVS_READWRITE, &h);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    nvs_erase_all(h);
+    nvs_commit(h);
+
+    char key[16];
+    uint8_t value[128];
+    uint8_t got[128];
+
+    counters_reset();
+    int64_t t0 = esp_timer_get_time();
+    for (int round = 0; round < BENCH_ROUNDS && ret == ESP_OK; round++) {
+        for (int i = 0; i < BENCH_KEYS && ret == ESP_OK; i++) {
+            make_key(key, i);
+            size_t len = make_value(value, i, round);
+            ret = nvs_set_blob(h, key, value, len);
+            if (ret == ESP_OK) {
+                ret = nvs_commit(h);
+            }
+        }
+    }
+    r->put_us = esp_timer_get_time() - t0;
+    counters_read(r);
+
+    t0 = esp_timer_get_time();
+    for (int round = 0; round < BENCH_GET_ROUNDS && ret == ESP_OK; round++) {
+        for (int i = 0; i < BENCH_KEYS && ret == ESP_OK; i++) {
+            make_key(key, i);
+            size_t len = sizeof(got);
+            ret = nvs_get_blob(h, key, got, &len);
+        }
+    }
+    r->get_us = esp_timer_get_time() - t0;
+
+    nvs_erase_all(h);
+    nvs_commit(h);
+    nvs_close(h);
+    return ret;
+}
+
+// ============================================
+// COREFS KV
+// ============================================
+
+static esp_err_t bench_corefs(bench_result_t* r) {
+    corefs_unlink(BENCH_PATH);
+
+    esp_err_t ret = corefs_kv_open(BENCH_PATH, &kv);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    char key[16];
+    uint8_t value[128];
+    uint8_t got[128];
+
+    counters_reset();
+    int64_t t0 = esp_timer_get_time();
+    for (int round = 0; round < BENCH_ROUNDS && ret == ESP_OK; round++) {
+        for (int i = 0; i < BENCH_KEYS && ret == ESP_OK; i++) {
+            make_key(key, i);
+            size_t len = make_value(value, i, round);
+            ret = corefs_kv_put(&kv, key, value, len);
+        }
+    }
+    r->put_us = esp_timer_get_time() - t0;
+    counters_read(r);
+
+    t0 = esp_timer_get_time();
+    for (int round = 0; round < BENCH_GET_ROUNDS && ret == ESP_OK; round++) {
+        for (int i = 0; i < BENCH_KEYS && ret == ESP_OK; i++) {
+            make_key(key, i);
+            size_t len = 0;
+            ret = corefs_kv_get(&kv, key, got, sizeof(got), &len);
+        }
+    }
+    r->get_us = esp_timer_get_time() - t0;
+
+    corefs_kv_stats_t stats;
+    if (corefs_kv_get_stats(&kv, &stats) == ESP_OK) {
+        ESP_LOGI(TAG, "CoreFS KV: %u keys, %u of %u log bytes live, %u compactions",
+                 stats.keys, stats.live_bytes, stats.log_bytes, stats.compactions);
+    }
+
+    corefs_kv_close(&kv);
+    corefs_unlink(BENCH_PATH);
+    return ret;
+}
+
+// ============================================
+// REPORT
+// ============================================
+
+static void report(const char* name, const bench_result_t* r) {
+    const uint32_t puts = BENCH_KEYS * BENCH_ROUNDS;
+    const uint32_t gets = BENCH_KEYS * BENCH_GET_ROUNDS;
+
+    ESP_LOGI(TAG, "%-10s put: %6lu/s  get: %6lu/s  erased: %7lu B (%4lu B/put)  written: %7lu B",
+             name,
+             (unsigned long)(puts * 1000000LL / (r->put_us ? r->put_us : 1)),
+             (unsigned long)(gets * 1000000LL / (r->get_us ? r->get_us : 1)),
+             (unsigned long)r->erased, (unsigned long)(r->erased / puts),
+             (unsigned long)r->written);
+}
+
+esp_err_t kv_bench_run(void) {
+    bench_result_t nvs = {0};
+    bench_result_t cfs = {0};
+
+    ESP_LOGI(TAG, "%d Keys x %d Puts, %d Gets pro Key", BENCH_KEYS, BENCH_ROUNDS, BENCH_GET_ROUNDS);
+
+    esp_err_t nvs_ret = bench_nvs(&nvs);
+    if (nvs_ret != ESP_OK) {
+        ESP_LOGW(TAG, "NVS: %s - ohne Vergleich", esp_err_to_name(nvs_ret));
+    }
+
+    esp_err_t ret = bench_corefs(&cfs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "CoreFS KV: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    if (nvs_ret == ESP_OK) {
+        report("NVS", &nvs);
+    }
+    report("CoreFS KV", &cfs);
+#if !CONFIG_SPI_FLASH_ENABLE_COUNTERS
+    ESP_LOGW(TAG, "CONFIG_SPI_FLASH_ENABLE_COUNTERS aus: keine Verschleißwerte");
+#endif
+    return ESP_OK;
+}
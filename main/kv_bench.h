@@ -0,0 +1,10 @@
+/**
+ * CoreFS Key-Value Store vs. NVS - Benchmark
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+// Braucht eine gemountete CoreFS Instanz und die "nvs" Partition
+esp_err_t kv_bench_run(void);
@@ -11,6 +11,10 @@
 #include "esp_log.h"
 #include "esp_partition.h"
 #include "corefs.h"
+#if CONFIG_COREFS_APP_BENCHMARKS
+#include "kv_bench.h"
+#include "compress_bench.h"
+#endif
 
 static const char* TAG = "main";
 
@@ -195,8 +199,26 @@ void app_main(void) {
         ESP_LOGE(TAG, "✗ File not found");
     }
     
+#if CONFIG_COREFS_APP_BENCHMARKS
     // ========================================
-    // SCHRITT 7: Final Stats
+    // SCHRITT 7: Key-Value Benchmark (CoreFS KV vs. NVS)
+    // ========================================
+    ESP_LOGI(TAG, "\n=== Key-Value Benchmark ===\n");
+    if (kv_bench_run() != ESP_OK) {
+        ESP_LOGE(TAG, "✗ Benchmark failed");
+    }
+    
+    // ========================================
+    // SCHRITT 8: Kompressions-Benchmark
+    // ========================================
+    ESP_LOGI(TAG, "\n=== Compression Benchmark ===\n");
+    if (compress_bench_run() != ESP_OK) {
+        ESP_LOGE(TAG, "✗ Benchmark failed");
+    }
+#endif
+    
+    // ========================================
+    // SCHRITT 9: Final Stats
     // ========================================
     ESP_LOGI(TAG, "\n=== System Status ===\n");
     ESP_LOGI(TAG, "CoreFS: Ready");
@@ -0,0 +1,254 @@
+/**
+ * dedup_race - block dedup against concurrent frees of the same block
+ *
+ * Runs on the threaded host port (HOST_THREADS) with the dedup index on.
+ * Every task writes one common block image now and then, so the index
+ * keeps pointing at a block some other task is about to free:
+ *
+ *   sharer   writes the common image to block 0 of its file (usually a
+ *            reference to someone else's block), checks it, writes a
+ *            private image over it (copy-on-write drops the reference)
+ *            and checks that
+ *   freer    truncates its file and writes the common image again, so
+ *            the indexed block is freed and a new one indexed
+ *   filler   rewrites blocks of its own file with private images; freed
+ *            blocks are allocated again at once
+ *
+ * A block freed while a sharer takes a reference to it ends up in a
+ * file and in the free pool at once: the filler overwrites it and a
+ * check fails, or the counts differ after a remount (mount rebuilds the
+ * bitmap and references from the inodes).
+ */
+
+#include "corefs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "host_port.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PART_SIZE    (512 * 1024)
+#define PART_ADDRESS 0x110000
+#define MAX_PAIRS    3               // Root holds 7 entries: sharers + freers + filler
+#define FILL_BLOCKS  8
+
+typedef enum {
+    ROLE_SHARER,
+    ROLE_FREER,
+    ROLE_FILLER,
+} role_t;
+
+typedef struct {
+    int id;                  // Bit in done, file number
+    role_t role;
+    uint32_t last;           // Last private image written (sharer)
+    unsigned long ops;
+} worker_t;
+
+static uint8_t image[PART_SIZE];
+
+static corefs_ctx_t* fs;
+static EventGroupHandle_t done;
+static int iterations = 20000;
+static volatile int errors;
+static worker_t workers[2 * MAX_PAIRS + 1];
+
+static void file_path(char* path, const worker_t* w) {
+    static const char* const prefix[] = { "/share", "/free", "/fill" };
+    snprintf(path, 16, "%s%d", prefix[w->role], w->id);
+}
+
+// The common image for tag 0, a private one of task id otherwise
+static void fill_block(uint8_t* buf, int id, uint32_t tag) {
+    for (int i = 0; i < COREFS_BLOCK_SIZE; i++) {
+        buf[i] = tag ? (uint8_t)(id * 31 + tag * 13 + i) : (uint8_t)(i * 7);
+    }
+    if (tag) {
+        memcpy(buf, &tag, sizeof(tag));
+        buf[sizeof(tag)] = (uint8_t)id;
+    }
+}
+
+static void fail(const char* what, int id) {
+    fprintf(stderr, "dedup_race: %s (task %d)\n", what, id);
+    __atomic_add_fetch(&errors, 1, __ATOMIC_SEQ_CST);
+}
+
+// Block index of f holds the image of (id, tag)
+static bool check_block(corefs_file_t* f, int index, int id, uint32_t tag) {
+    uint8_t buf[COREFS_BLOCK_SIZE];
+    uint8_t want[COREFS_BLOCK_SIZE];
+    fill_block(want, id, tag);
+    return corefs_pread(f, buf, sizeof(buf), index * COREFS_BLOCK_SIZE) == (int)sizeof(buf) &&
+           memcmp(buf, want, sizeof(buf)) == 0;
+}
+
+static bool write_block(corefs_file_t* f, int index, int id, uint32_t tag) {
+    uint8_t buf[COREFS_BLOCK_SIZE];
+    fill_block(buf, id, tag);
+    return corefs_pwrite(f, buf, sizeof(buf), index * COREFS_BLOCK_SIZE) == (int)sizeof(buf);
+}
+
+static void worker_task(void* arg) {
+    worker_t* w = arg;
+    char path[16];
+    file_path(path, w);
+
+    corefs_file_t* f = corefs_fs_open(fs, path, COREFS_O_RDWR | COREFS_O_CREAT | COREFS_O_TRUNC);
+    if (!f) {
+        fail("open", w->id);
+    }
+    for (int i = 0; f && i < iterations; i++) {
+        uint32_t tag = (uint32_t)i + 1;
+        if (w->role == ROLE_SHARER) {
+            if (!write_block(f, 0, w->id, 0) || !check_block(f, 0, w->id, 0)) {
+                fail("common image", w->id);
+                break;
+            }
+            if (!write_block(f, 0, w->id, tag) || !check_block(f, 0, w->id, tag)) {
+                fail("private image", w->id);
+                break;
+            }
+            w->last = tag;
+        } else if (w->role == ROLE_FREER) {
+            if (corefs_ftruncate(f, 0) != ESP_OK || !write_block(f, 0, w->id, 0)) {
+                fail("truncate and write", w->id);
+                break;
+            }
+        } else {
+            int index = i % FILL_BLOCKS;
+            if (!write_block(f, index, w->id, tag) || !check_block(f, index, w->id, tag)) {
+                fail("fill", w->id);
+                break;
+            }
+            w->last = tag;
+        }
+        w->ops++;
+    }
+    if (f) {
+        corefs_close(f);
+    }
+    xEventGroupSetBits(done, 1u << w->id);
+    vTaskDelete(NULL);
+}
+
+// Final contents of every file
+static int verify(int tasks) {
+    int bad = 0;
+    for (int i = 0; i < tasks; i++) {
+        worker_t* w = &workers[i];
+        char path[16];
+        file_path(path, w);
+        corefs_file_t* f = corefs_fs_open(fs, path, COREFS_O_RDONLY);
+        bool ok = f != NULL;
+        if (ok && w->role == ROLE_FILLER) {
+            // Block b last held the highest tag with tag - 1 = b (mod FILL_BLOCKS)
+            for (int b = 0; b < FILL_BLOCKS && ok; b++) {
+                uint32_t tag = w->last - (uint32_t)((w->last - 1 - b) % FILL_BLOCKS);
+                ok = check_block(f, b, w->id, tag);
+            }
+        } else if (ok) {
+            ok = check_block(f, 0, w->id, w->role == ROLE_SHARER ? w->last : 0);
+        }
+        if (f) {
+            corefs_close(f);
+        }
+        if (!ok) {
+            fail("verify", w->id);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+static uint32_t blocks_used(void) {
+    corefs_info_t info;
+    return corefs_fs_info(fs, &info) == ESP_OK ? info.blocks_used : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: dedup_race [-p pairs] [-n iterations]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int pairs = MAX_PAIRS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:n:")) != -1) {
+        switch (opt) {
+            case 'p': pairs = atoi(optarg); break;
+            case 'n': iterations = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (pairs < 1 || pairs > MAX_PAIRS || iterations < FILL_BLOCKS) {
+        usage();
+    }
+
+    esp_partition_t part;
+    host_partition_init(&part, image, sizeof(image), PART_ADDRESS);
+    memset(image, 0xFF, sizeof(image));
+
+    corefs_config_t cfg = COREFS_CONFIG_DEFAULT();
+    cfg.dedup_slots = 64;
+    if (corefs_format(&part) != ESP_OK || corefs_fs_mount(&part, &cfg, &fs) != ESP_OK) {
+        fprintf(stderr, "dedup_race: format/mount failed\n");
+        return 1;
+    }
+
+    int n = 0;
+    for (int i = 0; i < pairs; i++) {
+        workers[n] = (worker_t){ .id = n, .role = ROLE_SHARER };
+        n++;
+        workers[n] = (worker_t){ .id = n, .role = ROLE_FREER };
+        n++;
+    }
+    workers[n] = (worker_t){ .id = n, .role = ROLE_FILLER };
+    n++;
+
+    done = xEventGroupCreate();
+    for (int i = 0; i < n; i++) {
+        if (xTaskCreate(worker_task, "race", 8192, &workers[i], tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+            fprintf(stderr, "dedup_race: cannot start task %d\n", i);
+            return 1;
+        }
+    }
+    EventBits_t all = (EventBits_t)((1ull << n) - 1);
+    xEventGroupWaitBits(done, all, pdFALSE, pdTRUE, portMAX_DELAY);
+    vEventGroupDelete(done);
+
+    corefs_io_stats_t stats;
+    corefs_fs_get_io_stats(fs, &stats);
+    int bad = verify(n);
+    uint32_t used = blocks_used();
+    corefs_fs_unmount(fs);
+
+    // And from flash: same files, same block count
+    fs = NULL;
+    if (corefs_fs_mount(&part, &cfg, &fs) != ESP_OK) {
+        fprintf(stderr, "dedup_race: remount failed\n");
+        return 1;
+    }
+    bad += verify(n);
+    uint32_t used_after = blocks_used();
+    corefs_fs_unmount(fs);
+    if (used_after != used) {
+        fail("block count after remount", -1);
+        bad++;
+    }
+
+    unsigned long ops = 0;
+    for (int i = 0; i < n; i++) {
+        ops += workers[i].ops;
+    }
+    printf("tasks      %d sharers, %d freers, 1 filler, %d iterations each\n", pairs, pairs, iterations);
+    printf("ops        %lu, dedup hits %u, copy-on-write %u\n", ops, stats.dedup_hits, stats.cow_copies);
+    printf("blocks     %u used, %u after remount\n", used, used_after);
+    printf("errors     %d during the run, %d after it\n", errors - bad, bad);
+    printf("verify     %s\n", errors == 0 ? "ok" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+/**
+ * kv_bench - flash cost of the key-value store
+ *
+ * The CoreFS half of main/kv_bench.c, with the same load: keys named
+ * "cfg.itemNNN" with 10-100 byte values, each put rounds times, then
+ * every key read back get_rounds times. This one runs without hardware
+ * and measures CoreFS only. It says nothing about NVS: the device
+ * benchmark has not been run yet, so there are no NVS numbers and no
+ * claim that the store matches NVS on throughput or wear.
+ *
+ * Reported from corefs_fs_get_io_stats() for the puts, compaction
+ * included:
+ *
+ *   erased      bytes and 4 KB sectors erased
+ *   programmed  bytes programmed
+ *   per put     erased and programmed bytes divided by the puts
+ *
+ * At the end the partition is mounted again and every key is checked
+ * against its last value, so a number is never reported for a run that
+ * lost data.
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include "host_port.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PART_SIZE    (1024 * 1024)
+#define PART_ADDRESS 0x110000
+#define STORE_PATH   "/kvbench"
+#define MAX_KEYS     1000
+
+static uint8_t image[PART_SIZE];
+
+// Caller-owned index (several KB), kept off the stack
+static corefs_kv_t kv;
+
+static void make_key(char* key, int i) {
+    snprintf(key, 16, "cfg.item%03d", i);
+}
+
+static size_t make_value(uint8_t* buf, int i, int round) {
+    size_t len = 10 + (i * 7 + round * 13) % 91;
+    for (size_t k = 0; k < len; k++) {
+        buf[k] = (uint8_t)(i + round + k);
+    }
+    return len;
+}
+
+// Every key holds its value of the last round
+static int check(corefs_ctx_t* fs, int keys, int rounds) {
+    if (corefs_fs_kv_open(fs, STORE_PATH, &kv) != ESP_OK) {
+        return -1;
+    }
+
+    int bad = 0;
+    for (int i = 0; i < keys; i++) {
+        char key[16];
+        uint8_t want[128];
+        uint8_t got[128];
+        size_t len = 0;
+        make_key(key, i);
+        size_t want_len = make_value(want, i, rounds - 1);
+        if (corefs_kv_get(&kv, key, got, sizeof(got), &len) != ESP_OK ||
+            len != want_len || memcmp(got, want, len) != 0) {
+            bad++;
+        }
+    }
+    corefs_kv_close(&kv);
+    return bad ? -1 : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: kv_bench [-k keys] [-r rounds] [-g get_rounds]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int keys = 100;
+    int rounds = 20;
+    int get_rounds = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "k:r:g:")) != -1) {
+        switch (opt) {
+            case 'k': keys = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            case 'g': get_rounds = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (keys <= 0 || keys > MAX_KEYS || rounds <= 0 || get_rounds < 0) {
+        usage();
+    }
+
+    esp_partition_t part;
+    host_partition_init(&part, image, sizeof(image), PART_ADDRESS);
+    memset(image, 0xFF, sizeof(image));
+
+    corefs_config_t cfg = COREFS_CONFIG_DEFAULT();
+    corefs_ctx_t* fs = NULL;
+    if (corefs_format(&part) != ESP_OK || corefs_fs_mount(&part, &cfg, &fs) != ESP_OK ||
+        corefs_fs_kv_open(fs, STORE_PATH, &kv) != ESP_OK) {
+        fprintf(stderr, "kv_bench: format/mount/open failed\n");
+        return 1;
+    }
+
+    char key[16];
+    uint8_t value[128];
+
+    corefs_fs_reset_io_stats(fs);
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < keys; i++) {
+            make_key(key, i);
+            size_t len = make_value(value, i, round);
+            if (corefs_kv_put(&kv, key, value, len) != ESP_OK) {
+                fprintf(stderr, "kv_bench: put failed at round %d key %d\n", round, i);
+                return 1;
+            }
+        }
+    }
+    corefs_io_stats_t st;
+    corefs_fs_get_io_stats(fs, &st);
+
+    for (int round = 0; round < get_rounds; round++) {
+        for (int i = 0; i < keys; i++) {
+            size_t len = 0;
+            make_key(key, i);
+            if (corefs_kv_get(&kv, key, value, sizeof(value), &len) != ESP_OK) {
+                fprintf(stderr, "kv_bench: get failed at round %d key %d\n", round, i);
+                return 1;
+            }
+        }
+    }
+
+    corefs_kv_stats_t ks;
+    corefs_kv_get_stats(&kv, &ks);
+    corefs_kv_close(&kv);
+    corefs_fs_unmount(fs);
+
+    // Everything put must still be there
+    fs = NULL;
+    bool ok = corefs_fs_mount(&part, &cfg, &fs) == ESP_OK && check(fs, keys, rounds) == 0;
+    if (fs) {
+        corefs_fs_unmount(fs);
+    }
+
+    uint32_t puts = (uint32_t)keys * rounds;
+    printf("workload   %d keys x %d puts of 10-100 B, %d gets per key\n", keys, rounds, get_rounds);
+    printf("store      %u keys, %u of %u log bytes live, %u compactions\n",
+           ks.keys, ks.live_bytes, ks.log_bytes, ks.compactions);
+    printf("erased     %llu B (%llu sectors, %.2f per 100 puts)\n",
+           (unsigned long long)st.erased_bytes,
+           (unsigned long long)(st.erased_bytes / COREFS_SECTOR_SIZE),
+           100.0 * (st.erased_bytes / COREFS_SECTOR_SIZE) / puts);
+    printf("programmed %llu B\n", (unsigned long long)st.programmed_bytes);
+    printf("per put    %.0f B erased, %.0f B programmed\n",
+           (double)st.erased_bytes / puts, (double)st.programmed_bytes / puts);
+    printf("verify     %s\n", ok ? "ok" : "FAILED");
+    printf("nvs        not measured (device only: main/kv_bench.c)\n");
+    return ok ? 0 : 1;
+}
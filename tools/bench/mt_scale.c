@@ -0,0 +1,238 @@
+/**
+ * mt_scale - throughput of 1 to 6 tasks on one mounted CoreFS
+ *
+ * Runs on the threaded host port (HOST_THREADS). For each task count
+ * the tasks start together and stop after a fixed amount of data each;
+ * the aggregate rate is all their bytes over the wall time, best of
+ * three runs:
+ *
+ *   read own    every task reads its own 64 KB file, 2 KB at a time
+ *   read same   every task reads the same file
+ *   write own   every task overwrites 2 KB blocks of its own file,
+ *               fsync at the end
+ *
+ * Six tasks is the most the root directory (7 entries) has files for.
+ * Without -d the image is RAM and the numbers are CPU and lock cost;
+ * with -d every flash access holds the one flash bus for as long as a
+ * typical 4 MB SPI NOR part takes (W25Q32JV datasheet: 20 MB/s read,
+ * 0.7 ms per 256-byte page program, 45 ms per 4 KB sector erase).
+ */
+
+#include "corefs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "host_port.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PART_SIZE    (1024 * 1024)
+#define PART_ADDRESS 0x110000
+#define FILE_SIZE    (64 * 1024)
+#define IO_SIZE      2048
+#define MAX_TASKS    6
+#define GO           (1u << 31)
+#define RUNS         3
+
+typedef enum {
+    LOAD_READ_OWN,
+    LOAD_READ_SAME,
+    LOAD_WRITE_OWN,
+} load_t;
+
+typedef struct {
+    int id;
+    load_t load;
+    size_t bytes;
+    int failed;
+} worker_t;
+
+static uint8_t image[PART_SIZE];
+
+static corefs_ctx_t* fs;
+static EventGroupHandle_t events;
+static worker_t workers[MAX_TASKS];
+
+static void file_path(char* path, int file) {
+    snprintf(path, 16, "/file%d", file);
+}
+
+static void worker_task(void* arg) {
+    worker_t* w = arg;
+    char path[16];
+    uint8_t buf[IO_SIZE];
+    bool write = w->load == LOAD_WRITE_OWN;
+    file_path(path, w->load == LOAD_READ_SAME ? 0 : w->id);
+    memset(buf, w->id + 1, sizeof(buf));
+
+    corefs_file_t* f = corefs_fs_open(fs, path, write ? COREFS_O_RDWR : COREFS_O_RDONLY);
+    xEventGroupWaitBits(events, GO, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    // Tasks start at different offsets so they do not walk in lockstep
+    uint32_t pos = (uint32_t)(w->id * 5 * IO_SIZE) % FILE_SIZE;
+    for (size_t done = 0; f && done < w->bytes; done += IO_SIZE) {
+        int n = write ? corefs_pwrite(f, buf, IO_SIZE, pos) : corefs_pread(f, buf, IO_SIZE, pos);
+        if (n != IO_SIZE) {
+            break;
+        }
+        pos = (pos + IO_SIZE) % FILE_SIZE;
+    }
+    if (!f || (write && corefs_fsync(f) != ESP_OK)) {
+        w->failed = 1;
+    }
+    if (f) {
+        corefs_close(f);
+    }
+    xEventGroupSetBits(events, 1u << w->id);
+    vTaskDelete(NULL);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Aggregate KB/s of tasks running load, -1 on failure
+static double run(load_t load, int tasks, size_t bytes) {
+    EventBits_t all = (1u << tasks) - 1;
+    events = xEventGroupCreate();
+    for (int i = 0; i < tasks; i++) {
+        workers[i] = (worker_t){ .id = i, .load = load, .bytes = bytes };
+        if (xTaskCreate(worker_task, "scale", 4096, &workers[i], tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+            return -1;
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS(20));
+
+    double start = now();
+    xEventGroupSetBits(events, GO);
+    xEventGroupWaitBits(events, all, pdFALSE, pdTRUE, portMAX_DELAY);
+    double secs = now() - start;
+    vEventGroupDelete(events);
+
+    for (int i = 0; i < tasks; i++) {
+        if (workers[i].failed) {
+            return -1;
+        }
+    }
+    return (double)bytes * tasks / secs / 1024;
+}
+
+static int create_files(void) {
+    uint8_t buf[IO_SIZE];
+    for (int file = 0; file < MAX_TASKS; file++) {
+        char path[16];
+        file_path(path, file);
+        corefs_file_t* f = corefs_fs_open(fs, path, COREFS_O_RDWR | COREFS_O_CREAT | COREFS_O_TRUNC);
+        if (!f) {
+            return -1;
+        }
+        memset(buf, 0xA0 + file, sizeof(buf));
+        for (int i = 0; i < FILE_SIZE / IO_SIZE; i++) {
+            if (corefs_write(f, buf, sizeof(buf)) != IO_SIZE) {
+                corefs_close(f);
+                return -1;
+            }
+        }
+        if (corefs_close(f) != ESP_OK) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: mt_scale [-d] [-c cache_blocks] [-r read_kb] [-w write_kb]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    bool device = false;
+    int cache_blocks = 8;
+    int read_kb = -1;
+    int write_kb = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "dc:r:w:")) != -1) {
+        switch (opt) {
+            case 'd': device = true; break;
+            case 'c': cache_blocks = atoi(optarg); break;
+            case 'r': read_kb = atoi(optarg); break;
+            case 'w': write_kb = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    // Per task; the device model is slow enough for less
+    if (read_kb < 0) {
+        read_kb = device ? 512 : 65536;
+    }
+    if (write_kb < 0) {
+        write_kb = device ? 32 : 4096;
+    }
+    if (cache_blocks < 0 || read_kb <= 0 || write_kb <= 0) {
+        usage();
+    }
+
+    esp_partition_t part;
+    host_partition_init(&part, image, sizeof(image), PART_ADDRESS);
+    memset(image, 0xFF, sizeof(image));
+
+    corefs_config_t cfg = COREFS_CONFIG_DEFAULT();
+    cfg.cache_blocks = cache_blocks;
+    if (corefs_format(&part) != ESP_OK || corefs_fs_mount(&part, &cfg, &fs) != ESP_OK ||
+        create_files() != 0) {
+        fprintf(stderr, "mt_scale: format/mount/create failed\n");
+        return 1;
+    }
+    if (device) {
+        host_flash_timing_t timing = {
+            .read_ns_per_kb = 48828,
+            .program_ns_per_kb = 2800000,
+            .erase_us_per_sector = 45000,
+        };
+        host_flash_set_timing(&timing);
+    }
+
+    static const struct {
+        load_t load;
+        const char* name;
+    } loads[] = {
+        { LOAD_READ_OWN, "read own" },
+        { LOAD_READ_SAME, "read same" },
+        { LOAD_WRITE_OWN, "write own" },
+    };
+    static const int counts[] = { 1, 2, 4, 6 };
+
+    printf("flash      %s, %d cache blocks, %ld CPUs\n",
+           device ? "device timing" : "RAM", cache_blocks, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("per task   %d KB read, %d KB written, %d B per call\n", read_kb, write_kb, IO_SIZE);
+    printf("KB/s       %10s %10s %10s %10s\n", "1 task", "2 tasks", "4 tasks", "6 tasks");
+    int ret = 0;
+    for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+        size_t bytes = (size_t)(loads[l].load == LOAD_WRITE_OWN ? write_kb : read_kb) * 1024;
+        printf("%-10s", loads[l].name);
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            double rate_kb = 0;
+            for (int r = 0; r < RUNS && rate_kb >= 0; r++) {
+                double rate = run(loads[l].load, counts[c], bytes);
+                rate_kb = rate < 0 || rate > rate_kb ? rate : rate_kb;
+            }
+            if (rate_kb < 0) {
+                ret = 1;
+                printf(" %10s", "failed");
+            } else {
+                printf(" %10.0f", rate_kb);
+            }
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    host_flash_set_timing(NULL);
+    corefs_fs_unmount(fs);
+    return ret;
+}
@@ -0,0 +1,349 @@
+/**
+ * mt_stress - several tasks on one mounted CoreFS
+ *
+ * Runs on the threaded host port (HOST_THREADS): every worker is a
+ * FreeRTOS task, i.e. a pthread, and all of them share one instance:
+ *
+ *   private   one writer and one reader per file (-f files)
+ *   shared    -w writers on disjoint slices of one file, -r readers
+ *             over all of it
+ *   churn     one task creating, filling, closing and unlinking a file
+ *   wear      the background wear leveling task, every 5 ms
+ *
+ * Files are made of 256-byte chunks. A write rewrites a whole chunk
+ * with a new generation, so a reader must always see a chunk of a
+ * single generation: a torn or foreign chunk is a locking bug. After
+ * the run the partition is mounted again and every chunk must hold the
+ * last generation its writer wrote.
+ */
+
+#include "corefs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "host_port.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PART_SIZE    (1024 * 1024)
+#define PART_ADDRESS 0x110000
+#define CHUNK        256
+#define CHUNKS       64              // Chunks per file (16 KB)
+#define MAX_FILES    4               // Root holds 7 entries: private + shared + churn
+#define MAX_SHARED   8
+
+static uint8_t image[PART_SIZE];
+
+static corefs_ctx_t* fs;
+static EventGroupHandle_t done;
+static int iterations = 2000;
+static volatile int errors;
+
+typedef struct {
+    int id;                  // Bit in done
+    int file;                // 0..MAX_FILES-1 private, MAX_FILES shared
+    int first;               // Chunks this writer owns
+    int count;
+    EventBits_t writers;     // Readers: done bits of the file's writers
+    unsigned seed;
+    uint32_t gen[CHUNKS];    // Last generation written per chunk
+    unsigned long ops;
+} worker_t;
+
+static worker_t workers[2 * MAX_FILES + 2 * MAX_SHARED + 1];
+
+static void file_path(char* path, int file) {
+    if (file == MAX_FILES) {
+        strcpy(path, "/shared");
+    } else {
+        snprintf(path, 16, "/file%d", file);
+    }
+}
+
+// Chunk of file with generation gen: a header, then a pattern of all three
+static void fill_chunk(uint8_t* buf, int file, int chunk, uint32_t gen) {
+    uint32_t head[3] = { (uint32_t)file, (uint32_t)chunk, gen };
+    memcpy(buf, head, sizeof(head));
+    for (int i = sizeof(head); i < CHUNK; i++) {
+        buf[i] = (uint8_t)(file * 31 + chunk * 7 + gen * 13 + i);
+    }
+}
+
+// Generation of a consistent chunk, -1 if it is torn or misplaced
+static int64_t check_chunk(const uint8_t* buf, int file, int chunk) {
+    uint32_t head[3];
+    memcpy(head, buf, sizeof(head));
+    if (head[0] != (uint32_t)file || head[1] != (uint32_t)chunk) {
+        return -1;
+    }
+    uint8_t want[CHUNK];
+    fill_chunk(want, file, chunk, head[2]);
+    return memcmp(buf, want, CHUNK) == 0 ? (int64_t)head[2] : -1;
+}
+
+static void fail(const char* what, int file, int chunk) {
+    fprintf(stderr, "mt_stress: %s (file %d chunk %d)\n", what, file, chunk);
+    __atomic_add_fetch(&errors, 1, __ATOMIC_SEQ_CST);
+}
+
+static void writer_task(void* arg) {
+    worker_t* w = arg;
+    char path[16];
+    uint8_t buf[CHUNK];
+    file_path(path, w->file);
+
+    corefs_file_t* f = corefs_fs_open(fs, path, COREFS_O_RDWR);
+    if (!f) {
+        fail("writer open", w->file, -1);
+    } else {
+        for (int i = 0; i < iterations; i++) {
+            int chunk = w->first + (int)((unsigned)rand_r(&w->seed) % w->count);
+            uint32_t gen = w->gen[chunk] + 1;
+            fill_chunk(buf, w->file, chunk, gen);
+            if (corefs_pwrite(f, buf, CHUNK, chunk * CHUNK) != CHUNK) {
+                fail("pwrite", w->file, chunk);
+                break;
+            }
+            w->gen[chunk] = gen;
+            w->ops++;
+            if (i % 64 == 63 && corefs_fsync(f) != ESP_OK) {
+                fail("fsync", w->file, chunk);
+            }
+        }
+        corefs_close(f);
+    }
+    xEventGroupSetBits(done, 1u << w->id);
+    vTaskDelete(NULL);
+}
+
+// Reads runs of 1-4 chunks until every writer of the file is done
+static void reader_task(void* arg) {
+    worker_t* w = arg;
+    char path[16];
+    uint8_t buf[CHUNK * 4];
+    file_path(path, w->file);
+
+    corefs_file_t* f = corefs_fs_open(fs, path, COREFS_O_RDONLY);
+    if (!f) {
+        fail("reader open", w->file, -1);
+    } else {
+        while ((xEventGroupWaitBits(done, w->writers, pdFALSE, pdTRUE, 0) & w->writers) != w->writers) {
+            int chunk = (int)((unsigned)rand_r(&w->seed) % (CHUNKS - 3));
+            int n = 1 + (int)((unsigned)rand_r(&w->seed) % 4);
+            if (corefs_pread(f, buf, n * CHUNK, chunk * CHUNK) != n * CHUNK) {
+                fail("pread", w->file, chunk);
+                break;
+            }
+            for (int k = 0; k < n; k++) {
+                if (check_chunk(buf + k * CHUNK, w->file, chunk + k) < 0) {
+                    fail("torn chunk", w->file, chunk + k);
+                }
+            }
+            w->ops++;
+        }
+        corefs_close(f);
+    }
+    xEventGroupSetBits(done, 1u << w->id);
+    vTaskDelete(NULL);
+}
+
+static void churn_task(void* arg) {
+    worker_t* w = arg;
+    uint8_t buf[CHUNK * 8];
+    memset(buf, 0x5A, sizeof(buf));
+
+    for (int i = 0; i < iterations / 20; i++) {
+        corefs_file_t* f = corefs_fs_open(fs, "/churn", COREFS_O_RDWR | COREFS_O_CREAT | COREFS_O_TRUNC);
+        if (!f) {
+            fail("churn open", -1, -1);
+            break;
+        }
+        if (corefs_write(f, buf, sizeof(buf)) != (int)sizeof(buf)) {
+            fail("churn write", -1, -1);
+        }
+        corefs_close(f);
+        if (corefs_fs_unlink(fs, "/churn") != ESP_OK) {
+            fail("churn unlink", -1, -1);
+        }
+        w->ops++;
+    }
+    xEventGroupSetBits(done, 1u << w->id);
+    vTaskDelete(NULL);
+}
+
+// Initial contents: every chunk at generation 0
+static int create_file(int file) {
+    char path[16];
+    uint8_t buf[CHUNK];
+    file_path(path, file);
+    corefs_file_t* f = corefs_fs_open(fs, path, COREFS_O_RDWR | COREFS_O_CREAT | COREFS_O_TRUNC);
+    if (!f) {
+        return -1;
+    }
+    for (int c = 0; c < CHUNKS; c++) {
+        fill_chunk(buf, file, c, 0);
+        if (corefs_write(f, buf, CHUNK) != CHUNK) {
+            corefs_close(f);
+            return -1;
+        }
+    }
+    return corefs_close(f) == ESP_OK ? 0 : -1;
+}
+
+// Every chunk holds the last generation of its writer
+static int verify(worker_t** owner, int files) {
+    int bad = 0;
+    for (int file = 0; file <= MAX_FILES; file++) {
+        if (file < MAX_FILES && file >= files) {
+            continue;
+        }
+        char path[16];
+        uint8_t buf[CHUNK];
+        file_path(path, file);
+        corefs_file_t* f = corefs_fs_open(fs, path, COREFS_O_RDONLY);
+        if (!f || corefs_size(f) != CHUNKS * CHUNK) {
+            fail("verify open", file, -1);
+            bad++;
+            if (f) {
+                corefs_close(f);
+            }
+            continue;
+        }
+        for (int c = 0; c < CHUNKS; c++) {
+            worker_t* w = owner[file * CHUNKS + c];
+            uint32_t want = w ? w->gen[c] : 0;
+            if (corefs_pread(f, buf, CHUNK, c * CHUNK) != CHUNK || check_chunk(buf, file, c) != want) {
+                fail("verify", file, c);
+                bad++;
+            }
+        }
+        corefs_close(f);
+    }
+    return bad;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: mt_stress [-f files] [-w shared_writers] [-r shared_readers] [-n writes] [-c cache_blocks]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int files = MAX_FILES;
+    int shared_writers = 4;
+    int shared_readers = 4;
+    int cache_blocks = 8;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:w:r:n:c:")) != -1) {
+        switch (opt) {
+            case 'f': files = atoi(optarg); break;
+            case 'w': shared_writers = atoi(optarg); break;
+            case 'r': shared_readers = atoi(optarg); break;
+            case 'n': iterations = atoi(optarg); break;
+            case 'c': cache_blocks = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (files < 0 || files > MAX_FILES || shared_writers < 1 || shared_writers > MAX_SHARED ||
+        shared_readers < 0 || shared_readers > MAX_SHARED || iterations <= 0 || cache_blocks < 0) {
+        usage();
+    }
+
+    esp_partition_t part;
+    host_partition_init(&part, image, sizeof(image), PART_ADDRESS);
+    memset(image, 0xFF, sizeof(image));
+
+    corefs_config_t cfg = COREFS_CONFIG_DEFAULT();
+    cfg.cache_blocks = cache_blocks;
+    if (corefs_format(&part) != ESP_OK || corefs_fs_mount(&part, &cfg, &fs) != ESP_OK) {
+        fprintf(stderr, "mt_stress: format/mount failed\n");
+        return 1;
+    }
+    for (int file = 0; file <= MAX_FILES; file++) {
+        if ((file < files || file == MAX_FILES) && create_file(file) != 0) {
+            fprintf(stderr, "mt_stress: cannot create file %d\n", file);
+            return 1;
+        }
+    }
+    if (corefs_fs_wear_start(fs, 5, 1) != ESP_OK) {
+        fprintf(stderr, "mt_stress: wear task failed\n");
+        return 1;
+    }
+
+    // Writers first: a reader gets the done bits of its file's writers
+    static worker_t* owner[(MAX_FILES + 1) * CHUNKS];
+    int n = 0;
+    EventBits_t file_writers[MAX_FILES + 1] = { 0 };
+    for (int file = 0; file < files; file++) {
+        worker_t* w = &workers[n];
+        *w = (worker_t){ .id = n, .file = file, .first = 0, .count = CHUNKS };
+        file_writers[file] |= 1u << n++;
+    }
+    for (int i = 0; i < shared_writers; i++) {
+        worker_t* w = &workers[n];
+        int slice = CHUNKS / shared_writers;
+        *w = (worker_t){ .id = n, .file = MAX_FILES, .first = i * slice,
+                         .count = i == shared_writers - 1 ? CHUNKS - i * slice : slice };
+        file_writers[MAX_FILES] |= 1u << n++;
+    }
+    int writers = n;
+    for (int i = 0; i < writers; i++) {
+        for (int c = workers[i].first; c < workers[i].first + workers[i].count; c++) {
+            owner[workers[i].file * CHUNKS + c] = &workers[i];
+        }
+    }
+    for (int file = 0; file < files; file++) {
+        workers[n] = (worker_t){ .id = n, .file = file, .writers = file_writers[file] };
+        n++;
+    }
+    for (int i = 0; i < shared_readers; i++) {
+        workers[n] = (worker_t){ .id = n, .file = MAX_FILES, .writers = file_writers[MAX_FILES] };
+        n++;
+    }
+    int churn = n;
+    workers[n] = (worker_t){ .id = n };
+    n++;
+
+    done = xEventGroupCreate();
+    for (int i = 0; i < n; i++) {
+        workers[i].seed = (unsigned)i * 2654435761u + 1;
+        TaskFunction_t entry = i < writers ? writer_task : i < churn ? reader_task : churn_task;
+        if (xTaskCreate(entry, "stress", 4096, &workers[i], tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+            fprintf(stderr, "mt_stress: cannot start task %d\n", i);
+            return 1;
+        }
+    }
+    EventBits_t all = (EventBits_t)((1ull << n) - 1);
+    xEventGroupWaitBits(done, all, pdFALSE, pdTRUE, portMAX_DELAY);
+    vEventGroupDelete(done);
+
+    unsigned long writes = 0;
+    unsigned long reads = 0;
+    for (int i = 0; i < churn; i++) {
+        *(i < writers ? &writes : &reads) += workers[i].ops;
+    }
+
+    corefs_fs_wear_stop(fs);
+    int bad = verify(owner, files);
+    corefs_fs_unmount(fs);
+
+    // And all of it again from flash
+    fs = NULL;
+    if (corefs_fs_mount(&part, &cfg, &fs) != ESP_OK) {
+        fprintf(stderr, "mt_stress: remount failed\n");
+        return 1;
+    }
+    bad += verify(owner, files);
+    corefs_fs_unmount(fs);
+
+    printf("tasks      %d writers, %d readers, 1 churn, wear every 5 ms\n", writers, churn - writers);
+    printf("files      %d private, 1 shared by %d writers and %d readers\n",
+           files, shared_writers, shared_readers);
+    printf("ops        %lu chunk writes, %lu reads, %lu create/unlink\n",
+           writes, reads, workers[churn].ops);
+    printf("errors     %d during the run, %d after it\n", errors - bad, bad);
+    printf("verify     %s\n", errors == 0 ? "ok" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
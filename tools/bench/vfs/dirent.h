@@ -0,0 +1,26 @@
+/**
+ * CoreFS host benchmarks - dirent.h as ESP-IDF's newlib defines it
+ *
+ * A file system embeds DIR in its own directory stream, so it has to be
+ * a complete type (it is opaque in glibc).
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef struct {
+    uint16_t dd_vfs_idx;     // VFS index, filled in by the VFS
+    uint16_t dd_rsv;
+} DIR;
+
+struct dirent {
+    ino_t d_ino;
+    uint8_t d_type;
+    char d_name[256];
+};
+
+#define DT_UNKNOWN 0
+#define DT_REG     1
+#define DT_DIR     2
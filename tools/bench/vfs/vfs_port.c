@@ -0,0 +1,326 @@
+/**
+ * CoreFS host benchmarks - ESP-IDF VFS port
+ *
+ * The part of esp_vfs between newlib and a file system: one registered
+ * path prefix, a global descriptor table mapping to the file system's
+ * local descriptors (locked by open and close only), and every call
+ * dispatched to its hook.
+ *
+ * Streams follow newlib's stdio rather than glibc's, whose fopencookie()
+ * streams buffer differently: an st_blksize buffer allocated on first
+ * use; fread copies through it unless the stream is unbuffered
+ * (_IONBF), then it reads straight into the caller's memory; fwrite of
+ * a whole buffer or more goes straight out while the buffer is empty.
+ */
+
+#include "esp_vfs.h"
+#include "vfs_port.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FDS  64
+#define FD_BASE  3               // 0-2 are the console
+
+static struct {
+    char base[16];
+    size_t base_len;
+    esp_vfs_t vfs;
+    void* ctx;
+    bool used;
+} registered;
+
+static pthread_mutex_t fd_lock = PTHREAD_MUTEX_INITIALIZER;
+static int fd_table[MAX_FDS];    // Local descriptor + 1, 0 = free
+
+static host_vfs_stream_stats_t stream_stats;
+
+// ============================================
+// REGISTRATION
+// ============================================
+
+esp_err_t esp_vfs_register(const char* base_path, const esp_vfs_t* vfs, void* ctx) {
+    size_t len = strlen(base_path);
+    if (registered.used || len == 0 || len >= sizeof(registered.base) ||
+        !(vfs->flags & ESP_VFS_FLAG_CONTEXT_PTR)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(registered.base, base_path, len + 1);
+    registered.base_len = len;
+    registered.vfs = *vfs;
+    registered.ctx = ctx;
+    registered.used = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_unregister(const char* base_path) {
+    if (!registered.used || strcmp(base_path, registered.base) != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    registered.used = false;
+    return ESP_OK;
+}
+
+// ============================================
+// DESCRIPTORS
+// ============================================
+
+// Local descriptor of fd, -1 with errno = EBADF. A single read, so no
+// lock: only open and close take it, as in esp_vfs.c
+static int local_fd(int fd) {
+    int local = -1;
+    if (fd >= FD_BASE && fd < FD_BASE + MAX_FDS) {
+        local = __atomic_load_n(&fd_table[fd - FD_BASE], __ATOMIC_ACQUIRE) - 1;
+    }
+    if (local < 0) {
+        errno = EBADF;
+    }
+    return local;
+}
+
+int host_vfs_open(const char* path, int flags, int mode) {
+    if (!registered.used || strncmp(path, registered.base, registered.base_len) != 0 ||
+        path[registered.base_len] != '/') {
+        errno = ENOENT;
+        return -1;
+    }
+
+    int local = registered.vfs.open_p(registered.ctx, path + registered.base_len, flags, mode);
+    if (local < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&fd_lock);
+    for (int i = 0; i < MAX_FDS; i++) {
+        if (fd_table[i] == 0) {
+            fd_table[i] = local + 1;
+            pthread_mutex_unlock(&fd_lock);
+            return FD_BASE + i;
+        }
+    }
+    pthread_mutex_unlock(&fd_lock);
+
+    registered.vfs.close_p(registered.ctx, local);
+    errno = ENFILE;
+    return -1;
+}
+
+ssize_t host_vfs_read(int fd, void* dst, size_t size) {
+    int local = local_fd(fd);
+    return local < 0 ? -1 : registered.vfs.read_p(registered.ctx, local, dst, size);
+}
+
+ssize_t host_vfs_write(int fd, const void* src, size_t size) {
+    int local = local_fd(fd);
+    return local < 0 ? -1 : registered.vfs.write_p(registered.ctx, local, src, size);
+}
+
+off_t host_vfs_lseek(int fd, off_t offset, int whence) {
+    int local = local_fd(fd);
+    return local < 0 ? -1 : registered.vfs.lseek_p(registered.ctx, local, offset, whence);
+}
+
+int host_vfs_fstat(int fd, struct stat* st) {
+    int local = local_fd(fd);
+    return local < 0 ? -1 : registered.vfs.fstat_p(registered.ctx, local, st);
+}
+
+int host_vfs_close(int fd) {
+    int local = local_fd(fd);
+    if (local < 0) {
+        return -1;
+    }
+    int ret = registered.vfs.close_p(registered.ctx, local);
+    pthread_mutex_lock(&fd_lock);
+    fd_table[fd - FD_BASE] = 0;
+    pthread_mutex_unlock(&fd_lock);
+    return ret;
+}
+
+// ============================================
+// STREAMS
+// ============================================
+
+struct host_vfs_file {
+    int fd;
+    bool writing;
+    bool unbuffered;
+    char* buf;               // Buffer of size bytes (NULL unbuffered)
+    size_t size;
+    size_t pos;              // Next byte in buf
+    size_t len;              // Bytes in buf: read ahead, or written
+};
+
+static ssize_t stream_read(host_vfs_file_t* f, char* dst, size_t size) {
+    ssize_t n = host_vfs_read(f->fd, dst, size);
+    if (n > 0) {
+        stream_stats.calls++;
+        stream_stats.bytes += (unsigned long long)n;
+        stream_stats.direct += dst != f->buf;
+    }
+    return n;
+}
+
+static ssize_t stream_write(host_vfs_file_t* f, const char* src, size_t size) {
+    ssize_t n = host_vfs_write(f->fd, src, size);
+    if (n > 0) {
+        stream_stats.calls++;
+        stream_stats.bytes += (unsigned long long)n;
+        stream_stats.direct += src != f->buf;
+    }
+    return n;
+}
+
+static int stream_flush(host_vfs_file_t* f) {
+    if (f->writing && f->len > 0 && stream_write(f, f->buf, f->len) != (ssize_t)f->len) {
+        return -1;
+    }
+    f->len = 0;
+    return 0;
+}
+
+host_vfs_file_t* host_vfs_fopen(const char* path, const char* mode) {
+    int flags;
+    switch (mode[0]) {
+        case 'r': flags = O_RDONLY; break;
+        case 'w': flags = O_WRONLY | O_CREAT | O_TRUNC; break;
+        case 'a': flags = O_WRONLY | O_CREAT | O_APPEND; break;
+        default: errno = EINVAL; return NULL;
+    }
+
+    host_vfs_file_t* f = calloc(1, sizeof(*f));
+    if (!f) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    f->writing = mode[0] != 'r';
+
+    // newlib sizes the buffer from fstat() (__swhatbuf_r)
+    struct stat st;
+    f->fd = host_vfs_open(path, flags, 0666);
+    if (f->fd < 0 || host_vfs_fstat(f->fd, &st) != 0) {
+        if (f->fd >= 0) {
+            host_vfs_close(f->fd);
+        }
+        free(f);
+        return NULL;
+    }
+    f->size = st.st_blksize > 0 ? (size_t)st.st_blksize : BUFSIZ;
+    return f;
+}
+
+int host_vfs_setvbuf(host_vfs_file_t* f, int mode) {
+    if (f->buf || (mode != _IONBF && mode != _IOFBF)) {
+        errno = EINVAL;
+        return -1;
+    }
+    f->unbuffered = mode == _IONBF;
+    return 0;
+}
+
+// __srefill_r: fills the buffer, or reads straight into dst unbuffered
+static ssize_t stream_fill(host_vfs_file_t* f, char* dst, size_t want) {
+    if (f->unbuffered) {
+        return stream_read(f, dst, want);
+    }
+    if (!f->buf && !(f->buf = malloc(f->size))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    ssize_t n = stream_read(f, f->buf, f->size);
+    f->pos = 0;
+    f->len = n > 0 ? (size_t)n : 0;
+    return n;
+}
+
+// fread.c: copy what is buffered, refill, repeat
+size_t host_vfs_fread(void* dst, size_t size, size_t count, host_vfs_file_t* f) {
+    size_t total = size * count;
+    size_t resid = total;
+    char* p = dst;
+    if (f->writing) {
+        errno = EBADF;
+        return 0;
+    }
+
+    while (resid > 0) {
+        size_t avail = f->len - f->pos;
+        if (avail > 0) {
+            size_t n = avail < resid ? avail : resid;
+            memcpy(p, f->buf + f->pos, n);
+            f->pos += n;
+            p += n;
+            resid -= n;
+            continue;
+        }
+        ssize_t n = stream_fill(f, p, resid);
+        if (n <= 0) {
+            break;
+        }
+        if (f->unbuffered) {
+            p += n;
+            resid -= (size_t)n;
+        }
+    }
+    return size ? (total - resid) / size : 0;
+}
+
+// fvwrite.c: through the buffer while it holds data or the rest is
+// short, whole buffers straight from src when it is empty
+size_t host_vfs_fwrite(const void* src, size_t size, size_t count, host_vfs_file_t* f) {
+    size_t total = size * count;
+    size_t resid = total;
+    const char* p = src;
+    if (!f->writing) {
+        errno = EBADF;
+        return 0;
+    }
+    if (!f->unbuffered && !f->buf && !(f->buf = malloc(f->size))) {
+        errno = ENOMEM;
+        return 0;
+    }
+
+    while (resid > 0) {
+        ssize_t w;
+        if (f->unbuffered) {
+            w = stream_write(f, p, resid);
+        } else if (f->len > 0 || resid < f->size) {
+            w = (ssize_t)(f->size - f->len < resid ? f->size - f->len : resid);
+            memcpy(f->buf + f->len, p, (size_t)w);
+            f->len += (size_t)w;
+            if (f->len == f->size && stream_flush(f) != 0) {
+                break;
+            }
+        } else {
+            w = stream_write(f, p, resid / f->size * f->size);
+        }
+        if (w <= 0) {
+            break;
+        }
+        p += w;
+        resid -= (size_t)w;
+    }
+    return size ? (total - resid) / size : 0;
+}
+
+int host_vfs_fclose(host_vfs_file_t* f) {
+    int ret = stream_flush(f);
+    if (host_vfs_close(f->fd) != 0) {
+        ret = -1;
+    }
+    free(f->buf);
+    free(f);
+    return ret;
+}
+
+void host_vfs_stream_stats(host_vfs_stream_stats_t* stats, int reset) {
+    if (stats) {
+        *stats = stream_stats;
+    }
+    if (reset) {
+        memset(&stream_stats, 0, sizeof(stream_stats));
+    }
+}
@@ -0,0 +1,36 @@
+/**
+ * CoreFS host benchmarks - ESP-IDF VFS port
+ *
+ * Calls an application makes through newlib on the device: descriptors
+ * and streams on the path registered with esp_vfs_register().
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Stream traffic that reached the file system
+typedef struct {
+    unsigned long calls;     // read/write hooks called
+    unsigned long direct;    // ... with the caller's buffer, not the stream's
+    unsigned long long bytes;
+} host_vfs_stream_stats_t;
+
+int host_vfs_open(const char* path, int flags, int mode);
+ssize_t host_vfs_read(int fd, void* dst, size_t size);
+ssize_t host_vfs_write(int fd, const void* src, size_t size);
+off_t host_vfs_lseek(int fd, off_t offset, int whence);
+int host_vfs_fstat(int fd, struct stat* st);
+int host_vfs_close(int fd);
+
+// Streams as newlib implements them (modes "r", "w" and "a")
+typedef struct host_vfs_file host_vfs_file_t;
+
+host_vfs_file_t* host_vfs_fopen(const char* path, const char* mode);
+int host_vfs_setvbuf(host_vfs_file_t* f, int mode);   // _IOFBF or _IONBF, before any I/O
+size_t host_vfs_fread(void* dst, size_t size, size_t count, host_vfs_file_t* f);
+size_t host_vfs_fwrite(const void* src, size_t size, size_t count, host_vfs_file_t* f);
+int host_vfs_fclose(host_vfs_file_t* f);
+void host_vfs_stream_stats(host_vfs_stream_stats_t* stats, int reset);
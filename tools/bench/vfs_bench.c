@@ -0,0 +1,228 @@
+/**
+ * vfs_bench - cost of POSIX and stdio over the native API
+ *
+ * The same file is written and read back through four paths:
+ *
+ *   native  corefs_fs_open/corefs_write/corefs_read/corefs_close
+ *   posix   open/write/read/close through the VFS (corefs_vfs.c and the
+ *           ESP-IDF descriptor table in vfs/vfs_port.c)
+ *   stdio   fopen/fwrite/fread/fclose on top of that, the way newlib
+ *           does it: a buffer of st_blksize bytes
+ *   nbf     the same stream after setvbuf(f, NULL, _IONBF, 0)
+ *
+ * Each round runs all of them back to back, starting with a different
+ * one each time; a path is rated by its best round, so host noise does
+ * not land on one of them. Overhead is the extra time against native.
+ * The image is RAM, which leaves nothing but CPU cost in the numbers: on
+ * the device flash time comes on top of every path and the overhead
+ * shrinks. -d adds it (the SPI NOR timing of mt_scale; use a small file,
+ * every 4 KB written costs a 45 ms erase).
+ *
+ * The stream lines count the read/write hooks each stream called and
+ * how many of them got the caller's memory rather than the stream
+ * buffer. newlib writes a whole buffer or more straight through, but
+ * a buffered fread always copies through the buffer, one st_blksize
+ * read at a time; an unbuffered stream passes every fread through.
+ */
+
+#include "corefs.h"
+#include "host_port.h"
+#include "vfs_port.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PART_SIZE    (1024 * 1024)
+#define PART_ADDRESS 0x110000
+#define BASE_PATH    "/data"
+#define FILE_NAME    "/bench"
+#define MAX_FILE     (512 * 1024)
+
+enum { NATIVE, POSIX, STDIO, NBF, PATHS };
+
+static const char* const path_names[PATHS] = { "native", "posix", "stdio", "nbf" };
+
+static uint8_t image[PART_SIZE];
+static uint8_t src[MAX_FILE];
+static uint8_t dst[MAX_FILE];
+
+static corefs_ctx_t* fs;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Seconds to write size bytes in calls of chunk bytes, open to close
+static double write_file(int path, size_t size, size_t chunk) {
+    double start = now();
+    size_t done = 0;
+    if (path == NATIVE) {
+        corefs_file_t* f = corefs_fs_open(fs, FILE_NAME, COREFS_O_WRONLY | COREFS_O_CREAT | COREFS_O_TRUNC);
+        while (f && done < size && corefs_write(f, src + done, chunk) == (int)chunk) {
+            done += chunk;
+        }
+        if (!f || corefs_close(f) != ESP_OK) {
+            return -1;
+        }
+    } else if (path == POSIX) {
+        int fd = host_vfs_open(BASE_PATH FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        while (fd >= 0 && done < size && host_vfs_write(fd, src + done, chunk) == (ssize_t)chunk) {
+            done += chunk;
+        }
+        if (fd < 0 || host_vfs_close(fd) != 0) {
+            return -1;
+        }
+    } else {
+        host_vfs_file_t* f = host_vfs_fopen(BASE_PATH FILE_NAME, "w");
+        if (f && path == NBF) {
+            host_vfs_setvbuf(f, _IONBF);
+        }
+        while (f && done < size && host_vfs_fwrite(src + done, 1, chunk, f) == chunk) {
+            done += chunk;
+        }
+        if (!f || host_vfs_fclose(f) != 0) {
+            return -1;
+        }
+    }
+    return done == size ? now() - start : -1;
+}
+
+// Seconds to read the file back the same way; -1 if it differs
+static double read_file(int path, size_t size, size_t chunk) {
+    memset(dst, 0, size);
+    double start = now();
+    size_t done = 0;
+    if (path == NATIVE) {
+        corefs_file_t* f = corefs_fs_open(fs, FILE_NAME, COREFS_O_RDONLY);
+        while (f && done < size && corefs_read(f, dst + done, chunk) == (int)chunk) {
+            done += chunk;
+        }
+        if (!f || corefs_close(f) != ESP_OK) {
+            return -1;
+        }
+    } else if (path == POSIX) {
+        int fd = host_vfs_open(BASE_PATH FILE_NAME, O_RDONLY, 0);
+        while (fd >= 0 && done < size && host_vfs_read(fd, dst + done, chunk) == (ssize_t)chunk) {
+            done += chunk;
+        }
+        if (fd < 0 || host_vfs_close(fd) != 0) {
+            return -1;
+        }
+    } else {
+        host_vfs_file_t* f = host_vfs_fopen(BASE_PATH FILE_NAME, "r");
+        if (f && path == NBF) {
+            host_vfs_setvbuf(f, _IONBF);
+        }
+        while (f && done < size && host_vfs_fread(dst + done, 1, chunk, f) == chunk) {
+            done += chunk;
+        }
+        if (!f || host_vfs_fclose(f) != 0) {
+            return -1;
+        }
+    }
+    double secs = now() - start;
+    return done == size && memcmp(src, dst, size) == 0 ? secs : -1;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: vfs_bench [-d] [-s file_kb] [-c chunk_bytes] [-n rounds]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    size_t size = 256 * 1024;
+    size_t chunk = 32 * 1024;
+    int rounds = 50;
+    bool device = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ds:c:n:")) != -1) {
+        switch (opt) {
+            case 'd': device = true; break;
+            case 's': size = (size_t)atoi(optarg) * 1024; break;
+            case 'c': chunk = (size_t)atoi(optarg); break;
+            case 'n': rounds = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (size == 0 || size > MAX_FILE || chunk == 0 || size % chunk || rounds <= 0) {
+        usage();
+    }
+
+    esp_partition_t part;
+    host_partition_init(&part, image, sizeof(image), PART_ADDRESS);
+    memset(image, 0xFF, sizeof(image));
+    for (size_t i = 0; i < size; i++) {
+        src[i] = (uint8_t)(i * 7 + i / 2048);
+    }
+
+    corefs_config_t cfg = COREFS_CONFIG_DEFAULT();
+    if (corefs_format(&part) != ESP_OK || corefs_fs_mount(&part, &cfg, &fs) != ESP_OK ||
+        corefs_fs_vfs_register(fs, BASE_PATH) != ESP_OK) {
+        fprintf(stderr, "vfs_bench: format/mount/register failed\n");
+        return 1;
+    }
+    if (device) {
+        host_flash_timing_t timing = {
+            .read_ns_per_kb = 48828,
+            .program_ns_per_kb = 2800000,
+            .erase_us_per_sector = 45000,
+        };
+        host_flash_set_timing(&timing);
+    }
+
+    double best_write[PATHS];
+    double best_read[PATHS];
+    host_vfs_stream_stats_t writes[PATHS] = { 0 };
+    host_vfs_stream_stats_t reads[PATHS] = { 0 };
+    for (int p = 0; p < PATHS; p++) {
+        best_write[p] = best_read[p] = 1e9;
+    }
+    for (int r = 0; r < rounds; r++) {
+        for (int k = 0; k < PATHS; k++) {
+            int p = (r + k) % PATHS;
+            host_vfs_stream_stats(NULL, 1);
+            double w = write_file(p, size, chunk);
+            host_vfs_stream_stats(&writes[p], 1);
+            double rd = read_file(p, size, chunk);
+            host_vfs_stream_stats(&reads[p], 0);
+            if (w < 0 || rd < 0) {
+                fprintf(stderr, "vfs_bench: %s round %d failed\n", path_names[p], r);
+                return 1;
+            }
+            best_write[p] = w < best_write[p] ? w : best_write[p];
+            best_read[p] = rd < best_read[p] ? rd : best_read[p];
+        }
+    }
+    host_flash_set_timing(NULL);
+    corefs_vfs_unregister(BASE_PATH);
+    corefs_fs_unmount(fs);
+
+    double kb = (double)size / 1024;
+    printf("file       %zu KB in calls of %zu B, best of %d rounds, %s\n",
+           size / 1024, chunk, rounds, device ? "device timing" : "RAM image");
+    printf("%-10s %10s %9s %10s %9s\n", "", "write KB/s", "overhead", "read KB/s", "overhead");
+    for (int p = 0; p < PATHS; p++) {
+        printf("%-10s %10.0f", path_names[p], kb / best_write[p]);
+        if (p == NATIVE) {
+            printf(" %9s", "");
+        } else {
+            printf(" %+8.1f%%", (best_write[p] / best_write[NATIVE] - 1) * 100);
+        }
+        printf(" %10.0f", kb / best_read[p]);
+        if (p != NATIVE) {
+            printf(" %+8.1f%%", (best_read[p] / best_read[NATIVE] - 1) * 100);
+        }
+        printf("\n");
+    }
+    for (int p = STDIO; p < PATHS; p++) {
+        printf("%-10s write: %lu calls, %lu direct; read: %lu calls, %lu direct\n", path_names[p],
+               writes[p].calls, writes[p].direct, reads[p].calls, reads[p].direct);
+    }
+    return 0;
+}
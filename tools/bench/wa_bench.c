@@ -0,0 +1,190 @@
+/**
+ * wa_bench - write amplification of the log-plus-config workload
+ *
+ * The device pattern the placement classes were made for: a log that
+ * grows by short lines, opened and closed for each one, and a small
+ * config file rewritten every few lines, next to cold data that never
+ * changes. The partition is first filled to the given level with the
+ * cold files, so the allocator has to share sectors.
+ *
+ * Reported from corefs_fs_get_io_stats():
+ *
+ *   WA        programmed bytes / bytes passed to corefs_write
+ *   erases    4 KB sectors erased during the workload
+ *   siblings  live sector halves that had to be copied by an erase
+ *   rescue    erases of the rescue log and of the spare sector that
+ *             takes a sibling copy when no data sector is free
+ *   sectors   erases per data sector (sibling copies included)
+ *   classes   blocks allocated per placement class (meta/hot/cold)
+ *
+ * At the end the partition is mounted again and the log and config are
+ * checked, so a number is never reported for a run that lost data.
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include "host_port.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PART_SIZE    (1024 * 1024)
+#define PART_ADDRESS 0x110000
+#define LINE_SIZE    100      // One log line
+#define CONFIG_SIZE  300      // The config file
+#define CONFIG_EVERY 4        // Lines per config rewrite
+#define COLD_FILES   4        // The root node holds 7 entries
+
+static uint8_t image[PART_SIZE];
+
+static int put(corefs_ctx_t* fs, const char* path, const void* data, size_t len, uint32_t flags) {
+    corefs_file_t* f = corefs_fs_open(fs, path, COREFS_O_CREAT | COREFS_O_WRONLY | flags);
+    if (!f) {
+        return -1;
+    }
+    int n = corefs_write(f, data, len);
+    esp_err_t ret = corefs_close(f);
+    return (n == (int)len && ret == ESP_OK) ? 0 : -1;
+}
+
+// File consists of len copies of c
+static int check(corefs_ctx_t* fs, const char* path, char c, size_t len) {
+    static uint8_t buf[64 * 1024];
+    corefs_file_t* f = corefs_fs_open(fs, path, COREFS_O_RDONLY);
+    if (!f) {
+        return -1;
+    }
+    size_t total = 0;
+    int n;
+    while ((n = corefs_read(f, buf, sizeof(buf))) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (buf[i] != (uint8_t)c) {
+                corefs_close(f);
+                return -1;
+            }
+        }
+        total += n;
+    }
+    corefs_close(f);
+    return total == len ? 0 : -1;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: wa_bench [-n updates] [-f fill%%]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int updates = 2000;
+    int fill = 50;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:f:")) != -1) {
+        switch (opt) {
+            case 'n': updates = atoi(optarg); break;
+            case 'f': fill = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (updates <= 0 || fill < 0 || fill > 80) {
+        usage();
+    }
+
+    esp_partition_t part;
+    host_partition_init(&part, image, sizeof(image), PART_ADDRESS);
+    memset(image, 0xFF, sizeof(image));
+
+    corefs_config_t cfg = COREFS_CONFIG_DEFAULT();
+    corefs_ctx_t* fs = NULL;
+    if (corefs_format(&part) != ESP_OK || corefs_fs_mount(&part, &cfg, &fs) != ESP_OK) {
+        fprintf(stderr, "wa_bench: format/mount failed\n");
+        return 1;
+    }
+
+    // Cold data up to the fill level, in COLD_FILES equal files
+    corefs_info_t info;
+    corefs_fs_info(fs, &info);
+    uint32_t target = info.block_count * fill / 100;
+    uint32_t cold_blocks = target > info.blocks_used ?
+                           (target - info.blocks_used) / COLD_FILES : 0;
+    static uint8_t cold[COREFS_BLOCK_SIZE];
+    memset(cold, 'c', sizeof(cold));
+    for (int i = 0; i < COLD_FILES && cold_blocks > 0; i++) {
+        char path[16];
+        snprintf(path, sizeof(path), "/cold%d", i);
+        for (uint32_t b = 0; b < cold_blocks; b++) {
+            if (put(fs, path, cold, sizeof(cold), COREFS_O_APPEND) != 0) {
+                fprintf(stderr, "wa_bench: fill failed at %s\n", path);
+                return 1;
+            }
+        }
+    }
+    corefs_fs_info(fs, &info);
+    uint32_t filled = info.blocks_used;
+
+    char line[LINE_SIZE];
+    char config[CONFIG_SIZE];
+    memset(line, 'l', sizeof(line));
+    memset(config, 'k', sizeof(config));
+
+    static uint32_t erases[PART_SIZE / COREFS_SECTOR_SIZE];
+    host_flash_count_erases(erases, PART_SIZE / COREFS_SECTOR_SIZE);
+    corefs_fs_reset_io_stats(fs);
+    for (int i = 0; i < updates; i++) {
+        if (put(fs, "/log", line, sizeof(line), COREFS_O_APPEND) != 0 ||
+            (i % CONFIG_EVERY == 0 &&
+             put(fs, "/config", config, sizeof(config), COREFS_O_TRUNC) != 0)) {
+            fprintf(stderr, "wa_bench: write failed at update %d\n", i);
+            return 1;
+        }
+    }
+
+    corefs_io_stats_t st;
+    corefs_fs_get_io_stats(fs, &st);
+    corefs_fs_info(fs, &info);
+
+    // Rescue copies rotate through free data sectors; only the log and
+    // the spare sector behind it are fixed
+    uint32_t log_sector = fs->sb->rescue_block / 2;
+    uint32_t data_sector = (fs->sb->metadata_blocks + 1) / 2;
+    uint64_t data_erases = 0;
+    uint32_t data_max = 0;
+    for (uint32_t i = data_sector; i < PART_SIZE / COREFS_SECTOR_SIZE; i++) {
+        data_erases += erases[i];
+        data_max = erases[i] > data_max ? erases[i] : data_max;
+    }
+    uint32_t data_sectors = PART_SIZE / COREFS_SECTOR_SIZE - data_sector;
+    host_flash_count_erases(NULL, 0);
+    corefs_fs_unmount(fs);
+
+    // Everything written must still be there
+    fs = NULL;
+    bool ok = corefs_fs_mount(&part, &cfg, &fs) == ESP_OK &&
+              check(fs, "/log", 'l', (size_t)updates * LINE_SIZE) == 0 &&
+              check(fs, "/config", 'k', CONFIG_SIZE) == 0;
+    if (fs) {
+        corefs_fs_unmount(fs);
+    }
+
+    printf("workload   %d log lines of %d B, config %d B every %d lines\n",
+           updates, LINE_SIZE, CONFIG_SIZE, CONFIG_EVERY);
+    printf("partition  %u KB, %u of %u blocks used before, %u after\n",
+           PART_SIZE / 1024, filled, info.block_count, info.blocks_used);
+    printf("logical    %llu B\n", (unsigned long long)st.logical_bytes);
+    printf("programmed %llu B\n", (unsigned long long)st.programmed_bytes);
+    printf("erased     %llu B (%llu sectors)\n", (unsigned long long)st.erased_bytes,
+           (unsigned long long)(st.erased_bytes / COREFS_SECTOR_SIZE));
+    printf("siblings   %u\n", st.sibling_copies);
+    printf("rescue     log sector %u erases, spare sector %u\n",
+           erases[log_sector], erases[log_sector + 1]);
+    printf("sectors    data area %.1f erases average, %u most\n",
+           (double)data_erases / data_sectors, data_max);
+    printf("classes    meta %u hot %u cold %u\n", st.class_allocs[COREFS_CLASS_META],
+           st.class_allocs[COREFS_CLASS_HOT], st.class_allocs[COREFS_CLASS_COLD]);
+    printf("WA         %.2f programmed, %.2f erased\n",
+           (double)st.programmed_bytes / st.logical_bytes,
+           (double)st.erased_bytes / st.logical_bytes);
+    printf("verify     %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
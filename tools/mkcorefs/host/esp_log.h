@@ -0,0 +1,24 @@
+/**
+ * mkcorefs host port - ESP_LOGx on stderr
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+extern int host_log_level;   // 0 = off, 1 = errors ... 4 = debug
+
+uint32_t esp_log_timestamp(void);
+
+#define HOST_LOG(level, letter, tag, format, ...) do {                    \
+        if (host_log_level >= (level)) {                                  \
+            fprintf(stderr, letter " %s: " format "\n", tag, ##__VA_ARGS__); \
+        }                                                                 \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(1, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(2, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(3, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(4, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) do { } while (0)
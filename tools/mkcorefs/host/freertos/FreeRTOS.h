@@ -0,0 +1,20 @@
+/**
+ * mkcorefs host port - FreeRTOS types (1 tick = 1 ms)
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE            1
+#define pdFALSE           0
+#define pdPASS            pdTRUE
+#define pdFAIL            pdFALSE
+#define portMAX_DELAY     ((TickType_t)0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskIDLE_PRIORITY  0
@@ -0,0 +1,19 @@
+/**
+ * mkcorefs host port - event groups (create and wait need HOST_THREADS)
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_event_group* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+
+#ifdef HOST_THREADS
+EventGroupHandle_t xEventGroupCreate(void);
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear,
+                                BaseType_t all, TickType_t wait);
+void vEventGroupDelete(EventGroupHandle_t group);
+#endif
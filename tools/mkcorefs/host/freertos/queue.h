@@ -0,0 +1,14 @@
+/**
+ * mkcorefs host port - queues (async I/O), unavailable without HOST_THREADS
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+void vQueueDelete(QueueHandle_t queue);
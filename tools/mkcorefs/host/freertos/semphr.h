@@ -0,0 +1,18 @@
+/**
+ * mkcorefs host port - semaphores, no-ops without HOST_THREADS
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_sem* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
@@ -0,0 +1,27 @@
+/**
+ * mkcorefs host port - tasks, creating one fails without HOST_THREADS
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+typedef enum {
+    eNoAction = 0,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle);
+void vTaskDelete(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
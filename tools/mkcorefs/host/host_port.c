@@ -0,0 +1,613 @@
+/**
+ * mkcorefs host port
+ *
+ * Just enough of ESP-IDF and FreeRTOS to run the CoreFS sources on a PC.
+ * The partition is the image buffer in RAM with NOR semantics (erase sets
+ * 0xFF, programming only clears bits), so what the library writes is
+ * byte for byte what lands on flash. mkcorefs runs on one thread: locks
+ * are no-ops and background tasks cannot be started.
+ *
+ * Built with -DHOST_THREADS -pthread the port is multi-threaded instead
+ * (tools/bench): semaphores, tasks, notifications, queues and event
+ * groups map to pthreads, and the image is one flash device that serves
+ * one access at a time, optionally with device timing.
+ */
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "host_port.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HOST_THREADS
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+int host_log_level = 1;
+
+static uint8_t* image;
+static size_t image_size;
+
+// ============================================
+// PARTITION
+// ============================================
+
+// One SPI flash: accesses are serialized and, with a timing set, last as
+// long as on the device
+static host_flash_timing_t flash_timing;
+static uint32_t* erase_counts;
+static size_t erase_sectors;
+
+#ifdef HOST_THREADS
+static pthread_mutex_t flash_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void host_flash_set_timing(const host_flash_timing_t* timing) {
+    if (timing) {
+        flash_timing = *timing;
+    } else {
+        memset(&flash_timing, 0, sizeof(flash_timing));
+    }
+}
+
+void host_flash_count_erases(uint32_t* counts, size_t sectors) {
+    erase_counts = counts;
+    erase_sectors = counts ? sectors : 0;
+}
+
+static void flash_begin(void) {
+#ifdef HOST_THREADS
+    pthread_mutex_lock(&flash_lock);
+#endif
+}
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Sleeps the access out, spinning the last 100 us: a timer wakes up tens
+// of microseconds late, as long as a 2 KB read takes
+static void flash_end(uint64_t ns) {
+    if (ns) {
+        uint64_t until = clock_ns() + ns;
+        if (ns > 100000) {
+            uint64_t sleep = ns - 100000;
+            struct timespec ts = { .tv_sec = sleep / 1000000000u, .tv_nsec = sleep % 1000000000u };
+            while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+            }
+        }
+        while (clock_ns() < until) {
+        }
+    }
+#ifdef HOST_THREADS
+    pthread_mutex_unlock(&flash_lock);
+#endif
+}
+
+void host_partition_init(esp_partition_t* part, uint8_t* buf, size_t size, uint32_t address) {
+    memset(part, 0, sizeof(*part));
+    part->address = address;
+    part->size = size;
+    strcpy(part->label, "corefs");
+    image = buf;
+    image_size = size;
+}
+
+static bool in_range(const esp_partition_t* part, size_t offset, size_t size) {
+    return part && image && offset <= image_size && size <= image_size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t offset, void* dst, size_t size) {
+    if (!in_range(part, offset, size) || !dst) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    flash_begin();
+    memcpy(dst, image + offset, size);
+    flash_end((uint64_t)flash_timing.read_ns_per_kb * size / 1024);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t offset, const void* src, size_t size) {
+    if (!in_range(part, offset, size) || !src) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t* s = src;
+    flash_begin();
+    for (size_t i = 0; i < size; i++) {
+        image[offset + i] &= s[i];
+    }
+    flash_end((uint64_t)flash_timing.program_ns_per_kb * size / 1024);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t offset, size_t size) {
+    if (!in_range(part, offset, size) || offset % 4096 || size % 4096) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    flash_begin();
+    memset(image + offset, 0xFF, size);
+    for (size_t sector = offset / 4096; sector < (offset + size) / 4096 && sector < erase_sectors; sector++) {
+        erase_counts[sector]++;
+    }
+    flash_end((uint64_t)flash_timing.erase_us_per_sector * 1000 * (size / 4096));
+    return ESP_OK;
+}
+
+// ============================================
+// ESP-IDF
+// ============================================
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:                  return "ESP_OK";
+        case ESP_FAIL:                return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:          return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:     return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:   return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:    return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:       return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:   return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:         return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_CRC:     return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        default:                      return "UNKNOWN ERROR";
+    }
+}
+
+// Inode timestamps of a factory image start at zero
+uint32_t esp_log_timestamp(void) {
+    return 0;
+}
+
+// ============================================
+// FREERTOS
+// ============================================
+
+#ifdef HOST_THREADS
+
+// Absolute deadline for a wait of ticks (1 tick = 1 ms)
+static struct timespec deadline(TickType_t ticks) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+// Wait on cond; false once the deadline has passed
+static bool wait_until(pthread_cond_t* cond, pthread_mutex_t* mutex, TickType_t wait,
+                       const struct timespec* until) {
+    if (wait == 0) {
+        return false;
+    }
+    if (wait == portMAX_DELAY) {
+        pthread_cond_wait(cond, mutex);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, mutex, until) != ETIMEDOUT;
+}
+
+// Counting semaphore; a mutex is one with count 1, a recursive mutex
+// also counts the depth of its owner
+struct host_sem {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned count;
+    unsigned max;
+    pthread_t owner;
+    unsigned depth;
+};
+
+static struct host_sem* sem_new(unsigned max, unsigned count) {
+    struct host_sem* sem = calloc(1, sizeof(*sem));
+    if (!sem) {
+        return NULL;
+    }
+    pthread_mutex_init(&sem->mutex, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->count = count;
+    sem->max = max;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return sem_new(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+    return sem_new(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return sem_new(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    struct timespec until = deadline(wait);
+    pthread_mutex_lock(&sem->mutex);
+    while (sem->count == 0) {
+        if (!wait_until(&sem->cond, &sem->mutex, wait, &until) && sem->count == 0) {
+            pthread_mutex_unlock(&sem->mutex);
+            return pdFALSE;
+        }
+    }
+    sem->count--;
+    pthread_mutex_unlock(&sem->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    pthread_mutex_lock(&sem->mutex);
+    if (sem->count >= sem->max) {
+        pthread_mutex_unlock(&sem->mutex);
+        return pdFALSE;
+    }
+    sem->count++;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait) {
+    pthread_mutex_lock(&sem->mutex);
+    if (sem->depth && pthread_equal(sem->owner, pthread_self())) {
+        sem->depth++;
+        pthread_mutex_unlock(&sem->mutex);
+        return pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->mutex);
+
+    if (xSemaphoreTake(sem, wait) != pdTRUE) {
+        return pdFALSE;
+    }
+    pthread_mutex_lock(&sem->mutex);
+    sem->owner = pthread_self();
+    sem->depth = 1;
+    pthread_mutex_unlock(&sem->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+    pthread_mutex_lock(&sem->mutex);
+    if (sem->depth == 0 || !pthread_equal(sem->owner, pthread_self())) {
+        pthread_mutex_unlock(&sem->mutex);
+        return pdFALSE;
+    }
+    bool release = --sem->depth == 0;
+    pthread_mutex_unlock(&sem->mutex);
+    return release ? xSemaphoreGive(sem) : pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    if (sem) {
+        pthread_mutex_destroy(&sem->mutex);
+        pthread_cond_destroy(&sem->cond);
+        free(sem);
+    }
+}
+
+// A task is a detached thread with a notification value
+struct host_task {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    TaskFunction_t entry;
+    void* arg;
+    uint32_t value;
+    bool pending;
+};
+
+// Threads not started by xTaskCreate (main) get a handle on first use
+static __thread struct host_task* current_task;
+
+static struct host_task* task_new(TaskFunction_t entry, void* arg) {
+    struct host_task* task = calloc(1, sizeof(*task));
+    if (!task) {
+        return NULL;
+    }
+    pthread_mutex_init(&task->mutex, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    task->entry = entry;
+    task->arg = arg;
+    return task;
+}
+
+static void* task_main(void* arg) {
+    current_task = arg;
+    current_task->entry(current_task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+    struct host_task* t = task_new(task, arg);
+    if (!t) {
+        return pdFAIL;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, task_main, t) != 0) {
+        free(t);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (handle) {
+        *handle = t;
+    }
+    return pdPASS;
+}
+
+// Tasks only ever delete themselves; the handle stays valid, a late
+// notification must not touch freed memory
+void vTaskDelete(TaskHandle_t task) {
+    if (task == NULL || task == current_task) {
+        pthread_exit(NULL);
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (!current_task) {
+        current_task = task_new(NULL, NULL);
+    }
+    return current_task;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    usleep((useconds_t)ticks * 1000);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    struct host_task* t = task;
+    pthread_mutex_lock(&t->mutex);
+    switch (action) {
+        case eSetBits:                  t->value |= value; break;
+        case eIncrement:                t->value++; break;
+        case eSetValueWithOverwrite:    t->value = value; break;
+        case eSetValueWithoutOverwrite: if (!t->pending) t->value = value; break;
+        default: break;
+    }
+    t->pending = true;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->mutex);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+    struct host_task* t = xTaskGetCurrentTaskHandle();
+    struct timespec until = deadline(wait);
+    pthread_mutex_lock(&t->mutex);
+    while (t->value == 0 && wait_until(&t->cond, &t->mutex, wait, &until)) {
+    }
+    uint32_t value = t->value;
+    if (value) {
+        t->value = clear ? 0 : value - 1;
+    }
+    t->pending = false;
+    pthread_mutex_unlock(&t->mutex);
+    return value;
+}
+
+// Ring of fixed-size items
+struct host_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint8_t* items;
+    unsigned length;
+    unsigned item_size;
+    unsigned head;
+    unsigned used;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct host_queue* queue = calloc(1, sizeof(*queue));
+    if (!queue) {
+        return NULL;
+    }
+    queue->items = malloc((size_t)length * item_size);
+    if (!queue->items) {
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+    struct timespec until = deadline(wait);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->used == queue->length) {
+        if (!wait_until(&queue->cond, &queue->mutex, wait, &until) &&
+            queue->used == queue->length) {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFAIL;
+        }
+    }
+    unsigned slot = (queue->head + queue->used) % queue->length;
+    memcpy(queue->items + (size_t)slot * queue->item_size, item, queue->item_size);
+    queue->used++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+    struct timespec until = deadline(wait);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->used == 0) {
+        if (!wait_until(&queue->cond, &queue->mutex, wait, &until) && queue->used == 0) {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFAIL;
+        }
+    }
+    memcpy(item, queue->items + (size_t)queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->used--;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdPASS;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue) {
+        pthread_mutex_destroy(&queue->mutex);
+        pthread_cond_destroy(&queue->cond);
+        free(queue->items);
+        free(queue);
+    }
+}
+
+struct host_event_group {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    struct host_event_group* group = calloc(1, sizeof(*group));
+    if (group) {
+        pthread_mutex_init(&group->mutex, NULL);
+        pthread_cond_init(&group->cond, NULL);
+    }
+    return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    pthread_mutex_lock(&group->mutex);
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    pthread_cond_broadcast(&group->cond);
+    pthread_mutex_unlock(&group->mutex);
+    return now;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear,
+                                BaseType_t all, TickType_t wait) {
+    struct timespec until = deadline(wait);
+    pthread_mutex_lock(&group->mutex);
+    while (all ? (group->bits & bits) != bits : (group->bits & bits) == 0) {
+        if (!wait_until(&group->cond, &group->mutex, wait, &until)) {
+            break;
+        }
+    }
+    EventBits_t now = group->bits;
+    bool met = all ? (now & bits) == bits : (now & bits) != 0;
+    if (met && clear) {
+        group->bits &= ~bits;
+    }
+    pthread_mutex_unlock(&group->mutex);
+    return now;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    if (group) {
+        pthread_mutex_destroy(&group->mutex);
+        pthread_cond_destroy(&group->cond);
+        free(group);
+    }
+}
+
+#else
+
+// Single thread
+static struct host_sem {
+    int unused;
+} host_sem;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return &host_sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+    return &host_sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return &host_sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait) {
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait) {
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+    return pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return NULL;
+}
+
+void vTaskDelay(TickType_t ticks) {
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) {
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+    return 0;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return NULL;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+    return pdFAIL;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+    return pdFAIL;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,23 @@
+/**
+ * mkcorefs host port - image buffer setup
+ */
+
+#pragma once
+
+#include "esp_partition.h"
+
+// Device timing of the image (all zero: RAM speed)
+typedef struct {
+    uint32_t read_ns_per_kb;
+    uint32_t program_ns_per_kb;
+    uint32_t erase_us_per_sector;
+} host_flash_timing_t;
+
+// Back part with buf (size bytes); address is only reported
+void host_partition_init(esp_partition_t* part, uint8_t* buf, size_t size, uint32_t address);
+
+// Every later flash access takes as long as timing says (NULL: no delay)
+void host_flash_set_timing(const host_flash_timing_t* timing);
+
+// Every later sector erase adds one to counts[sector] (NULL: stop)
+void host_flash_count_erases(uint32_t* counts, size_t sectors);
@@ -0,0 +1,428 @@
+/**
+ * mkcorefs - CoreFS Partition Image Builder
+ *
+ * Builds a ready-to-flash CoreFS partition from a directory tree, so a
+ * factory station programs the whole file system with one esptool
+ * write_flash instead of every device creating its files at first boot.
+ *
+ * The image is made by the CoreFS sources themselves (host_port.c stands
+ * in for flash and FreeRTOS): corefs_format, a mount, then the files are
+ * placed by hand instead of through the allocator:
+ *
+ *   - each inode gets a sector of its own, like the allocator keeps META
+ *     blocks apart from data
+ *   - file data follows from the next sector, one contiguous run per file,
+ *     files back to back in access order (-l list, the rest sorted by path)
+ *   - the blocks are reserved in the bitmap and the root directory node is
+ *     written through corefs_btree_insert
+ *
+ * A clean unmount seals the superblock. Mount rebuilds the bitmap from the
+ * inodes, so the image holds nothing the device would not have written.
+ * Before the image is saved, a copy is mounted again and every file is
+ * read back and compared.
+ */
+
+#include "corefs.h"
+#include "esp_log.h"
+#include "host_port.h"
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_SIZE     0x2F0000   // corefs partition in partitions.csv
+#define DEFAULT_ADDRESS  0x110000
+#define NAME_MAX_LEN     63         // Root node entry name
+#define MAX_ENTRIES      (COREFS_BTREE_ORDER - 1)  // One flat root node
+#define BLOCKS_PER_SECTOR (COREFS_SECTOR_SIZE / COREFS_BLOCK_SIZE)
+#define UNLISTED         0x7FFFFFFF
+
+typedef struct {
+    char path[NAME_MAX_LEN + 2];   // "/" + name relative to the source dir
+    char* host_path;
+    uint32_t size;
+    uint32_t blocks;
+    int order;                     // Line in the access list, UNLISTED otherwise
+    uint32_t inode_block;
+    uint32_t first_block;
+} entry_t;
+
+static entry_t entries[MAX_ENTRIES];
+static int entry_count;
+
+// ============================================
+// SOURCE TREE
+// ============================================
+
+static int walk(const char* root, const char* rel) {
+    char dir_path[PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s%s", root, rel);
+
+    DIR* dir = opendir(dir_path);
+    if (!dir) {
+        fprintf(stderr, "mkcorefs: %s: %s\n", dir_path, strerror(errno));
+        return -1;
+    }
+
+    int ret = 0;
+    struct dirent* de;
+    while (ret == 0 && (de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+
+        char name[PATH_MAX];
+        snprintf(name, sizeof(name), "%s/%s", rel, de->d_name);
+        char host_path[PATH_MAX];
+        snprintf(host_path, sizeof(host_path), "%s%s", root, name);
+
+        struct stat st;
+        if (stat(host_path, &st) != 0) {
+            fprintf(stderr, "mkcorefs: %s: %s\n", host_path, strerror(errno));
+            ret = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            ret = walk(root, name);
+        } else if (S_ISREG(st.st_mode)) {
+            if (entry_count == MAX_ENTRIES) {
+                fprintf(stderr, "mkcorefs: more than %d files (one root directory node)\n",
+                        MAX_ENTRIES);
+                ret = -1;
+            } else if (strlen(name) - 1 > NAME_MAX_LEN) {
+                fprintf(stderr, "mkcorefs: %s: name longer than %d characters\n",
+                        name, NAME_MAX_LEN);
+                ret = -1;
+            } else if (st.st_size > (off_t)COREFS_MAX_BLOCKS * COREFS_BLOCK_SIZE) {
+                fprintf(stderr, "mkcorefs: %s: larger than %u KB\n",
+                        name, COREFS_MAX_BLOCKS * COREFS_BLOCK_SIZE / 1024);
+                ret = -1;
+            } else {
+                entry_t* e = &entries[entry_count++];
+                strcpy(e->path, name);
+                e->host_path = strdup(host_path);
+                e->size = (uint32_t)st.st_size;
+                e->blocks = (e->size + COREFS_BLOCK_SIZE - 1) / COREFS_BLOCK_SIZE;
+                e->order = UNLISTED;
+            }
+        }
+    }
+
+    closedir(dir);
+    return ret;
+}
+
+// One path per line, relative to the source dir; '#' starts a comment
+static int read_order(const char* list) {
+    FILE* f = fopen(list, "r");
+    if (!f) {
+        fprintf(stderr, "mkcorefs: %s: %s\n", list, strerror(errno));
+        return -1;
+    }
+
+    char line[PATH_MAX];
+    int n = 0;
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "#\r\n")] = '\0';
+        char* p = line;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        size_t len = strlen(p);
+        while (len && (p[len - 1] == ' ' || p[len - 1] == '\t')) {
+            p[--len] = '\0';
+        }
+        if (len == 0) {
+            continue;
+        }
+        if (*p == '/') {
+            p++;
+        }
+
+        int i;
+        for (i = 0; i < entry_count; i++) {
+            if (strcmp(entries[i].path + 1, p) == 0) {
+                break;
+            }
+        }
+        if (i == entry_count) {
+            fprintf(stderr, "mkcorefs: %s: '%s' is not in the source tree\n", list, p);
+            ret = -1;
+        } else if (entries[i].order == UNLISTED) {
+            entries[i].order = n++;
+        }
+    }
+
+    fclose(f);
+    return ret;
+}
+
+static int by_access(const void* a, const void* b) {
+    const entry_t* x = a;
+    const entry_t* y = b;
+    if (x->order != y->order) {
+        return x->order < y->order ? -1 : 1;
+    }
+    return strcmp(x->path, y->path);
+}
+
+// ============================================
+// IMAGE
+// ============================================
+
+static esp_err_t write_blocks(const esp_partition_t* part, uint32_t block, const void* buf, size_t len) {
+    return esp_partition_write(part, (size_t)block * COREFS_BLOCK_SIZE, buf, len);
+}
+
+static esp_err_t place_file(corefs_ctx_t* fs, const esp_partition_t* part, entry_t* e,
+                            corefs_inode_t* inode, uint8_t* data) {
+    FILE* f = fopen(e->host_path, "rb");
+    if (!f) {
+        fprintf(stderr, "mkcorefs: %s: %s\n", e->host_path, strerror(errno));
+        return ESP_FAIL;
+    }
+    size_t got = fread(data, 1, e->size, f);
+    fclose(f);
+    if (got != e->size) {
+        fprintf(stderr, "mkcorefs: %s: short read\n", e->host_path);
+        return ESP_FAIL;
+    }
+
+    // The tail of the last block reads as zeros, as after corefs_write
+    memset(data + e->size, 0, e->blocks * COREFS_BLOCK_SIZE - e->size);
+
+    memset(inode, 0, sizeof(*inode));
+    inode->magic = COREFS_FILE_MAGIC;
+    inode->inode_num = fs->next_inode_num++;
+    inode->size = e->size;
+    inode->blocks_used = e->blocks;
+    inode->mode = 0644;
+    strncpy(inode->name, e->path + 1, COREFS_MAX_FILENAME - 1);
+
+    for (uint32_t i = 0; i < e->blocks; i++) {
+        uint32_t block = e->first_block + i;
+        if (!corefs_block_reserve(fs, block)) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        inode->block_list[i] = block;
+    }
+    if (!corefs_block_reserve(fs, e->inode_block)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Straight into the erased image: no sector erase, no wear counted
+    esp_err_t ret = ESP_OK;
+    if (e->blocks) {
+        ret = write_blocks(part, e->first_block, data, e->blocks * COREFS_BLOCK_SIZE);
+    }
+    if (ret == ESP_OK) {
+        inode->checksum = crc32(inode, sizeof(*inode));
+        ret = write_blocks(part, e->inode_block, inode, sizeof(*inode));
+    }
+    if (ret == ESP_OK) {
+        ret = corefs_btree_insert(fs, e->path, e->inode_block);
+    }
+    return ret;
+}
+
+/**
+ * Lay out the files on a formatted, mounted image. Returns the first
+ * block past the last file.
+ */
+static esp_err_t build(corefs_ctx_t* fs, const esp_partition_t* part, uint32_t* end) {
+    uint32_t next = fs->sb->metadata_blocks;
+    next = (next + BLOCKS_PER_SECTOR - 1) / BLOCKS_PER_SECTOR * BLOCKS_PER_SECTOR;
+
+    for (int i = 0; i < entry_count; i++) {
+        entries[i].inode_block = next;
+        next += BLOCKS_PER_SECTOR;
+    }
+
+    uint32_t data_blocks = 0;
+    for (int i = 0; i < entry_count; i++) {
+        entries[i].first_block = next + data_blocks;
+        data_blocks += entries[i].blocks;
+    }
+    *end = next + data_blocks;
+
+    if (*end > fs->sb->block_count) {
+        fprintf(stderr, "mkcorefs: needs %u blocks, the partition has %u\n",
+                *end, fs->sb->block_count);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    corefs_inode_t* inode = malloc(sizeof(corefs_inode_t));
+    uint8_t* data = malloc(COREFS_MAX_BLOCKS * COREFS_BLOCK_SIZE);
+    if (!inode || !data) {
+        free(inode);
+        free(data);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i < entry_count && ret == ESP_OK; i++) {
+        ret = place_file(fs, part, &entries[i], inode, data);
+        if (ret != ESP_OK) {
+            fprintf(stderr, "mkcorefs: %s: %s\n", entries[i].path, esp_err_to_name(ret));
+        }
+    }
+
+    free(inode);
+    free(data);
+    return ret;
+}
+
+// Mount the finished image and compare every file with its source
+static esp_err_t verify(const esp_partition_t* part) {
+    corefs_config_t cfg = COREFS_CONFIG_DEFAULT();
+    corefs_ctx_t* fs = NULL;
+    esp_err_t ret = corefs_fs_mount(part, &cfg, &fs);
+    if (ret != ESP_OK) {
+        fprintf(stderr, "mkcorefs: verify: mount failed: %s\n", esp_err_to_name(ret));
+        return ret;
+    }
+
+    uint8_t* want = malloc(COREFS_MAX_BLOCKS * COREFS_BLOCK_SIZE);
+    uint8_t* got = malloc(COREFS_MAX_BLOCKS * COREFS_BLOCK_SIZE + 1);
+    if (!want || !got) {
+        ret = ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < entry_count && ret == ESP_OK; i++) {
+        entry_t* e = &entries[i];
+        FILE* f = fopen(e->host_path, "rb");
+        size_t n = f ? fread(want, 1, e->size, f) : 0;
+        if (f) {
+            fclose(f);
+        }
+
+        corefs_file_t* file = corefs_fs_open(fs, e->path, COREFS_O_RDONLY);
+        int r = file ? corefs_read(file, got, e->size + 1) : -1;
+        if (file) {
+            corefs_close(file);
+        }
+
+        if (n != e->size || r != (int)e->size || memcmp(want, got, e->size) != 0) {
+            fprintf(stderr, "mkcorefs: verify: %s differs from the source\n", e->path);
+            ret = ESP_ERR_INVALID_CRC;
+        }
+    }
+
+    free(want);
+    free(got);
+    esp_err_t un = corefs_fs_unmount(fs);
+    return ret != ESP_OK ? ret : un;
+}
+
+// ============================================
+// MAIN
+// ============================================
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: mkcorefs [-s size] [-a address] [-l order.txt] [-v] <dir> <image.bin>\n"
+            "  -s size     partition size in bytes (default 0x%X)\n"
+            "  -a address  partition offset, for the esptool hint (default 0x%X)\n"
+            "  -l file     access order: one path per line, placed first\n"
+            "  -v          CoreFS log output (repeat for more)\n",
+            DEFAULT_SIZE, DEFAULT_ADDRESS);
+}
+
+int main(int argc, char** argv) {
+    uint32_t size = DEFAULT_SIZE;
+    uint32_t address = DEFAULT_ADDRESS;
+    const char* order = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:a:l:vh")) != -1) {
+        switch (opt) {
+            case 's': size = strtoul(optarg, NULL, 0); break;
+            case 'a': address = strtoul(optarg, NULL, 0); break;
+            case 'l': order = optarg; break;
+            case 'v': host_log_level++; break;
+            default: usage(); return 2;
+        }
+    }
+    if (argc - optind != 2) {
+        usage();
+        return 2;
+    }
+    const char* src = argv[optind];
+    const char* out = argv[optind + 1];
+
+    if (size == 0 || size % COREFS_SECTOR_SIZE || address % COREFS_SECTOR_SIZE) {
+        fprintf(stderr, "mkcorefs: size and address must be multiples of %u\n",
+                COREFS_SECTOR_SIZE);
+        return 1;
+    }
+
+    if (walk(src, "") != 0 || (order && read_order(order) != 0)) {
+        return 1;
+    }
+    qsort(entries, entry_count, sizeof(entries[0]), by_access);
+
+    uint8_t* image = malloc(size);
+    uint8_t* check = malloc(size);
+    if (!image || !check) {
+        fprintf(stderr, "mkcorefs: out of memory\n");
+        return 1;
+    }
+    memset(image, 0xFF, size);
+
+    esp_partition_t part;
+    host_partition_init(&part, image, size, address);
+
+    corefs_config_t cfg = COREFS_CONFIG_DEFAULT();
+    corefs_ctx_t* fs = NULL;
+    esp_err_t ret = corefs_format(&part);
+    if (ret == ESP_OK) {
+        ret = corefs_fs_mount(&part, &cfg, &fs);
+    }
+    if (ret != ESP_OK) {
+        fprintf(stderr, "mkcorefs: format/mount failed: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+
+    uint32_t end = 0;
+    ret = build(fs, &part, &end);
+    esp_err_t un = corefs_fs_unmount(fs);
+    if (ret == ESP_OK) {
+        ret = un;
+    }
+    if (ret != ESP_OK) {
+        return 1;
+    }
+
+    // Verify on a copy: a mount changes the superblock
+    memcpy(check, image, size);
+    host_partition_init(&part, check, size, address);
+    if (verify(&part) != ESP_OK) {
+        return 1;
+    }
+
+    FILE* f = fopen(out, "wb");
+    if (!f || fwrite(image, 1, size, f) != size || fclose(f) != 0) {
+        fprintf(stderr, "mkcorefs: %s: %s\n", out, strerror(errno));
+        return 1;
+    }
+
+    for (int i = 0; i < entry_count; i++) {
+        const entry_t* e = &entries[i];
+        if (e->blocks) {
+            printf("%-40s %7u B  inode %5u  data %5u-%u\n", e->path, e->size,
+                   e->inode_block, e->first_block, e->first_block + e->blocks - 1);
+        } else {
+            printf("%-40s %7u B  inode %5u\n", e->path, e->size, e->inode_block);
+        }
+    }
+    printf("%d files, %u of %u blocks used, image %s (%u KB)\n",
+           entry_count, end, size / COREFS_BLOCK_SIZE, out, size / 1024);
+    printf("flash: esptool.py write_flash 0x%X %s\n", address, out);
+
+    free(image);
+    free(check);
+    return 0;
+}